@@ -151,7 +151,8 @@ struct blk_alloc_hints {
             is_contiguous{false},
             multiplier{1},
             max_blks_per_entry{BlkId::max_blks_in_op()},
-            stream_info{(uintptr_t) nullptr} {}
+            stream_info{(uintptr_t) nullptr},
+            hotness_key{0} {}
 
     blk_temp_t desired_temp;       // Temperature hint for the device
     uint32_t dev_id_hint;          // which physical device to pick (hint if any) -1 for don't care
@@ -160,6 +161,7 @@ struct blk_alloc_hints {
     uint32_t multiplier;         // blks allocated in a blkid should be a multiple of multiplier
     uint32_t max_blks_per_entry; // Number of blks on every entry
     uintptr_t stream_info;
+    uint64_t hotness_key; // Identity of the data being written (say lba), used to derive temperature. 0 for none
 #ifdef _PRERELEASE
     bool error_simulate = false; // can error simulate happen
 #endif
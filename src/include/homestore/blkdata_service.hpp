@@ -16,6 +16,7 @@
 #pragma once
 #include <sys/uio.h>
 #include <cstdint>
+#include <vector>
 
 #include <folly/small_vector.h>
 #include <sisl/fds/buffer.hpp>
@@ -32,12 +33,14 @@ class VirtualDev;
 struct vdev_info_block;
 struct stream_info_t;
 class BlkReadTracker;
+class WriteHotnessTracker;
 struct blk_alloc_hints;
 
 struct async_info {
     io_completion_cb_t cb;
     bool is_read{false};
-    BlkId bid; // only needed when is_read is true, used for blk read tracker;
+    BlkId bid;                 // only needed when is_read is true, used for blk read tracker;
+    std::vector< BlkId > bids; // same as bid, but for read on multiple blkids
     sisl::atomic_counter< int > outstanding_io_cnt = 0;
 };
 
@@ -46,7 +49,7 @@ using blk_list_t = folly::small_vector< blk_t, 4 >;
 
 class BlkDataService {
 public:
-    BlkDataService();
+    explicit BlkDataService(blk_allocator_type_t allocator_type = blk_allocator_type_t::varsize);
     ~BlkDataService();
 
     /**
@@ -67,10 +70,11 @@ public:
      * @brief : asynchronous write without input block ids. Block ids will be allocated by this api and returned;
      *
      * @param sgs : the data buffer that needs to be written
-     * @param hints : blk alloc hints
+     * @param hints : blk alloc hints. If hotness_key is set and desired_temp is not, temperature is derived from how
+     * often the key is overwritten
      * @param out_blkids : the output block ids that were allocated and written to
      * @param cb : callback that will be triggered after write completes;
-     * @param part_of_batch : is this write part of a batch;
+     * @param part_of_batch : is this write part of a batch, if so caller is expected to call submit_batch at the end;
      */
     void async_alloc_write(const sisl::sg_list& sgs, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkids,
                            const io_completion_cb_t& cb, bool part_of_batch = false);
@@ -82,7 +86,7 @@ public:
      * @param hints : blk alloc hints
      * @param in_blkids : input block ids that this write should be written to;
      * @param cb : callback that will be triggered after write completes
-     * @param part_of_batch : is this write part of a batch;
+     * @param part_of_batch : is this write part of a batch, if so caller is expected to call submit_batch at the end;
      */
     void async_write(const sisl::sg_list& sgs, const blk_alloc_hints& hints, const std::vector< BlkId >& in_blkids,
                      const io_completion_cb_t& cb, bool part_of_batch = false);
@@ -99,6 +103,25 @@ public:
     void async_read(const BlkId& bid, sisl::sg_list& sgs, uint32_t size, const io_completion_cb_t& cb,
                     bool part_of_batch = false);
 
+    /**
+     * @brief : asynchronous read on multiple blocks, say the ones returned by async_alloc_write for a large write. Read
+     * on all the blocks are issued in parallel, which for a striped data vdev are spread across the devices.
+     *
+     * @param bids : block ids to read, in the order the data is to be filled in sgs
+     * @param sgs : the read buffer stored
+     * @param size : size to read, which is total size of all the block ids
+     * @param cb : callback that will be triggered after read on all block ids completes
+     * @param part_of_batch : is this read part of batch;
+     */
+    void async_read(const std::vector< BlkId >& bids, sisl::sg_list& sgs, uint32_t size, const io_completion_cb_t& cb,
+                    bool part_of_batch = false);
+
+    /**
+     * @brief : submit the ios issued with part_of_batch. It has to be called on the thread which issued them, as the
+     * batched writes are held back (and merged if adjacent) till then.
+     */
+    void submit_batch();
+
     /**
      * @brief : commit a block, usually called during recovery
      *
@@ -179,7 +202,9 @@ private:
 private:
     std::unique_ptr< VirtualDev > m_vdev;
     std::unique_ptr< BlkReadTracker > m_blk_read_tracker;
+    std::unique_ptr< WriteHotnessTracker > m_hotness_tracker; // Only if there are more than one blk temperatures
     uint32_t m_page_size;
+    blk_allocator_type_t m_allocator_type;
 };
 
 extern BlkDataService& data_service();
@@ -59,6 +59,10 @@ struct blkstore_blob {
 struct sb_blkstore_blob : blkstore_blob {
     BlkId blkid;
 };
+
+struct data_blkstore_blob : blkstore_blob {
+    blk_allocator_type_t allocator_type; // none (zeroed by older versions) is treated as varsize
+};
 #pragma pack()
 
 typedef std::function< void(void) > hs_init_done_cb_t;
@@ -95,12 +99,14 @@ private:
 
     float m_index_store_size_pct{0};
     float m_data_store_size_pct{0};
+    blk_allocator_type_t m_data_allocator_type{blk_allocator_type_t::varsize};
     float m_meta_store_size_pct{0};
     float m_data_log_store_size_pct{0};
     float m_ctrl_log_store_size_pct{0};
 
     hs_init_done_cb_t m_init_done_cb{nullptr};
     hs_init_starting_cb_t m_before_init_starting_cb{nullptr};
+    Clock::time_point m_init_start_time;
 
     static constexpr float data_blkstore_pct{84.0};
     static constexpr float indx_blkstore_pct{3.0};
@@ -133,7 +139,8 @@ public:
     ///////////////////////////// Member functions /////////////////////////////////////////////
     HomeStore& with_params(const hs_input_params& input);
     HomeStore& with_meta_service(float size_pct);
-    HomeStore& with_data_service(float size_pct);
+    HomeStore& with_data_service(float size_pct,
+                                 blk_allocator_type_t allocator_type = blk_allocator_type_t::varsize);
     HomeStore& with_log_service(float data_size_pct, float ctrl_size_pct);
     HomeStore& with_index_service(float index_size_pct, std::unique_ptr< IndexServiceCallbacks > cbs);
     HomeStore& after_init_done(hs_init_done_cb_t init_done_cb);
@@ -169,6 +176,7 @@ public:
     IndexService& index_service() { return *m_index_service; }
     DeviceManager* device_mgr() { return m_dev_mgr.get(); }
     ResourceMgr& resource_mgr() { return *m_resource_mgr.get(); }
+    HomeStoreStatusMgr* status_mgr() { return m_status_mgr.get(); }
     CPManager& cp_mgr() { return *m_cp_mgr.get(); }
     std::shared_ptr< sisl::Evictor > evictor() { return m_evictor; }
 
@@ -68,6 +68,7 @@ struct IndexBuffer {
     IndexBufferPtr m_next_buffer{nullptr};                   // Next buffer in the chain
     // Number of leader buffers we are waiting for before we write this buffer
     sisl::atomic_counter< int > m_wait_for_leaders{0};
+    uint32_t m_cache_ordinal{0}; // Ordinal of the index table owning this buffer, used for per table cache accounting
 
     IndexBuffer(BlkId blkid, uint32_t buf_size, uint32_t align_size);
 
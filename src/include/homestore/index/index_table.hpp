@@ -37,12 +37,14 @@ template < typename K, typename V >
 class IndexTable : public IndexTableBase, Btree< K, V > {
 private:
     superblk< index_table_sb > m_sb;
+    uint32_t m_cache_ordinal;
     std::function< void(BtreeRequest*, btee_status_t) > m_btree_op_comp_cb;
 
 public:
     IndexTable(uuid_t uuid, const BtreeConfig& cfg, btree_op_comp_cb_t op_comp_cb, on_kv_read_t read_cb = nullptr,
                on_kv_update_t update_cb = nullptr, on_kv_remove_t remove_cb = nullptr) :
             Btree< K, V >{cfg, std::move(read_cb), std::move(update_cb), std::move(remove_cb)},
+            m_cache_ordinal{index_service().cache_ordinal(uuid)},
             m_btree_op_comp_cb{std::move(op_comp_cb)} {
         auto const [status, root_id] = create_root_node(nullptr);
         if (status != btree_status_t::success) {
@@ -56,6 +58,7 @@ public:
     IndexTable(const superblk< index_table_sb >& sb, const BtreeConfig& cfg, btree_op_comp_cb_t op_comp_cb,
                on_kv_read_t read_cb = nullptr, on_kv_update_t update_cb = nullptr, on_kv_remove_t remove_cb = nullptr) :
             Btree< K, V >{cfg, std::move(read_cb), std::move(update_cb), std::move(remove_cb)},
+            m_cache_ordinal{index_service().cache_ordinal(sb->uuid)},
             m_btree_op_comp_cb{std::move(op_comp_cb)} {
         m_sb = sb;
     }
@@ -123,6 +126,7 @@ protected:
     ////////////////// Override Implementation of underlying store requirements //////////////////
     BtreeNodePtr alloc_node(bool is_leaf) override {
         return wb_cache()->alloc_buf([this](const IndexBufferPtr& idx_buf) -> BtreeNode {
+            idx_buf->m_cache_ordinal = m_cache_ordinal;
             BtreeNode* n = this->init_node(idx_buf->raw_buffer(), sizeof(IndexBtreeNode), idx_buf->blkid().to_integer(),
                                            true, is_leaf);
             uint8_t* ctx_mem = uintptr_cast(IndexBtreeNode::convert(n));
@@ -171,6 +175,7 @@ protected:
     btree_status_t read_node_impl(bnodeid_t id, sisl::BtreeNodePtr& node) override {
         auto const ret = wb_cache()->read_buf(id, node, iomanager.am_i_tight_loop_reactor(),
                                               [this](const IndexBufferPtr& idx_buf) -> BtreeNode {
+                                                  idx_buf->m_cache_ordinal = m_cache_ordinal;
                                                   return this->init_node(idx_buf->raw_buffer(), sizeof(IndexBtreeNode),
                                                                          idx_buf->blkid().to_integer(), true, is_leaf);
                                               });
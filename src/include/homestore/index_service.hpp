@@ -19,6 +19,7 @@
 #include <vector>
 
 #include <iomgr/iomgr.hpp>
+#include <nlohmann/json.hpp>
 #include <homestore/homestore_decl.hpp>
 #include <homestore/index/index_internal.hpp>
 #include <homestore/superblk_handler.hpp>
@@ -26,6 +27,7 @@
 namespace homestore {
 
 class IndexWBCache;
+class IndexCacheQuota;
 class IndexTableBase;
 class VirtualDev;
 
@@ -38,6 +40,7 @@ class IndexService {
 private:
     std::unique_ptr< IndexServiceCallbacks > m_svc_cbs;
     std::unique_ptr< IndexWBCache > m_wb_cache;
+    std::unique_ptr< IndexCacheQuota > m_cache_quota;
     std::shared_ptr< VirtualDev > m_vdev;
     std::vector< iomgr::io_thread_t > m_btree_write_thread_ids; // user io threads for btree write
     uint32_t m_btree_write_thrd_idx{0};
@@ -47,6 +50,7 @@ private:
 
 public:
     IndexService(std::unique_ptr< IndexServiceCallbacks > cbs);
+    ~IndexService();
 
     // Creates the vdev that is needed to initialize the device
     void create_vdev(uint64_t size);
@@ -63,6 +67,15 @@ public:
 
     uint64_t used_size() const;
 
+    /// @brief Get the ordinal of the index table within index cache, registering it if needed. Every buffer owned
+    /// by the table is stamped with this ordinal so that cache residency is accounted per table.
+    uint32_t cache_ordinal(uuid_t uuid);
+
+    /// @brief Override the default minimum and maximum index cache quota of the table (in percentage of cache size)
+    void set_cache_quota(uuid_t uuid, double min_pct, double max_pct);
+
+    nlohmann::json get_status(int verbosity) const;
+
     iomgr::io_thread_t get_next_btree_write_thread();
     IndexWBCache& wb_cache() { return *m_wb_cache; }
 
@@ -0,0 +1,133 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+
+#include "common/homestore_assert.hpp"
+#include "blk_alloc_summary.h"
+
+namespace homestore {
+BlkAllocSummary::BlkAllocSummary(const blk_cap_t total_blks, const blk_num_t blks_per_portion) :
+        m_total_blks{total_blks},
+        m_blks_per_portion{blks_per_portion},
+        m_ngroups{static_cast< blk_num_t >((total_blks + blks_per_group - 1) / blks_per_group)},
+        m_group_free_cnt(m_ngroups, 0),
+        m_portion_free_blks((total_blks + blks_per_portion - 1) / blks_per_portion, 0) {
+    HS_REL_ASSERT_EQ(blks_per_portion % blks_per_group, 0, "Blks per portion should be multiple of summary group");
+
+    const auto nwords{(m_ngroups + 63) / 64};
+    m_nonfull_bits = std::make_unique< std::atomic< uint64_t >[] >(nwords);
+    for (blk_num_t w{0}; w < nwords; ++w) {
+        m_nonfull_bits[w].store(0, std::memory_order_relaxed);
+    }
+}
+
+void BlkAllocSummary::rebuild(sisl::Bitset& bm) {
+    std::fill(m_group_free_cnt.begin(), m_group_free_cnt.end(), 0);
+    std::fill(m_portion_free_blks.begin(), m_portion_free_blks.end(), 0);
+    for (blk_num_t w{0}; w < (m_ngroups + 63) / 64; ++w) {
+        m_nonfull_bits[w].store(0, std::memory_order_relaxed);
+    }
+    if (m_total_blks == 0) { return; }
+
+    // Walk the free runs one portion at a time, so that the run fits in blk_count_t
+    const blk_num_t last_blk{static_cast< blk_num_t >(m_total_blks - 1)};
+    blk_num_t cur{0};
+    while (cur <= last_blk) {
+        const blk_num_t portion_end{std::min< blk_num_t >(cur - (cur % m_blks_per_portion) + m_blks_per_portion - 1,
+                                                          last_blk)};
+        const auto b{bm.get_next_contiguous_n_reset_bits(cur, portion_end, 1, portion_end - cur + 1)};
+        if (b.nbits == 0) {
+            if (portion_end == last_blk) { break; }
+            cur = portion_end + 1;
+            continue;
+        }
+        mark_free(b.start_bit, b.nbits);
+        cur = b.start_bit + b.nbits;
+    }
+}
+
+void BlkAllocSummary::update(const blk_num_t start_blk, const blk_count_t nblks, const bool is_free) {
+    blk_num_t blk{start_blk};
+    const blk_num_t end{start_blk + nblks};
+    while (blk < end) {
+        const blk_num_t grp{blk / blks_per_group};
+        const blk_num_t grp_end{std::min((grp + 1) * blks_per_group, end)};
+        const auto n{static_cast< uint8_t >(grp_end - blk)};
+
+        auto& cnt{m_group_free_cnt[grp]};
+        const uint64_t grp_bit{static_cast< uint64_t >(1) << (grp % 64)};
+        if (is_free) {
+            HS_DBG_ASSERT_LE(cnt + n, blks_per_group, "Summary group free count overflow");
+            if (cnt == 0) { m_nonfull_bits[grp / 64].fetch_or(grp_bit, std::memory_order_relaxed); }
+            cnt += n;
+        } else {
+            HS_DBG_ASSERT_GE(cnt, n, "Summary group free count underflow");
+            cnt -= n;
+            if (cnt == 0) { m_nonfull_bits[grp / 64].fetch_and(~grp_bit, std::memory_order_relaxed); }
+        }
+        blk = grp_end;
+    }
+
+    // Caller ensures the range is within one portion
+    auto& pfree{m_portion_free_blks[start_blk / m_blks_per_portion]};
+    is_free ? (pfree += nblks) : (pfree -= nblks);
+}
+
+blk_num_t BlkAllocSummary::next_group(blk_num_t grp, const blk_num_t last_grp, const bool nonfull) const {
+    while (grp <= last_grp) {
+        uint64_t word{m_nonfull_bits[grp / 64].load(std::memory_order_relaxed)};
+        if (!nonfull) { word = ~word; }
+        word &= (~static_cast< uint64_t >(0) << (grp % 64)); // Ignore the groups before grp in this word
+        if (word != 0) {
+            const blk_num_t found{(grp & ~static_cast< blk_num_t >(63)) +
+                                  static_cast< blk_num_t >(__builtin_ctzll(word))};
+            return std::min(found, last_grp + 1);
+        }
+        grp = (grp & ~static_cast< blk_num_t >(63)) + 64;
+    }
+    return last_grp + 1;
+}
+
+BlkAllocSummary::BlkRun BlkAllocSummary::next_free_run(sisl::Bitset& bm, const blk_num_t start_blk,
+                                                       const blk_num_t end_blk, const blk_count_t min_nbits,
+                                                       const blk_count_t max_nbits) const {
+    const blk_num_t last_grp{end_blk / blks_per_group};
+    blk_num_t grp{start_blk / blks_per_group};
+
+    while (grp <= last_grp) {
+        // Skip the full groups and find the stretch of groups which has free blks
+        grp = next_group(grp, last_grp, true /* nonfull */);
+        if (grp > last_grp) { break; }
+        const blk_num_t stretch_end{next_group(grp + 1, last_grp, false /* nonfull */) - 1};
+
+        blk_cap_t stretch_free{0};
+        for (blk_num_t g{grp}; (g <= stretch_end) && (stretch_free < min_nbits); ++g) {
+            stretch_free += m_group_free_cnt[g];
+        }
+
+        if (stretch_free >= min_nbits) {
+            const blk_num_t s{std::max(start_blk, grp * blks_per_group)};
+            const blk_num_t e{std::min(end_blk, stretch_end * blks_per_group + blks_per_group - 1)};
+            const auto b{bm.get_next_contiguous_n_reset_bits(s, e, min_nbits, max_nbits)};
+            if (b.nbits != 0) {
+                return BlkRun{static_cast< blk_num_t >(b.start_bit), static_cast< blk_count_t >(b.nbits)};
+            }
+        }
+        grp = stretch_end + 1;
+    }
+    return BlkRun{};
+}
+} // namespace homestore
@@ -0,0 +1,90 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <sisl/fds/bitset.hpp>
+#include <homestore/blk.h>
+
+namespace homestore {
+
+/*
+ * Summary of free blks in the allocator cache bitmap, maintained alongside the bitmap so that searches for free runs
+ * do not have to walk through every word of a mostly full bitmap.
+ *
+ * Level 0: Every group of 64 blks has a count of free blks in that group.
+ * Level 1: A bitmap with one bit per group which is set if the group has atleast one free blk. One 64 bit word of
+ *          this covers 4096 blks, so a full region is skipped with a single tzcnt.
+ * Level 2: Count of free blks per portion, so that a portion which cannot satisfy the request is skipped in O(1).
+ *
+ * A free run can never span a group which has no free blks, so the bitmap search is confined to stretches of
+ * consecutive non-full groups which have enough free blks in total to hold the requested run.
+ *
+ * Level 0 and level 2 counts of a portion are updated and read under the portion lock. Blks per portion is a multiple
+ * of group size, so a group never spans portions. Level 1 words could span portions and hence are atomic.
+ */
+class BlkAllocSummary {
+public:
+    static constexpr blk_num_t blks_per_group{64};
+
+    struct BlkRun {
+        blk_num_t start_bit{0};
+        blk_count_t nbits{0};
+    };
+
+    BlkAllocSummary(const blk_cap_t total_blks, const blk_num_t blks_per_portion);
+    BlkAllocSummary(const BlkAllocSummary&) = delete;
+    BlkAllocSummary(BlkAllocSummary&&) noexcept = delete;
+    BlkAllocSummary& operator=(const BlkAllocSummary&) = delete;
+    BlkAllocSummary& operator=(BlkAllocSummary&&) noexcept = delete;
+    ~BlkAllocSummary() = default;
+
+    /// @brief Rebuild the entire summary from the given bitmap. Expected to be called before allocator is in use.
+    void rebuild(sisl::Bitset& bm);
+
+    void mark_used(const blk_num_t start_blk, const blk_count_t nblks) { update(start_blk, nblks, false); }
+    void mark_free(const blk_num_t start_blk, const blk_count_t nblks) { update(start_blk, nblks, true); }
+
+    /// @brief Find the next contiguous run of free blks of size [min_nbits, max_nbits] within [start_blk, end_blk]
+    /// (both inclusive) skipping regions which cannot hold such a run.
+    /// @return BlkRun with nbits = 0 if there are no such free run
+    [[nodiscard]] BlkRun next_free_run(sisl::Bitset& bm, const blk_num_t start_blk, const blk_num_t end_blk,
+                                       const blk_count_t min_nbits, const blk_count_t max_nbits) const;
+
+    [[nodiscard]] blk_cap_t portion_free_blks(const blk_num_t portion_num) const {
+        return m_portion_free_blks[portion_num];
+    }
+
+private:
+    void update(const blk_num_t start_blk, const blk_count_t nblks, const bool is_free);
+
+    // Returns first group in [grp, last_grp] which has atleast one free (or no free if nonfull = false) blk or
+    // last_grp + 1 if none.
+    [[nodiscard]] blk_num_t next_group(blk_num_t grp, const blk_num_t last_grp, const bool nonfull) const;
+
+private:
+    blk_cap_t m_total_blks;
+    blk_num_t m_blks_per_portion;
+    blk_num_t m_ngroups;
+    std::vector< uint8_t > m_group_free_cnt;                     // Level 0
+    std::unique_ptr< std::atomic< uint64_t >[] > m_nonfull_bits; // Level 1
+    std::vector< blk_cap_t > m_portion_free_blks;                // Level 2
+};
+} // namespace homestore
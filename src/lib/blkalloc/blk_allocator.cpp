@@ -13,6 +13,8 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+
 #include "blk_allocator.h"
 //#include "blkalloc_cp.hpp"
 
@@ -35,6 +37,14 @@ BlkAllocator::BlkAllocator(const BlkAllocConfig& cfg, chunk_num_t id) : m_cfg{cf
 
     // NOTE:  Blocks per portion must be modulo word size so locks do not fall on same word
     assert(m_cfg.get_blks_per_portion() % m_disk_bm->word_size() == 0);
+
+    // Page is made up of whole bitmap words, so that two pages never share a word
+    m_disk_bm_page_nbits = std::max< blk_num_t >(HS_DYNAMIC_CONFIG(blkallocator.disk_bm_page_size) / 8 * 64, 64);
+    m_num_disk_bm_pages = (m_cfg.get_total_blks() + m_disk_bm_page_nbits - 1) / m_disk_bm_page_nbits;
+    m_disk_bm_dirty_pages = std::make_unique< std::atomic< bool >[] >(m_num_disk_bm_pages);
+    for (uint32_t p{0}; p < m_num_disk_bm_pages; ++p) {
+        m_disk_bm_dirty_pages[p].store(true, std::memory_order_relaxed);
+    }
 }
 
 void BlkAllocator::set_disk_bm(std::unique_ptr< sisl::Bitset > recovered_bm) {
@@ -89,7 +99,8 @@ BlkAllocStatus BlkAllocator::alloc_on_disk(const BlkId& in_bid) {
                 BLKALLOC_REL_ASSERT(get_disk_bm_const()->is_bits_reset(in_bid.get_blk_num(), in_bid.get_nblks()),
                                     "Expected disk blks to reset");
             }
-            get_disk_bm_mutable()->set_bits(in_bid.get_blk_num(), in_bid.get_nblks());
+            m_disk_bm->set_bits(in_bid.get_blk_num(), in_bid.get_nblks());
+            set_disk_bm_dirty(in_bid.get_blk_num(), in_bid.get_nblks());
             portion->decrease_available_blocks(in_bid.get_nblks());
             BLKALLOC_LOG(DEBUG, "blks allocated {} chunk number {}", in_bid.to_string(), m_chunk_id);
         }
@@ -182,12 +193,58 @@ void BlkAllocator::free_on_disk(const BlkId& b) {
                                     "Expected disk bits to set blk num {} num blks {}", b.get_blk_num(), b.get_nblks());
             }
         }
-        get_disk_bm_mutable()->reset_bits(b.get_blk_num(), b.get_nblks());
+        m_disk_bm->reset_bits(b.get_blk_num(), b.get_nblks());
+        set_disk_bm_dirty(b.get_blk_num(), b.get_nblks());
         portion->increase_available_blocks(b.get_nblks());
     }
 }
 
-sisl::byte_array BlkAllocator::acquire_underlying_buffer() {
+void BlkAllocator::free_on_disk(const std::vector< BlkId >& blkids) {
+    assert(m_auto_recovery);
+    static thread_local std::vector< BlkId > s_merged;
+    s_merged.clear();
+    coalesce_blkids(blkids, s_merged);
+
+    size_t i{0};
+    while (i < s_merged.size()) {
+        BlkAllocPortion* portion = blknum_to_portion(s_merged[i].get_blk_num());
+        auto lock{portion->portion_auto_lock()};
+        do {
+            const auto& b{s_merged[i]};
+            if (m_inited) {
+                BLKALLOC_REL_ASSERT(get_disk_bm_const()->is_bits_set(b.get_blk_num(), b.get_nblks()),
+                                    "Expected disk bits to set blk num {} num blks {}", b.get_blk_num(),
+                                    b.get_nblks());
+            }
+            m_disk_bm->reset_bits(b.get_blk_num(), b.get_nblks());
+            set_disk_bm_dirty(b.get_blk_num(), b.get_nblks());
+            portion->increase_available_blocks(b.get_nblks());
+        } while ((++i < s_merged.size()) && (blknum_to_portion(s_merged[i].get_blk_num()) == portion));
+    }
+}
+
+void BlkAllocator::coalesce_blkids(const std::vector< BlkId >& blkids, std::vector< BlkId >& out_blkids) const {
+    static thread_local std::vector< BlkId > s_sorted;
+    s_sorted.assign(blkids.cbegin(), blkids.cend());
+    std::sort(s_sorted.begin(), s_sorted.end(),
+              [](const BlkId& a, const BlkId& b) { return a.get_blk_num() < b.get_blk_num(); });
+
+    const auto first_idx{out_blkids.size()};
+    for (const auto& b : s_sorted) {
+        if (out_blkids.size() > first_idx) {
+            auto& last{out_blkids.back()};
+            if ((last.get_blk_num() + last.get_nblks() == b.get_blk_num()) &&
+                (last.get_nblks() + b.get_nblks() <= BlkId::max_blks_in_op()) &&
+                (blknum_to_portion_num(last.get_blk_num()) == blknum_to_portion_num(b.get_blk_num()))) {
+                last.set_nblks(last.get_nblks() + b.get_nblks());
+                continue;
+            }
+        }
+        out_blkids.emplace_back(b.get_blk_num(), b.get_nblks(), m_chunk_id);
+    }
+}
+
+void BlkAllocator::start_alloc_list() {
     // prepare and temporary alloc list, where blkalloc is accumulated till underlying buffer is released.
     // RCU will wait for all I/Os that are still in critical section (allocating on disk bm) to complete and exit;
     auto alloc_list_ptr = new sisl::ThreadVector< BlkId >();
@@ -195,9 +252,82 @@ sisl::byte_array BlkAllocator::acquire_underlying_buffer() {
     synchronize_rcu();
 
     BLKALLOC_REL_ASSERT(old_alloc_list_ptr == nullptr, "Multiple acquires concurrently?");
+}
+
+sisl::byte_array BlkAllocator::acquire_underlying_buffer() {
+    start_alloc_list();
     return (m_disk_bm->serialize(m_cfg.get_align_size()));
 }
 
+std::vector< uint32_t > BlkAllocator::acquire_dirty_disk_bm_pages() {
+    start_alloc_list();
+
+    // Reset the overall dirty flag before collecting pages, so that any page dirtied from now on sets it again
+    is_disk_bm_dirty = false;
+    std::vector< uint32_t > dirty_pages;
+    for (uint32_t p{0}; p < m_num_disk_bm_pages; ++p) {
+        if (m_disk_bm_dirty_pages[p].exchange(false, std::memory_order_acq_rel)) { dirty_pages.push_back(p); }
+    }
+    return dirty_pages;
+}
+
+sisl::byte_array BlkAllocator::serialize_disk_bm_page(uint32_t page_num) const {
+    const blk_num_t start_blk{page_num * m_disk_bm_page_nbits};
+    const blk_num_t nbits{std::min< blk_num_t >(m_disk_bm_page_nbits, m_cfg.get_total_blks() - start_blk)};
+    const blk_num_t end_blk{start_blk + nbits - 1};
+
+    // Page is built as all allocated and then free runs are reset, so cost is proportional to number of free runs
+    sisl::Bitset page_bm{nbits, m_chunk_id, m_cfg.get_align_size()};
+    page_bm.set_bits(0, nbits);
+    blk_num_t cur{start_blk};
+    while (cur <= end_blk) {
+        const auto b{m_disk_bm->get_next_contiguous_n_reset_bits(cur, end_blk, 1, end_blk - cur + 1)};
+        if (b.nbits == 0) { break; }
+        page_bm.reset_bits(b.start_bit - start_blk, b.nbits);
+        cur = b.start_bit + b.nbits;
+    }
+    return page_bm.serialize(m_cfg.get_align_size());
+}
+
+void BlkAllocator::apply_disk_bm_page(blk_num_t start_blk, const sisl::Bitset& page_bm) {
+    BLKALLOC_REL_ASSERT_CMP(start_blk + page_bm.size(), <=, m_cfg.get_total_blks());
+    const blk_num_t nbits{static_cast< blk_num_t >(page_bm.size())};
+    if (nbits == 0) { return; }
+
+    m_disk_bm->set_bits(start_blk, nbits);
+    blk_num_t cur{0};
+    while (cur < nbits) {
+        const auto b{page_bm.get_next_contiguous_n_reset_bits(cur, nbits - 1, 1, nbits - cur)};
+        if (b.nbits == 0) { break; }
+        m_disk_bm->reset_bits(start_blk + b.start_bit, b.nbits);
+        cur = b.start_bit + b.nbits;
+    }
+
+    const uint32_t page_num{start_blk / m_disk_bm_page_nbits};
+    if ((start_blk % m_disk_bm_page_nbits == 0) &&
+        (nbits == std::min< blk_num_t >(m_disk_bm_page_nbits, m_cfg.get_total_blks() - start_blk))) {
+        m_disk_bm_dirty_pages[page_num].store(false, std::memory_order_release);
+    } else {
+        set_disk_bm_dirty(start_blk, nbits);
+    }
+}
+
+void BlkAllocator::set_disk_bm_dirty() {
+    for (uint32_t p{0}; p < m_num_disk_bm_pages; ++p) {
+        m_disk_bm_dirty_pages[p].store(true, std::memory_order_release);
+    }
+    is_disk_bm_dirty = true;
+}
+
+void BlkAllocator::set_disk_bm_dirty(blk_num_t start_blk, blk_num_t nblks) {
+    const uint32_t first_page{start_blk / m_disk_bm_page_nbits};
+    const uint32_t last_page{(start_blk + nblks - 1) / m_disk_bm_page_nbits};
+    for (auto p{first_page}; p <= last_page; ++p) {
+        m_disk_bm_dirty_pages[p].store(true, std::memory_order_release);
+    }
+    is_disk_bm_dirty = true;
+}
+
 void BlkAllocator::release_underlying_buffer() {
     // set to nullptr, so that alloc will go to disk bm directly
     // wait for all I/Os in critical section (still accumulating bids) to complete and exit;
@@ -201,6 +201,10 @@ public:
  * 1. It contains atleast all the blks allocated upto that checkpoint. It can contain blks allocated for next
  *    checkpoints also.
  * 2. It contains blks freed only upto that checkpoint.
+ *
+ * Disk bitmap is divided into pages of disk_bm_page_nbits() blks each and every page tracks if it is modified since it
+ * was last persisted, so that checkpoint persists only the modified pages and its cost is proportional to the churn
+ * and not to the size of the chunk.
  */
 
 class BlkAllocator {
@@ -231,6 +235,21 @@ public:
 
     bool need_flush_dirty_bm() const { return is_disk_bm_dirty; }
 
+    ///////////////////// Disk bitmap page related routines ////////////////////////
+    blk_num_t disk_bm_page_nbits() const { return m_disk_bm_page_nbits; }
+    uint32_t num_disk_bm_pages() const { return m_num_disk_bm_pages; }
+
+    // Same as acquire_underlying_buffer, except that instead of entire bitmap, it returns the pages modified since the
+    // last acquire and marks them clean. Caller is expected to call release_underlying_buffer once pages are persisted.
+    std::vector< uint32_t > acquire_dirty_disk_bm_pages();
+
+    // Serialized bitmap of the blks [page_num * disk_bm_page_nbits(), (page_num + 1) * disk_bm_page_nbits())
+    sisl::byte_array serialize_disk_bm_page(uint32_t page_num) const;
+
+    // Overwrite the disk bitmap starting at start_blk with the page bitmap recovered. If the page matches the current
+    // page layout, the page is considered clean.
+    void apply_disk_bm_page(blk_num_t start_blk, const sisl::Bitset& page_bm);
+
     void set_disk_bm(std::unique_ptr< sisl::Bitset > recovered_bm);
     BlkAllocPortion* get_blk_portion(blk_num_t portion_num) {
         HS_DBG_ASSERT_LT(portion_num, m_cfg.get_total_portions(), "Portion num is not in range");
@@ -262,6 +281,13 @@ public:
 
     void free_on_disk(const BlkId& b);
 
+    // Batch version of free_on_disk. Adjacent blkids are merged and each portion is locked only once.
+    void free_on_disk(const std::vector< BlkId >& blkids);
+
+    // Sort the blkids by blk num and merge the physically adjacent ones into maximal extents. Merged extent never
+    // spans a portion or exceeds BlkId::max_blks_in_op(). Merged extents are appended to out_blkids.
+    void coalesce_blkids(const std::vector< BlkId >& blkids, std::vector< BlkId >& out_blkids) const;
+
     // Acquire the underlying bitmap buffer and while the caller has acquired, all the new allocations
     // will be captured in a separate list and then pushes into buffer once released.
     // NOTE: THIS IS NON-THREAD SAFE METHOD. Caller is expected to ensure synchronization between multiple
@@ -300,7 +326,9 @@ public:
 private:
     sisl::Bitset* get_debug_bm() { return m_debug_bm.get(); }
     sisl::ThreadVector< BlkId >* get_alloc_blk_list();
-    void set_disk_bm_dirty() { is_disk_bm_dirty = true; }
+    void start_alloc_list();
+    void set_disk_bm_dirty();
+    void set_disk_bm_dirty(blk_num_t start_blk, blk_num_t nblks);
 
 protected:
     BlkAllocConfig m_cfg;
@@ -318,6 +346,9 @@ private:
     std::atomic< int64_t > m_alloced_blk_count{0};
     bool m_auto_recovery{false};
     std::atomic< bool > is_disk_bm_dirty{true}; // initially disk_bm treated as dirty
+    blk_num_t m_disk_bm_page_nbits;
+    uint32_t m_num_disk_bm_pages;
+    std::unique_ptr< std::atomic< bool >[] > m_disk_bm_dirty_pages; // initially all pages treated as dirty
 };
 
 /* FixedBlkAllocator is a fast allocator where it allocates only 1 size block and ALL free blocks are cached instead
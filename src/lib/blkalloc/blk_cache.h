@@ -213,6 +213,7 @@ struct SlabCacheConfig {
         blk_count_t slab_size;      // Size of this slab (in terms of number of blks)
         blk_cap_t max_entries;      // Max entries allowed in this slab
         float refill_threshold_pct; // At what percentage empty should we start refilling this slab cache
+        uint32_t magazine_size{0};  // Max entries in per thread magazine in front of slab queue, 0 to disable
         std::vector< float > m_level_distribution_pct; // How to distribute entries into multiple levels
         std::string m_name;                            // Name of the base blk allocator
     };
@@ -224,8 +225,9 @@ struct SlabCacheConfig {
         std::string str;
         for (const auto& s : m_per_slab_cfg) {
             fmt::format_to(std::back_inserter(str),
-                           "[nblks={} max_entries={} refill_threshold={} level distribution=[{}]], ", s.slab_size,
-                           s.max_entries, s.refill_threshold_pct, fmt::join(s.m_level_distribution_pct, ","));
+                           "[nblks={} max_entries={} refill_threshold={} magazine_size={} level distribution=[{}]], ",
+                           s.slab_size, s.max_entries, s.refill_threshold_pct, s.magazine_size,
+                           fmt::join(s.m_level_distribution_pct, ","));
         }
         return str;
     }
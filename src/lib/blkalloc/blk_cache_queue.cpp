@@ -13,6 +13,9 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <numeric>
+#include <thread>
+
 #include "common/homestore_assert.hpp"
 #include "varsize_blk_allocator.h"
 #include "blk_cache_queue.h"
@@ -45,7 +48,7 @@ FreeBlkCacheQueue::FreeBlkCacheQueue(const SlabCacheConfig& cfg, BlkAllocMetrics
         }
 
         auto ptr{std::make_unique< SlabCacheQueue >(slab_cfg.slab_size, level_limits, slab_cfg.refill_threshold_pct,
-                                                    metrics)};
+                                                    slab_cfg.magazine_size, metrics)};
         m_slab_queues.push_back(std::move(ptr));
     }
 }
@@ -105,7 +108,7 @@ blk_count_t FreeBlkCacheQueue::try_free_blks(const blk_cache_entry& entry,
 #endif
 
         e.set_nblks(m_slab_queues[slab_idx]->get_slab_size());
-        if (!push_slab(slab_idx, e, false /* only_this_level */)) {
+        if (!recycle_slab(slab_idx, e)) {
             excess_blks.push_back(e);
             num_zombied += e.get_nblks();
         }
@@ -146,7 +149,9 @@ blk_cap_t FreeBlkCacheQueue::try_fill_cache(const blk_cache_fill_req& fill_req,
             // Try to push the cache entry to slab and keep accounting as to how much
             const blk_cache_entry e{blk_num, slab_size, fill_req.preferred_level};
             if (!push_slab(slab_idx, e, fill_req.only_this_level)) {
-                fill_session.slab_requirements[slab_idx].mark_refill_done();
+                // If restricted to a level, only that level is full. Other levels could still be filled by subsequent
+                // requests of their temperature.
+                if (!fill_req.only_this_level) { fill_session.slab_requirements[slab_idx].mark_refill_done(); }
                 break;
             }
 
@@ -209,7 +214,7 @@ BlkAllocStatus FreeBlkCacheQueue::try_alloc_in_slab(const slab_idx_t slab_idx, c
     blk_count_t num_allocated{0};
     for (blk_num_t i{0}; i < nentries; ++i) {
         blk_cache_entry e;
-        if (const auto popped_level{pop_slab(slab_idx, req.preferred_level, false /* only_this_level */, e)}) {
+        if (const auto popped_level{pop_slab(slab_idx, req.preferred_level, e)}) {
             resp.out_blks.push_back(e);
             num_allocated += m_slab_queues[slab_idx]->slab_size();
 
@@ -282,9 +287,18 @@ std::optional< blk_temp_t > FreeBlkCacheQueue::push_slab(const slab_idx_t slab_i
     return ret;
 }
 
+std::optional< blk_temp_t > FreeBlkCacheQueue::recycle_slab(const slab_idx_t slab_idx, const blk_cache_entry& entry) {
+    const auto ret{m_slab_queues[slab_idx]->magazine_push(entry)};
+    if (ret) {
+        BLKALLOC_LOG(TRACE, "BlkCache: Recycled entry=[{}] to level=[{}.{}]", entry.to_string(),
+                     m_slab_queues[slab_idx]->slab_size(), *ret);
+    }
+    return ret;
+}
+
 std::optional< blk_temp_t > FreeBlkCacheQueue::pop_slab(const slab_idx_t slab_idx, const blk_temp_t level,
-                                                        const bool only_this_level, blk_cache_entry& out_entry) {
-    const auto ret{m_slab_queues[slab_idx]->pop(level, only_this_level, out_entry)};
+                                                        blk_cache_entry& out_entry) {
+    const auto ret{m_slab_queues[slab_idx]->magazine_pop(level, out_entry)};
     if (ret) {
         BLKALLOC_LOG(TRACE, "BlkCache: Popped entry=[{}] from level=[{}.{}], slab_queue size={}", out_entry.to_string(),
                      m_slab_queues[slab_idx]->slab_size(), *ret, m_slab_queues[slab_idx]->num_level_entries(*ret));
@@ -293,8 +307,12 @@ std::optional< blk_temp_t > FreeBlkCacheQueue::pop_slab(const slab_idx_t slab_id
 }
 
 SlabCacheQueue::SlabCacheQueue(const blk_count_t slab_size, const std::vector< blk_cap_t >& level_limits,
-                               const float refill_pct, BlkAllocMetrics* parent_metrics) :
-        m_slab_size{slab_size}, m_metrics{m_slab_size, this, parent_metrics} {
+                               const float refill_pct, const uint32_t magazine_size, BlkAllocMetrics* parent_metrics) :
+        m_slab_size{slab_size},
+        m_metrics{m_slab_size, this, parent_metrics},
+        m_parent_metrics{parent_metrics},
+        m_magazines{magazine_size, static_cast< blk_temp_t >(level_limits.size()),
+                    std::accumulate(level_limits.cbegin(), level_limits.cend(), blk_cap_t{0})} {
     for (auto& limit : level_limits) {
         auto ptr{std::make_unique< folly::MPMCQueue< blk_cache_entry > >(limit)};
         m_level_queues.push_back(std::move(ptr));
@@ -334,11 +352,116 @@ std::optional< blk_temp_t > SlabCacheQueue::pop(const blk_temp_t input_level, co
             popped = m_level_queues[level]->read(out_entry);
         } while (!popped);
     }
-    return popped ? std::optional< blk_temp_t >{start_level} : std::nullopt;
+    return popped ? std::optional< blk_temp_t >{level} : std::nullopt;
+}
+
+std::optional< blk_temp_t > SlabCacheQueue::magazine_pop(const blk_temp_t input_level, blk_cache_entry& out_entry) {
+    if (!m_magazines.is_enabled()) {
+        const auto ret{pop(input_level, false /* only_this_level */, out_entry)};
+        if (ret) { COUNTER_INCREMENT(*m_parent_metrics, num_slab_queue_pops, 1); }
+        return ret;
+    }
+
+    const blk_temp_t start_level{
+        static_cast< blk_temp_t >((input_level >= m_level_queues.size()) ? m_level_queues.size() - 1 : input_level)};
+    auto& shard{m_magazines.this_thread_shard()};
+
+    // Exhaust everything of the requested level, including the entries other threads are sitting on, before falling
+    // back to the next level, in the same order as pop() does.
+    blk_temp_t level{start_level};
+    do {
+        {
+            std::unique_lock< std::mutex > lg{shard.mtx};
+            if (magazine_pop_level(shard, level, out_entry)) { return level; }
+        }
+        if (magazine_steal(shard, level, out_entry)) { return level; }
+        level = (level + 1) % m_level_queues.size();
+    } while (level != start_level);
+    return std::nullopt;
+}
+
+/* This method assumes that shard lock is already taken */
+bool SlabCacheQueue::magazine_pop_level(SlabMagazineCache::magazine_shard& shard, const blk_temp_t level,
+                                        blk_cache_entry& out_entry) {
+    auto& mag{m_magazines.loaded_magazine(shard, level)};
+    if (mag->is_empty()) {
+        if (m_magazines.exchange_for_full(level, mag)) {
+            COUNTER_INCREMENT(m_metrics, num_magazine_depot_exchanges, 1);
+        } else {
+            // Refill half the magazine in one go, so that a thread which only allocates touches the shared level
+            // queue once every few allocations. The other half is left for frees to land without overflowing.
+            const uint32_t batch{std::max(m_magazines.magazine_size() / 2, 1u)};
+            blk_cache_entry e;
+            while ((mag->m_rounds.size() < batch) && pop(level, true /* only_this_level */, e)) {
+                mag->m_rounds.push_back(e);
+            }
+            if (mag->is_empty()) { return false; }
+            COUNTER_INCREMENT(m_metrics, num_magazine_refills, 1);
+        }
+    } else {
+        COUNTER_INCREMENT(*m_parent_metrics, num_magazine_hits, 1);
+    }
+
+    out_entry = mag->m_rounds.back();
+    mag->m_rounds.pop_back();
+    shard.update_nrounds();
+    return true;
+}
+
+bool SlabCacheQueue::magazine_steal(SlabMagazineCache::magazine_shard& shard, const blk_temp_t level,
+                                    blk_cache_entry& out_entry) {
+    // Slab queue and depot of the level are empty, but other threads could be sitting on entries they freed. Caller
+    // should not be holding its own shard lock, so that two threads stealing from each other do not deadlock.
+    static thread_local std::vector< blk_cache_entry > s_stolen;
+    s_stolen.clear();
+    if (m_magazines.steal(shard, level, s_stolen) == 0) { return false; }
+    COUNTER_INCREMENT(m_metrics, num_magazine_steals, 1);
+
+    // Keep one for this allocation and stash the rest in our magazine (which could have been filled by another
+    // thread sharing this shard meanwhile, in which case give them back to the slab queue of the level).
+    out_entry = s_stolen.back();
+    s_stolen.pop_back();
+
+    std::unique_lock< std::mutex > lg{shard.mtx};
+    auto& mag{m_magazines.loaded_magazine(shard, level)};
+    for (const auto& e : s_stolen) {
+        if (!mag->is_full()) {
+            mag->m_rounds.push_back(e);
+        } else {
+            [[maybe_unused]] const auto pushed{push(e, false /* only_this_level */)};
+            HS_DBG_ASSERT(pushed, "Stolen entries are expected to fit in slab queue");
+        }
+    }
+    shard.update_nrounds();
+    return true;
+}
+
+std::optional< blk_temp_t > SlabCacheQueue::magazine_push(const blk_cache_entry& entry) {
+    if (!m_magazines.is_enabled()) { return push(entry, false /* only_this_level */); }
+
+    const blk_temp_t level{static_cast< blk_temp_t >(
+        (entry.get_temperature() >= m_level_queues.size()) ? m_level_queues.size() - 1 : entry.get_temperature())};
+    auto& shard{m_magazines.this_thread_shard()};
+    std::unique_lock< std::mutex > lg{shard.mtx};
+
+    auto& mag{m_magazines.loaded_magazine(shard, level)};
+    if (mag->is_full()) {
+        if (m_magazines.exchange_for_empty(level, mag)) {
+            COUNTER_INCREMENT(m_metrics, num_magazine_depot_exchanges, 1);
+        } else {
+            // Depot is full as well, its time to give it back to the shared level queues directly.
+            lg.unlock();
+            return push(entry, false /* only_this_level */);
+        }
+    }
+
+    mag->m_rounds.push_back(entry);
+    shard.update_nrounds();
+    return level;
 }
 
 blk_cap_t SlabCacheQueue::entry_count() const {
-    blk_cap_t sz{0};
+    blk_cap_t sz{m_magazines.entry_count()};
     for (size_t l{0}; l < m_level_queues.size(); ++l) {
         sz += num_level_entries(l);
     }
@@ -369,6 +492,112 @@ void SlabCacheQueue::close_session(const uint64_t session_id) {
     m_refill_session.compare_exchange_strong(expected_session_id, 0, std::memory_order_acq_rel);
 }
 
+SlabMagazineCache::SlabMagazineCache(const uint32_t magazine_size, const blk_temp_t nlevels,
+                                     const blk_cap_t slab_capacity) :
+        m_nlevels{nlevels},
+        m_nshards{std::clamp< uint32_t >(std::thread::hardware_concurrency(), 1, max_shards)},
+        m_max_depot_mags{m_nshards} {
+    // Entries held in loaded magazines and the depot are invisible to other threads until they are stolen, so limit
+    // them to a quarter of the slab capacity. Slabs which are too small to afford it go without magazines.
+    const blk_cap_t max_held_entries{slab_capacity / 4};
+    const blk_cap_t max_mags{static_cast< blk_cap_t >(m_nlevels) * (m_nshards + m_max_depot_mags)};
+    m_magazine_size = static_cast< uint32_t >(std::min< blk_cap_t >(magazine_size, max_held_entries / max_mags));
+    if (m_magazine_size < 2) { m_magazine_size = 0; }
+
+    if (is_enabled()) {
+        m_shards = std::make_unique< magazine_shard[] >(m_nshards);
+        m_depots.resize(m_nlevels);
+        for (auto& depot : m_depots) {
+            depot.full_mags.reserve(m_max_depot_mags);
+        }
+    }
+}
+
+SlabMagazineCache::magazine_shard& SlabMagazineCache::this_thread_shard() {
+    static std::atomic< uint32_t > s_next_thread_ordinal{0};
+    static thread_local const uint32_t t_thread_ordinal{s_next_thread_ordinal.fetch_add(1, std::memory_order_relaxed)};
+    return m_shards[t_thread_ordinal % m_nshards];
+}
+
+/* This method assumes that shard lock is already taken */
+std::unique_ptr< blk_cache_magazine >& SlabMagazineCache::loaded_magazine(magazine_shard& shard,
+                                                                         const blk_temp_t level) {
+    if (shard.loaded.empty()) { shard.loaded.resize(m_nlevels); }
+    auto& mag{shard.loaded[level]};
+    if (!mag) { mag = std::make_unique< blk_cache_magazine >(m_magazine_size); }
+    return mag;
+}
+
+/* This method assumes that shard lock is already taken */
+void SlabMagazineCache::magazine_shard::update_nrounds() {
+    uint32_t n{0};
+    for (const auto& mag : loaded) {
+        if (mag) { n += static_cast< uint32_t >(mag->m_rounds.size()); }
+    }
+    nrounds.store(n, std::memory_order_relaxed);
+}
+
+blk_cap_t SlabMagazineCache::entry_count() const {
+    if (!is_enabled()) { return 0; }
+
+    blk_cap_t count{m_depot_entries.load(std::memory_order_relaxed)};
+    for (uint32_t i{0}; i < m_nshards; ++i) {
+        count += m_shards[i].nrounds.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+bool SlabMagazineCache::exchange_for_full(const blk_temp_t level, std::unique_ptr< blk_cache_magazine >& mag) {
+    std::unique_lock< std::mutex > lg{m_depot_mtx};
+    auto& depot{m_depots[level]};
+    if (depot.full_mags.empty()) { return false; }
+
+    depot.empty_mags.push_back(std::move(mag));
+    mag = std::move(depot.full_mags.back());
+    depot.full_mags.pop_back();
+    m_depot_entries.fetch_sub(mag->m_rounds.size(), std::memory_order_relaxed);
+    return true;
+}
+
+bool SlabMagazineCache::exchange_for_empty(const blk_temp_t level, std::unique_ptr< blk_cache_magazine >& mag) {
+    std::unique_lock< std::mutex > lg{m_depot_mtx};
+    auto& depot{m_depots[level]};
+    if (depot.full_mags.size() >= m_max_depot_mags) { return false; }
+
+    m_depot_entries.fetch_add(mag->m_rounds.size(), std::memory_order_relaxed);
+    depot.full_mags.push_back(std::move(mag));
+    if (depot.empty_mags.empty()) {
+        mag = std::make_unique< blk_cache_magazine >(m_magazine_size);
+    } else {
+        mag = std::move(depot.empty_mags.back());
+        depot.empty_mags.pop_back();
+    }
+    return true;
+}
+
+uint32_t SlabMagazineCache::steal(const magazine_shard& self_shard, const blk_temp_t level,
+                                  std::vector< blk_cache_entry >& out_entries) {
+    // Take half of the first non-empty magazine of the level loaded by other threads
+    for (uint32_t i{0}; i < m_nshards; ++i) {
+        auto& from_shard{m_shards[i]};
+        if (&from_shard == &self_shard) { continue; }
+        if (from_shard.nrounds.load(std::memory_order_relaxed) == 0) { continue; }
+
+        std::unique_lock< std::mutex > lg{from_shard.mtx};
+        if (from_shard.loaded.empty() || !from_shard.loaded[level] || from_shard.loaded[level]->is_empty()) {
+            continue;
+        }
+
+        auto& from_rounds{from_shard.loaded[level]->m_rounds};
+        const auto nsteal{(from_rounds.size() + 1) / 2};
+        out_entries.insert(out_entries.end(), from_rounds.end() - nsteal, from_rounds.end());
+        from_rounds.resize(from_rounds.size() - nsteal);
+        from_shard.update_nrounds();
+        return static_cast< uint32_t >(nsteal);
+    }
+    return 0;
+}
+
 SlabMetrics::SlabMetrics(const blk_count_t slab_size, SlabCacheQueue* const slab_queue, BlkAllocMetrics* const parent) :
         sisl::MetricsGroup{"SlabMetrics", fmt::format("{}_slab_{:03d}", parent->instance_name(), slab_size)},
         m_slab_queue{slab_queue} {
@@ -379,6 +608,9 @@ SlabMetrics::SlabMetrics(const blk_count_t slab_size, SlabCacheQueue* const slab
     REGISTER_COUNTER(num_slab_splits, "Number of split in this slab to serve lower slab alloc");
     REGISTER_COUNTER(num_slab_merges, "Number of merges in this slab to serve higher slab alloc");
     REGISTER_COUNTER(num_slab_refills, "Number of entries refilled in this slab");
+    REGISTER_COUNTER(num_magazine_refills, "Number of times a thread magazine is refilled from slab queues");
+    REGISTER_COUNTER(num_magazine_depot_exchanges, "Number of times a thread magazine is exchanged with depot");
+    REGISTER_COUNTER(num_magazine_steals, "Number of times entries are stolen from other thread magazines");
 
     REGISTER_GAUGE(slab_available_entries, "Available entries in the slab for allocation");
     REGISTER_GAUGE(slab_total_entries, "Total entries possible in the slab for allocation");
@@ -18,6 +18,7 @@
 #include <atomic>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
@@ -45,10 +46,79 @@ private:
     SlabCacheQueue* m_slab_queue;
 };
 
+/*
+ * Magazine is a small LIFO stash of slab entries of one level. Each thread allocates from and frees to its own
+ * magazine of the level and goes to the shared slab level queue or the depot only when its magazine underflows or
+ * overflows. This avoids the cache line bouncing on MPMC queues when every alloc/free of every thread hits the same
+ * slab queue.
+ */
+struct blk_cache_magazine {
+    explicit blk_cache_magazine(const uint32_t capacity) : m_capacity{capacity} { m_rounds.reserve(capacity); }
+
+    [[nodiscard]] bool is_empty() const { return m_rounds.empty(); }
+    [[nodiscard]] bool is_full() const { return m_rounds.size() >= m_capacity; }
+
+    uint32_t m_capacity;
+    std::vector< blk_cache_entry > m_rounds;
+};
+
+class SlabMagazineCache {
+public:
+    static constexpr uint32_t max_shards{128};
+
+    SlabMagazineCache(const uint32_t magazine_size, const blk_temp_t nlevels, const blk_cap_t slab_capacity);
+    SlabMagazineCache(const SlabMagazineCache&) = delete;
+    SlabMagazineCache(SlabMagazineCache&&) noexcept = delete;
+    SlabMagazineCache& operator=(const SlabMagazineCache&) = delete;
+    SlabMagazineCache& operator=(SlabMagazineCache&&) noexcept = delete;
+    ~SlabMagazineCache() = default;
+
+    [[nodiscard]] bool is_enabled() const { return (m_magazine_size != 0); }
+    [[nodiscard]] uint32_t magazine_size() const { return m_magazine_size; }
+    [[nodiscard]] blk_cap_t entry_count() const;
+
+private:
+    friend class SlabCacheQueue;
+
+    // Threads (and thus reactors) are spread across the shards by their ordinal. Each shard is on its own cache line
+    // so that the lock and the magazines of one thread does not share a cache line with another thread.
+    struct alignas(64) magazine_shard {
+        std::mutex mtx;
+        std::vector< std::unique_ptr< blk_cache_magazine > > loaded; // One magazine per level
+        std::atomic< uint32_t > nrounds{0}; // Mirror of loaded rounds across levels for lockless entry count
+
+        void update_nrounds();
+    };
+
+    // Full and empty magazines of one level shared across all threads of this slab
+    struct magazine_depot {
+        std::vector< std::unique_ptr< blk_cache_magazine > > full_mags;
+        std::vector< std::unique_ptr< blk_cache_magazine > > empty_mags;
+    };
+
+    [[nodiscard]] magazine_shard& this_thread_shard();
+    [[nodiscard]] std::unique_ptr< blk_cache_magazine >& loaded_magazine(magazine_shard& shard, const blk_temp_t level);
+    [[nodiscard]] bool exchange_for_full(const blk_temp_t level, std::unique_ptr< blk_cache_magazine >& mag);
+    [[nodiscard]] bool exchange_for_empty(const blk_temp_t level, std::unique_ptr< blk_cache_magazine >& mag);
+    [[nodiscard]] uint32_t steal(const magazine_shard& self_shard, const blk_temp_t level,
+                                 std::vector< blk_cache_entry >& out_entries);
+
+private:
+    uint32_t m_magazine_size;
+    blk_temp_t m_nlevels;
+    std::unique_ptr< magazine_shard[] > m_shards;
+    uint32_t m_nshards;
+
+    std::mutex m_depot_mtx;
+    std::vector< magazine_depot > m_depots; // One depot per level
+    std::atomic< blk_cap_t > m_depot_entries{0};
+    uint32_t m_max_depot_mags; // Max full magazines in the depot of each level
+};
+
 class SlabCacheQueue {
 public:
     SlabCacheQueue(const blk_count_t slab_size, const std::vector< blk_cap_t >& level_limits, const float refill_pct,
-                   BlkAllocMetrics* metrics);
+                   const uint32_t magazine_size, BlkAllocMetrics* metrics);
     SlabCacheQueue(const SlabCacheQueue&) = delete;
     SlabCacheQueue(SlabCacheQueue&&) noexcept = delete;
     SlabCacheQueue& operator=(const SlabCacheQueue&) = delete;
@@ -58,6 +128,12 @@ public:
     [[nodiscard]] std::optional< blk_temp_t > push(const blk_cache_entry& entry, const bool only_this_level);
     [[nodiscard]] std::optional< blk_temp_t > pop(const blk_temp_t level, const bool only_this_level,
                                                   blk_cache_entry& out_entry);
+
+    // Alloc/free path variants of pop/push, which are served from this thread's magazine of the level if enabled.
+    // Like pop/push, they fall back to other levels and return the level the entry is actually popped from/pushed to.
+    [[nodiscard]] std::optional< blk_temp_t > magazine_pop(const blk_temp_t level, blk_cache_entry& out_entry);
+    [[nodiscard]] std::optional< blk_temp_t > magazine_push(const blk_cache_entry& entry);
+
     [[nodiscard]] blk_cap_t entry_count() const;
     [[nodiscard]] blk_cap_t entry_capacity() const;
     [[nodiscard]] blk_cap_t num_level_entries(const blk_temp_t level) const;
@@ -73,6 +149,12 @@ public:
 
     blk_count_t get_slab_size() const { return m_slab_size; }
 
+private:
+    [[nodiscard]] bool magazine_pop_level(SlabMagazineCache::magazine_shard& shard, const blk_temp_t level,
+                                          blk_cache_entry& out_entry);
+    [[nodiscard]] bool magazine_steal(SlabMagazineCache::magazine_shard& shard, const blk_temp_t level,
+                                      blk_cache_entry& out_entry);
+
 private:
     blk_count_t m_slab_size; // Slab size in-terms of number of pages
     std::vector< std::unique_ptr< folly::MPMCQueue< blk_cache_entry > > > m_level_queues;
@@ -80,6 +162,8 @@ private:
     blk_cap_t m_total_capacity{0};
     blk_cap_t m_refill_threshold_limits; // For every level whats their threshold limit size
     SlabMetrics m_metrics;
+    BlkAllocMetrics* m_parent_metrics;
+    SlabMagazineCache m_magazines;
 };
 
 class FreeBlkCacheQueue : public FreeBlkCache {
@@ -114,7 +198,8 @@ private:
     [[nodiscard]] std::optional< blk_temp_t > push_slab(const slab_idx_t slab_idx, const blk_cache_entry& entry,
                                                         const bool only_this_level);
     [[nodiscard]] std::optional< blk_temp_t > pop_slab(const slab_idx_t slab_idx, const blk_temp_t level,
-                                                       const bool only_this_level, blk_cache_entry& out_entry);
+                                                       blk_cache_entry& out_entry);
+    [[nodiscard]] std::optional< blk_temp_t > recycle_slab(const slab_idx_t slab_idx, const blk_cache_entry& entry);
 
     [[nodiscard]] inline SlabMetrics& slab_metrics(const slab_idx_t slab_idx) const {
         return m_slab_queues[slab_idx]->metrics();
@@ -0,0 +1,250 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+
+#include "common/homestore_assert.hpp"
+#include "common/homestore_flip.hpp"
+#include "extent_blk_allocator.h"
+
+namespace homestore {
+ExtentBlkAllocator::ExtentBlkAllocator(const BlkAllocConfig& cfg, bool init, chunk_num_t chunk_id) :
+        BlkAllocator(cfg, chunk_id), m_metrics{cfg.get_name().c_str()} {
+    BLKALLOC_LOG(INFO, "Creating ExtentBlkAllocator with config: {}", cfg.to_string());
+    if (init) { inited(); }
+}
+
+void ExtentBlkAllocator::inited() {
+    if (m_inited) { return; }
+
+    {
+        // Build the free extents out of persisted bitmap. Scan is done one portion at a time so that run fits in
+        // blk_count_t and adjacent runs across portions are coalesced while adding.
+        std::unique_lock< std::mutex > lg{m_mtx};
+        m_by_offset.clear();
+        m_by_size.clear();
+        m_free_blks = 0;
+
+        const auto total_blks{m_cfg.get_total_blks()};
+        const auto blks_per_portion{m_cfg.get_blks_per_portion()};
+        for (blk_num_t start{0}; start < total_blks; start += blks_per_portion) {
+            const blk_num_t end{static_cast< blk_num_t >(std::min(start + blks_per_portion, total_blks) - 1)};
+            blk_num_t cur{start};
+            while (cur <= end) {
+                const auto b{get_disk_bm_const()->get_next_contiguous_n_reset_bits(cur, end, 1, end - cur + 1)};
+                if (b.nbits == 0) { break; }
+                add_free_extent(b.start_bit, b.nbits);
+                cur = b.start_bit + b.nbits;
+            }
+        }
+        BLKALLOC_LOG(INFO, "ExtentBlkAllocator initialized with free_blks={} in free_extents={}", m_free_blks,
+                     m_by_offset.size());
+    }
+    BlkAllocator::inited();
+}
+
+BlkAllocStatus ExtentBlkAllocator::alloc(BlkId& out_blkid) {
+    static thread_local std::vector< BlkId > s_ids;
+    s_ids.clear();
+
+    auto const status = alloc(1, blk_alloc_hints{}, s_ids);
+    if (status == BlkAllocStatus::SUCCESS) { out_blkid = s_ids[0]; }
+    return status;
+}
+
+BlkAllocStatus ExtentBlkAllocator::alloc(blk_count_t nblks, const blk_alloc_hints& hints,
+                                         std::vector< BlkId >& out_blkids) {
+    BLKALLOC_LOG_ASSERT(m_inited, "Alloc before initialized");
+    BLKALLOC_LOG_ASSERT_CMP(nblks % hints.multiplier, ==, 0);
+    COUNTER_INCREMENT(m_metrics, num_alloc, 1);
+
+#ifdef _PRERELEASE
+    if (hints.error_simulate && homestore_flip->test_flip("extent_blkalloc_no_blks", nblks)) {
+        return BlkAllocStatus::SPACE_FULL;
+    }
+#endif
+
+    auto const first_new_idx{out_blkids.size()};
+    blk_count_t nblks_remain{nblks};
+    uint32_t nextents{0};
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+
+        // Best fit: Smallest extent which can hold the entire request
+        auto it{m_by_size.lower_bound(std::make_pair(static_cast< blk_cap_t >(nblks), blk_num_t{0}))};
+        if (it != m_by_size.end()) {
+            carve(it->second, nblks, hints, out_blkids);
+            nblks_remain = 0;
+            nextents = 1;
+        } else if (!hints.is_contiguous) {
+            // No single extent can hold it, carve out of largest extents to keep the number of pieces minimum
+            while ((nblks_remain > 0) && !m_by_size.empty()) {
+                auto const [ext_nblks, ext_start]{*m_by_size.rbegin()};
+                blk_cap_t const take{std::min< blk_cap_t >(nblks_remain, ext_nblks) / hints.multiplier *
+                                     hints.multiplier};
+                if (take == 0) { break; } // Largest extent is smaller than multiplier, so is every other extent
+                carve(ext_start, take, hints, out_blkids);
+                nblks_remain -= take;
+                ++nextents;
+            }
+        }
+    }
+
+    if (nextents > 0) { HISTOGRAM_OBSERVE(m_metrics, num_extents_per_alloc, nextents); }
+
+    auto const nblks_alloced{static_cast< blk_count_t >(nblks - nblks_remain)};
+    if (nblks_alloced > 0) {
+        incr_alloced_blk_count(nblks_alloced);
+        for (auto i{first_new_idx}; i < out_blkids.size(); ++i) {
+            alloc_on_realtime(out_blkids[i]);
+        }
+    }
+
+    if (nblks_remain == 0) { return BlkAllocStatus::SUCCESS; }
+    if (nblks_alloced > 0) {
+        COUNTER_INCREMENT(m_metrics, num_alloc_partial, 1);
+        BLKALLOC_LOG(DEBUG, "nblks={} allocated={} partial allocation", nblks, nblks_alloced);
+        return BlkAllocStatus::PARTIAL;
+    }
+
+    COUNTER_INCREMENT(m_metrics, num_alloc_failure, 1);
+    BLKALLOC_LOG(ERROR, "nblks={} failed to alloc any number of blocks, free_blks={} largest_free_extent={}", nblks,
+                 available_blks(), largest_free_extent());
+    return hints.is_contiguous && (available_blks() >= nblks) ? BlkAllocStatus::FAILED : BlkAllocStatus::SPACE_FULL;
+}
+
+void ExtentBlkAllocator::free(const std::vector< BlkId >& blk_ids) {
+    for (const auto& blk_id : blk_ids) {
+        free(blk_id);
+    }
+}
+
+void ExtentBlkAllocator::free(const BlkId& b) {
+    if (!m_inited) {
+        BLKALLOC_LOG(DEBUG, "Free not required for blk num = {}", b.get_blk_num());
+        return;
+    }
+
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        add_free_extent(b.get_blk_num(), b.get_nblks());
+    }
+    decr_alloced_blk_count(b.get_nblks());
+    BLKALLOC_LOG(TRACE, "Freed blkid={}", b.to_string());
+}
+
+blk_cap_t ExtentBlkAllocator::available_blks() const { return m_cfg.get_total_blks() - get_used_blks(); }
+blk_cap_t ExtentBlkAllocator::get_used_blks() const { return get_alloced_blk_count(); }
+
+bool ExtentBlkAllocator::is_blk_alloced(const BlkId& b, bool use_lock) const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+
+    // Blks are allocated if they don't overlap with any free extent
+    auto it{m_by_offset.upper_bound(b.get_blk_num())};
+    if ((it != m_by_offset.end()) && (it->first < b.get_blk_num() + b.get_nblks())) { return false; }
+    if (it != m_by_offset.begin()) {
+        --it;
+        if (it->first + it->second > b.get_blk_num()) { return false; }
+    }
+    return true;
+}
+
+size_t ExtentBlkAllocator::num_free_extents() const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return m_by_offset.size();
+}
+
+blk_cap_t ExtentBlkAllocator::largest_free_extent() const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return m_by_size.empty() ? 0 : m_by_size.rbegin()->first;
+}
+
+std::string ExtentBlkAllocator::to_string() const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return fmt::format("Total Blks={} Free Blks={} Free Extents={} Largest Free Extent={}", m_cfg.get_total_blks(),
+                       m_free_blks, m_by_offset.size(), m_by_size.empty() ? 0 : m_by_size.rbegin()->first);
+}
+
+/* This method assumes that m_mtx is already taken */
+void ExtentBlkAllocator::add_free_extent(blk_num_t start, blk_cap_t nblks) {
+    auto next{m_by_offset.lower_bound(start)};
+    BLKALLOC_REL_ASSERT((next == m_by_offset.end()) || (start + nblks <= next->first),
+                        "Freeing blk_num={} nblks={} overlaps with free extent [{}, {}]", start, nblks,
+                        (next == m_by_offset.end()) ? 0 : next->first,
+                        (next == m_by_offset.end()) ? 0 : next->second);
+    m_free_blks += nblks;
+
+    bool coalesced{false};
+    if (next != m_by_offset.begin()) {
+        auto prev{std::prev(next)};
+        BLKALLOC_REL_ASSERT(prev->first + prev->second <= start,
+                            "Freeing blk_num={} nblks={} overlaps with free extent [{}, {}]", start, nblks,
+                            prev->first, prev->second);
+        if (prev->first + prev->second == start) {
+            start = prev->first;
+            nblks += prev->second;
+            remove_free_extent(prev);
+            coalesced = true;
+        }
+    }
+
+    if ((next != m_by_offset.end()) && (start + nblks == next->first)) {
+        nblks += next->second;
+        remove_free_extent(next);
+        coalesced = true;
+    }
+
+    m_by_offset.emplace(start, nblks);
+    m_by_size.emplace(nblks, start);
+    if (coalesced) { COUNTER_INCREMENT(m_metrics, num_free_coalesced, 1); }
+    GAUGE_UPDATE(m_metrics, num_free_extents, m_by_offset.size());
+}
+
+/* This method assumes that m_mtx is already taken. It only removes from index and doesn't account free blks */
+void ExtentBlkAllocator::remove_free_extent(std::map< blk_num_t, blk_cap_t >::iterator it) {
+    m_by_size.erase(std::make_pair(it->second, it->first));
+    m_by_offset.erase(it);
+}
+
+/* This method assumes that m_mtx is already taken. Allocates nblks from the start of the free extent starting at start
+ * and puts the remaining back as free extent */
+void ExtentBlkAllocator::carve(blk_num_t start, blk_cap_t nblks, const blk_alloc_hints& hints,
+                               std::vector< BlkId >& out_blkids) {
+    auto it{m_by_offset.find(start)};
+    BLKALLOC_REL_ASSERT(it != m_by_offset.end(), "Carving from non existent free extent at blk_num={}", start);
+    BLKALLOC_REL_ASSERT_CMP(it->second, >=, nblks);
+
+    auto const ext_nblks{it->second};
+    remove_free_extent(it);
+    if (ext_nblks > nblks) {
+        m_by_offset.emplace(start + nblks, ext_nblks - nblks);
+        m_by_size.emplace(ext_nblks - nblks, start + nblks);
+    }
+    m_free_blks -= nblks;
+    GAUGE_UPDATE(m_metrics, num_free_extents, m_by_offset.size());
+
+    // Each BlkId can hold only upto max_blks_per_entry, but all of them are physically adjacent.
+    blk_cap_t const max_per_entry{
+        std::max< blk_cap_t >(std::min< blk_cap_t >(hints.max_blks_per_entry, BlkId::max_blks_in_op()) /
+                                  hints.multiplier * hints.multiplier,
+                              hints.multiplier)};
+    while (nblks > 0) {
+        auto const n{std::min(nblks, max_per_entry)};
+        out_blkids.emplace_back(start, static_cast< blk_count_t >(n), m_chunk_id);
+        start += n;
+        nblks -= n;
+    }
+}
+} // namespace homestore
@@ -0,0 +1,107 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sisl/metrics/metrics.hpp>
+
+#include <homestore/blk.h>
+#include "blk_allocator.h"
+
+namespace homestore {
+
+class ExtentBlkAllocMetrics : public sisl::MetricsGroup {
+public:
+    explicit ExtentBlkAllocMetrics(const char* inst_name) : sisl::MetricsGroup("ExtentBlkAlloc", inst_name) {
+        REGISTER_COUNTER(num_alloc, "Number of blks alloc attempts");
+        REGISTER_COUNTER(num_alloc_failure, "Number of blk alloc failures");
+        REGISTER_COUNTER(num_alloc_partial, "Number of blk alloc partial allocations");
+        REGISTER_COUNTER(num_free_coalesced, "Number of frees which are merged with neighboring free extents");
+        REGISTER_GAUGE(num_free_extents, "Number of free extents");
+        REGISTER_HISTOGRAM(num_extents_per_alloc, "Number of free extents an allocation is carved from",
+                           HistogramBucketsType(LinearUpto64Buckets));
+
+        register_me_to_farm();
+    }
+
+    ExtentBlkAllocMetrics(const ExtentBlkAllocMetrics&) = delete;
+    ExtentBlkAllocMetrics(ExtentBlkAllocMetrics&&) noexcept = delete;
+    ExtentBlkAllocMetrics& operator=(const ExtentBlkAllocMetrics&) = delete;
+    ExtentBlkAllocMetrics& operator=(ExtentBlkAllocMetrics&&) noexcept = delete;
+    ~ExtentBlkAllocMetrics() { deregister_me_from_farm(); }
+};
+
+/* ExtentBlkAllocator keeps the free space as extents instead of bitmap + cache. Free extents are indexed both by their
+ * start blk and by their size, so that
+ *
+ * 1. Allocation picks the smallest free extent which can satisfy the entire request (best fit) in O(log n). If there
+ *    is no such extent for a non-contiguous request, it is carved out of the largest extents, so the number of pieces
+ *    is as minimum as possible.
+ * 2. Free merges the blks with adjacent free extents in O(log n), so free space doesn't get fragmented over time.
+ *
+ * Large requests are carved out of a single extent and hence the BlkIds returned for it are physically adjacent, even
+ * though each BlkId is limited to BlkId::max_blks_in_op(). This is useful for data objects of several MBs, which
+ * otherwise gets scattered across the slabs of VarsizeBlkAllocator.
+ *
+ * All operations are serialized by a single lock. This allocator is meant for chunks with large objects where the
+ * rate of allocation is low compared to the size of each allocation.
+ */
+class ExtentBlkAllocator : public BlkAllocator {
+public:
+    ExtentBlkAllocator(const BlkAllocConfig& cfg, bool init, chunk_num_t chunk_id);
+    ExtentBlkAllocator(const ExtentBlkAllocator&) = delete;
+    ExtentBlkAllocator(ExtentBlkAllocator&&) noexcept = delete;
+    ExtentBlkAllocator& operator=(const ExtentBlkAllocator&) = delete;
+    ExtentBlkAllocator& operator=(ExtentBlkAllocator&&) noexcept = delete;
+    ~ExtentBlkAllocator() override = default;
+
+    BlkAllocStatus alloc(BlkId& bid) override;
+    BlkAllocStatus alloc(blk_count_t nblks, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkid) override;
+    void free(const std::vector< BlkId >& blk_ids) override;
+    void free(const BlkId& b) override;
+    void inited() override;
+
+    blk_cap_t available_blks() const override;
+    blk_cap_t get_used_blks() const override;
+    bool is_blk_alloced(const BlkId& in_bid, bool use_lock = false) const override;
+    std::string to_string() const override;
+
+    /// @brief Number of free extents the free space is made up of. Lower the better.
+    [[nodiscard]] size_t num_free_extents() const;
+
+    /// @brief Size of the largest free extent, i.e. largest contiguous blks that can be allocated.
+    [[nodiscard]] blk_cap_t largest_free_extent() const;
+
+private:
+    void add_free_extent(blk_num_t start, blk_cap_t nblks);
+    void remove_free_extent(std::map< blk_num_t, blk_cap_t >::iterator it);
+    void carve(blk_num_t start, blk_cap_t nblks, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkids);
+
+private:
+    mutable std::mutex m_mtx;
+    std::map< blk_num_t, blk_cap_t > m_by_offset;            // start blk -> nblks
+    std::set< std::pair< blk_cap_t, blk_num_t > > m_by_size; // (nblks, start blk)
+    blk_cap_t m_free_blks{0};
+    ExtentBlkAllocMetrics m_metrics;
+};
+} // namespace homestore
@@ -55,6 +55,7 @@ VarsizeBlkAllocator::VarsizeBlkAllocator(const VarsizeBlkAllocConfig& cfg, bool
 
     // TODO: Raise exception when blk_size > page_size or total blks is less than some number etc...
     m_cache_bm = std::make_unique< sisl::Bitset >(cfg.get_total_blks(), chunk_id, cfg.get_align_size());
+    m_cache_sum = std::make_unique< BlkAllocSummary >(cfg.get_total_blks(), cfg.get_blks_per_portion());
 
     // NOTE: Number of blocks must be modulo word size so locks do not fall on same word
     HS_REL_ASSERT_EQ(m_cfg.get_blks_per_portion() % m_cache_bm->word_size(), 0,
@@ -70,6 +71,15 @@ VarsizeBlkAllocator::VarsizeBlkAllocator(const VarsizeBlkAllocConfig& cfg, bool
         m_segments.push_back(std::move(seg));
     }
 
+    // Assign the temperature to each portion based on which temperature group it falls in
+    for (blk_num_t p{0}; p < cfg.get_total_portions(); ++p) {
+        get_blk_portion(p)->set_temperature(cfg.portion_temperature(p));
+    }
+    m_temp_metrics.reserve(cfg.get_num_temperatures());
+    for (blk_temp_t t{1}; t <= cfg.get_num_temperatures(); ++t) {
+        m_temp_metrics.push_back(std::make_unique< BlkAllocTempMetrics >(fmt::format("{}_temp_{}", cfg.get_name(), t)));
+    }
+
     // Create free blk Cache of type Queue
     if (m_cfg.get_use_slabs()) {
         m_fb_cache = std::make_unique< FreeBlkCacheQueue >(cfg.get_slab_config(), &m_metrics);
@@ -247,11 +257,33 @@ bool VarsizeBlkAllocator::is_blk_alloced(const BlkId& b, bool use_lock) const {
 }
 
 void VarsizeBlkAllocator::inited() {
+    auto phase_start{Clock::now()};
     m_cache_bm->copy(*(get_disk_bm_const()));
+    const auto copy_us{get_elapsed_time_us(phase_start)};
+
+    phase_start = Clock::now();
+    m_cache_sum->rebuild(*m_cache_bm);
     BlkAllocator::inited();
+    const auto count_us{get_elapsed_time_us(phase_start)};
+
+    // Fill the cache upto its refill threshold right away, so that the allocations soon after the startup are served
+    // from cache instead of falling into direct alloc while waiting for the sweeper threads.
+    phase_start = Clock::now();
+    blk_cap_t warmup_nblks{0};
+    if (m_cfg.get_use_slabs() && HS_DYNAMIC_CONFIG(blkallocator.warmup_cache_on_init)) {
+        std::unique_lock< std::mutex > alloc_lock{m_mutex};
+        if ((m_state == BlkAllocatorState::INIT) && prepare_sweep(nullptr, false /* fill_entire_cache */)) {
+            fill_cache(m_sweep_segment, *m_cur_fill_session);
+            warmup_nblks = m_cur_fill_session->overall_refilled_num_blks;
+        }
+        // State is left as INIT, so that sweeper continues to fill the entire cache in background.
+    }
+    const auto warmup_us{get_elapsed_time_us(phase_start)};
 
-    BLKALLOC_LOG(INFO, "VarSizeBlkAllocator initialized loading bitmap of size={} used blks={} from persistent storage",
-                 in_bytes(m_cache_bm->size()), get_alloced_blk_count());
+    BLKALLOC_LOG(INFO,
+                 "VarSizeBlkAllocator initialized loading bitmap of size={} used blks={} from persistent storage, "
+                 "cache warmed up with blks={}. Time taken: bitmap_copy={}us free_count={}us cache_warmup={}us",
+                 in_bytes(m_cache_bm->size()), get_alloced_blk_count(), warmup_nblks, copy_us, count_us, warmup_us);
 
     // if use slabs then add to sweeper threads queue
     if (m_cfg.get_use_slabs()) {
@@ -349,6 +381,8 @@ void VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache
 
     blk_cache_fill_req fill_req;
     fill_req.preferred_level = 1;
+    // With multiple temperatures, don't let the blks of one temperature overflow into the level of other temperature.
+    fill_req.only_this_level = (m_cfg.get_num_temperatures() > 1);
 
     BLKALLOC_LOG(TRACE, "Allocator sweep session={} for portion_num={} sweep blk_id_range=[{}-{}]",
                  fill_session.session_id, portion_num, cur_blk_id, end_blk_id);
@@ -356,10 +390,12 @@ void VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache
     BlkAllocPortion& portion = *(get_blk_portion(portion_num));
     {
         auto lock{portion.portion_auto_lock()};
-        while (!fill_session.overall_refill_done && (cur_blk_id <= end_blk_id)) {
+        if (m_cache_sum->portion_free_blks(portion_num) == 0) { COUNTER_INCREMENT(m_metrics, num_portions_skipped, 1); }
+        while (!fill_session.overall_refill_done && (cur_blk_id <= end_blk_id) &&
+               (m_cache_sum->portion_free_blks(portion_num) > 0)) {
             // Get next reset bits and insert to cache and then reset those bits
-            auto const b{
-                m_cache_bm->get_next_contiguous_n_reset_bits(cur_blk_id, end_blk_id, 1, end_blk_id - cur_blk_id + 1)};
+            auto const b{m_cache_sum->next_free_run(*m_cache_bm, cur_blk_id, end_blk_id, 1,
+                                                    end_blk_id - cur_blk_id + 1)};
 
             // If there are no free blocks within the assigned portion
             if (b.nbits == 0) { break; }
@@ -383,6 +419,7 @@ void VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache
             // Set the bitmap indicating the blocks are allocated
             if (nblks_added > 0) {
                 m_cache_bm->set_bits(b.start_bit, nblks_added);
+                m_cache_sum->mark_used(b.start_bit, nblks_added);
                 if (portion.decrease_available_blocks(nblks_added) == 0) break;
             }
             cur_blk_id = b.start_bit + b.nbits;
@@ -552,6 +589,7 @@ BlkAllocStatus VarsizeBlkAllocator::alloc(blk_count_t nblks, const blk_alloc_hin
         for (const auto& b : out_blkids) {
             alloc_on_realtime(b);
         }
+        account_alloc_temperature(out_blkids, hints.desired_temp);
 
 #ifdef _PRERELEASE
         alloc_sanity_check(total_allocated, hints, out_blkids);
@@ -562,9 +600,46 @@ BlkAllocStatus VarsizeBlkAllocator::alloc(blk_count_t nblks, const blk_alloc_hin
 }
 
 void VarsizeBlkAllocator::free(const std::vector< BlkId >& blk_ids) {
-    for (const auto& blk_id : blk_ids) {
-        free(blk_id);
+    if (blk_ids.size() <= 1) {
+        for (const auto& blk_id : blk_ids) {
+            free(blk_id);
+        }
+        return;
     }
+
+    if (!m_inited) {
+        BLKALLOC_LOG(DEBUG, "Free not required for {} blkids", blk_ids.size());
+        return;
+    }
+
+    // Merge the physically adjacent blkids, so that they are recycled as larger slab entries instead of piling up as
+    // fragmented single blk entries in the smaller slabs.
+    static thread_local std::vector< BlkId > s_merged;
+    static thread_local std::vector< blk_cache_entry > s_entries;
+    static thread_local std::vector< blk_cache_entry > s_excess_blks;
+    s_merged.clear();
+    s_entries.clear();
+    s_excess_blks.clear();
+    coalesce_blkids(blk_ids, s_merged);
+    COUNTER_INCREMENT(m_metrics, num_blkids_coalesced_on_free, blk_ids.size() - s_merged.size());
+
+    blk_cap_t nblks_freed{0};
+    for (const auto& b : s_merged) {
+        const auto temp{blknum_to_temperature(b.get_blk_num())};
+        s_entries.push_back(blkid_to_blk_cache_entry(b, temp));
+        nblks_freed += b.get_nblks();
+        COUNTER_INCREMENT(temp_metrics(temp), num_blks_freed, b.get_nblks());
+    }
+
+    if (m_cfg.get_use_slabs()) {
+        [[maybe_unused]] const blk_count_t num_zombied{m_fb_cache->try_free_blks(s_entries, s_excess_blks)};
+        free_on_bitmap(s_excess_blks);
+    } else {
+        free_on_bitmap(s_entries);
+    }
+
+    decr_alloced_blk_count(nblks_freed);
+    BLKALLOC_LOG(TRACE, "Freed {} blkids as {} extents, nblks={}", blk_ids.size(), s_merged.size(), nblks_freed);
 }
 
 void VarsizeBlkAllocator::free(const BlkId& b) {
@@ -577,8 +652,10 @@ void VarsizeBlkAllocator::free(const BlkId& b) {
         static thread_local std::vector< blk_cache_entry > excess_blks;
         excess_blks.clear();
 
-        [[maybe_unused]] const blk_count_t num_zombied{
-            m_fb_cache->try_free_blks(blkid_to_blk_cache_entry(b, 2), excess_blks)};
+        // Recycle the blks into the level of the temperature they belong to, so that they are reused for the data of
+        // same temperature.
+        [[maybe_unused]] const blk_count_t num_zombied{m_fb_cache->try_free_blks(
+            blkid_to_blk_cache_entry(b, blknum_to_temperature(b.get_blk_num())), excess_blks)};
 
         for (const auto& e : excess_blks) {
             BLKALLOC_LOG(TRACE, "Freeing in bitmap of entry={} - excess of free_blks size={}", e.to_string(),
@@ -591,9 +668,21 @@ void VarsizeBlkAllocator::free(const BlkId& b) {
     }
 
     decr_alloced_blk_count(b.get_nblks());
+    COUNTER_INCREMENT(temp_metrics(blknum_to_temperature(b.get_blk_num())), num_blks_freed, b.get_nblks());
     BLKALLOC_LOG(TRACE, "Freed blk_num={}", blkid_to_blk_cache_entry(b).to_string());
 }
 
+void VarsizeBlkAllocator::account_alloc_temperature(const std::vector< BlkId >& blkids, const blk_temp_t desired_temp) {
+    const bool temp_requested{m_cfg.is_valid_temperature(desired_temp)};
+    for (const auto& b : blkids) {
+        const auto temp{blknum_to_temperature(b.get_blk_num())};
+        COUNTER_INCREMENT(temp_metrics(temp), num_blks_alloced, b.get_nblks());
+        if (temp_requested && (temp != desired_temp)) {
+            COUNTER_INCREMENT(temp_metrics(desired_temp), num_blks_misplaced, b.get_nblks());
+        }
+    }
+}
+
 blk_cap_t VarsizeBlkAllocator::available_blks() const { return m_cfg.get_total_blks() - get_used_blks(); }
 blk_cap_t VarsizeBlkAllocator::get_used_blks() const { return get_alloced_blk_count(); }
 
@@ -608,12 +697,29 @@ void VarsizeBlkAllocator::free_on_bitmap(const BlkId& b) {
                          "Expected end bit to be smaller than portion end bit");
         BLKALLOC_REL_ASSERT(m_cache_bm->is_bits_set(b.get_blk_num(), b.get_nblks()), "Expected bits to be set");
         m_cache_bm->reset_bits(b.get_blk_num(), b.get_nblks());
+        m_cache_sum->mark_free(b.get_blk_num(), b.get_nblks());
         portion->increase_available_blocks(b.get_nblks());
     }
     BLKALLOC_LOG(TRACE, "Freeing directly to portion={} blkid={} set_bits_count={}",
                  blknum_to_portion_num(b.get_blk_num()), b.to_string(), get_alloced_blk_count());
 }
 
+/* Entries are expected to be sorted by blk num, so that each portion is locked only once */
+void VarsizeBlkAllocator::free_on_bitmap(const std::vector< blk_cache_entry >& sorted_entries) {
+    size_t i{0};
+    while (i < sorted_entries.size()) {
+        BlkAllocPortion* portion = blknum_to_portion(sorted_entries[i].get_blk_num());
+        auto lock{portion->portion_auto_lock()};
+        do {
+            const auto& e{sorted_entries[i]};
+            BLKALLOC_REL_ASSERT(m_cache_bm->is_bits_set(e.get_blk_num(), e.get_nblks()), "Expected bits to be set");
+            m_cache_bm->reset_bits(e.get_blk_num(), e.get_nblks());
+            m_cache_sum->mark_free(e.get_blk_num(), e.get_nblks());
+            portion->increase_available_blocks(e.get_nblks());
+        } while ((++i < sorted_entries.size()) && (blknum_to_portion(sorted_entries[i].get_blk_num()) == portion));
+    }
+}
+
 #ifdef _PRERELEASE
 bool VarsizeBlkAllocator::is_set_on_bitmap(const BlkId& b) const {
     const BlkAllocPortion* portion = blknum_to_portion_const(b.get_blk_num());
@@ -704,7 +810,16 @@ BlkAllocStatus VarsizeBlkAllocator::alloc_blks_direct(blk_count_t nblks, const b
 
     if (m_start_portion_num == INVALID_PORTION_NUM) { m_start_portion_num = m_rand_portion_num_generator(re); }
 
-    auto portion_num = m_start_portion_num;
+    // If temperature is requested, start the search within the portions of that temperature
+    blk_num_t start_portion_num{m_start_portion_num};
+    if ((m_cfg.get_num_temperatures() > 1) && m_cfg.is_valid_temperature(hints.desired_temp)) {
+        const auto portions_per_temp{m_cfg.get_portions_per_temp_group()};
+        start_portion_num = std::min< blk_num_t >((hints.desired_temp - 1) * portions_per_temp +
+                                                      (m_start_portion_num % portions_per_temp),
+                                                  m_cfg.get_total_portions() - 1);
+    }
+
+    auto portion_num = start_portion_num;
     blk_count_t const min_blks = hints.is_contiguous ? nblks : std::min< blk_count_t >(nblks, hints.multiplier);
     blk_count_t nblks_remain = nblks;
     do {
@@ -713,10 +828,14 @@ BlkAllocStatus VarsizeBlkAllocator::alloc_blks_direct(blk_count_t nblks, const b
         auto const end_blk_id = cur_blk_id + m_cfg.get_blks_per_portion() - 1;
         {
             auto lock{portion.portion_auto_lock()};
-            while (nblks_remain && (cur_blk_id <= end_blk_id) && (portion.get_available_blocks() > 0)) {
+            if (m_cache_sum->portion_free_blks(portion_num) < std::min(min_blks, nblks_remain)) {
+                COUNTER_INCREMENT(m_metrics, num_portions_skipped, 1);
+            }
+            while (nblks_remain && (cur_blk_id <= end_blk_id) && (portion.get_available_blocks() > 0) &&
+                   (m_cache_sum->portion_free_blks(portion_num) >= std::min(min_blks, nblks_remain))) {
                 // Get next reset bits and insert to cache and then reset those bits
-                auto const b = m_cache_bm->get_next_contiguous_n_reset_bits(
-                    cur_blk_id, end_blk_id, std::min(min_blks, nblks_remain), nblks_remain);
+                auto const b = m_cache_sum->next_free_run(*m_cache_bm, cur_blk_id, end_blk_id,
+                                                          std::min(min_blks, nblks_remain), nblks_remain);
                 if (b.nbits == 0) { break; }
                 HS_DBG_ASSERT_GE(end_blk_id, b.start_bit, "Expected start bit to be smaller than end bit");
                 HS_DBG_ASSERT_LE(b.nbits, nblks_remain);
@@ -732,14 +851,15 @@ BlkAllocStatus VarsizeBlkAllocator::alloc_blks_direct(blk_count_t nblks, const b
 
                 // Set the bitmap indicating the blocks are allocated
                 m_cache_bm->set_bits(b.start_bit, b.nbits);
+                m_cache_sum->mark_used(b.start_bit, b.nbits);
                 if (portion.decrease_available_blocks(b.nbits) == 0) break;
                 cur_blk_id = b.start_bit + b.nbits;
             }
         }
         if (++portion_num == m_cfg.get_total_portions()) { portion_num = 0; }
         BLKALLOC_LOG(TRACE, "alloc direct unable to find in prev portion, searching in portion={}, start_portion={}",
-                     portion_num, m_start_portion_num);
-    } while ((nblks_remain > 0) && (portion_num != m_start_portion_num) && !hints.is_contiguous);
+                     portion_num, start_portion_num);
+    } while ((nblks_remain > 0) && (portion_num != start_portion_num) && !hints.is_contiguous);
 
     // save which portion we were at for next allocation;
     m_start_portion_num = portion_num;
@@ -793,5 +913,11 @@ std::string VarsizeBlkAllocator::to_string() const {
                        m_state, m_cfg.get_total_blks(), m_fb_cache->total_free_blks(), get_alloced_blk_count());
 }
 
-nlohmann::json VarsizeBlkAllocator::get_metrics_in_json() { return m_metrics.get_result_in_json(true); }
+nlohmann::json VarsizeBlkAllocator::get_metrics_in_json() {
+    auto j{m_metrics.get_result_in_json(true)};
+    for (auto& tm : m_temp_metrics) {
+        j["temperatures"].push_back(tm->get_result_in_json(true));
+    }
+    return j;
+}
 } // namespace homestore
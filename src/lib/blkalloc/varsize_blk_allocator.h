@@ -34,6 +34,7 @@
 
 #include <homestore/blk.h>
 #include "blk_allocator.h"
+#include "blk_alloc_summary.h"
 #include "blk_cache.h"
 #include "common/homestore_assert.hpp"
 #include "common/homestore_config.hpp"
@@ -46,6 +47,7 @@ class VarsizeBlkAllocConfig : public BlkAllocConfig {
 private:
     uint32_t m_phys_page_size;
     seg_num_t m_nsegments;
+    blk_temp_t m_num_temperatures;
     const blk_cap_t m_blks_per_temp_group;
     blk_cap_t m_max_cache_blks;
     SlabCacheConfig m_slab_config;
@@ -61,7 +63,8 @@ public:
             BlkAllocConfig{blk_size, align_sz, size, name, realtime_bm_on},
             m_phys_page_size{ppage_sz},
             m_nsegments{HS_DYNAMIC_CONFIG(blkallocator.max_segments)},
-            m_blks_per_temp_group{get_total_blks() / HS_DYNAMIC_CONFIG(blkallocator.num_blk_temperatures)},
+            m_num_temperatures{std::max< blk_temp_t >(HS_DYNAMIC_CONFIG(blkallocator.num_blk_temperatures), 1)},
+            m_blks_per_temp_group{get_total_blks() / m_num_temperatures},
             m_use_slabs{use_slabs} {
         // Initialize the max cache blks as minimum dictated by the number of blks or memory limits whichever is lower
         const blk_cap_t size_by_count{static_cast< blk_cap_t >(std::trunc(
@@ -79,7 +82,7 @@ public:
         HS_REL_ASSERT_GT(HS_DYNAMIC_CONFIG(blkallocator.free_blk_slab_distribution).size(), 0,
                          "Config does not have free blk slab distribution");
         const auto reuse_pct{HS_DYNAMIC_CONFIG(blkallocator.free_blk_reuse_pct)};
-        const auto num_temp{HS_DYNAMIC_CONFIG(blkallocator.num_blk_temperatures)};
+        const auto num_temp{m_num_temperatures};
         const auto num_temp_slab_pct{(100.0 - reuse_pct) / static_cast< double >(num_temp)};
 
         m_slab_config.m_name = name;
@@ -90,6 +93,9 @@ public:
             s_cfg.max_entries = static_cast< blk_cap_t >((m_max_cache_blks / s_cfg.slab_size) * (pct / 100.0));
             s_cfg.m_name = name;
             s_cfg.refill_threshold_pct = HS_DYNAMIC_CONFIG(blkallocator.free_blk_cache_refill_threshold_pct);
+            // Magazines are not partitioned by level, so they would hand out blks of any temperature. Hence they are
+            // used only when there is single temperature.
+            s_cfg.magazine_size = (num_temp > 1) ? 0 : HS_DYNAMIC_CONFIG(blkallocator.free_blk_magazine_size);
 
             // Distribute the slab among different temperature based on config provided
             s_cfg.m_level_distribution_pct.reserve(num_temp + 1);
@@ -132,6 +138,19 @@ public:
     //////////// Blks related getters/setters /////////////
     blk_cap_t get_max_cache_blks() const { return m_max_cache_blks; }
     blk_cap_t get_blks_per_temp_group() const { return m_blks_per_temp_group; }
+
+    //////////// Temperature related getters /////////////
+    // Portions are split into equal sized contiguous groups, one per temperature starting from temperature 1. Any
+    // remaining portions at the end belong to the last temperature.
+    blk_temp_t get_num_temperatures() const { return m_num_temperatures; }
+    blk_num_t get_portions_per_temp_group() const {
+        return std::max< blk_num_t >(get_total_portions() / m_num_temperatures, 1);
+    }
+    blk_temp_t portion_temperature(const blk_num_t portion_num) const {
+        return static_cast< blk_temp_t >(
+            1 + std::min< blk_num_t >(portion_num / get_portions_per_temp_group(), m_num_temperatures - 1));
+    }
+    bool is_valid_temperature(const blk_temp_t temp) const { return (temp >= 1) && (temp <= m_num_temperatures); }
     blk_cap_t get_blks_per_phys_page() const {
         blk_cap_t nblks = get_phys_page_size() / get_blk_size();
         assert(get_blks_per_portion() % nblks == 0);
@@ -198,6 +217,11 @@ public:
         REGISTER_COUNTER(num_alloc_partial, "Number of blk alloc partial allocations");
         REGISTER_COUNTER(num_retries, "Number of times it retried because of empty cache");
         REGISTER_COUNTER(num_blks_alloc_direct, "Number of blks alloc attempt directly because of empty cache");
+        REGISTER_COUNTER(num_portions_skipped, "Number of portions skipped during search based on free blks summary");
+        REGISTER_COUNTER(num_blkids_coalesced_on_free,
+                         "Number of freed blkids merged with physically adjacent ones during batch free");
+        REGISTER_COUNTER(num_magazine_hits, "Number of slab entries allocated from the thread magazine as is");
+        REGISTER_COUNTER(num_slab_queue_pops, "Number of slab entries allocated from slab queues bypassing magazines");
 
         REGISTER_HISTOGRAM(frag_pct_distribution, "Distribution of fragmentation percentage",
                            HistogramBucketsType(LinearUpto64Buckets));
@@ -212,10 +236,33 @@ public:
     ~BlkAllocMetrics() { deregister_me_from_farm(); }
 };
 
+/* Per temperature accounting of blk usage. Ratio of freed to alloced blks in a temperature is the rate at which blks
+ * of that temperature are reused, which is a proxy of how well the data of similar lifetime is grouped together.
+ * Misplaced blks are the ones requested for this temperature, but had to be allocated from other temperature. */
+class BlkAllocTempMetrics : public sisl::MetricsGroup {
+public:
+    explicit BlkAllocTempMetrics(const std::string& inst_name) :
+            sisl::MetricsGroup("BlkAllocTemperature", inst_name) {
+        REGISTER_COUNTER(num_blks_alloced, "Number of blks allocated in this temperature");
+        REGISTER_COUNTER(num_blks_freed, "Number of blks freed in this temperature");
+        REGISTER_COUNTER(num_blks_misplaced, "Number of blks requested in this temperature but allocated elsewhere");
+
+        register_me_to_farm();
+    }
+
+    BlkAllocTempMetrics(const BlkAllocTempMetrics&) = delete;
+    BlkAllocTempMetrics(BlkAllocTempMetrics&&) noexcept = delete;
+    BlkAllocTempMetrics& operator=(const BlkAllocTempMetrics&) = delete;
+    BlkAllocTempMetrics& operator=(BlkAllocTempMetrics&&) noexcept = delete;
+    ~BlkAllocTempMetrics() { deregister_me_from_farm(); }
+};
+
 /* VarsizeBlkAllocator provides a flexibility in allocation. It provides following features:
  *
  * 1. Could allocate variable number of blks in single allocation
- * 2. Provides the option of allocating blocks based on requested temperature.
+ * 2. Provides the option of allocating blocks based on requested temperature. Blk space is divided into one
+ *    contiguous group of portions per temperature, and the blks of a portion are cached and recycled only in the
+ *    level of its temperature, so data with similar lifetime ends up in the same region of the device.
  * 3. Caching of available blocks instead of scanning during allocation.
  *
  */
@@ -238,6 +285,7 @@ public:
 
     blk_cap_t available_blks() const override;
     blk_cap_t get_used_blks() const override;
+    blk_cap_t cached_free_blks() const { return m_fb_cache ? m_fb_cache->total_free_blks() : 0; }
     bool is_blk_alloced(const BlkId& in_bid, bool use_lock = false) const override;
     std::string to_string() const override;
     nlohmann::json get_metrics_in_json();
@@ -260,7 +308,8 @@ private:
     std::condition_variable m_cv; // CV to signal thread
     BlkAllocatorState m_state;    // Current state of the blkallocator
 
-    std::unique_ptr< sisl::Bitset > m_cache_bm; // Bitset representing entire blks in this allocator
+    std::unique_ptr< sisl::Bitset > m_cache_bm;     // Bitset representing entire blks in this allocator
+    std::unique_ptr< BlkAllocSummary > m_cache_sum; // Summary of free blks in m_cache_bm to speed up the search
     std::unique_ptr< FreeBlkCache > m_fb_cache; // Free Blks cache
 
     VarsizeBlkAllocConfig m_cfg; // Config for Varsize
@@ -272,6 +321,7 @@ private:
 
     std::uniform_int_distribution< blk_num_t > m_rand_portion_num_generator;
     BlkAllocMetrics m_metrics;
+    std::vector< std::unique_ptr< BlkAllocTempMetrics > > m_temp_metrics; // Index 0 is temperature 1
 
     // TODO: this fields needs to be passed in from hints and persisted in volume's sb;
     blk_num_t m_start_portion_num{INVALID_PORTION_NUM};
@@ -298,12 +348,20 @@ private:
     void fill_cache_in_portion(blk_num_t portion_num, blk_cache_fill_session& fill_session);
 
     void free_on_bitmap(const BlkId& b);
+    void free_on_bitmap(const std::vector< blk_cache_entry >& sorted_entries);
+    void account_alloc_temperature(const std::vector< BlkId >& blkids, blk_temp_t desired_temp);
 
     //////////////////////////////////////////// Convenience routines ///////////////////////////////////////////
     ///////////////////// Physical page related routines ////////////////////////
     blk_num_t blknum_to_phys_pageid(blk_num_t blknum) const { return blknum / get_config().get_blks_per_phys_page(); }
     blk_num_t offset_within_phys_page(blk_num_t blknum) const { return blknum % get_config().get_blks_per_phys_page(); }
 
+    ///////////////////// Temperature related routines ////////////////////////
+    blk_temp_t blknum_to_temperature(blk_num_t blknum) const {
+        return blknum_to_portion_const(blknum)->temperature();
+    }
+    BlkAllocTempMetrics& temp_metrics(blk_temp_t temp) { return *m_temp_metrics[temp - 1]; }
+
     ///////////////////// Segment related routines ////////////////////////
     seg_num_t blknum_to_segment_num(blk_num_t blknum) const {
         const auto seg_num{blknum / get_config().get_blks_per_segment()};
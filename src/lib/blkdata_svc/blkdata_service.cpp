@@ -20,18 +20,32 @@
 #include "common/homestore_config.hpp" // is_data_drive_hdd
 #include "common/error.h"
 #include "blk_read_tracker.hpp"
+#include "write_hotness_tracker.hpp"
 
 namespace homestore {
 
 BlkDataService& data_service() { return hs()->data_service(); }
 
-BlkDataService::BlkDataService() { m_blk_read_tracker = std::make_unique< BlkReadTracker >(); }
+BlkDataService::BlkDataService(blk_allocator_type_t allocator_type) : m_allocator_type{allocator_type} {
+    m_blk_read_tracker = std::make_unique< BlkReadTracker >();
+
+    const auto num_temps{HS_DYNAMIC_CONFIG(blkallocator.num_blk_temperatures)};
+    if (num_temps > 1) {
+        m_hotness_tracker = std::make_unique< WriteHotnessTracker >(
+            HS_DYNAMIC_CONFIG(blkallocator.write_hotness_sketch_width), num_temps);
+    }
+}
 BlkDataService::~BlkDataService() = default;
 
 // recovery path
 void BlkDataService::open_vdev(vdev_info_block* vb) {
+    // Allocator type is persisted at the time of vdev creation and overrides whatever is configured now
+    const auto blob{r_cast< const data_blkstore_blob* >(vb->context_data)};
+    if (blob->allocator_type != blk_allocator_type_t::none) { m_allocator_type = blob->allocator_type; }
+
     m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "DataVDev", vb, PhysicalDevGroup::DATA,
-                                            blk_allocator_type_t::varsize, vb->is_failed(), true /* auto_recovery */);
+                                            m_allocator_type, vb->is_failed(), true /* auto_recovery */);
+    m_vdev->set_io_class(io_class_t::latency, io_class_t::latency); // Data reads and writes are foreground ios
 
     m_page_size = vb->blk_size;
 
@@ -51,12 +65,14 @@ void BlkDataService::async_free_blk(const BlkId bid, const io_completion_cb_t& c
 
 // first-time boot path
 void BlkDataService::create_vdev(uint64_t size) {
-    struct blkstore_blob blob;
+    struct data_blkstore_blob blob;
     blob.type = blkstore_type::DATA_STORE;
+    blob.allocator_type = m_allocator_type;
     m_page_size = hs()->device_mgr()->phys_page_size({PhysicalDevGroup::DATA});
-    m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "DataVDev", PhysicalDevGroup::DATA,
-                                            blk_allocator_type_t::varsize, size, 0, true /* is_stripe */, m_page_size,
-                                            (char*)&blob, sizeof(blkstore_blob), true /* auto_recovery */);
+    m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "DataVDev", PhysicalDevGroup::DATA, m_allocator_type,
+                                            size, 0, true /* is_stripe */, m_page_size, (char*)&blob,
+                                            sizeof(data_blkstore_blob), true /* auto_recovery */);
+    m_vdev->set_io_class(io_class_t::latency, io_class_t::latency); // Data reads and writes are foreground ios
 }
 
 void BlkDataService::async_read(const BlkId& bid, sisl::sg_list& sgs, uint32_t size, const io_completion_cb_t& cb,
@@ -77,6 +93,27 @@ void BlkDataService::async_read(const BlkId& bid, sisl::sg_list& sgs, uint32_t s
                         reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
 }
 
+void BlkDataService::async_read(const std::vector< BlkId >& bids, sisl::sg_list& sgs, uint32_t size,
+                                const io_completion_cb_t& cb, bool part_of_batch) {
+    if (bids.size() == 1) {
+        async_read(bids.front(), sgs, size, cb, part_of_batch);
+        return;
+    }
+
+    for (const auto& bid : bids) {
+        m_blk_read_tracker->insert(bid);
+    }
+
+    auto as_info = sisl::ObjectAllocator< async_info >::make_object();
+    as_info->cb = cb;
+    as_info->is_read = true;
+    as_info->bids = bids;
+    as_info->outstanding_io_cnt.increment(1);
+
+    m_vdev->async_readv(sgs.iovs.data(), sgs.iovs.size(), size, bids, BlkDataService::process_data_completion,
+                        reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
+}
+
 void BlkDataService::process_data_completion(std::error_condition ec, void* cookie) {
     auto as_info = reinterpret_cast< async_info* >(cookie);
 
@@ -84,7 +121,13 @@ void BlkDataService::process_data_completion(std::error_condition ec, void* cook
 
         if (as_info->is_read) {
             // this will trigger any pending free_blk on this read to complete;
-            hs()->data_service().read_blk_tracker()->remove(as_info->bid);
+            if (as_info->bids.empty()) {
+                hs()->data_service().read_blk_tracker()->remove(as_info->bid);
+            } else {
+                for (const auto& bid : as_info->bids) {
+                    hs()->data_service().read_blk_tracker()->remove(bid);
+                }
+            }
         }
 
         // send callback to caller;
@@ -105,13 +148,11 @@ void BlkDataService::async_write(const sisl::sg_list& sgs, const blk_alloc_hints
         m_vdev->async_writev(sgs.iovs.data(), sgs.iovs.size(), in_blkids[0], BlkDataService::process_data_completion,
                              reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
     } else {
-        sisl::sg_iterator sg_it{sgs.iovs};
-        for (const auto& bid : in_blkids) {
-            const auto iovs = sg_it.next_iovs(bid.get_nblks() * m_page_size);
-            as_info->outstanding_io_cnt.increment(1);
-            m_vdev->async_writev(iovs.data(), iovs.size(), bid, BlkDataService::process_data_completion,
-                                 reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
-        }
+        // vdev splits the buffers across the blkids and writes all of them in parallel, which for a striped vdev are
+        // spread across the pdevs
+        as_info->outstanding_io_cnt.increment(1);
+        m_vdev->async_writev(sgs.iovs.data(), sgs.iovs.size(), in_blkids, BlkDataService::process_data_completion,
+                             reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
     }
 }
 
@@ -119,7 +160,14 @@ void BlkDataService::async_alloc_write(const sisl::sg_list& sgs, const blk_alloc
                                        std::vector< BlkId >& out_blkids, const io_completion_cb_t& cb,
                                        bool part_of_batch) {
     out_blkids.clear();
-    const auto status = alloc_blks(sgs.size, hints, out_blkids);
+    auto status{BlkAllocStatus::FAILED};
+    if (m_hotness_tracker && (hints.hotness_key != 0) && (hints.desired_temp == 0)) {
+        auto temp_hints{hints};
+        temp_hints.desired_temp = m_hotness_tracker->record_write(hints.hotness_key);
+        status = alloc_blks(sgs.size, temp_hints, out_blkids);
+    } else {
+        status = alloc_blks(sgs.size, hints, out_blkids);
+    }
     if (status != BlkAllocStatus::SUCCESS) {
         cb(std::make_error_condition(std::errc::resource_unavailable_try_again));
         return;
@@ -128,6 +176,8 @@ void BlkDataService::async_alloc_write(const sisl::sg_list& sgs, const blk_alloc
     async_write(sgs, hints, out_blkids, cb, part_of_batch);
 }
 
+void BlkDataService::submit_batch() { m_vdev->submit_batch(); }
+
 BlkAllocStatus BlkDataService::alloc_blks(uint32_t size, const blk_alloc_hints& hints,
                                           std::vector< BlkId >& out_blkids) {
     HS_DBG_ASSERT_EQ(size % m_page_size, 0, "Non aligned size requested");
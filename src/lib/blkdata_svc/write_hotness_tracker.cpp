@@ -0,0 +1,86 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <limits>
+
+#include "common/homestore_config.hpp"
+#include "write_hotness_tracker.hpp"
+
+namespace homestore {
+WriteHotnessTracker::WriteHotnessTracker(uint32_t width, blk_temp_t num_temperatures) :
+        m_num_temperatures{std::max< blk_temp_t >(num_temperatures, 1)} {
+    // Round up the width to power of 2, so that slot is computed by masking
+    width = std::max< uint32_t >(width, 64);
+    width = static_cast< uint32_t >(1) << (32 - __builtin_clz(width - 1));
+    m_width_mask = width - 1;
+    m_counters = std::make_unique< std::atomic< uint32_t >[] >(static_cast< size_t >(sketch_depth) * width);
+    for (size_t i{0}; i < static_cast< size_t >(sketch_depth) * width; ++i) {
+        m_counters[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+blk_temp_t WriteHotnessTracker::record_write(uint64_t key) {
+    uint32_t count{std::numeric_limits< uint32_t >::max()};
+    for (uint32_t row{0}; row < sketch_depth; ++row) {
+        count = std::min(count, m_counters[slot(row, key)].fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    if (m_writes_since_decay.fetch_add(1, std::memory_order_relaxed) + 1 >=
+        HS_DYNAMIC_CONFIG(blkallocator.write_hotness_decay_interval)) {
+        decay();
+    }
+    return to_temperature(count);
+}
+
+uint32_t WriteHotnessTracker::estimate(uint64_t key) const {
+    uint32_t count{std::numeric_limits< uint32_t >::max()};
+    for (uint32_t row{0}; row < sketch_depth; ++row) {
+        count = std::min(count, m_counters[slot(row, key)].load(std::memory_order_relaxed));
+    }
+    return count;
+}
+
+blk_temp_t WriteHotnessTracker::to_temperature(uint32_t count) const {
+    if (count == 0) { return 1; }
+    const uint32_t log2_count{static_cast< uint32_t >(31 - __builtin_clz(count))};
+    return static_cast< blk_temp_t >(1 + std::min< uint32_t >(log2_count, m_num_temperatures - 1));
+}
+
+uint32_t WriteHotnessTracker::slot(uint32_t row, uint64_t key) const {
+    // Different seed for every row so that keys colliding in one row are unlikely to collide in others
+    uint64_t h{key + (static_cast< uint64_t >(row) + 1) * 0x9E3779B97F4A7C15ULL};
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= (h >> 31);
+    return row * (m_width_mask + 1) + static_cast< uint32_t >(h & m_width_mask);
+}
+
+void WriteHotnessTracker::decay() {
+    // Only one thread needs to decay, others can continue recording. Increments racing with the decay could be lost,
+    // which is fine for an estimate.
+    std::unique_lock< std::mutex > lg{m_decay_mtx, std::try_to_lock};
+    if (!lg.owns_lock()) { return; }
+    if (m_writes_since_decay.load(std::memory_order_relaxed) <
+        HS_DYNAMIC_CONFIG(blkallocator.write_hotness_decay_interval)) {
+        return;
+    }
+    m_writes_since_decay.store(0, std::memory_order_relaxed);
+
+    const size_t nslots{static_cast< size_t >(sketch_depth) * (m_width_mask + 1)};
+    for (size_t i{0}; i < nslots; ++i) {
+        m_counters[i].store(m_counters[i].load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+    }
+}
+} // namespace homestore
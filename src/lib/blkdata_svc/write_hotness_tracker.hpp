@@ -0,0 +1,64 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "homestore/blk.h"
+
+namespace homestore {
+
+/*
+ * Tracks how often each piece of data (identified by the hotness key of the write) is overwritten and maps it to a
+ * blk temperature. Frequencies are kept in a count-min sketch, so memory is fixed irrespective of number of keys and
+ * the estimate can only be higher than the actual count. After every decay interval writes all counters are halved,
+ * so that the data which is no longer overwritten cools down.
+ *
+ * Temperature is 1 + log2(write count) capped at the number of temperatures, i.e. data written once is coldest and
+ * each doubling of overwrites makes it one level hotter.
+ */
+class WriteHotnessTracker {
+public:
+    static constexpr uint32_t sketch_depth{4};
+
+    WriteHotnessTracker(uint32_t width, blk_temp_t num_temperatures);
+    WriteHotnessTracker(const WriteHotnessTracker&) = delete;
+    WriteHotnessTracker(WriteHotnessTracker&&) noexcept = delete;
+    WriteHotnessTracker& operator=(const WriteHotnessTracker&) = delete;
+    WriteHotnessTracker& operator=(WriteHotnessTracker&&) noexcept = delete;
+    ~WriteHotnessTracker() = default;
+
+    /// @brief Record a write of the given key and return the temperature the data should be placed in
+    blk_temp_t record_write(uint64_t key);
+
+    /// @brief Estimated number of writes of the key since it was last cooled down
+    [[nodiscard]] uint32_t estimate(uint64_t key) const;
+
+    [[nodiscard]] blk_temp_t to_temperature(uint32_t count) const;
+
+private:
+    [[nodiscard]] uint32_t slot(uint32_t row, uint64_t key) const;
+    void decay();
+
+private:
+    uint32_t m_width_mask;
+    blk_temp_t m_num_temperatures;
+    std::unique_ptr< std::atomic< uint32_t >[] > m_counters; // sketch_depth rows of width counters each
+    std::atomic< uint64_t > m_writes_since_decay{0};
+    std::mutex m_decay_mtx;
+};
+} // namespace homestore
@@ -15,9 +15,11 @@
  *********************************************************************************/
 #include "homestore_utils.hpp"
 #include "homestore_assert.hpp"
+#include "iobuf_pool.hpp"
 
 namespace homestore {
 uint8_t* hs_utils::iobuf_alloc(const size_t size, const sisl::buftag tag, const size_t alignment) {
+    if (auto buf = IoBufPool::instance().alloc(size, tag, alignment); buf != nullptr) { return buf; }
     if (tag == sisl::buftag::btree_node) {
         HS_DBG_ASSERT_EQ(size, m_btree_mempool_size);
         auto buf = iomanager.iobuf_pool_alloc(alignment, size, tag);
@@ -32,6 +34,7 @@ uint8_t* hs_utils::iobuf_alloc(const size_t size, const sisl::buftag tag, const
 hs_uuid_t hs_utils::gen_system_uuid() { return std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()); }
 
 void hs_utils::iobuf_free(uint8_t* const ptr, const sisl::buftag tag) {
+    if (IoBufPool::instance().free(ptr, tag)) { return; }
     if (tag == sisl::buftag::btree_node) {
         iomanager.iobuf_pool_free(ptr, m_btree_mempool_size, tag);
     } else {
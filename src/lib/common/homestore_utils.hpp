@@ -15,6 +15,8 @@
  *********************************************************************************/
 #pragma once
 
+#include <memory>
+
 #include "homestore_config.hpp"
 #include <sisl/fds/buffer.hpp>
 
@@ -44,4 +46,13 @@ public:
                                             const size_t alignment);
     static hs_uuid_t gen_system_uuid();
 };
+
+template < sisl::buftag Tag >
+struct iobuf_deleter {
+    void operator()(uint8_t* ptr) const { hs_utils::iobuf_free(ptr, Tag); }
+};
+
+// Owner of a buffer allocated through hs_utils::iobuf_alloc
+template < sisl::buftag Tag >
+using iobuf_unique_ptr = std::unique_ptr< uint8_t, iobuf_deleter< Tag > >;
 } // namespace homestore
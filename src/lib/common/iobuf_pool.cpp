@@ -0,0 +1,180 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <limits>
+#include <sys/mman.h>
+
+#include <sisl/fds/utils.hpp>
+#include <sisl/logging/logging.h>
+
+#include "homestore_assert.hpp"
+#include "iobuf_pool.hpp"
+
+namespace homestore {
+static constexpr uint16_t invalid_slot{std::numeric_limits< uint16_t >::max()};
+
+// Slot claimed by the thread, released on thread exit so that a later thread can take over its free buffers
+struct iobuf_pool_slot_holder {
+    uint16_t slot{invalid_slot};
+
+    ~iobuf_pool_slot_holder() {
+        if (slot == invalid_slot) { return; }
+        IoBufPool::instance().m_slots[slot].in_use.store(false, std::memory_order_release);
+    }
+};
+static thread_local iobuf_pool_slot_holder s_slot_holder;
+
+IoBufPool& IoBufPool::instance() {
+    // Never destroyed, as buffers could be freed by threads exiting after the static destructors run
+    static IoBufPool* s_pool = new IoBufPool();
+    return *s_pool;
+}
+
+void IoBufPool::start(uint64_t cap) {
+    if (m_base != nullptr) { return; }
+
+    auto const nregions = cap / region_size;
+    if (nregions == 0) {
+        LOGINFO("IoBufPool is disabled as the cap={} is less than a region", cap);
+        return;
+    }
+    auto const len = nregions * region_size;
+
+    // Explicit hugepages if they are reserved, otherwise reserve address space and let THP back it as it is carved
+    void* mem = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) {
+        m_hugetlb = true;
+        m_base = r_cast< uint8_t* >(mem);
+    } else {
+        mem = ::mmap(nullptr, len + region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                     -1, 0);
+        if (mem == MAP_FAILED) {
+            LOGWARN("IoBufPool is disabled as mmap of size={} failed, error={}", len, errno);
+            return;
+        }
+        m_base = r_cast< uint8_t* >(sisl::round_up(r_cast< uintptr_t >(mem), region_size));
+        ::madvise(m_base, len, MADV_HUGEPAGE);
+    }
+
+    m_regions = std::make_unique< region_info[] >(nregions);
+    m_nregions = nregions;
+    m_metrics = std::make_unique< IoBufPoolMetrics >();
+    LOGINFO("IoBufPool started with cap={} regions={} hugetlb={}", len, nregions, m_hugetlb);
+}
+
+uint8_t* IoBufPool::alloc(size_t size, sisl::buftag tag, size_t alignment) {
+    if (m_base == nullptr) { return nullptr; }
+    if ((size == 0) || (size > max_class_size)) { return nullptr; }
+
+    auto const cls = class_of(size);
+    if (alignment > class_size(cls)) { return nullptr; }
+
+    auto const slot_num = my_slot();
+    if (slot_num == invalid_slot) {
+        COUNTER_INCREMENT(*m_metrics, iobuf_pool_fallback_count, 1);
+        return nullptr;
+    }
+
+    auto& sl = m_slots[slot_num];
+    if (sl.free_list[cls] == nullptr) {
+        // Take over everything other threads returned to us in one shot, before carving out a new region
+        sl.free_list[cls] = sl.returned[cls].exchange(nullptr, std::memory_order_acquire);
+        if ((sl.free_list[cls] == nullptr) && !carve_region(slot_num, cls)) {
+            COUNTER_INCREMENT(*m_metrics, iobuf_pool_fallback_count, 1);
+            return nullptr;
+        }
+    }
+
+    auto* fb = sl.free_list[cls];
+    sl.free_list[cls] = fb->next;
+
+    m_used_size.fetch_add(class_size(cls), std::memory_order_relaxed);
+    m_tag_used[tag_index(tag)].fetch_add(class_size(cls), std::memory_order_relaxed);
+    COUNTER_INCREMENT(*m_metrics, iobuf_pool_alloc_count, 1);
+    return r_cast< uint8_t* >(fb);
+}
+
+bool IoBufPool::free(uint8_t* buf, sisl::buftag tag) {
+    if (!owns(buf)) { return false; }
+
+    auto const& ri = m_regions[(buf - m_base) / region_size];
+    auto const cls = ri.cls;
+    m_used_size.fetch_sub(class_size(cls), std::memory_order_relaxed);
+    m_tag_used[tag_index(tag)].fetch_sub(class_size(cls), std::memory_order_relaxed);
+
+    auto* fb = r_cast< free_buf* >(buf);
+    auto& sl = m_slots[ri.slot];
+    if (s_slot_holder.slot == ri.slot) {
+        fb->next = sl.free_list[cls];
+        sl.free_list[cls] = fb;
+    } else {
+        // Push only stack, owner pops the entire stack at once, so there is no ABA to worry about
+        auto& head = sl.returned[cls];
+        fb->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(fb->next, fb, std::memory_order_release, std::memory_order_relaxed)) {}
+        COUNTER_INCREMENT(*m_metrics, iobuf_pool_remote_free_count, 1);
+    }
+    return true;
+}
+
+int64_t IoBufPool::used_size(sisl::buftag tag) const {
+    return m_tag_used[tag_index(tag)].load(std::memory_order_relaxed);
+}
+
+size_t IoBufPool::class_of(size_t size) {
+    size_t cls{0};
+    while (class_size(cls) < size) {
+        ++cls;
+    }
+    return cls;
+}
+
+size_t IoBufPool::tag_index(sisl::buftag tag) { return std::min(s_cast< size_t >(tag), max_tags - 1); }
+
+uint16_t IoBufPool::my_slot() {
+    if (s_slot_holder.slot != invalid_slot) { return s_slot_holder.slot; }
+
+    for (uint16_t i{0}; i < max_slots; ++i) {
+        bool expected{false};
+        if (m_slots[i].in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            s_slot_holder.slot = i;
+            return i;
+        }
+    }
+    return invalid_slot;
+}
+
+bool IoBufPool::carve_region(uint16_t slot_num, size_t cls) {
+    auto const r = m_next_region.fetch_add(1, std::memory_order_relaxed);
+    if (r >= m_nregions) { return false; }
+
+    m_regions[r] = region_info{s_cast< uint8_t >(cls), slot_num};
+
+    // Chain all the buffers of the region to the free list of the slot. This also faults in the region upfront
+    auto* region = m_base + r * region_size;
+    auto const sz = class_size(cls);
+    free_buf* head{nullptr};
+    for (auto off = region_size; off > 0; off -= sz) {
+        auto* fb = r_cast< free_buf* >(region + off - sz);
+        fb->next = head;
+        head = fb;
+    }
+    m_slots[slot_num].free_list[cls] = head;
+
+    GAUGE_UPDATE(*m_metrics, iobuf_pool_mapped_size, (r + 1) * region_size);
+    return true;
+}
+} // namespace homestore
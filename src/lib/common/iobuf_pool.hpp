@@ -0,0 +1,137 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <sisl/fds/buffer.hpp>
+#include <sisl/metrics/metrics.hpp>
+
+namespace homestore {
+
+class IoBufPoolMetrics : public sisl::MetricsGroup {
+public:
+    explicit IoBufPoolMetrics() : sisl::MetricsGroup("IoBufPool", "iobuf_pool") {
+        REGISTER_COUNTER(iobuf_pool_alloc_count, "Number of io buffers allocated from the pool");
+        REGISTER_COUNTER(iobuf_pool_fallback_count,
+                         "Number of io buffers which fall back to general allocator as pool is exhausted");
+        REGISTER_COUNTER(iobuf_pool_remote_free_count, "Number of io buffers freed by a thread other than its owner");
+        REGISTER_GAUGE(iobuf_pool_mapped_size, "Bytes of the pool carved into buffers so far");
+        register_me_to_farm();
+    }
+
+    IoBufPoolMetrics(const IoBufPoolMetrics&) = delete;
+    IoBufPoolMetrics(IoBufPoolMetrics&&) noexcept = delete;
+    IoBufPoolMetrics& operator=(const IoBufPoolMetrics&) = delete;
+    IoBufPoolMetrics& operator=(IoBufPoolMetrics&&) noexcept = delete;
+    ~IoBufPoolMetrics() { deregister_me_from_farm(); }
+};
+
+/*
+ * IoBufPool: Pool of DMA aligned io buffers, in power of 2 size classes from 4K to 1MB, so that io buffers are not
+ * allocated from general allocator (and page faulted) on the io path.
+ *
+ * The entire pool is a single virtual range of upto the cap (set through ResourceMgr) reserved upfront, backed by 2MB
+ * hugepages when available or transparent hugepages otherwise. The range is carved into 2MB regions on demand, each
+ * region holding buffers of a single size class, so a buffer is always aligned to its size and its class is found
+ * from its address alone.
+ *
+ * Each thread (reactor) owns a slot with a free list per size class, which only the owner accesses and hence needs
+ * no locks. A buffer freed by another thread is pushed to the lock-free return list of its owner slot, which the
+ * owner takes over in one shot once its free list runs out. Slots outlive threads, a new thread takes over the
+ * slot and the buffers of a thread that exited.
+ *
+ * Requests larger than the largest class, with alignment beyond their class or after the pool is exhausted are not
+ * served, callers (hs_utils::iobuf_alloc) fall back to the general allocator for those.
+ */
+class IoBufPool {
+public:
+    static constexpr size_t region_size{2 * 1024 * 1024};
+    static constexpr size_t min_class_size{4096};
+    static constexpr size_t num_classes{9}; // 4K to 1MB
+    static constexpr size_t max_class_size{min_class_size << (num_classes - 1)};
+    static constexpr size_t max_slots{256};
+    static constexpr size_t max_tags{32};
+
+    static IoBufPool& instance();
+
+    IoBufPool(const IoBufPool&) = delete;
+    IoBufPool(IoBufPool&&) noexcept = delete;
+    IoBufPool& operator=(const IoBufPool&) = delete;
+    IoBufPool& operator=(IoBufPool&&) noexcept = delete;
+
+    /// @brief Reserve the pool of upto cap bytes. Pool stays for the lifetime of the process, so calls after the first
+    /// successful one are ignored.
+    void start(uint64_t cap);
+
+    /// @brief Allocate from the pool, returns nullptr if the request can't be served by the pool
+    [[nodiscard]] uint8_t* alloc(size_t size, sisl::buftag tag, size_t alignment);
+
+    /// @brief Free the buffer to the pool, returns false if the buffer was not allocated from the pool
+    bool free(uint8_t* buf, sisl::buftag tag);
+
+    [[nodiscard]] bool owns(const uint8_t* buf) const {
+        return (m_base != nullptr) && (buf >= m_base) && (buf < m_base + m_nregions * region_size);
+    }
+
+    [[nodiscard]] uint64_t cap() const { return m_nregions * region_size; }
+    [[nodiscard]] uint64_t used_size() const { return m_used_size.load(std::memory_order_relaxed); }
+    [[nodiscard]] int64_t used_size(sisl::buftag tag) const;
+
+private:
+    IoBufPool() = default;
+    ~IoBufPool() = default;
+
+    struct free_buf {
+        free_buf* next;
+    };
+
+    struct alignas(64) slot {
+        std::atomic< bool > in_use{false};
+        std::array< free_buf*, num_classes > free_list{};                // Accessed only by the owner thread
+        std::array< std::atomic< free_buf* >, num_classes > returned{}; // Pushed by other threads
+    };
+
+    struct region_info {
+        uint8_t cls{0};
+        uint16_t slot{0};
+    };
+
+    static size_t class_of(size_t size);
+    static size_t class_size(size_t cls) { return min_class_size << cls; }
+    static size_t tag_index(sisl::buftag tag);
+
+    uint16_t my_slot();
+    bool carve_region(uint16_t slot_num, size_t cls);
+
+private:
+    uint8_t* m_base{nullptr};
+    size_t m_nregions{0};
+    bool m_hugetlb{false};
+    std::atomic< size_t > m_next_region{0};
+    std::unique_ptr< region_info[] > m_regions;
+    std::array< slot, max_slots > m_slots;
+    std::atomic< uint64_t > m_used_size{0};
+    std::array< std::atomic< int64_t >, max_tags > m_tag_used{};
+    std::unique_ptr< IoBufPoolMetrics > m_metrics;
+
+    friend struct iobuf_pool_slot_holder;
+};
+} // namespace homestore
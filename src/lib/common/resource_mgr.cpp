@@ -16,6 +16,7 @@
 #include <homestore/homestore.hpp>
 #include "resource_mgr.hpp"
 #include "homestore_assert.hpp"
+#include "iobuf_pool.hpp"
 
 namespace homestore {
 ResourceMgr& resource_mgr() { return hs()->resource_mgr(); }
@@ -110,6 +111,12 @@ uint64_t ResourceMgr::get_cache_size() const {
     return ((HS_STATIC_CONFIG(input.io_mem_size()) * HS_DYNAMIC_CONFIG(resource_limits.cache_size_percent)) / 100);
 }
 
+uint64_t ResourceMgr::get_iobuf_pool_cap() const {
+    return ((HS_STATIC_CONFIG(input.io_mem_size()) * HS_DYNAMIC_CONFIG(resource_limits.iobuf_pool_percent)) / 100);
+}
+
+uint64_t ResourceMgr::cur_iobuf_pool_size() const { return IoBufPool::instance().used_size(); }
+
 /* monitor journal size */
 bool ResourceMgr::check_journal_size(const uint64_t used_size, const uint64_t total_size) {
     if (m_journal_exceed_cb) {
@@ -75,6 +75,10 @@ public:
     /* get cache size */
     uint64_t get_cache_size() const;
 
+    /* io buffer pool size */
+    uint64_t get_iobuf_pool_cap() const;
+    uint64_t cur_iobuf_pool_size() const;
+
     /* monitor journal size */
     bool check_journal_size(const uint64_t used_size, const uint64_t total_size);
     void register_journal_exceed_cb(exceed_limit_cb_t cb);
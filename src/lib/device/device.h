@@ -23,6 +23,7 @@
 #include <cstdint>
 #include <exception>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -37,6 +38,7 @@
 #include <sisl/fds/utils.hpp>
 
 #include <homestore/homestore_decl.hpp>
+#include "discard_mgr.hpp"
 
 using namespace iomgr;
 SISL_LOGGING_DECL(device, DEVICE_MANAGER)
@@ -65,6 +67,7 @@ class DeviceManager {
     typedef std::function< void(DeviceManager*, vdev_info_block*) > NewVDevCallback;
     typedef std::function< void(PhysicalDevChunk*) > chunk_add_callback;
     typedef std::function< void(vdev_info_block*) > vdev_error_callback;
+    typedef std::function< void(PhysicalDev*, bool /* is_slow */) > slow_dev_callback;
 
     // friend classes
     friend class PhysicalDev;
@@ -95,6 +98,12 @@ public:
     uint32_t atomic_page_size(PhysicalDevGroup pdev_group) const;
     void handle_error(PhysicalDev* pdev);
 
+    /// @brief Register a callback, which is called whenever a pdev is marked or unmarked slow by the slow device
+    /// detector. Expected to be registered by components which outlive the device manager's init_done/close_devices.
+    void register_slow_dev_cb(slow_dev_callback cb);
+
+    DiscardMgr& discard_mgr() { return m_discard_mgr; }
+
     /* This is not very efficient implementation of get_all_devices(), however, this is expected to be called during
      * the start of the devices and for that purpose its efficient enough */
     // TO DO: Possibly make two functions or return std::pair if not sufficient
@@ -119,7 +128,7 @@ public:
 
     /* Allocate a new vdev for required size */
     vdev_info_block* alloc_vdev(uint32_t req_size, uint32_t nmirrors, uint32_t blk_size, uint32_t nchunks, char* blob,
-                                uint64_t size);
+                                uint64_t size, uint32_t stripe_unit_blks = 0);
 
     /* Free up the vdev_id */
     void free_vdev(vdev_info_block* vb);
@@ -141,6 +150,7 @@ public:
     void init_done();
     void close_devices();
     bool is_first_time_boot() const { return m_first_time_boot; }
+    hs_uuid_t system_uuid() const { return m_data_system_uuid; }
     std::vector< PhysicalDev* > get_devices(PhysicalDevGroup pdev_group) const;
     // void zero_pdev_sbs();
 
@@ -169,12 +179,20 @@ private:
                                        PhysicalDevChunk* prev_chunk);
     void remove_chunk(uint32_t chunk_id);
     void blk_alloc_meta_blk_found_cb(meta_blk* mblk, sisl::byte_view buf, size_t size);
+    void blk_alloc_page_meta_blk_found_cb(meta_blk* mblk, sisl::byte_view buf, size_t size);
+    void blk_alloc_journal_meta_blk_found_cb(meta_blk* mblk, sisl::byte_view buf, size_t size);
     uint32_t get_common_phys_page_sz() const;
     uint32_t get_common_align_sz() const;
     int get_device_open_flags(const std::string& devname) const;
 
     static int get_open_flags(io_flag oflags);
 
+    /* Compares tail latency of each pdev over the last interval with the median of its peers and marks/unmarks
+     * it slow, if it is consistently off */
+    void detect_slow_devices();
+    void start_slow_dev_detector();
+    void stop_slow_dev_detector();
+
 private:
     int m_hdd_open_flags;
     int m_ssd_open_flags;
@@ -214,6 +232,17 @@ private:
     bool m_first_time_boot{true};
     hs_uuid_t m_data_system_uuid{INVALID_SYSTEM_UUID};
     uint32_t m_num_sys_chunks{0};
+
+    struct slow_dev_state {
+        uint32_t slow_windows{0}; // Consecutive intervals the pdev was off from its peers
+        uint32_t ok_windows{0};   // Consecutive intervals the pdev was in line with its peers
+    };
+    std::mutex m_slow_dev_mtx;
+    std::map< const PhysicalDev*, slow_dev_state > m_slow_dev_states;
+    std::vector< slow_dev_callback > m_slow_dev_cbs;
+    iomgr::timer_handle_t m_slow_dev_timer_hdl{iomgr::null_timer_handle};
+
+    DiscardMgr m_discard_mgr;
 }; // class DeviceManager
 
 } // namespace homestore
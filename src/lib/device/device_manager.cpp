@@ -13,9 +13,15 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstring>
 #include <ctime>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
 
 #ifdef __linux__
 #include <sys/stat.h>
@@ -25,6 +31,7 @@
 #include <sisl/fds/bitset.hpp>
 #include <iomgr/iomgr.hpp>
 #include <isa-l/crc.h>
+#include <sisl/utility/thread_factory.hpp>
 
 #include <homestore/meta_service.hpp>
 #include <homestore/homestore.hpp>
@@ -41,6 +48,40 @@ namespace homestore {
 
 std::atomic< uint64_t > vdev_req_context::s_req_id{0};
 
+// Opening a device and reading/writing its superblock are sync ios, so it is done for all devices in parallel on upto
+// device.num_dev_init_threads threads. If any of them throws, the exception of the lowest device index is rethrown
+// once all of them are done, so that the error reported doesn't depend on the thread timing.
+static void for_each_device_parallel(size_t ndevs, const std::function< void(size_t) >& fn) {
+    if (ndevs == 0) { return; }
+    size_t nthreads{HS_DYNAMIC_CONFIG(device.num_dev_init_threads)};
+    if (nthreads == 0) { nthreads = ndevs; }
+    nthreads = std::min(nthreads, ndevs);
+
+    std::vector< std::exception_ptr > errors(ndevs);
+    std::atomic< size_t > next_dev{0};
+    auto const run{[&fn, &errors, &next_dev, ndevs]() {
+        size_t i;
+        while ((i = next_dev.fetch_add(1, std::memory_order_relaxed)) < ndevs) {
+            try {
+                fn(i);
+            } catch (...) { errors[i] = std::current_exception(); }
+        }
+    }};
+
+    std::vector< std::thread > threads;
+    for (size_t t{1}; t < nthreads; ++t) {
+        threads.emplace_back(sisl::named_thread("dev_init" + std::to_string(t), run));
+    }
+    run();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (auto& e : errors) {
+        if (e) { std::rethrow_exception(e); }
+    }
+}
+
 DeviceManager::DeviceManager(const std::vector< dev_info >& data_devices, NewVDevCallback vcb,
                              uint32_t vdev_metadata_size, iomgr::io_interface_comp_cb_t io_comp_cb,
                              vdev_error_callback vdev_error_cb) :
@@ -106,14 +147,29 @@ DeviceManager::DeviceManager(const std::vector< dev_info >& data_devices, NewVDe
         dm_derived.vdev_hdr = &dm_derived.info->vdev_hdr;
     };
 
-    uint32_t max_phys_page_size{0}, max_align_size{0};
-    for (const auto& d : m_data_devices) {
+    struct dev_probe {
+        bool valid_sb{false};
+        hs_uuid_t system_uuid{INVALID_SYSTEM_UUID};
+        uint32_t page_size{0};
+        uint32_t align_size{0};
+    };
+    std::vector< dev_probe > probes(m_data_devices.size());
+    for_each_device_parallel(m_data_devices.size(), [this, &probes](size_t i) {
+        const auto& d = m_data_devices[i];
         auto pdev = std::make_unique< PhysicalDev >(d.dev_names, get_device_open_flags(d.dev_names));
-        if (pdev->has_valid_superblock(m_data_system_uuid)) { m_first_time_boot = false; }
-        auto const page_size = pdev->page_size();
-        auto const align_size = pdev->align_size();
-        max_align_size = std::max(max_align_size, align_size);
-        max_phys_page_size = std::max(max_phys_page_size, page_size);
+        probes[i].valid_sb = pdev->has_valid_superblock(probes[i].system_uuid);
+        probes[i].page_size = pdev->page_size();
+        probes[i].align_size = pdev->align_size();
+    });
+
+    uint32_t max_phys_page_size{0}, max_align_size{0};
+    for (const auto& p : probes) {
+        if (p.valid_sb) {
+            m_first_time_boot = false;
+            m_data_system_uuid = p.system_uuid;
+        }
+        max_align_size = std::max(max_align_size, p.align_size);
+        max_phys_page_size = std::max(max_phys_page_size, p.page_size);
     }
 
     initialize_memory_structures(&m_data_chunk_memory, m_data_dm_derived, max_phys_page_size, max_align_size);
@@ -128,6 +184,11 @@ bool DeviceManager::init() {
     uint64_t max_dev_offset{0};
     meta_service().register_handler("BLK_ALLOC", bind_this(DeviceManager::blk_alloc_meta_blk_found_cb, 3), nullptr,
                                     true /* do_crc */);
+    meta_service().register_handler("BLK_ALLOC_PAGE", bind_this(DeviceManager::blk_alloc_page_meta_blk_found_cb, 3),
+                                    nullptr, true /* do_crc */);
+    meta_service().register_handler("BLK_ALLOC_JOURNAL",
+                                    bind_this(DeviceManager::blk_alloc_journal_meta_blk_found_cb, 3), nullptr,
+                                    true /* do_crc */);
 
     if (!m_first_time_boot) {
         HS_DBG_ASSERT_NE(m_data_system_uuid, INVALID_SYSTEM_UUID);
@@ -247,12 +308,24 @@ void DeviceManager::load_and_repair_devices(const hs_uuid_t& sys_uuid) {
     auto* chunk_memory = get_chunk_memory();
     auto& dm_derived = get_dm_derived();
     auto& gen_count = get_gen_count();
-    for (const auto& d : m_data_devices) {
+
+    // Devices are opened and their superblocks loaded in parallel, but reconciled below in the order of devices, so
+    // that the device picked for the latest gen count is same as that of a sequential load
+    std::vector< std::unique_ptr< PhysicalDev > > pdevs(m_data_devices.size());
+    std::vector< uint8_t > pdev_inited(m_data_devices.size(), 0);
+    for_each_device_parallel(m_data_devices.size(), [&](size_t i) {
+        const auto& d = m_data_devices[i];
         bool is_inited;
-        std::unique_ptr< PhysicalDev > pdev =
-            std::make_unique< PhysicalDev >(this, d.dev_names, get_device_open_flags(d.dev_names), sys_uuid,
-                                            INVALID_DEV_ID, 0, false, dm_derived.info_size, m_io_comp_cb, &is_inited);
-        if (!is_inited) {
+        pdevs[i] = std::make_unique< PhysicalDev >(this, d.dev_names, get_device_open_flags(d.dev_names), sys_uuid,
+                                                   INVALID_DEV_ID, 0, false, dm_derived.info_size, m_io_comp_cb,
+                                                   &is_inited);
+        pdev_inited[i] = is_inited ? 1 : 0;
+    });
+
+    for (size_t i{0}; i < m_data_devices.size(); ++i) {
+        const auto& d = m_data_devices[i];
+        auto pdev = std::move(pdevs[i]);
+        if (!pdev_inited[i]) {
             // Super block is not present, possibly a new device, will format the device later
             HS_LOG(CRITICAL, device,
                    "{} device {} appears to be not formatted. Will format it and replace it with the "
@@ -389,26 +462,48 @@ void DeviceManager::add_chunks(uint32_t vid, const chunk_add_callback& cb) {
 }
 
 void DeviceManager::inited() {
-    auto const init_pdevs = [this]() {
-        auto& dm_derived = get_dm_derived();
-        auto const pdev_start_id{0};
-        for (uint32_t dev_id = pdev_start_id; dev_id < pdev_start_id + dm_derived.pdev_hdr->num_phys_devs; ++dev_id) {
-            auto* pdev = get_pdev(dev_id);
-            uint32_t cid = pdev->first_chunk_id();
-            while (cid != INVALID_CHUNK_ID) {
-                auto* chunk = get_chunk_mutable(cid);
-                if (chunk->vdev_id() == INVALID_VDEV_ID) {
-                    cid = chunk->next_chunk_id();
-                    continue;
-                }
+    std::vector< PhysicalDevChunk* > chunks;
+    auto& dm_derived = get_dm_derived();
+    auto const pdev_start_id{0};
+    for (uint32_t dev_id = pdev_start_id; dev_id < pdev_start_id + dm_derived.pdev_hdr->num_phys_devs; ++dev_id) {
+        auto* pdev = get_pdev(dev_id);
+        uint32_t cid = pdev->first_chunk_id();
+        while (cid != INVALID_CHUNK_ID) {
+            auto* chunk = get_chunk_mutable(cid);
+            if (chunk->vdev_id() != INVALID_VDEV_ID) {
                 HS_DBG_ASSERT_NOTNULL(chunk->blk_allocator().get());
-                chunk->blk_allocator_mutable()->inited();
-                cid = chunk->next_chunk_id();
+                chunks.push_back(chunk);
             }
+            cid = chunk->next_chunk_id();
         }
-    };
+    }
+    if (chunks.empty()) { return; }
+
+    // Each chunk has its own allocator, so their bitmaps are loaded and caches warmed up in parallel.
+    auto const start_time{Clock::now()};
+    size_t nthreads{HS_DYNAMIC_CONFIG(blkallocator.num_init_load_threads)};
+    if (nthreads == 0) { nthreads = std::max(std::thread::hardware_concurrency(), 1u); }
+    nthreads = std::min(nthreads, chunks.size());
+
+    std::atomic< size_t > next_chunk{0};
+    auto const init_chunks{[&chunks, &next_chunk]() {
+        size_t i;
+        while ((i = next_chunk.fetch_add(1, std::memory_order_relaxed)) < chunks.size()) {
+            chunks[i]->recover_bm_pages_done();
+            chunks[i]->blk_allocator_mutable()->inited();
+        }
+    }};
 
-    init_pdevs();
+    std::vector< std::thread > threads;
+    for (size_t t{1}; t < nthreads; ++t) {
+        threads.emplace_back(sisl::named_thread("blkalloc_init" + std::to_string(t), init_chunks));
+    }
+    init_chunks();
+    for (auto& t : threads) {
+        t.join();
+    }
+    LOGINFO("Blk allocators of {} chunks initialized using {} threads in {} ms", chunks.size(), nthreads,
+            get_elapsed_time_ms(start_time));
 }
 
 void DeviceManager::blk_alloc_meta_blk_found_cb(meta_blk* mblk, sisl::byte_view buf, size_t size) {
@@ -418,6 +513,28 @@ void DeviceManager::blk_alloc_meta_blk_found_cb(meta_blk* mblk, sisl::byte_view
     chunk->recover(std::move(recovered_bm), mblk);
 }
 
+void DeviceManager::blk_alloc_page_meta_blk_found_cb(meta_blk* mblk, sisl::byte_view buf, size_t size) {
+    auto const meta_buf{meta_service().to_meta_buf(buf, size)};
+    HS_REL_ASSERT_GE(meta_buf->size, sizeof(blkalloc_bm_page_hdr), "Invalid size of blkalloc bitmap page");
+    auto const* hdr{r_cast< const blkalloc_bm_page_hdr* >(meta_buf->bytes)};
+    HS_REL_ASSERT_EQ(hdr->magic, BLKALLOC_BM_PAGE_MAGIC, "Invalid magic of blkalloc bitmap page");
+
+    // Bitset needs its serialized form at the start of the buffer
+    auto page_buf{hs_utils::make_byte_array(meta_buf->size - sizeof(blkalloc_bm_page_hdr), true /* aligned */,
+                                            sisl::buftag::metablk, meta_service().align_size())};
+    std::memcpy(page_buf->bytes, meta_buf->bytes + sizeof(blkalloc_bm_page_hdr), page_buf->size);
+    get_chunk_mutable(hdr->chunk_id)->recover_bm_page(*hdr, std::make_unique< sisl::Bitset >(page_buf), mblk);
+}
+
+void DeviceManager::blk_alloc_journal_meta_blk_found_cb(meta_blk* mblk, sisl::byte_view buf, size_t size) {
+    auto const meta_buf{meta_service().to_meta_buf(buf, size)};
+    auto const* hdr{r_cast< const blkalloc_bm_journal_hdr* >(meta_buf->bytes)};
+    HS_REL_ASSERT_EQ(hdr->magic, BLKALLOC_BM_JOURNAL_MAGIC, "Invalid magic of blkalloc bitmap journal");
+    HS_REL_ASSERT_GE(meta_buf->size, blkalloc_bm_journal_hdr::size(hdr->num_pages),
+                     "Invalid size of blkalloc bitmap journal");
+    get_chunk_mutable(hdr->chunk_id)->recover_bm_journal(*hdr, mblk);
+}
+
 void DeviceManager::init_done() {
     auto const init_done_pdevs{[this]() {
         auto& dm_derived = get_dm_derived();
@@ -429,9 +546,13 @@ void DeviceManager::init_done() {
     }};
 
     init_done_pdevs();
+    start_slow_dev_detector();
+    m_discard_mgr.start();
 }
 
 void DeviceManager::close_devices() {
+    stop_slow_dev_detector();
+    m_discard_mgr.stop();
     auto const close_pdevs{[this]() {
         auto& dm_derived = get_dm_derived();
         auto const pdev_start_id{0};
@@ -444,6 +565,83 @@ void DeviceManager::close_devices() {
     close_pdevs();
 }
 
+void DeviceManager::register_slow_dev_cb(slow_dev_callback cb) {
+    std::unique_lock< std::mutex > lg{m_slow_dev_mtx};
+    m_slow_dev_cbs.push_back(std::move(cb));
+}
+
+void DeviceManager::start_slow_dev_detector() {
+    auto const interval_ms = HS_DYNAMIC_CONFIG(device.slow_dev_check_interval_ms);
+    if (interval_ms == 0) { return; }
+    m_slow_dev_timer_hdl =
+        iomanager.schedule_global_timer(interval_ms * 1000ul * 1000ul, true /* recurring */, nullptr /* cookie */,
+                                        iomgr::thread_regex::all_worker, [this](void*) { detect_slow_devices(); });
+}
+
+void DeviceManager::stop_slow_dev_detector() {
+    if (m_slow_dev_timer_hdl == iomgr::null_timer_handle) { return; }
+    iomanager.cancel_timer(m_slow_dev_timer_hdl);
+    m_slow_dev_timer_hdl = iomgr::null_timer_handle;
+}
+
+void DeviceManager::detect_slow_devices() {
+    std::unique_lock< std::mutex > lg{m_slow_dev_mtx};
+
+    auto const pct = HS_DYNAMIC_CONFIG(device.slow_dev_latency_percentile);
+    auto const min_samples = HS_DYNAMIC_CONFIG(device.slow_dev_min_samples);
+    std::vector< std::pair< PhysicalDev*, uint64_t > > lats;
+    for (auto* pdev : get_all_devices()) {
+        lats.emplace_back(pdev, pdev->window_latency_percentile_us(pct, min_samples));
+    }
+
+    auto const factor = HS_DYNAMIC_CONFIG(device.slow_dev_latency_factor);
+    auto const min_lat = HS_DYNAMIC_CONFIG(device.slow_dev_min_latency_us);
+    auto const nwindows = std::max(HS_DYNAMIC_CONFIG(device.slow_dev_windows), 1u);
+    std::vector< uint64_t > peer_lats;
+    for (auto const& [pdev, lat] : lats) {
+        // Not enough ios in this interval to judge the device either way
+        if (lat == 0) { continue; }
+
+        // Peers are the other devices of same type which had enough ios in this interval
+        peer_lats.clear();
+        for (auto const& [peer, peer_lat] : lats) {
+            if ((peer != pdev) && (peer_lat != 0) && (peer->is_hdd() == pdev->is_hdd())) {
+                peer_lats.push_back(peer_lat);
+            }
+        }
+        if (peer_lats.empty()) { continue; }
+        auto const mid = peer_lats.begin() + peer_lats.size() / 2;
+        std::nth_element(peer_lats.begin(), mid, peer_lats.end());
+
+        auto& state = m_slow_dev_states[pdev];
+        if ((lat > min_lat) && (s_cast< double >(lat) > factor * s_cast< double >(*mid))) {
+            ++state.slow_windows;
+            state.ok_windows = 0;
+        } else {
+            ++state.ok_windows;
+            state.slow_windows = 0;
+        }
+
+        bool changed{false};
+        if (!pdev->is_slow() && (state.slow_windows >= nwindows)) {
+            HS_LOG(WARN, device, "Marking device {} slow, p{} latency={}us peers median={}us", pdev->get_devname(), pct,
+                   lat, *mid);
+            pdev->set_slow(true);
+            changed = true;
+        } else if (pdev->is_slow() && (state.ok_windows >= nwindows)) {
+            HS_LOG(INFO, device, "Device {} is no more slow, p{} latency={}us peers median={}us", pdev->get_devname(),
+                   pct, lat, *mid);
+            pdev->set_slow(false);
+            changed = true;
+        }
+        if (changed) {
+            for (auto& cb : m_slow_dev_cbs) {
+                cb(pdev, pdev->is_slow());
+            }
+        }
+    }
+}
+
 int DeviceManager::get_open_flags(const io_flag oflags) {
     int open_flags;
 
@@ -579,7 +777,7 @@ void DeviceManager::free_chunk(PhysicalDevChunk* chunk) {
 }
 
 vdev_info_block* DeviceManager::alloc_vdev(uint32_t req_size, uint32_t nmirrors, uint32_t blk_size, uint32_t nchunks,
-                                           char* blob, uint64_t size) {
+                                           char* blob, uint64_t size, uint32_t stripe_unit_blks) {
     std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
 
     vdev_info_block* vb = alloc_new_vdev_slot();
@@ -591,6 +789,7 @@ vdev_info_block* DeviceManager::alloc_vdev(uint32_t req_size, uint32_t nmirrors,
     vb->num_mirrors = nmirrors;
     vb->blk_size = blk_size;
     vb->num_primary_chunks = nchunks;
+    vb->stripe_unit_blks = stripe_unit_blks;
     assert(req_size <= vdev_info_block::max_context_size());
     std::memcpy(vb->context_data, blob, req_size);
 
@@ -710,11 +909,17 @@ vdev_info_block* DeviceManager::alloc_new_vdev_slot() {
     return nullptr;
 }
 
+static iomgr::drive_type drive_type_of(const std::string& devname) {
+    // Memory backed drives behave as the fastest of the drives
+    return MemDrive::is_mem_drive(devname) ? iomgr::drive_type::file_on_nvme
+                                           : iomgr::DriveInterface::get_drive_type(devname);
+}
+
 iomgr::drive_type DeviceManager::get_drive_type(const std::vector< dev_info >& devices) {
-    iomgr::drive_type dtype = iomgr::DriveInterface::get_drive_type(devices[0].dev_names);
+    iomgr::drive_type dtype = drive_type_of(devices[0].dev_names);
 #ifndef NDEBUG
     for (auto i{1u}; i < devices.size(); ++i) {
-        auto observed_dtype = iomgr::DriveInterface::get_drive_type(devices[i].dev_names);
+        auto observed_dtype = drive_type_of(devices[i].dev_names);
         HS_DBG_ASSERT_EQ(enum_name(dtype), enum_name(observed_dtype),
                          "Expected all phys dev have same drive_type, mismatched dev={}", devices[i].dev_names);
     }
@@ -724,7 +929,7 @@ iomgr::drive_type DeviceManager::get_drive_type(const std::vector< dev_info >& d
 }
 
 bool DeviceManager::is_hdd(const std::string& devname) const {
-    const iomgr::drive_type dtype = iomgr::DriveInterface::get_drive_type(devname);
+    const iomgr::drive_type dtype = drive_type_of(devname);
     if (dtype == iomgr::drive_type::block_hdd || dtype == iomgr::drive_type::file_on_hdd) { return true; }
     return false;
 }
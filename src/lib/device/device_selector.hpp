@@ -15,28 +15,54 @@
  *********************************************************************************/
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <random>
 #include <vector>
 #include <folly/ThreadLocal.h>
 #include "blkalloc/blk_allocator.h"
+#include "common/homestore_config.hpp"
+#include "physical_dev.hpp"
 
 namespace homestore {
-class PhysicalDev;
 
-class RoundRobinDeviceSelector {
+/* Device selector picks the index of the physical device (in the order pdevs are added) a vdev should allocate blks
+ * from, for the requests which are not already pinned to a chunk through stream hints. */
+class DeviceSelector {
 public:
-    explicit RoundRobinDeviceSelector() { *m_last_dev_ind = 0; }
-
-    RoundRobinDeviceSelector(const RoundRobinDeviceSelector&) = delete;
-    RoundRobinDeviceSelector(RoundRobinDeviceSelector&&) noexcept = delete;
-    RoundRobinDeviceSelector& operator=(const RoundRobinDeviceSelector&) = delete;
-    RoundRobinDeviceSelector& operator=(RoundRobinDeviceSelector&&) noexcept = delete;
-
-    ~RoundRobinDeviceSelector() = default;
+    DeviceSelector() = default;
+    DeviceSelector(const DeviceSelector&) = delete;
+    DeviceSelector(DeviceSelector&&) noexcept = delete;
+    DeviceSelector& operator=(const DeviceSelector&) = delete;
+    DeviceSelector& operator=(DeviceSelector&&) noexcept = delete;
+    virtual ~DeviceSelector() = default;
 
     void add_pdev(const PhysicalDev* const pdev) { m_pdevs.push_back(pdev); }
 
     uint32_t select(const blk_alloc_hints& hints) {
-        if (*m_last_dev_ind == (m_pdevs.size() - 1)) {
+        // Caller has pinned the device
+        if ((hints.dev_id_hint != INVALID_DEV_ID) && (hints.dev_id_hint < m_pdevs.size())) {
+            return hints.dev_id_hint;
+        }
+        return (m_pdevs.size() <= 1) ? 0 : do_select(hints);
+    }
+
+protected:
+    virtual uint32_t do_select(const blk_alloc_hints& hints) = 0;
+
+protected:
+    std::vector< const PhysicalDev* > m_pdevs;
+};
+
+class RoundRobinDeviceSelector : public DeviceSelector {
+public:
+    explicit RoundRobinDeviceSelector() { *m_last_dev_ind = 0; }
+    ~RoundRobinDeviceSelector() override = default;
+
+protected:
+    uint32_t do_select(const blk_alloc_hints&) override {
+        if (*m_last_dev_ind >= (m_pdevs.size() - 1)) {
             *m_last_dev_ind = 0;
         } else {
             ++(*m_last_dev_ind);
@@ -46,8 +72,45 @@ public:
     }
 
 private:
-    std::vector< const PhysicalDev* > m_pdevs;
     folly::ThreadLocal< uint32_t > m_last_dev_ind;
 };
 
+/* Picks 2 devices at random and chooses the one with lower cost, where cost is the expected wait of a new IO, i.e
+ * (outstanding ios + 1) * ewma completion latency, scaled up as the device runs out of free space. Power of two
+ * choices keeps the load balanced nearly as well as looking at all devices, while not herding every thread on to
+ * the single least loaded device. A slow or busy device keeps getting a share of the load proportional to its
+ * speed, instead of the equal share round robin gives. Devices marked slow by the slow device detector of
+ * DeviceManager have their cost scaled up further by slow_dev_cost_penalty. */
+class LoadAwareDeviceSelector : public DeviceSelector {
+public:
+    using free_ratio_cb_t = std::function< double(uint32_t dev_ind) >;
+
+    explicit LoadAwareDeviceSelector(free_ratio_cb_t free_ratio_cb) : m_free_ratio_cb{std::move(free_ratio_cb)} {}
+    ~LoadAwareDeviceSelector() override = default;
+
+protected:
+    uint32_t do_select(const blk_alloc_hints&) override {
+        static thread_local std::default_random_engine s_re{std::random_device{}()};
+        const auto n{static_cast< uint32_t >(m_pdevs.size())};
+        std::uniform_int_distribution< uint32_t > dist{0, n - 1};
+        const uint32_t a{dist(s_re)};
+        uint32_t b{dist(s_re)};
+        if (b == a) { b = (a + 1) % n; }
+        return (cost(b) < cost(a)) ? b : a;
+    }
+
+private:
+    double cost(uint32_t dev_ind) const {
+        const auto* pdev{m_pdevs[dev_ind]};
+        const double wait{static_cast< double >(std::max< int64_t >(pdev->outstanding_ios(), 0) + 1) *
+                          static_cast< double >(pdev->ewma_latency_us() + 1)};
+        const double free_ratio{m_free_ratio_cb ? std::max(m_free_ratio_cb(dev_ind), 0.01) : 1.0};
+        const double penalty{pdev->is_slow() ? HS_DYNAMIC_CONFIG(device.slow_dev_cost_penalty) : 1.0};
+        return wait * penalty / free_ratio;
+    }
+
+private:
+    free_ratio_cb_t m_free_ratio_cb;
+};
+
 } // namespace homestore
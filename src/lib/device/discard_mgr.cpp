@@ -0,0 +1,256 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+#include "blkalloc/blk_allocator.h"
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+#include "discard_mgr.hpp"
+#include "physical_dev.hpp"
+
+SISL_LOGGING_DECL(device)
+
+namespace homestore {
+
+void DiscardMgr::start() {
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        if (m_started || !HS_DYNAMIC_CONFIG(device.discard_enabled)) { return; }
+        m_started = true;
+        m_reactor_running = true;
+    }
+
+    // Discards are sync calls which could take a while on some drives, so they are done in their own reactor
+    iomanager.create_reactor("hs_discard", INTERRUPT_LOOP, [this](bool thread_started) {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        if (thread_started) {
+            m_discard_thread = iomanager.iothread_self();
+            m_timer_hdl = iomanager.schedule_thread_timer(
+                HS_DYNAMIC_CONFIG(device.discard_interval_ms) * 1000ul * 1000ul, true /* recurring */,
+                nullptr /* cookie */, [this](void*) { discard_pending(); });
+        } else {
+            m_discard_thread = nullptr;
+            m_reactor_running = false;
+        }
+        m_reactor_cv.notify_all();
+    });
+
+    // Wait for the reactor to come up, so that stop() always has a thread to stop
+    std::unique_lock< std::mutex > lg{m_mtx};
+    m_reactor_cv.wait(lg, [this] { return (m_discard_thread != nullptr) || !m_reactor_running; });
+}
+
+void DiscardMgr::stop() {
+    std::map< PhysicalDev*, pdev_queue > queues;
+    iomgr::io_thread_t discard_thread;
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        if (!m_started) { return; }
+        m_started = false;
+        discard_thread = m_discard_thread;
+        queues.swap(m_queues);
+        GAUGE_UPDATE(m_metrics, discard_pending_bytes, 0);
+    }
+
+    // Thread timer can only be cancelled on its own thread. Once the reactor exits, no discard is in progress and none
+    // can start, so the blks still queued can be freed to the allocators before they go away.
+    if (discard_thread != nullptr) {
+        iomanager.run_on(discard_thread, [this]([[maybe_unused]] const io_thread_addr_t addr) {
+            iomgr::timer_handle_t timer_hdl;
+            {
+                std::unique_lock< std::mutex > lg{m_mtx};
+                timer_hdl = std::exchange(m_timer_hdl, iomgr::null_timer_handle);
+            }
+            if (timer_hdl != iomgr::null_timer_handle) { iomanager.cancel_timer(timer_hdl); }
+            iomanager.stop_io_loop();
+        });
+    }
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        m_reactor_cv.wait(lg, [this] { return !m_reactor_running; });
+    }
+
+    for (auto& [pdev, q] : queues) {
+        for (auto& [offset, e] : q.extents) {
+            COUNTER_INCREMENT(m_metrics, discard_skipped_bytes, e.size);
+            free_to_allocator(e.chunk, {e.bid});
+        }
+    }
+}
+
+void DiscardMgr::free_blks(PhysicalDevChunk* chunk, const std::vector< BlkId >& blkids,
+                           const std::vector< PhysicalDevChunk* >& mirrors) {
+    if (blkids.empty()) { return; }
+
+    auto ba = chunk->blk_allocator_mutable();
+    auto* pdev = chunk->physical_dev_mutable();
+    auto const blk_size = ba->get_config().get_blk_size();
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        if (!m_started || !can_discard(pdev)) {
+            lg.unlock();
+            free_to_allocator(chunk, blkids);
+            return;
+        }
+    }
+
+    static thread_local std::vector< BlkId > s_extents;
+    static thread_local std::vector< BlkId > s_free_now;
+    s_extents.clear();
+    s_free_now.clear();
+    ba->coalesce_blkids(blkids, s_extents);
+
+    // Allocator reuses upto free_blk_reuse_pct of the freed blks soon, so only the rest (the largest extents) are
+    // worth discarding
+    std::sort(s_extents.begin(), s_extents.end(),
+              [](const BlkId& a, const BlkId& b) { return a.get_nblks() > b.get_nblks(); });
+    uint64_t total_size{0};
+    for (const auto& b : s_extents) {
+        total_size += b.data_size(blk_size);
+    }
+    auto const reuse_pct = std::clamp(HS_DYNAMIC_CONFIG(blkallocator.free_blk_reuse_pct), 0.0, 100.0);
+    auto const discard_target = static_cast< uint64_t >(total_size * (100.0 - reuse_pct) / 100.0);
+    auto const min_size = HS_DYNAMIC_CONFIG(device.discard_min_size);
+    auto const max_pending = HS_DYNAMIC_CONFIG(device.discard_max_pending_size);
+
+    uint64_t skipped_size{0};
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        auto& q = m_queues[pdev];
+        uint64_t queued_size{0};
+        for (const auto& b : s_extents) {
+            auto const size = b.data_size(blk_size);
+            if ((queued_size >= discard_target) || (size < min_size) || (q.pending_bytes + size > max_pending)) {
+                s_free_now.push_back(b);
+                skipped_size += size;
+                continue;
+            }
+            auto const offset = uint64_cast(b.get_blk_num()) * blk_size + chunk->start_offset();
+            q.extents.emplace(offset, pending_extent{chunk, b, size, mirrors});
+            q.pending_bytes += size;
+            queued_size += size;
+        }
+        GAUGE_UPDATE(m_metrics, discard_pending_bytes, pending_bytes_locked());
+    }
+
+    if (!s_free_now.empty()) {
+        COUNTER_INCREMENT(m_metrics, discard_skipped_bytes, skipped_size);
+        free_to_allocator(chunk, s_free_now);
+    }
+}
+
+uint64_t DiscardMgr::pending_bytes() const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return pending_bytes_locked();
+}
+
+/* This method assumes that m_mtx is already taken */
+uint64_t DiscardMgr::pending_bytes_locked() const {
+    uint64_t total{0};
+    for (const auto& [pdev, q] : m_queues) {
+        total += q.pending_bytes;
+    }
+    return total;
+}
+
+/* This method assumes that m_mtx is already taken */
+bool DiscardMgr::can_discard(PhysicalDev* pdev) const {
+    if (!HS_DYNAMIC_CONFIG(device.discard_enabled) || pdev->is_hdd()) { return false; }
+    auto const it = m_queues.find(pdev);
+    return (it == m_queues.cend()) || !it->second.unsupported;
+}
+
+void DiscardMgr::discard_pending() {
+    struct discard_run {
+        PhysicalDev* pdev;
+        PhysicalDevChunk* chunk;
+        uint64_t offset;
+        uint64_t size;
+        std::vector< PhysicalDevChunk* > mirrors;
+        std::vector< BlkId > bids;
+    };
+
+    std::vector< discard_run > runs;
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        if (!m_started) { return; }
+
+        auto const rate = static_cast< double >(HS_DYNAMIC_CONFIG(device.discard_max_bytes_per_sec));
+        auto const interval_sec = HS_DYNAMIC_CONFIG(device.discard_interval_ms) / 1000.0;
+        for (auto& [pdev, q] : m_queues) {
+            // Budget could go negative for a run larger than the per interval budget, which is paid off later
+            if (rate != 0) { q.budget = std::min(rate, q.budget + rate * interval_sec); }
+
+            while (!q.extents.empty() && ((rate == 0) || (q.budget > 0))) {
+                auto it = q.extents.begin();
+                discard_run r{pdev, it->second.chunk, it->first, it->second.size, std::move(it->second.mirrors),
+                              {it->second.bid}};
+                q.extents.erase(it);
+
+                // Merge the physically adjacent extents of the same chunk into one discard
+                while (!q.extents.empty()) {
+                    it = q.extents.begin();
+                    if ((it->first != r.offset + r.size) || (it->second.chunk != r.chunk)) { break; }
+                    r.size += it->second.size;
+                    r.bids.push_back(it->second.bid);
+                    q.extents.erase(it);
+                }
+                q.pending_bytes -= r.size;
+                if (rate != 0) { q.budget -= static_cast< double >(r.size); }
+                runs.push_back(std::move(r));
+            }
+        }
+        GAUGE_UPDATE(m_metrics, discard_pending_bytes, pending_bytes_locked());
+    }
+
+    for (auto& r : runs) {
+        discard_range(r.pdev, r.offset, r.size);
+        for (auto* mchunk : r.mirrors) {
+            discard_range(mchunk->physical_dev_mutable(), mchunk->start_offset() + (r.offset - r.chunk->start_offset()),
+                          r.size);
+        }
+        free_to_allocator(r.chunk, r.bids);
+    }
+}
+
+bool DiscardMgr::discard_range(PhysicalDev* pdev, uint64_t offset, uint64_t size) {
+    auto const start_time = Clock::now();
+    auto const err = pdev->sync_discard(size, offset);
+    HISTOGRAM_OBSERVE(m_metrics, discard_latency, get_elapsed_time_us(start_time));
+    COUNTER_INCREMENT(m_metrics, discard_count, 1);
+    if (err == 0) {
+        COUNTER_INCREMENT(m_metrics, discard_bytes, size);
+        return true;
+    }
+
+    COUNTER_INCREMENT(m_metrics, discard_error_count, 1);
+    if ((err == EOPNOTSUPP) || (err == ENOTTY)) {
+        HS_LOG(INFO, device, "Device {} doesn't support discard, not discarding it anymore", pdev->get_devname());
+        std::unique_lock< std::mutex > lg{m_mtx};
+        m_queues[pdev].unsupported = true;
+    } else {
+        HS_LOG(WARN, device, "Discard of offset={} size={} on device {} failed, errno={}", offset, size,
+               pdev->get_devname(), err);
+    }
+    return false;
+}
+
+void DiscardMgr::free_to_allocator(PhysicalDevChunk* chunk, const std::vector< BlkId >& blkids) {
+    chunk->blk_allocator_mutable()->free(blkids);
+}
+} // namespace homestore
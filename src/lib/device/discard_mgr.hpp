@@ -0,0 +1,123 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sisl/metrics/metrics.hpp>
+#include <iomgr/iomgr.hpp>
+
+#include <homestore/blk.h>
+
+namespace homestore {
+class PhysicalDev;
+class PhysicalDevChunk;
+
+class DiscardMgrMetrics : public sisl::MetricsGroupWrapper {
+public:
+    explicit DiscardMgrMetrics() : sisl::MetricsGroupWrapper{"DiscardMgr", "discard_mgr"} {
+        REGISTER_COUNTER(discard_bytes, "Bytes discarded on the devices");
+        REGISTER_COUNTER(discard_count, "Number of discard calls issued on the devices");
+        REGISTER_COUNTER(discard_skipped_bytes, "Freed bytes returned to allocator without discard");
+        REGISTER_COUNTER(discard_error_count, "Number of discard calls failed");
+        REGISTER_GAUGE(discard_pending_bytes, "Freed bytes waiting to be discarded");
+        REGISTER_HISTOGRAM(discard_latency, "Latency of a discard call in us");
+        register_me_to_farm();
+    }
+
+    DiscardMgrMetrics(const DiscardMgrMetrics&) = delete;
+    DiscardMgrMetrics(DiscardMgrMetrics&&) noexcept = delete;
+    DiscardMgrMetrics& operator=(const DiscardMgrMetrics&) = delete;
+    DiscardMgrMetrics& operator=(DiscardMgrMetrics&&) noexcept = delete;
+    ~DiscardMgrMetrics() { deregister_me_from_farm(); }
+};
+
+/*
+ * DiscardMgr: Tells the SSDs about the blks freed at CP, so that the drive doesn't keep copying dead data during its
+ * garbage collection.
+ *
+ * The blks freed are held back from the allocator till they are discarded, otherwise a discard issued later could
+ * wipe out the data of the blk reallocated in the meantime. As the allocator prefers to reuse recently freed blks
+ * (blkallocator.free_blk_reuse_pct), that share of the freed bytes, picked from the smallest extents, is returned to
+ * the allocator right away without discard, since those blks are going to be overwritten soon anyways. Rest of the
+ * extents are queued per pdev, merged with the physically adjacent extents already queued and discarded in the
+ * background in pdev offset order, within the configured rate, after which they are freed to the allocator.
+ *
+ * Blks are queued here only after they are freed on the disk bitmap (see VirtualDev::free_blks_on_cp), so the CP
+ * persists them as free irrespective of the discard. Only the in-memory free, i.e. their reuse, waits for the discard.
+ *
+ * HDDs and devices which don't support discard are skipped altogether.
+ */
+class DiscardMgr {
+public:
+    DiscardMgr() = default;
+    DiscardMgr(const DiscardMgr&) = delete;
+    DiscardMgr(DiscardMgr&&) noexcept = delete;
+    DiscardMgr& operator=(const DiscardMgr&) = delete;
+    DiscardMgr& operator=(DiscardMgr&&) noexcept = delete;
+    ~DiscardMgr() = default;
+
+    /// @brief Start the reactor which discards the queued blks in the background, if discard is enabled
+    void start();
+
+    /// @brief Stop and join the discard reactor and free all the blks still waiting for discard to their allocators
+    void stop();
+
+    /// @brief Free the blkids of the chunk (and its mirrors) to the chunk's allocator, after discarding them if
+    /// applicable.
+    void free_blks(PhysicalDevChunk* chunk, const std::vector< BlkId >& blkids,
+                   const std::vector< PhysicalDevChunk* >& mirrors = {});
+
+    uint64_t pending_bytes() const;
+
+private:
+    struct pending_extent {
+        PhysicalDevChunk* chunk;
+        BlkId bid;
+        uint64_t size;
+        std::vector< PhysicalDevChunk* > mirrors;
+    };
+
+    struct pdev_queue {
+        std::map< uint64_t /* dev offset */, pending_extent > extents;
+        uint64_t pending_bytes{0};
+        double budget{0}; // Bytes which can be discarded now as per the rate
+        bool unsupported{false};
+    };
+
+    // All of below assume m_mtx is taken
+    bool can_discard(PhysicalDev* pdev) const;
+    uint64_t pending_bytes_locked() const;
+
+    void discard_pending();
+    bool discard_range(PhysicalDev* pdev, uint64_t offset, uint64_t size);
+    void free_to_allocator(PhysicalDevChunk* chunk, const std::vector< BlkId >& blkids);
+
+private:
+    mutable std::mutex m_mtx;
+    std::map< PhysicalDev*, pdev_queue > m_queues;
+    bool m_started{false};
+    bool m_reactor_running{false};
+    std::condition_variable m_reactor_cv; // Signalled when the discard reactor comes up or exits
+    iomgr::io_thread_t m_discard_thread{nullptr};
+    iomgr::timer_handle_t m_timer_hdl{iomgr::null_timer_handle};
+    DiscardMgrMetrics m_metrics;
+};
+} // namespace homestore
@@ -0,0 +1,232 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "common/homestore_config.hpp"
+#include "io_scheduler.hpp"
+
+namespace homestore {
+
+static uint32_t class_qd(io_class_t cls) {
+    switch (cls) {
+    case io_class_t::latency:
+        return HS_DYNAMIC_CONFIG(device.io_sched_latency_qd);
+    case io_class_t::throughput:
+        return HS_DYNAMIC_CONFIG(device.io_sched_throughput_qd);
+    default:
+        return HS_DYNAMIC_CONFIG(device.io_sched_background_qd);
+    }
+}
+
+static double class_weight(io_class_t cls) {
+    uint32_t weight;
+    switch (cls) {
+    case io_class_t::latency:
+        weight = HS_DYNAMIC_CONFIG(device.io_sched_latency_weight);
+        break;
+    case io_class_t::throughput:
+        weight = HS_DYNAMIC_CONFIG(device.io_sched_throughput_weight);
+        break;
+    default:
+        weight = HS_DYNAMIC_CONFIG(device.io_sched_background_weight);
+        break;
+    }
+    return static_cast< double >(std::max(weight, 1u));
+}
+
+static uint64_t class_rate(io_class_t cls) {
+    switch (cls) {
+    case io_class_t::latency:
+        return HS_DYNAMIC_CONFIG(device.io_sched_latency_rate);
+    case io_class_t::throughput:
+        return HS_DYNAMIC_CONFIG(device.io_sched_throughput_rate);
+    default:
+        return HS_DYNAMIC_CONFIG(device.io_sched_background_rate);
+    }
+}
+
+IoScheduler::IoScheduler(const std::string& devname) : m_metrics{devname} {}
+
+IoScheduler::~IoScheduler() {
+    if (m_refill_timer_hdl != iomgr::null_timer_handle) { iomanager.cancel_timer(m_refill_timer_hdl); }
+}
+
+void IoScheduler::submit(io_class_t cls, uint64_t size, io_issue_cb_t issue_cb, bool part_of_batch) {
+    bool held_back{false};
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        auto& cs = m_classes[s_cast< size_t >(cls)];
+
+        // Ios of a class are issued in order, so nothing can go ahead of the ios already held back
+        if (!cs.queue.empty() || !can_dispatch(cls, Clock::now())) {
+            // A class which was idle joins the backlog at the current virtual time, so that it can't claim the share it
+            // didn't use. While it stays backlogged, its ios are tagged back to back from there.
+            if (cs.queue.empty()) { cs.vfinish = std::max(cs.vfinish, m_vtime); }
+            cs.queue.push_back(pending_io{size, std::move(issue_cb)});
+            held_back = true;
+            switch (cls) {
+            case io_class_t::latency:
+                COUNTER_INCREMENT(m_metrics, latency_class_queued_ios, 1);
+                break;
+            case io_class_t::throughput:
+                COUNTER_INCREMENT(m_metrics, throughput_class_queued_ios, 1);
+                break;
+            default:
+                COUNTER_INCREMENT(m_metrics, background_class_queued_ios, 1);
+                break;
+            }
+        } else {
+            cs.vfinish = std::max(cs.vfinish, m_vtime);
+            on_dispatch(cls, size);
+        }
+    }
+
+    if (held_back) {
+        // Arms the refill timer, if it is waiting only on tokens
+        dispatch();
+    } else {
+        issue_cb(part_of_batch);
+    }
+}
+
+void IoScheduler::on_complete(io_class_t cls, uint64_t latency_us) {
+    switch (cls) {
+    case io_class_t::latency:
+        HISTOGRAM_OBSERVE(m_metrics, latency_class_io_latency, latency_us);
+        break;
+    case io_class_t::throughput:
+        HISTOGRAM_OBSERVE(m_metrics, throughput_class_io_latency, latency_us);
+        break;
+    default:
+        HISTOGRAM_OBSERVE(m_metrics, background_class_io_latency, latency_us);
+        break;
+    }
+
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        auto& cs = m_classes[s_cast< size_t >(cls)];
+        if (cs.outstanding > 0) { --cs.outstanding; }
+    }
+    dispatch();
+}
+
+uint32_t IoScheduler::outstanding_ios(io_class_t cls) const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return m_classes[s_cast< size_t >(cls)].outstanding;
+}
+
+size_t IoScheduler::queued_ios(io_class_t cls) const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return m_classes[s_cast< size_t >(cls)].queue.size();
+}
+
+void IoScheduler::dispatch() {
+    std::vector< io_issue_cb_t > issue_cbs;
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        collect_dispatchable(issue_cbs);
+    }
+
+    // Issue outside the lock, as the io could complete inline and come back to the scheduler
+    for (auto& cb : issue_cbs) {
+        cb(false /* part_of_batch */);
+    }
+}
+
+/* This method assumes that m_mtx is already taken */
+bool IoScheduler::can_dispatch(io_class_t cls, Clock::time_point now) {
+    auto& cs = m_classes[s_cast< size_t >(cls)];
+    if (cs.outstanding >= class_qd(cls)) { return false; }
+    if (class_rate(cls) == 0) { return true; }
+    refill(cls, now);
+    return (cs.tokens > 0);
+}
+
+/* This method assumes that m_mtx is already taken */
+void IoScheduler::on_dispatch(io_class_t cls, uint64_t size) {
+    auto& cs = m_classes[s_cast< size_t >(cls)];
+    ++cs.outstanding;
+    if (class_rate(cls) != 0) { cs.tokens -= static_cast< double >(size); }
+
+    // Caller has already moved the virtual finish time of an idle class to the current virtual time
+    auto const start = cs.vfinish;
+    cs.vfinish = start + static_cast< double >(size) / class_weight(cls);
+    m_vtime = std::max(m_vtime, start);
+}
+
+/* This method assumes that m_mtx is already taken */
+void IoScheduler::refill(io_class_t cls, Clock::time_point now) {
+    auto& cs = m_classes[s_cast< size_t >(cls)];
+    auto const rate = static_cast< double >(class_rate(cls));
+    auto const elapsed_sec = std::chrono::duration< double >(now - cs.last_refill).count();
+    cs.last_refill = now;
+    cs.tokens = std::min(rate / 10 /* burst of 100ms */, cs.tokens + rate * elapsed_sec);
+}
+
+/* This method assumes that m_mtx is already taken */
+void IoScheduler::collect_dispatchable(std::vector< io_issue_cb_t >& out) {
+    auto const now = Clock::now();
+    while (true) {
+        // Pick the held back io with the smallest virtual finish time, among the classes within their limits
+        int best{-1};
+        double best_finish{std::numeric_limits< double >::max()};
+        for (size_t c{0}; c < num_classes; ++c) {
+            auto const cls = s_cast< io_class_t >(c);
+            auto& cs = m_classes[c];
+            if (cs.queue.empty() || !can_dispatch(cls, now)) { continue; }
+
+            auto const finish = cs.vfinish + static_cast< double >(cs.queue.front().size) / class_weight(cls);
+            if (finish < best_finish) {
+                best_finish = finish;
+                best = s_cast< int >(c);
+            }
+        }
+        if (best < 0) { break; }
+
+        auto& cs = m_classes[best];
+        auto pio = std::move(cs.queue.front());
+        cs.queue.pop_front();
+        on_dispatch(s_cast< io_class_t >(best), pio.size);
+        out.push_back(std::move(pio.issue_cb));
+    }
+
+    // A class held back only by its rate limit has no completion to trigger its dispatch, so wake up once the
+    // tokens for its next io are refilled
+    if (m_refill_timer_hdl != iomgr::null_timer_handle) { return; }
+    double wait_sec{0};
+    for (size_t c{0}; c < num_classes; ++c) {
+        auto const cls = s_cast< io_class_t >(c);
+        auto const& cs = m_classes[c];
+        auto const rate = class_rate(cls);
+        if (cs.queue.empty() || (rate == 0) || (cs.outstanding >= class_qd(cls))) { continue; }
+        auto const w = (1 - cs.tokens) / static_cast< double >(rate);
+        if ((wait_sec == 0) || (w < wait_sec)) { wait_sec = w; }
+    }
+    if (wait_sec <= 0) { return; }
+
+    m_refill_timer_hdl = iomanager.schedule_global_timer(
+        static_cast< uint64_t >(wait_sec * 1000 * 1000 * 1000) + 1, false /* recurring */, nullptr /* cookie */,
+        iomgr::thread_regex::all_worker, [this](void*) {
+            {
+                std::unique_lock< std::mutex > lg{m_mtx};
+                m_refill_timer_hdl = iomgr::null_timer_handle;
+            }
+            dispatch();
+        });
+}
+} // namespace homestore
@@ -0,0 +1,126 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sisl/metrics/metrics.hpp>
+#include <sisl/utility/enum.hpp>
+#include <iomgr/iomgr.hpp>
+
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+// Priority class of an io. latency: log writes and foreground reads/writes, throughput: CP flushes, background: scrub,
+// defrag and such ios which could be delayed indefinitely
+ENUM(io_class_t, uint8_t, latency, throughput, background);
+
+class IoSchedulerMetrics : public sisl::MetricsGroupWrapper {
+public:
+    explicit IoSchedulerMetrics(const std::string& devname) : sisl::MetricsGroupWrapper{"IoScheduler", devname} {
+        REGISTER_HISTOGRAM(latency_class_io_latency, "Latency of latency critical ios in us", "io_class_latency",
+                           {"io_class", "latency"});
+        REGISTER_HISTOGRAM(throughput_class_io_latency, "Latency of throughput ios in us", "io_class_latency",
+                           {"io_class", "throughput"});
+        REGISTER_HISTOGRAM(background_class_io_latency, "Latency of background ios in us", "io_class_latency",
+                           {"io_class", "background"});
+        REGISTER_COUNTER(latency_class_queued_ios, "Latency critical ios held back by the scheduler",
+                         "io_class_queued_ios", {"io_class", "latency"});
+        REGISTER_COUNTER(throughput_class_queued_ios, "Throughput ios held back by the scheduler",
+                         "io_class_queued_ios", {"io_class", "throughput"});
+        REGISTER_COUNTER(background_class_queued_ios, "Background ios held back by the scheduler",
+                         "io_class_queued_ios", {"io_class", "background"});
+        register_me_to_farm();
+    }
+
+    IoSchedulerMetrics(const IoSchedulerMetrics&) = delete;
+    IoSchedulerMetrics(IoSchedulerMetrics&&) noexcept = delete;
+    IoSchedulerMetrics& operator=(const IoSchedulerMetrics&) = delete;
+    IoSchedulerMetrics& operator=(IoSchedulerMetrics&&) noexcept = delete;
+    ~IoSchedulerMetrics() { deregister_me_from_farm(); }
+};
+
+/*
+ * IoScheduler: Per physical device scheduler of the async ios issued by the vdevs on it. Each io class has
+ *
+ * 1. Queue depth: Maximum ios of the class outstanding on the device. Ios beyond it are held in the scheduler, so
+ *    that a big CP flush doesn't fill up the device queue ahead of foreground reads.
+ * 2. Weight: Held back ios are dispatched in weighted fair order, i.e. each class gets a share of the bytes issued in
+ *    proportion to its weight, as long as it has ios waiting.
+ * 3. Rate: Token bucket limit on bytes per second, with a burst of 100ms worth of bytes. 0 means unlimited.
+ *
+ * Ios are issued right away if the class has room in all of the above and nothing of the class is held back already.
+ * Held back ios are dispatched as ios of the device complete or tokens refill. All limits are hotswappable.
+ */
+class IoScheduler {
+public:
+    // Issues the io on the device, part_of_batch is false for the ios dispatched later by the scheduler
+    using io_issue_cb_t = std::function< void(bool /* part_of_batch */) >;
+
+    explicit IoScheduler(const std::string& devname);
+    IoScheduler(const IoScheduler&) = delete;
+    IoScheduler(IoScheduler&&) noexcept = delete;
+    IoScheduler& operator=(const IoScheduler&) = delete;
+    IoScheduler& operator=(IoScheduler&&) noexcept = delete;
+    ~IoScheduler();
+
+    /// @brief Issue the io of given class and size now, or hold it back till the class is within its limits
+    void submit(io_class_t cls, uint64_t size, io_issue_cb_t issue_cb, bool part_of_batch);
+
+    /// @brief Completion of an io submitted earlier, with the latency since it was submitted to the scheduler
+    void on_complete(io_class_t cls, uint64_t latency_us);
+
+    uint32_t outstanding_ios(io_class_t cls) const;
+    size_t queued_ios(io_class_t cls) const;
+
+private:
+    struct pending_io {
+        uint64_t size;
+        io_issue_cb_t issue_cb;
+    };
+
+    struct class_state {
+        std::deque< pending_io > queue;
+        uint32_t outstanding{0};
+        double vfinish{0};      // Virtual finish time of the last dispatched io of the class
+        double tokens{0};       // Bytes which can be issued now, could go negative for an io larger than the burst
+        Clock::time_point last_refill{Clock::now()};
+    };
+
+    static constexpr size_t num_classes{3};
+
+    // All of below assume m_mtx is taken
+    bool can_dispatch(io_class_t cls, Clock::time_point now);
+    void on_dispatch(io_class_t cls, uint64_t size);
+    void refill(io_class_t cls, Clock::time_point now);
+    void collect_dispatchable(std::vector< io_issue_cb_t >& out);
+
+    void dispatch();
+
+private:
+    mutable std::mutex m_mtx;
+    std::array< class_state, num_classes > m_classes;
+    double m_vtime{0}; // Virtual start time of the last dispatched io
+    iomgr::timer_handle_t m_refill_timer_hdl{iomgr::null_timer_handle};
+    IoSchedulerMetrics m_metrics;
+};
+} // namespace homestore
@@ -13,6 +13,7 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <functional>
@@ -33,11 +34,51 @@
 #include "common/resource_mgr.hpp"
 
 namespace homestore {
+/* Appends the iovecs covering [offset, offset + len) of the data described by iov */
+static void slice_iovs(const iovec* iov, int iovcnt, uint64_t offset, uint64_t len, std::vector< iovec >& out) {
+    for (int i{0}; (i < iovcnt) && (len > 0); ++i) {
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+        auto const sz = std::min< uint64_t >(iov[i].iov_len - offset, len);
+        out.push_back(iovec{r_cast< uint8_t* >(iov[i].iov_base) + offset, sz});
+        offset = 0;
+        len -= sz;
+    }
+}
+
+void JournalVirtualDev::init_stripe(bool is_init) {
+    auto const npdevs = m_primary_pdev_chunks_list.size();
+    if (!is_striped() || (npdevs < 2)) { return; }
+
+    // Layout is derived only from what is persisted at creation, so that it stays the same across restarts
+    auto const unit = uint64_cast(stripe_unit_blks()) * block_size();
+    auto const nchunks = m_primary_pdev_chunks_list[0].chunks_in_pdev.size();
+    if ((m_chunk_size % unit != 0) ||
+        !std::all_of(m_primary_pdev_chunks_list.cbegin(), m_primary_pdev_chunks_list.cend(),
+                     [nchunks](const pdev_chunk_map& pcm) { return pcm.chunks_in_pdev.size() == nchunks; })) {
+        HS_LOG(WARN, device, "Chunks of journal vdev {} are not uniform across pdevs, appends are not striped", m_name);
+        return;
+    }
+    m_stripe_width = s_cast< uint32_t >(npdevs);
+    m_stripe_unit = unit;
+
+    // End of a segment is kept in its first chunk, which is set to the chunk size at creation
+    if (is_init) {
+        for (uint32_t seg{0}; seg < num_segments(); ++seg) {
+            m_mgr->update_end_of_chunk(segment_chunk(seg), segment_size());
+        }
+    }
+    HS_LOG(INFO, device, "Journal vdev {} appends are striped across {} pdevs in units of {}", m_name, m_stripe_width,
+           in_bytes(m_stripe_unit));
+}
+
 off_t JournalVirtualDev::alloc_next_append_blk(size_t sz) {
     if (used_size() + sz > size()) {
         // not enough space left;
         HS_LOG(ERROR, device, "No space left! m_write_sz_in_total: {}, m_reserved_sz: {}", m_write_sz_in_total.load(),
-               m_reserved_sz);
+               m_reserved_sz.load());
         return INVALID_OFFSET;
     }
 
@@ -47,40 +88,38 @@ off_t JournalVirtualDev::alloc_next_append_blk(size_t sz) {
 
     const off_t ds_off = data_start_offset();
     const off_t end_offset = tail_offset();
-    off_t offset_in_chunk{0};
-    uint32_t dev_id{0}, chunk_id{0};
-
-    auto const dev_in_offset = logical_to_dev_offset(end_offset, dev_id, chunk_id, offset_in_chunk);
+    off_t offset_in_seg{0};
+    auto const seg = logical_to_segment(end_offset, offset_in_seg);
 
 #ifndef NDEBUG
     if (end_offset < ds_off) { HS_DBG_ASSERT_EQ(size() - used_size(), static_cast< uint64_t >(ds_off - end_offset)); }
 #endif
     // works for both "end_offset >= ds_off" and "end_offset < ds_off";
-    if (offset_in_chunk + sz <= m_chunk_size) {
+    if (offset_in_seg + sz <= segment_size()) {
         // not acrossing boundary, nothing to do;
-    } else if ((used_size() + (m_chunk_size - offset_in_chunk) + sz) <= size()) {
+    } else if ((used_size() + (segment_size() - offset_in_seg) + sz) <= size()) {
         // across chunk boundary, still enough space;
 
         // Update the overhead to total write size;
-        m_write_sz_in_total.fetch_add(m_chunk_size - offset_in_chunk, std::memory_order_relaxed);
+        m_write_sz_in_total.fetch_add(segment_size() - offset_in_seg, std::memory_order_relaxed);
 
         // If across chunk boundary, update the chunk super-block of the chunk size
-        auto* chunk = m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
-        m_mgr->update_end_of_chunk(chunk, offset_in_chunk);
+        auto* chunk = segment_chunk(seg);
+        m_mgr->update_end_of_chunk(chunk, offset_in_seg);
 
 #ifdef _PRERELEASE
         HomeStoreFlip::test_and_abort("abort_after_update_eof_cur_chunk");
 #endif
         // get next chunk handle
-        auto* next_chunk = get_next_chunk(dev_id, chunk_id);
+        auto* next_chunk = segment_chunk((seg + 1) % num_segments());
         if (next_chunk != chunk) {
             // Since we are re-using a new chunk, update this chunk's end as its original size;
-            m_mgr->update_end_of_chunk(next_chunk, m_chunk_size);
+            m_mgr->update_end_of_chunk(next_chunk, segment_size());
         }
     } else {
         // across chunk boundary and no space left;
         HS_LOG(ERROR, device, "No space left! m_write_sz_in_total: {}, m_reserved_sz: {}", m_write_sz_in_total.load(),
-               m_reserved_sz);
+               m_reserved_sz.load());
         return INVALID_OFFSET;
         // m_reserved_sz stays sthe same;
     }
@@ -105,37 +144,64 @@ bool JournalVirtualDev::validate_append_size(size_t count) const {
     if (used_size() + count > size()) {
         // not enough space left;
         HS_LOG(ERROR, device, "No space left! m_write_sz_in_total: {}, m_reserved_sz: {}", m_write_sz_in_total.load(),
-               m_reserved_sz);
+               m_reserved_sz.load());
         return false;
     }
 
     if (m_reserved_sz != 0) {
         HS_LOG(ERROR, device, "write can't be served when m_reserved_sz:{} is not comsumed by pwrite yet.",
-               m_reserved_sz);
+               m_reserved_sz.load());
         return false;
     }
     return true;
 }
 
-auto JournalVirtualDev::process_pwrite_offset(size_t len, off_t offset) {
-    off_t offset_in_chunk{0};
-    uint32_t dev_id{0}, chunk_id{0};
-
-    // convert logical offset to dev offset
-    const uint64_t offset_in_dev = logical_to_dev_offset(offset, dev_id, chunk_id, offset_in_chunk);
+std::vector< JournalVirtualDev::stripe_piece > JournalVirtualDev::process_pwrite_offset(size_t len, off_t offset) {
+    off_t offset_in_seg{0};
+    auto const seg = logical_to_segment(offset, offset_in_seg);
 
     // this assert only valid for pwrite/pwritev, which calls alloc_next_append_blk to get the offset to do the
     // write, which guarantees write will with the returned offset will not accross chunk boundary.
-    HS_REL_ASSERT_GE(m_chunk_size - offset_in_chunk, len, "Writing size: {} crossing chunk is not allowed!", len);
+    HS_REL_ASSERT_GE(segment_size() - offset_in_seg, len, "Writing size: {} crossing chunk is not allowed!", len);
     m_write_sz_in_total.fetch_add(len, std::memory_order_relaxed);
 
-    HS_LOG(TRACE, device, "Writing in device: {}, offset: {}, m_write_sz_in_total: {}, start off: {}", to_hex(dev_id),
-           to_hex(offset_in_dev), to_hex(m_write_sz_in_total.load()), to_hex(data_start_offset()));
+    HS_LOG(TRACE, device, "Writing in segment: {}, offset: {}, m_write_sz_in_total: {}, start off: {}", seg,
+           to_hex(offset_in_seg), to_hex(m_write_sz_in_total.load()), to_hex(data_start_offset()));
+
+    auto pieces = split_by_stripe(seg, offset_in_seg, len);
+    if (pieces.size() > 1) { COUNTER_INCREMENT(m_metrics, vdev_striped_io_count, 1); }
+    return pieces;
+}
 
-    PhysicalDevChunk* chunk = m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
-    auto* pdev = m_primary_pdev_chunks_list[dev_id].pdev;
+std::vector< JournalVirtualDev::stripe_piece > JournalVirtualDev::split_by_stripe(uint32_t seg, off_t offset_in_seg,
+                                                                                  uint64_t len) const {
+    std::vector< stripe_piece > pieces;
+    if (m_stripe_width == 1) {
+        pieces.push_back(stripe_piece{segment_chunk(seg), uint64_cast(offset_in_seg), len, {{0, len}}});
+        return pieces;
+    }
 
-    return std::make_tuple(pdev, chunk, offset_in_dev);
+    // Units of a pdev in the range are in consecutive rows, so they are contiguous in its chunk
+    pieces.resize(m_stripe_width);
+    for (uint64_t done{0}; done < len;) {
+        auto const pos = uint64_cast(offset_in_seg) + done;
+        auto const unit = pos / m_stripe_unit;
+        auto const offset_in_unit = pos % m_stripe_unit;
+        auto const sz = std::min(m_stripe_unit - offset_in_unit, len - done);
+        auto const member = s_cast< uint32_t >(unit % m_stripe_width);
+
+        auto& p = pieces[member];
+        if (p.size == 0) {
+            p.chunk = segment_chunk(seg, member);
+            p.offset_in_chunk = (unit / m_stripe_width) * m_stripe_unit + offset_in_unit;
+        }
+        p.slices.emplace_back(done, sz);
+        p.size += sz;
+        done += sz;
+    }
+    pieces.erase(std::remove_if(pieces.begin(), pieces.end(), [](const stripe_piece& p) { return p.size == 0; }),
+                 pieces.end());
+    return pieces;
 }
 
 /////////////////////////////// Write Section //////////////////////////////////
@@ -143,8 +209,8 @@ void JournalVirtualDev::async_append(const uint8_t* buf, size_t size, vdev_io_co
     if (!validate_append_size(size)) {
         cb(std::make_error_condition(std::errc::no_space_on_device), nullptr /*cookie*/);
     } else {
-        auto [pdev, chunk, offset_in_dev] = process_pwrite_offset(size, m_seek_cursor);
-        async_write_internal(r_cast< const char* >(buf), size, pdev, chunk, offset_in_dev, std::move(cb));
+        auto const pieces = process_pwrite_offset(size, m_seek_cursor);
+        async_write_pieces(buf, size, pieces, std::move(cb));
         m_seek_cursor += size;
     }
 }
@@ -163,11 +229,11 @@ void JournalVirtualDev::async_append(const uint8_t* buf, size_t size, vdev_io_co
  *
  */
 void JournalVirtualDev::async_pwrite(const uint8_t* buf, size_t size, off_t offset, vdev_io_comp_cb_t cb) {
-    HS_REL_ASSERT_LE(size, m_reserved_sz, "Write size: larger then reserved size is not allowed!");
+    HS_REL_ASSERT_LE(size, m_reserved_sz.load(), "Write size: larger then reserved size is not allowed!");
     m_reserved_sz -= size; // update reserved size
 
-    auto [pdev, chunk, offset_in_dev] = process_pwrite_offset(size, offset);
-    async_write_internal(r_cast< const char* >(buf), size, pdev, chunk, offset_in_dev, std::move(cb));
+    auto const pieces = process_pwrite_offset(size, offset);
+    async_write_pieces(buf, size, pieces, std::move(cb));
 }
 
 void JournalVirtualDev::async_pwritev(const iovec* iov, int iovcnt, off_t offset, vdev_io_comp_cb_t cb) {
@@ -175,19 +241,25 @@ void JournalVirtualDev::async_pwritev(const iovec* iov, int iovcnt, off_t offset
 
     // if size is smaller than reserved size, it means write will never be overlapping start offset;
     // it is guaranteed by alloc_next_append_blk api;
-    HS_REL_ASSERT_LE(size, m_reserved_sz, "Write size: larger then reserved size: is not allowed!");
+    HS_REL_ASSERT_LE(size, m_reserved_sz.load(), "Write size: larger then reserved size: is not allowed!");
 
     m_reserved_sz -= size;
-    auto [pdev, chunk, offset_in_dev] = process_pwrite_offset(size, offset);
-    async_writev_internal(iov, iovcnt, size, pdev, chunk, offset_in_dev, std::move(cb));
+    auto const pieces = process_pwrite_offset(size, offset);
+    if (pieces.size() == 1) {
+        auto* chunk = pieces[0].chunk;
+        async_writev_internal(iov, iovcnt, size, chunk->physical_dev_mutable(), chunk,
+                              chunk->start_offset() + pieces[0].offset_in_chunk, std::move(cb));
+    } else {
+        async_write_striped(iov, iovcnt, pieces, std::move(cb));
+    }
 }
 
 ssize_t JournalVirtualDev::sync_pwrite(const uint8_t* buf, size_t size, off_t offset) {
-    HS_REL_ASSERT_LE(size, m_reserved_sz, "Write size: larger then reserved size is not allowed!");
+    HS_REL_ASSERT_LE(size, m_reserved_sz.load(), "Write size: larger then reserved size is not allowed!");
     m_reserved_sz -= size; // update reserved size
 
-    auto [pdev, chunk, offset_in_dev] = process_pwrite_offset(size, offset);
-    return sync_write_internal(r_cast< const char* >(buf), size, pdev, chunk, offset_in_dev);
+    iovec iov{const_cast< uint8_t* >(buf), size};
+    return sync_write_pieces(&iov, 1, process_pwrite_offset(size, offset));
 }
 
 ssize_t JournalVirtualDev::sync_pwritev(const iovec* iov, int iovcnt, off_t offset) {
@@ -195,11 +267,82 @@ ssize_t JournalVirtualDev::sync_pwritev(const iovec* iov, int iovcnt, off_t offs
 
     // if size is smaller than reserved size, it means write will never be overlapping start offset;
     // it is guaranteed by alloc_next_append_blk api;
-    HS_REL_ASSERT_LE(size, m_reserved_sz, "Write size: larger then reserved size: is not allowed!");
+    HS_REL_ASSERT_LE(size, m_reserved_sz.load(), "Write size: larger then reserved size: is not allowed!");
 
     m_reserved_sz -= size;
-    auto [pdev, chunk, offset_in_dev] = process_pwrite_offset(size, offset);
-    return sync_writev_internal(iov, iovcnt, pdev, chunk, offset_in_dev);
+    return sync_write_pieces(iov, iovcnt, process_pwrite_offset(size, offset));
+}
+
+void JournalVirtualDev::async_write_pieces(const uint8_t* buf, size_t size, const std::vector< stripe_piece >& pieces,
+                                           vdev_io_comp_cb_t cb) {
+    if (pieces.size() == 1) {
+        auto* chunk = pieces[0].chunk;
+        async_write_internal(r_cast< const char* >(buf), size, chunk->physical_dev_mutable(), chunk,
+                             chunk->start_offset() + pieces[0].offset_in_chunk, std::move(cb));
+    } else {
+        iovec iov{const_cast< uint8_t* >(buf), size};
+        async_write_striped(&iov, 1, pieces, std::move(cb));
+    }
+}
+
+void JournalVirtualDev::async_write_striped(const iovec* iov, int iovcnt, const std::vector< stripe_piece >& pieces,
+                                            vdev_io_comp_cb_t cb) {
+    struct striped_write {
+        std::vector< std::vector< iovec > > iovs; // Kept till the ios are completed
+        std::atomic< size_t > pending;
+        std::mutex mtx;
+        std::error_condition err{no_error};
+        vdev_io_comp_cb_t cb;
+    };
+
+    auto ctx = std::make_shared< striped_write >();
+    ctx->cb = std::move(cb);
+    ctx->pending.store(pieces.size(), std::memory_order_relaxed);
+    ctx->iovs.resize(pieces.size());
+    for (size_t i{0}; i < pieces.size(); ++i) {
+        for (const auto& [off, sz] : pieces[i].slices) {
+            slice_iovs(iov, iovcnt, off, sz, ctx->iovs[i]);
+        }
+    }
+
+    // Pieces are on different pdevs, so they are all issued together and the append completes with the last of them
+    for (size_t i{0}; i < pieces.size(); ++i) {
+        auto* chunk = pieces[i].chunk;
+        async_writev_internal(ctx->iovs[i].data(), int_cast(ctx->iovs[i].size()), pieces[i].size,
+                              chunk->physical_dev_mutable(), chunk, chunk->start_offset() + pieces[i].offset_in_chunk,
+                              [ctx](std::error_condition err, void* cookie) {
+                                  if (err != no_error) {
+                                      std::unique_lock< std::mutex > lg{ctx->mtx};
+                                      if (ctx->err == no_error) { ctx->err = err; }
+                                  }
+                                  if (ctx->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                                      if (ctx->cb) { ctx->cb(ctx->err, cookie); }
+                                  }
+                              });
+    }
+}
+
+ssize_t JournalVirtualDev::sync_write_pieces(const iovec* iov, int iovcnt, const std::vector< stripe_piece >& pieces) {
+    if (pieces.size() == 1) {
+        auto* chunk = pieces[0].chunk;
+        return sync_writev_internal(iov, iovcnt, chunk->physical_dev_mutable(), chunk,
+                                    chunk->start_offset() + pieces[0].offset_in_chunk);
+    }
+
+    ssize_t total{0};
+    std::vector< iovec > piece_iovs;
+    for (const auto& p : pieces) {
+        piece_iovs.clear();
+        for (const auto& [off, sz] : p.slices) {
+            slice_iovs(iov, iovcnt, off, sz, piece_iovs);
+        }
+        auto const ret = sync_writev_internal(piece_iovs.data(), int_cast(piece_iovs.size()),
+                                              p.chunk->physical_dev_mutable(), p.chunk,
+                                              p.chunk->start_offset() + p.offset_in_chunk);
+        if (ret < 0) { return ret; }
+        total += ret;
+    }
+    return total;
 }
 
 #if 0
@@ -235,21 +378,32 @@ off_t JournalVirtualDev::process_pwrite_offset(size_t len, off_t offset, uint32_
 
 /////////////////////////////// Read Section //////////////////////////////////
 ssize_t JournalVirtualDev::sync_next_read(uint8_t* buf, size_t size_rd) {
-    uint32_t dev_id{0}, chunk_id{0};
-    off_t offset_in_chunk{0};
+    off_t next_cursor{0};
+    size_rd = next_read_size(m_seek_cursor, size_rd, next_cursor);
 
-    logical_to_dev_offset(m_seek_cursor, dev_id, chunk_id, offset_in_chunk);
+    auto const bytes_read = sync_pread(buf, size_rd, m_seek_cursor);
+    if (bytes_read != -1) {
+        // Update seek cursor after read;
+        HS_REL_ASSERT_EQ((size_t)bytes_read, size_rd, "bytes_read returned: {} must be equal to requested size: {}!",
+                         bytes_read, size_rd);
+        m_seek_cursor = next_cursor;
+    }
+
+    return bytes_read;
+}
 
-    auto* chunk = m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
+size_t JournalVirtualDev::next_read_size(off_t cursor, size_t size_rd, off_t& next_cursor) const {
+    off_t offset_in_chunk{0};
+    auto* chunk = segment_chunk(logical_to_segment(cursor, offset_in_chunk));
     auto const end_of_chunk = chunk->end_of_chunk();
-    auto const chunk_size = std::min< uint64_t >(end_of_chunk, m_chunk_size);
+    auto const chunk_size = std::min< uint64_t >(end_of_chunk, segment_size());
 
     bool across_chunk{false};
 
-    HS_REL_ASSERT_LE((uint64_t)end_of_chunk, m_chunk_size, "Invalid end of chunk: {} detected on chunk num: {}",
+    HS_REL_ASSERT_LE((uint64_t)end_of_chunk, segment_size(), "Invalid end of chunk: {} detected on chunk num: {}",
                      end_of_chunk, chunk->chunk_id());
     HS_REL_ASSERT_LE((uint64_t)offset_in_chunk, chunk_size,
-                     "Invalid m_seek_cursor: {} which falls in beyond end of chunk: {}!", m_seek_cursor, end_of_chunk);
+                     "Invalid cursor: {} which falls in beyond end of chunk: {}!", cursor, end_of_chunk);
 
     // if read size is larger then what's left in this chunk
     if (size_rd >= (chunk_size - offset_in_chunk)) {
@@ -258,59 +412,72 @@ ssize_t JournalVirtualDev::sync_next_read(uint8_t* buf, size_t size_rd) {
         across_chunk = true;
     }
 
-    auto const bytes_read = sync_pread(buf, size_rd, m_seek_cursor);
-    if (bytes_read != -1) {
-        // Update seek cursor after read;
-        HS_REL_ASSERT_EQ((size_t)bytes_read, size_rd, "bytes_read returned: {} must be equal to requested size: {}!",
-                         bytes_read, size_rd);
-        m_seek_cursor += bytes_read;
-        if (across_chunk) { m_seek_cursor += (m_chunk_size - end_of_chunk); }
-        m_seek_cursor = m_seek_cursor % size();
-    }
-
-    return bytes_read;
+    next_cursor = cursor + size_rd;
+    if (across_chunk) { next_cursor += (segment_size() - end_of_chunk); }
+    next_cursor = next_cursor % size();
+    return size_rd;
 }
 
 ssize_t JournalVirtualDev::sync_pread(uint8_t* buf, size_t size, off_t offset) {
-    uint32_t dev_id{0}, chunk_id{0};
     off_t offset_in_chunk{0};
-
-    const uint64_t offset_in_dev = logical_to_dev_offset(offset, dev_id, chunk_id, offset_in_chunk);
+    auto const seg = logical_to_segment(offset, offset_in_chunk);
 
     // if the read count is acrossing chunk, only return what's left in this chunk
-    if (m_chunk_size - offset_in_chunk < size) {
+    if (segment_size() - offset_in_chunk < size) {
         // truncate requsted read length to end of chunk;
-        size = m_chunk_size - offset_in_chunk;
+        size = segment_size() - offset_in_chunk;
     }
 
-    auto* pdev = m_primary_pdev_chunks_list[dev_id].pdev;
-    auto* pchunk = m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
-
-    return sync_read_internal(r_cast< char* >(buf), size, pdev, pchunk, offset_in_dev);
+    auto const pieces = split_by_stripe(seg, offset_in_chunk, size);
+    if (pieces.size() == 1) {
+        auto* pchunk = pieces[0].chunk;
+        return sync_read_internal(r_cast< char* >(buf), size, pchunk->physical_dev_mutable(), pchunk,
+                                  pchunk->start_offset() + pieces[0].offset_in_chunk);
+    }
+    iovec iov{buf, size};
+    return sync_read_pieces(&iov, 1, pieces);
 }
 
 ssize_t JournalVirtualDev::sync_preadv(iovec* iov, int iovcnt, off_t offset) {
-    uint32_t dev_id{0}, chunk_id{0};
     off_t offset_in_chunk{0};
-
     uint64_t len = VirtualDev::get_len(iov, iovcnt);
-    const uint64_t offset_in_dev = logical_to_dev_offset(offset, dev_id, chunk_id, offset_in_chunk);
+    auto const seg = logical_to_segment(offset, offset_in_chunk);
 
-    if (m_chunk_size - offset_in_chunk < len) {
+    if (segment_size() - offset_in_chunk < len) {
         HS_DBG_ASSERT_EQ(
             iovcnt, 1,
             "iovector more than 1 element is not supported when requested read len is acrossing chunk boundary.");
         if (iovcnt > 1) { return -1; }
 
         // truncate requsted read length to end of chunk;
-        len = m_chunk_size - offset_in_chunk;
+        len = segment_size() - offset_in_chunk;
         iov[0].iov_len = len; // is this needed?
     }
 
-    auto* pdev = m_primary_pdev_chunks_list[dev_id].pdev;
-    auto* chunk = m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
+    auto const pieces = split_by_stripe(seg, offset_in_chunk, len);
+    if (pieces.size() == 1) {
+        auto* chunk = pieces[0].chunk;
+        return sync_readv_internal(iov, iovcnt, len, chunk->physical_dev_mutable(), chunk,
+                                   chunk->start_offset() + pieces[0].offset_in_chunk);
+    }
+    return sync_read_pieces(iov, iovcnt, pieces);
+}
 
-    return sync_readv_internal(iov, iovcnt, len, pdev, chunk, offset_in_dev);
+ssize_t JournalVirtualDev::sync_read_pieces(const iovec* iov, int iovcnt, const std::vector< stripe_piece >& pieces) {
+    ssize_t total{0};
+    std::vector< iovec > piece_iovs;
+    for (const auto& p : pieces) {
+        piece_iovs.clear();
+        for (const auto& [off, sz] : p.slices) {
+            slice_iovs(iov, iovcnt, off, sz, piece_iovs);
+        }
+        auto const ret = sync_readv_internal(piece_iovs.data(), int_cast(piece_iovs.size()), p.size,
+                                             p.chunk->physical_dev_mutable(), p.chunk,
+                                             p.chunk->start_offset() + p.offset_in_chunk);
+        if (ret < 0) { return ret; }
+        total += ret;
+    }
+    return total;
 }
 
 off_t JournalVirtualDev::lseek(off_t offset, int whence) {
@@ -335,20 +502,17 @@ off_t JournalVirtualDev::lseek(off_t offset, int whence) {
  */
 off_t JournalVirtualDev::dev_offset(off_t nbytes) const {
     off_t vdev_offset = data_start_offset();
-    uint32_t dev_id{0}, chunk_id{0};
     off_t offset_in_chunk{0};
     off_t cur_read_cur{0};
 
     while (cur_read_cur != nbytes) {
-        logical_to_dev_offset(vdev_offset, dev_id, chunk_id, offset_in_chunk);
-
-        auto* chunk = m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
+        auto const* chunk = segment_chunk(logical_to_segment(vdev_offset, offset_in_chunk));
         auto const end_of_chunk = chunk->end_of_chunk();
-        auto const chunk_size{std::min< uint64_t >(end_of_chunk, m_chunk_size)};
+        auto const chunk_size{std::min< uint64_t >(end_of_chunk, segment_size())};
         auto const remaining = nbytes - cur_read_cur;
         if (remaining >= (static_cast< off_t >(chunk_size) - offset_in_chunk)) {
             cur_read_cur += (chunk_size - offset_in_chunk);
-            vdev_offset += (m_chunk_size - offset_in_chunk);
+            vdev_offset += (segment_size() - offset_in_chunk);
             vdev_offset = vdev_offset % size();
         } else {
             vdev_offset += remaining;
@@ -417,38 +581,24 @@ void JournalVirtualDev::truncate(off_t offset) {
     m_truncate_done = true;
 }
 
-uint64_t JournalVirtualDev::get_offset_in_dev(uint32_t dev_id, uint32_t chunk_id, uint64_t offset_in_chunk) const {
-    return get_chunk_start_offset(dev_id, chunk_id) + offset_in_chunk;
+uint32_t JournalVirtualDev::logical_to_segment(off_t log_offset, off_t& offset_in_segment) const {
+    auto const seg = s_cast< uint32_t >(uint64_cast(log_offset) / segment_size());
+    HS_DBG_ASSERT_LT(seg, num_segments(), "Input log_offset is invalid: {}, should be between 0 ~ {}", log_offset,
+                     size());
+    offset_in_segment = s_cast< off_t >(uint64_cast(log_offset) % segment_size());
+    return seg;
 }
 
-uint64_t JournalVirtualDev::get_chunk_start_offset(uint32_t dev_id, uint32_t chunk_id) const {
-    return m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id]->start_offset();
-}
+PhysicalDevChunk* JournalVirtualDev::segment_chunk(uint32_t seg, uint32_t member) const {
+    if (m_stripe_width > 1) { return m_primary_pdev_chunks_list[member].chunks_in_pdev[seg]; }
 
-uint64_t JournalVirtualDev::logical_to_dev_offset(off_t log_offset, uint32_t& dev_id, uint32_t& chunk_id,
-                                                  off_t& offset_in_chunk) const {
-    dev_id = 0;
-    chunk_id = 0;
-    offset_in_chunk = 0;
-
-    uint64_t off_l{static_cast< uint64_t >(log_offset)};
-    for (size_t d{0}; d < m_primary_pdev_chunks_list.size(); ++d) {
-        for (size_t c{0}; c < m_primary_pdev_chunks_list[d].chunks_in_pdev.size(); ++c) {
-            if (off_l >= m_chunk_size) {
-                off_l -= m_chunk_size;
-            } else {
-                dev_id = d;
-                chunk_id = c;
-                offset_in_chunk = off_l;
-
-                return get_offset_in_dev(dev_id, chunk_id, offset_in_chunk);
-            }
-        }
+    // Without striping, segments are the chunks of first pdev followed by the chunks of the next one and so on
+    for (const auto& pcm : m_primary_pdev_chunks_list) {
+        if (seg < pcm.chunks_in_pdev.size()) { return pcm.chunks_in_pdev[seg]; }
+        seg -= s_cast< uint32_t >(pcm.chunks_in_pdev.size());
     }
-
-    HS_DBG_ASSERT(false, "Input log_offset is invalid: {}, should be between 0 ~ {}", log_offset,
-                  m_chunk_size * m_num_chunks);
-    return 0;
+    HS_DBG_ASSERT(false, "Invalid segment: {}, num segments: {}", seg, num_segments());
+    return nullptr;
 }
 
 void JournalVirtualDev::high_watermark_check() {
@@ -465,13 +615,9 @@ void JournalVirtualDev::high_watermark_check() {
 }
 
 bool JournalVirtualDev::is_alloc_accross_chunk(size_t size) {
-    off_t offset_in_chunk{0};
-    const off_t end_offset = tail_offset();
-    uint32_t dev_id{0}, chunk_id{0};
-
-    logical_to_dev_offset(end_offset, dev_id, chunk_id, offset_in_chunk);
-
-    return (offset_in_chunk + size > m_chunk_size);
+    off_t offset_in_seg{0};
+    logical_to_segment(tail_offset(), offset_in_seg);
+    return (offset_in_seg + size > segment_size());
 }
 
 nlohmann::json JournalVirtualDev::get_status(int log_level) const {
@@ -481,7 +627,9 @@ nlohmann::json JournalVirtualDev::get_status(int log_level) const {
     j["JournalVirtualDev"]["data_start_offset"] = m_data_start_offset;
     j["JournalVirtualDev"]["write_size"] = m_write_sz_in_total.load(std::memory_order_relaxed);
     j["JournalVirtualDev"]["truncate_done"] = m_truncate_done;
-    j["JournalVirtualDev"]["reserved_size"] = m_reserved_sz;
+    j["JournalVirtualDev"]["reserved_size"] = m_reserved_sz.load();
+    j["JournalVirtualDev"]["stripe_width"] = m_stripe_width;
+    j["JournalVirtualDev"]["stripe_unit"] = m_stripe_unit;
     return j;
 }
 } // namespace homestore
@@ -19,6 +19,8 @@
 #include <atomic>
 #include <functional>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "device.h"
 #include "virtual_dev.hpp"
@@ -26,6 +28,15 @@
 namespace homestore {
 typedef std::function< void(const off_t ret_off) > alloc_next_blk_cb_t;
 
+/*
+ * JournalVirtualDev: Circular log over the chunks of the vdev, addressed by a logical offset. The logical space is a
+ * sequence of segments and an append never crosses a segment, the unused tail of a segment being recorded as its end
+ * in the first chunk of the segment.
+ *
+ * If the vdev is striped across pdevs, a segment is the chunk at the same index on every pdev and its space is laid
+ * round robin across them in stripe units, so that an append is written as one io per pdev it spans, all in parallel
+ * and consecutive appends rotate across the pdevs. Otherwise a segment is just a chunk.
+ */
 class JournalVirtualDev : public VirtualDev {
     struct Chunk_EOF_t {
         uint64_t e;
@@ -45,7 +56,18 @@ private:
     std::atomic< uint64_t > m_write_sz_in_total{0}; // this size will be decreased by truncate and increased by append;
     bool m_truncate_done{true};
     vdev_high_watermark_cb_t m_hwm_cb{nullptr};
-    uint64_t m_reserved_sz{0}; // write size within chunk, used to check chunk boundary;
+    std::atomic< uint64_t > m_reserved_sz{0}; // write size within chunk, used to check chunk boundary;
+    uint32_t m_stripe_width{1}; // Number of pdevs each segment is striped across
+    uint64_t m_stripe_unit{0};  // Bytes laid on a pdev before moving to the next one within a segment
+
+    // Part of an io which falls on one chunk of the segment. Slices are the parts of the caller's buffer, as
+    // (offset, size), which are laid contiguously on the chunk.
+    struct stripe_piece {
+        PhysicalDevChunk* chunk{nullptr};
+        uint64_t offset_in_chunk{0};
+        uint64_t size{0};
+        std::vector< std::pair< uint64_t, uint64_t > > slices;
+    };
 
 public:
     /* Create a new virtual dev for these parameters */
@@ -54,12 +76,18 @@ public:
                       bool auto_recovery = false, vdev_high_watermark_cb_t hwm_cb = nullptr) :
             VirtualDev{mgr,     name,         pdev_group,    blk_allocator_type_t::none,
                        size_in, nmirror,      is_stripe,     blk_size,
-                       context, context_size, auto_recovery, hwm_cb} {}
+                       context, context_size, auto_recovery, hwm_cb} {
+        set_io_class(io_class_t::latency, io_class_t::latency);
+        init_stripe(true /* is_init */);
+    }
 
     /* Load the virtual dev from vdev_info_block and create a Virtual Dev. */
     JournalVirtualDev(DeviceManager* mgr, const char* name, vdev_info_block* vb, PhysicalDevGroup pdev_group,
                       bool recovery_init, bool auto_recovery = false, vdev_high_watermark_cb_t hwm_cb = nullptr) :
-            VirtualDev(mgr, name, vb, pdev_group, blk_allocator_type_t::none, recovery_init, auto_recovery, hwm_cb) {}
+            VirtualDev(mgr, name, vb, pdev_group, blk_allocator_type_t::none, recovery_init, auto_recovery, hwm_cb) {
+        set_io_class(io_class_t::latency, io_class_t::latency);
+        init_stripe(false /* is_init */);
+    }
 
     JournalVirtualDev(const JournalVirtualDev& other) = delete;
     JournalVirtualDev& operator=(const JournalVirtualDev& other) = delete;
@@ -149,6 +177,18 @@ public:
      */
     ssize_t sync_next_read(uint8_t* buf, size_t count_in);
 
+    /**
+     * @brief : get the size sync_next_read would read at the cursor, without doing the read. It lets the callers
+     * issue the reads of the stream ahead with sync_pread, without moving the cursor of the device.
+     *
+     * @param cursor : the logical offset of the read
+     * @param count : the size wanted to be read
+     * @param next_cursor : the cursor of the read which follows this one
+     *
+     * @return : the size which could be read at the cursor, which is smaller than count at the end of chunk.
+     */
+    size_t next_read_size(off_t cursor, size_t count, off_t& next_cursor) const;
+
     /**
      * @brief : reads up to count bytes at offset into the buffer starting at buf.
      * The curosr is not updated.
@@ -260,7 +300,9 @@ public:
      *
      * @return : the used space in vdev
      */
-    uint64_t used_size() const override { return m_write_sz_in_total.load(std::memory_order_relaxed) + m_reserved_sz; }
+    uint64_t used_size() const override {
+        return m_write_sz_in_total.load(std::memory_order_relaxed) + m_reserved_sz.load(std::memory_order_relaxed);
+    }
 
     /**
      * @brief : get the free space left in vdev
@@ -276,6 +318,11 @@ public:
      */
     uint64_t available_blks() const override { return available_size() / block_size(); }
 
+    /**
+     * @brief : get the number of pdevs the appends are striped across, 1 if not striped
+     */
+    uint32_t stripe_width() const { return m_stripe_width; }
+
     /**
      * @brief Get the status of the journal vdev and its internal structures
      * @param log_level: Log level to do verbosity.
@@ -337,43 +384,46 @@ private:
      *
      * @return : the unique offset
      */
-    auto process_pwrite_offset(size_t len, off_t offset);
+    std::vector< stripe_piece > process_pwrite_offset(size_t len, off_t offset);
     void do_pwrite(const uint8_t* buf, size_t count, off_t offset, vdev_io_comp_cb_t cb);
 
     /**
-     * @brief : convert logical offset in chunk to the physical device offset
-     *
-     * @param dev_id : the device id
-     * @param chunk_id : the chunk id;
-     * @param offset_in_chunk : the logical offset in chunk;
+     * @brief : Decide the segment layout from the persisted stripe unit and the chunks of the vdev
      *
-     * @return : the physical device offset;
+     * @param is_init : true if the vdev is being created, in which case the end of every segment is initialized
      */
-    uint64_t get_offset_in_dev(uint32_t dev_id, uint32_t chunk_id, uint64_t offset_in_chunk) const;
+    void init_stripe(bool is_init);
+
+    uint64_t segment_size() const { return m_chunk_size * m_stripe_width; }
+    uint32_t num_segments() const { return m_num_chunks / m_stripe_width; }
 
     /**
-     * @brief : get the physical start offset of the chunk;
+     * @brief : Convert from logical offset to the segment and the offset within it
      *
-     * @param dev_id : the deivce id;
-     * @param chunk_id : the chunk id;
+     * @param log_offset : the logical offset
+     * @param offset_in_segment : the relative offset in segment after conversion
      *
-     * @return : the physical start offset of the chunk;
+     * @return : the segment number
      */
-    uint64_t get_chunk_start_offset(uint32_t dev_id, uint32_t chunk_id) const;
+    uint32_t logical_to_segment(off_t log_offset, off_t& offset_in_segment) const;
 
     /**
-     * @brief : Convert from logical offset to device offset.
-     * It handles device overloop, e.g. reach to end of the device then start from the beginning device
-     *
-     * @param log_offset : the logical offset
-     * @param dev_id     : the device id after convertion
-     * @param chunk_id   : the chunk id after convertion
-     * @param offset_in_chunk : the relative offset in chunk
-     *
-     * @return : the unique offset after converion;
+     * @brief : get the chunk of the segment on the member'th pdev it is striped across. First chunk of the segment
+     * holds its end.
+     */
+    PhysicalDevChunk* segment_chunk(uint32_t seg, uint32_t member = 0) const;
+
+    /**
+     * @brief : Split the range within the segment into one piece per chunk it falls on
      */
-    uint64_t logical_to_dev_offset(off_t log_offset, uint32_t& dev_id, uint32_t& chunk_id,
-                                   off_t& offset_in_chunk) const;
+    std::vector< stripe_piece > split_by_stripe(uint32_t seg, off_t offset_in_seg, uint64_t len) const;
+
+    void async_write_pieces(const uint8_t* buf, size_t size, const std::vector< stripe_piece >& pieces,
+                            vdev_io_comp_cb_t cb);
+    void async_write_striped(const iovec* iov, int iovcnt, const std::vector< stripe_piece >& pieces,
+                             vdev_io_comp_cb_t cb);
+    ssize_t sync_write_pieces(const iovec* iov, int iovcnt, const std::vector< stripe_piece >& pieces);
+    ssize_t sync_read_pieces(const iovec* iov, int iovcnt, const std::vector< stripe_piece >& pieces);
 
     bool validate_append_size(size_t count) const;
 
@@ -0,0 +1,248 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <system_error>
+#include <thread>
+
+#include <sys/mman.h>
+
+#include <sisl/fds/utils.hpp>
+#include <sisl/logging/logging.h>
+
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+#include "mem_drive.hpp"
+
+namespace homestore {
+static constexpr uint64_t mem_drive_hugepage_size{2 * 1024 * 1024};
+
+static std::mutex s_mem_drives_mtx;
+static std::map< std::string, std::shared_ptr< MemDrive > > s_mem_drives;
+
+/* Splits "mem:<name>[:<size_mb>]" into the name of the drive and its size in bytes */
+static std::pair< std::string, uint64_t > parse_mem_devname(const std::string& devname) {
+    auto name = devname.substr(std::strlen(MemDrive::s_name_prefix));
+    uint64_t size_mb = HS_DYNAMIC_CONFIG(device.mem_drive_default_size_mb);
+
+    auto const pos = name.rfind(':');
+    if ((pos != std::string::npos) && (pos + 1 < name.size()) &&
+        std::all_of(name.cbegin() + pos + 1, name.cend(), [](char c) { return std::isdigit(c); })) {
+        size_mb = std::stoull(name.substr(pos + 1));
+        name.resize(pos);
+    }
+    return {name, size_mb * 1024 * 1024};
+}
+
+bool MemDrive::is_mem_drive(const std::string& devname) { return (devname.rfind(s_name_prefix, 0) == 0); }
+
+std::shared_ptr< MemDrive > MemDrive::open(const std::string& devname) {
+    auto const [name, size] = parse_mem_devname(devname);
+
+    std::unique_lock< std::mutex > lg{s_mem_drives_mtx};
+    auto it = s_mem_drives.find(name);
+    if (it == s_mem_drives.end()) {
+        it = s_mem_drives.emplace(name, std::make_shared< MemDrive >(devname, size)).first;
+    } else if (it->second->size() != size) {
+        LOGWARN("Memory drive {} is already created with size={}, ignoring the size={} asked now", name,
+                it->second->size(), size);
+    }
+    return it->second;
+}
+
+void MemDrive::remove(const std::string& devname) {
+    std::unique_lock< std::mutex > lg{s_mem_drives_mtx};
+    s_mem_drives.erase(parse_mem_devname(devname).first);
+}
+
+MemDrive::MemDrive(const std::string& devname, uint64_t size) :
+        m_devname{devname}, m_size{size}, m_mapped_size{sisl::round_up(size, mem_drive_hugepage_size)} {
+    // Prefer the reserved hugepages, failing which ask for transparent hugepages
+    void* mem = ::mmap(nullptr, m_mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1,
+                       0);
+    if (mem == MAP_FAILED) {
+        mem = ::mmap(nullptr, m_mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                     0);
+        if (mem == MAP_FAILED) {
+            throw std::system_error(errno, std::system_category(), "error while mapping memory drive " + devname);
+        }
+        ::madvise(mem, m_mapped_size, MADV_HUGEPAGE);
+    }
+    m_base = r_cast< uint8_t* >(mem);
+    LOGINFO("Created memory drive {} of size={}", m_devname, in_bytes(m_size));
+}
+
+MemDrive::~MemDrive() {
+    if (m_base) { ::munmap(m_base, m_mapped_size); }
+}
+
+void MemDrive::attach_completion_cb(const iomgr::io_interface_comp_cb_t& cb) {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    m_comp_cb = cb;
+}
+
+iomgr::drive_attributes MemDrive::attributes() {
+    iomgr::drive_attributes attr;
+    attr.phys_page_size = 4096;
+    attr.align_size = 512;
+    attr.atomic_phys_page_size = 4096;
+    attr.num_streams = 1;
+    return attr;
+}
+
+ssize_t MemDrive::sync_read(char* data, uint32_t size, uint64_t offset) {
+    iovec iov{data, size};
+    return sync_readv(&iov, 1, size, offset);
+}
+
+ssize_t MemDrive::sync_readv(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset) {
+    if (!copy_out(iov, iovcnt, size, offset)) {
+        errno = EINVAL;
+        return -1;
+    }
+    complete_sync(charge(size, true /* is_read */));
+    return size;
+}
+
+ssize_t MemDrive::sync_write(const char* data, uint32_t size, uint64_t offset) {
+    iovec iov{const_cast< char* >(data), size};
+    return sync_writev(&iov, 1, size, offset);
+}
+
+ssize_t MemDrive::sync_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset) {
+    if (!copy_in(iov, iovcnt, size, offset)) {
+        errno = EINVAL;
+        return -1;
+    }
+    complete_sync(charge(size, false /* is_read */));
+    return size;
+}
+
+void MemDrive::async_read(char* data, uint32_t size, uint64_t offset, uint8_t* cookie) {
+    iovec iov{data, size};
+    async_readv(&iov, 1, size, offset, cookie);
+}
+
+void MemDrive::async_readv(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset, uint8_t* cookie) {
+    // Data is copied right away, since the caller is not supposed to look at the buffer till it is completed
+    if (!copy_out(iov, iovcnt, size, offset)) {
+        complete_async(Clock::now(), -EINVAL, cookie);
+        return;
+    }
+    complete_async(charge(size, true /* is_read */), 0, cookie);
+}
+
+void MemDrive::async_write(const char* data, uint32_t size, uint64_t offset, uint8_t* cookie) {
+    iovec iov{const_cast< char* >(data), size};
+    async_writev(&iov, 1, size, offset, cookie);
+}
+
+void MemDrive::async_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset, uint8_t* cookie) {
+    if (!copy_in(iov, iovcnt, size, offset)) {
+        complete_async(Clock::now(), -EINVAL, cookie);
+        return;
+    }
+    complete_async(charge(size, false /* is_read */), 0, cookie);
+}
+
+void MemDrive::fsync(uint8_t* cookie) { complete_async(Clock::now(), 0, cookie); }
+
+void MemDrive::write_zero(uint64_t size, uint64_t offset, uint8_t* cookie) {
+    if (offset + size > m_size) {
+        complete_async(Clock::now(), -EINVAL, cookie);
+        return;
+    }
+    std::memset(m_base + offset, 0, size);
+    complete_async(charge(size, false /* is_read */), 0, cookie);
+}
+
+int MemDrive::discard(uint64_t size, uint64_t offset) {
+    if (offset + size > m_size) { return EINVAL; }
+
+    // Give the whole hugepages within the range back to the system, which are read as zeros afterwards
+    auto const start = sisl::round_up(offset, mem_drive_hugepage_size);
+    auto const end = sisl::round_down(offset + size, mem_drive_hugepage_size);
+    if ((end > start) && (::madvise(m_base + start, end - start, MADV_DONTNEED) != 0)) { return errno; }
+    return 0;
+}
+
+bool MemDrive::copy_in(const iovec* iov, int iovcnt, uint64_t size, uint64_t offset) {
+    if (offset + size > m_size) { return false; }
+    for (int i{0}; (i < iovcnt) && (size > 0); ++i) {
+        auto const len = std::min< uint64_t >(iov[i].iov_len, size);
+        std::memcpy(m_base + offset, iov[i].iov_base, len);
+        offset += len;
+        size -= len;
+    }
+    return true;
+}
+
+bool MemDrive::copy_out(const iovec* iov, int iovcnt, uint64_t size, uint64_t offset) const {
+    if (offset + size > m_size) { return false; }
+    for (int i{0}; (i < iovcnt) && (size > 0); ++i) {
+        auto const len = std::min< uint64_t >(iov[i].iov_len, size);
+        std::memcpy(iov[i].iov_base, m_base + offset, len);
+        offset += len;
+        size -= len;
+    }
+    return true;
+}
+
+Clock::time_point MemDrive::charge(uint64_t size, bool is_read) {
+    auto const now = Clock::now();
+    auto const bw_mbps = HS_DYNAMIC_CONFIG(device.mem_drive_bandwidth_mbps);
+    auto const latency = std::chrono::microseconds{is_read ? HS_DYNAMIC_CONFIG(device.mem_drive_read_latency_us)
+                                                           : HS_DYNAMIC_CONFIG(device.mem_drive_write_latency_us)};
+    if (bw_mbps == 0) { return now + latency; }
+
+    // The drive transfers one io at a time, so the io waits for the ones issued before it
+    auto const xfer_time = std::chrono::nanoseconds{
+        static_cast< uint64_t >(static_cast< double >(size) * 1000000000.0 / (bw_mbps * 1024.0 * 1024.0))};
+    std::unique_lock< std::mutex > lg{m_mtx};
+    m_busy_until = std::max(m_busy_until, now) + xfer_time;
+    return m_busy_until + latency;
+}
+
+void MemDrive::complete_sync(Clock::time_point done_time) const {
+    if (done_time > Clock::now()) { std::this_thread::sleep_until(done_time); }
+}
+
+void MemDrive::complete_async(Clock::time_point done_time, int64_t res, uint8_t* cookie) {
+    auto comp_cb = [self = shared_from_this(), res, cookie]() { self->m_comp_cb(res, cookie); };
+
+    auto const now = Clock::now();
+    if (!iomanager.am_i_io_reactor()) {
+        if (done_time <= now) {
+            comp_cb();
+        } else {
+            iomanager.schedule_global_timer(
+                std::chrono::duration_cast< std::chrono::nanoseconds >(done_time - now).count(), false /* recurring */,
+                nullptr /* cookie */, iomgr::thread_regex::all_io, [comp_cb](void*) { comp_cb(); });
+        }
+    } else if (done_time <= now) {
+        // Caller doesn't expect the completion before the submit returns, so defer it to the next loop of the reactor
+        iomanager.run_on(iomanager.iothread_self(), [comp_cb](io_thread_addr_t) { comp_cb(); });
+    } else {
+        iomanager.schedule_thread_timer(std::chrono::duration_cast< std::chrono::nanoseconds >(done_time - now).count(),
+                                        false /* recurring */, nullptr /* cookie */,
+                                        [comp_cb](void*) { comp_cb(); });
+    }
+}
+} // namespace homestore
@@ -0,0 +1,103 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <iomgr/iomgr.hpp>
+
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+
+/*
+ * MemDrive: A drive backed by an anonymous memory region (hugepages where available) instead of a real device, with a
+ * configurable latency and bandwidth model. It is used by the benchmarks, to measure HomeStore itself on a repeatable
+ * device rather than the noise of whatever drive the test machine has.
+ *
+ * Devices are named "mem:<name>[:<size_mb>]" and PhysicalDev does all its io on a MemDrive instead of the iomgr drive
+ * interface for such names. The region of a name lives till the process exits or it is removed, so that HomeStore
+ * could be restarted on it in the same process to benchmark the recovery as well.
+ *
+ * Every io is charged size / bandwidth of drive time, queued behind the ios already issued on the drive, plus the
+ * fixed latency of its kind. Sync ios block the caller till then, while async ios are completed through the attached
+ * completion callback on the issuing reactor once that time has elapsed.
+ */
+class MemDrive : public std::enable_shared_from_this< MemDrive > {
+public:
+    static constexpr const char* s_name_prefix{"mem:"};
+
+    static bool is_mem_drive(const std::string& devname);
+
+    /// @brief Get the drive of this name, creating it if it is not there already.
+    static std::shared_ptr< MemDrive > open(const std::string& devname);
+
+    /// @brief Release the memory of the drive, once the users which have it open are done with it.
+    static void remove(const std::string& devname);
+
+    MemDrive(const std::string& devname, uint64_t size);
+    MemDrive(const MemDrive&) = delete;
+    MemDrive(MemDrive&&) noexcept = delete;
+    MemDrive& operator=(const MemDrive&) = delete;
+    MemDrive& operator=(MemDrive&&) noexcept = delete;
+    ~MemDrive();
+
+    void attach_completion_cb(const iomgr::io_interface_comp_cb_t& cb);
+    uint64_t size() const { return m_size; }
+    const std::string& devname() const { return m_devname; }
+    static iomgr::drive_attributes attributes();
+
+    ssize_t sync_read(char* data, uint32_t size, uint64_t offset);
+    ssize_t sync_readv(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset);
+    ssize_t sync_write(const char* data, uint32_t size, uint64_t offset);
+    ssize_t sync_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset);
+
+    void async_read(char* data, uint32_t size, uint64_t offset, uint8_t* cookie);
+    void async_readv(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset, uint8_t* cookie);
+    void async_write(const char* data, uint32_t size, uint64_t offset, uint8_t* cookie);
+    void async_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset, uint8_t* cookie);
+    void fsync(uint8_t* cookie);
+    void write_zero(uint64_t size, uint64_t offset, uint8_t* cookie);
+
+    /// @brief Returns 0 on success or the errno
+    int discard(uint64_t size, uint64_t offset);
+
+private:
+    bool copy_in(const iovec* iov, int iovcnt, uint64_t size, uint64_t offset);
+    bool copy_out(const iovec* iov, int iovcnt, uint64_t size, uint64_t offset) const;
+
+    // Returns the time at which the io of this size would be complete on the drive
+    Clock::time_point charge(uint64_t size, bool is_read);
+    void complete_sync(Clock::time_point done_time) const;
+    void complete_async(Clock::time_point done_time, int64_t res, uint8_t* cookie);
+
+private:
+    std::string m_devname;
+    uint8_t* m_base{nullptr};
+    uint64_t m_size;
+    uint64_t m_mapped_size;
+
+    std::mutex m_mtx;
+    Clock::time_point m_busy_until; // Time till which the drive is busy transferring the ios already issued
+    iomgr::io_interface_comp_cb_t m_comp_cb;
+};
+} // namespace homestore
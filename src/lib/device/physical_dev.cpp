@@ -13,6 +13,8 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <exception>
 #include <iostream>
@@ -24,6 +26,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #endif
 
 #include <folly/Exception.h>
@@ -50,7 +53,8 @@ size_t dm_info::s_dm_info_block_size{sizeof(dm_info) + s_pdev_info_blocks_size +
 
 // this constructor is to read superblock to determine whether it is first time boot;
 //
-PhysicalDev::PhysicalDev(const std::string& devname, int oflags) : m_devname{devname}, m_metrics{devname} {
+PhysicalDev::PhysicalDev(const std::string& devname, int oflags) :
+        m_devname{devname}, m_metrics{devname}, m_io_sched{devname} {
     read_and_fill_superblock(oflags);
 }
 
@@ -59,7 +63,7 @@ PhysicalDev::PhysicalDev(const std::string& devname, int oflags) : m_devname{dev
 PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int oflags, const hs_uuid_t& system_uuid,
                          uint32_t dev_num, uint64_t dev_offset, bool is_init, uint64_t dm_info_size,
                          const iomgr::io_interface_comp_cb_t& io_comp_cb, bool* is_inited) :
-        m_mgr{mgr}, m_devname{devname}, m_metrics{devname} {
+        m_mgr{mgr}, m_devname{devname}, m_metrics{devname}, m_io_sched{devname} {
     read_and_fill_superblock(oflags);
 
     if (is_init) { m_super_blk->set_system_uuid(system_uuid); }
@@ -69,7 +73,8 @@ PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int ofl
 
     int oflags_used = oflags;
     if (devname.find("/tmp") == 0 ||
-        ((m_drive_iface->interface_type() == drive_interface_type::uring) && !m_mgr->is_hdd_direct_io_mode())) {
+        (m_drive_iface && (m_drive_iface->interface_type() == drive_interface_type::uring) &&
+         !m_mgr->is_hdd_direct_io_mode())) {
         // tmp directory in general does not allow Direct I/O
         LOGINFO("Trying to remove O_DIRECT bit from open flags: before: {}, after: {}", oflags_used,
                 oflags & (~O_DIRECT));
@@ -78,8 +83,8 @@ PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int ofl
 
     LOGINFO("Opening device {} with {} mode.", devname, oflags_used & O_DIRECT ? "DIRECT_IO" : "BUFFERED_IO");
 
-    m_iodev = iomgr::DriveInterface::open_dev(devname, oflags_used);
-    if (m_iodev == nullptr
+    open_drive(devname, oflags_used);
+    if ((!m_mem_drive && (m_iodev == nullptr))
 #ifdef _PRERELEASE
         || (homestore_flip->test_flip("device_boot_fail", devname.c_str()))
 #endif
@@ -89,12 +94,15 @@ PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int ofl
         HS_LOG(ERROR, device, "device open failed errno {} dev_name {}", errno, devname.c_str());
         throw std::system_error(errno, std::system_category(), "error while opening the device");
     }
-    m_drive_iface = m_iodev->drive_interface();
-    m_drive_iface->attach_completion_cb(io_comp_cb);
+    if (m_mem_drive) {
+        m_mem_drive->attach_completion_cb(io_comp_cb);
+    } else {
+        m_drive_iface->attach_completion_cb(io_comp_cb);
+    }
 
     // Get the device size
     try {
-        m_devsize = m_drive_iface->get_size(m_iodev.get());
+        m_devsize = m_mem_drive ? m_mem_drive->size() : m_drive_iface->get_size(m_iodev.get());
     } catch (std::exception& e) {
         free_superblock();
         throw(e);
@@ -111,7 +119,7 @@ PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int ofl
     if (m_devsize != current_size) {
         LOGWARN("device size is not the multiple of physical page size old size {}", current_size);
     }
-    LOGINFO("Device {} opened with dev_id={} size={}", m_devname, m_iodev->dev_id(), in_bytes(m_devsize));
+    LOGINFO("Device {} opened with dev_id={} size={}", m_devname, drive_dev_id(), in_bytes(m_devsize));
     m_dm_chunk[0] = m_dm_chunk[1] = nullptr;
     if (is_init) {
         /* create a chunk */
@@ -215,17 +223,15 @@ void PhysicalDev::read_and_fill_superblock(int oflags) {
     auto const minimal_sb_size = super_block::s_min_sb_size;
     alloc_superblock(minimal_sb_size, 512);
 
-    m_iodev = iomgr::DriveInterface::open_dev(m_devname, oflags);
-    m_drive_iface = m_iodev->drive_interface();
-
-    auto const bytes_read = m_drive_iface->sync_read(m_iodev.get(), reinterpret_cast< char* >(m_super_blk),
-                                                     static_cast< uint32_t >(minimal_sb_size), 0);
+    open_drive(m_devname, oflags);
+    auto const bytes_read =
+        drive_sync_read(reinterpret_cast< char* >(m_super_blk), static_cast< uint32_t >(minimal_sb_size), 0);
     if (sisl_unlikely((bytes_read < 0) || (static_cast< size_t >(bytes_read) != minimal_sb_size))) {
         throw std::system_error(errno, std::system_category(), "error while reading a superblock" + get_devname());
     }
 
     bool is_init_required = false;
-    auto const iomgr_attr = iomgr::DriveInterface::get_attributes(m_devname);
+    auto const iomgr_attr = m_mem_drive ? MemDrive::attributes() : iomgr::DriveInterface::get_attributes(m_devname);
     LOGINFO("Device Superblock {}", m_super_blk->to_string());
 
     if (validate_device()) {
@@ -299,12 +305,12 @@ bool PhysicalDev::load_super_block(const hs_uuid_t& system_uuid) {
 void PhysicalDev::read_dm_chunk(char* const mem, const uint64_t size) {
     HS_DBG_ASSERT_EQ(m_super_blk->dm_chunk[m_cur_indx & s_dm_chunk_mask].get_chunk_size(), size);
     auto const offset = m_super_blk->dm_chunk[m_cur_indx & s_dm_chunk_mask].chunk_start_offset;
-    m_drive_iface->sync_read(m_iodev.get(), mem, size, offset);
+    drive_sync_read(mem, size, offset);
 }
 
 void PhysicalDev::write_dm_chunk(const uint64_t gen_cnt, const char* const mem, const uint64_t size) {
     auto const offset = m_dm_chunk[(++m_cur_indx) & s_dm_chunk_mask]->start_offset();
-    m_drive_iface->sync_write(m_iodev.get(), mem, size, offset);
+    drive_sync_write(mem, size, offset);
     write_super_block(gen_cnt);
 }
 
@@ -348,11 +354,13 @@ void PhysicalDev::zero_boot_sbs(const std::vector< dev_info >& devices, int ofla
         HS_LOG_ASSERT_LE(sizeof(super_block), superblock_size,
                          "Device {} Ondisk Superblock size not enough to hold in-mem", dev_str);
         // open device
-        auto iodev = iomgr::DriveInterface::open_dev(dev_str, oflags);
+        const bool is_mem_drive{MemDrive::is_mem_drive(dev_str)};
+        auto iodev = is_mem_drive ? nullptr : iomgr::DriveInterface::open_dev(dev_str, oflags);
 
         // write zeroed sb to disk
-        auto const bytes =
-            iodev->drive_interface()->sync_write(iodev.get(), (const char*)super_blk, superblock_size, 0);
+        auto const bytes = is_mem_drive
+            ? MemDrive::open(dev_str)->sync_write((const char*)super_blk, superblock_size, 0)
+            : iodev->drive_interface()->sync_write(iodev.get(), (const char*)super_blk, superblock_size, 0);
         if (sisl_unlikely((bytes < 0) || (static_cast< size_t >(bytes) != superblock_size))) {
             LOGINFO("Failed to zeroed superblock of device: {}, errno: {}", dev_str, errno);
             throw std::system_error(errno, std::system_category(), "error while writing a superblock" + dev_str);
@@ -361,7 +369,7 @@ void PhysicalDev::zero_boot_sbs(const std::vector< dev_info >& devices, int ofla
         LOGINFO("Successfully zeroed superblock of device: {}", dev_str);
 
         // close device;
-        iodev->drive_interface()->close_dev(iodev);
+        if (iodev) { iodev->drive_interface()->close_dev(iodev); }
         // free super_blk
         hs_utils::iobuf_free(reinterpret_cast< uint8_t* >(super_blk), sisl::buftag::superblk);
     }
@@ -377,7 +385,33 @@ bool PhysicalDev::has_valid_superblock(hs_uuid_t& out_uuid) {
     return ret;
 }
 
-void PhysicalDev::close_device() { m_drive_iface->close_dev(m_iodev); }
+void PhysicalDev::close_device() {
+    // Memory backed drive stays around, so that it could be opened again on restart
+    if (m_mem_drive) {
+        m_mem_drive.reset();
+    } else {
+        m_drive_iface->close_dev(m_iodev);
+    }
+}
+
+void PhysicalDev::open_drive(const std::string& devname, int oflags) {
+    if (MemDrive::is_mem_drive(devname)) {
+        m_mem_drive = MemDrive::open(devname);
+        return;
+    }
+    m_iodev = iomgr::DriveInterface::open_dev(devname, oflags);
+    if (m_iodev) { m_drive_iface = m_iodev->drive_interface(); }
+}
+
+ssize_t PhysicalDev::drive_sync_read(char* data, uint32_t size, uint64_t offset) {
+    return m_mem_drive ? m_mem_drive->sync_read(data, size, offset)
+                       : m_drive_iface->sync_read(m_iodev.get(), data, size, offset);
+}
+
+ssize_t PhysicalDev::drive_sync_write(const char* data, uint32_t size, uint64_t offset) {
+    return m_mem_drive ? m_mem_drive->sync_write(data, size, offset)
+                       : m_drive_iface->sync_write(m_iodev.get(), data, size, offset);
+}
 
 void PhysicalDev::init_done() {
     m_super_blk->set_init_done(true);
@@ -409,8 +443,8 @@ inline bool PhysicalDev::validate_device() const {
 
 inline void PhysicalDev::write_superblock() {
     auto const superblock_size = SUPERBLOCK_SIZE(page_size());
-    auto const bytes{m_drive_iface->sync_write(m_iodev.get(), reinterpret_cast< const char* >(m_super_blk),
-                                               static_cast< uint32_t >(superblock_size), 0)};
+    auto const bytes{drive_sync_write(reinterpret_cast< const char* >(m_super_blk),
+                                      static_cast< uint32_t >(superblock_size), 0)};
     if (sisl_unlikely((bytes < 0) || (static_cast< size_t >(bytes) != superblock_size))) {
 
         throw std::system_error(errno, std::system_category(), "error while writing a superblock" + get_devname());
@@ -419,8 +453,8 @@ inline void PhysicalDev::write_superblock() {
 
 inline void PhysicalDev::read_superblock() {
     auto const superblock_size = SUPERBLOCK_SIZE(page_size());
-    auto const bytes{m_drive_iface->sync_read(m_iodev.get(), reinterpret_cast< char* >(m_super_blk),
-                                              static_cast< uint32_t >(superblock_size), 0)};
+    auto const bytes{
+        drive_sync_read(reinterpret_cast< char* >(m_super_blk), static_cast< uint32_t >(superblock_size), 0)};
     if (sisl_unlikely((bytes < 0) || (static_cast< size_t >(bytes) != superblock_size))) {
         throw std::system_error(errno, std::system_category(), "error while reading a superblock" + get_devname());
     }
@@ -428,33 +462,129 @@ inline void PhysicalDev::read_superblock() {
 
 void PhysicalDev::write(const char* data, uint32_t size, uint64_t offset, uint8_t* cookie, bool part_of_batch) {
     HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
-    m_drive_iface->async_write(m_iodev.get(), data, size, offset, cookie, part_of_batch);
+    if (m_mem_drive) {
+        m_mem_drive->async_write(data, size, offset, cookie);
+    } else {
+        m_drive_iface->async_write(m_iodev.get(), data, size, offset, cookie, part_of_batch);
+    }
 }
 
 void PhysicalDev::writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset, uint8_t* cookie,
                          bool part_of_batch) {
     HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
-    m_drive_iface->async_writev(m_iodev.get(), iov, iovcnt, size, offset, cookie, part_of_batch);
+    if (m_mem_drive) {
+        m_mem_drive->async_writev(iov, iovcnt, size, offset, cookie);
+    } else {
+        m_drive_iface->async_writev(m_iodev.get(), iov, iovcnt, size, offset, cookie, part_of_batch);
+    }
 }
 
 void PhysicalDev::read(char* data, uint32_t size, uint64_t offset, uint8_t* cookie, bool part_of_batch) {
     HISTOGRAM_OBSERVE(m_metrics, read_io_sizes, (((size - 1) / 1024) + 1));
-    m_drive_iface->async_read(m_iodev.get(), data, size, offset, cookie, part_of_batch);
+    if (m_mem_drive) {
+        m_mem_drive->async_read(data, size, offset, cookie);
+    } else {
+        m_drive_iface->async_read(m_iodev.get(), data, size, offset, cookie, part_of_batch);
+    }
 }
 
 void PhysicalDev::readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset, uint8_t* cookie, bool part_of_batch) {
     HISTOGRAM_OBSERVE(m_metrics, read_io_sizes, (((size - 1) / 1024) + 1));
-    m_drive_iface->async_readv(m_iodev.get(), iov, iovcnt, size, offset, cookie, part_of_batch);
+    if (m_mem_drive) {
+        m_mem_drive->async_readv(iov, iovcnt, size, offset, cookie);
+    } else {
+        m_drive_iface->async_readv(m_iodev.get(), iov, iovcnt, size, offset, cookie, part_of_batch);
+    }
 }
 
-void PhysicalDev::fsync(uint8_t* cookie) { m_drive_iface->fsync(m_iodev.get(), cookie); }
+static size_t latency_bucket(uint64_t latency_us, size_t nbuckets) {
+    return std::min< size_t >((latency_us == 0) ? 0 : (64 - __builtin_clzll(latency_us)), nbuckets - 1);
+}
+
+void PhysicalDev::record_latency(uint64_t latency_us, bool is_read, uint64_t size) {
+    const size_t bucket{latency_bucket(latency_us, num_read_lat_buckets)};
+    m_window_lat_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    if (size != 0) {
+        if (is_read) {
+            if (size <= 4096) {
+                HISTOGRAM_OBSERVE(m_metrics, drive_read_latency_upto_4k, latency_us);
+            } else if (size <= 65536) {
+                HISTOGRAM_OBSERVE(m_metrics, drive_read_latency_upto_64k, latency_us);
+            } else {
+                HISTOGRAM_OBSERVE(m_metrics, drive_read_latency_large, latency_us);
+            }
+        } else {
+            if (size <= 4096) {
+                HISTOGRAM_OBSERVE(m_metrics, drive_write_latency_upto_4k, latency_us);
+            } else if (size <= 65536) {
+                HISTOGRAM_OBSERVE(m_metrics, drive_write_latency_upto_64k, latency_us);
+            } else {
+                HISTOGRAM_OBSERVE(m_metrics, drive_write_latency_large, latency_us);
+            }
+        }
+    }
+    if (!is_read) { return; }
+
+    m_read_lat_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    // Racing halving could lose few samples, which is fine as it is only a guide
+    if (m_read_lat_samples.fetch_add(1, std::memory_order_relaxed) + 1 >= max_read_lat_samples) {
+        m_read_lat_samples.store(max_read_lat_samples / 2, std::memory_order_relaxed);
+        for (auto& b : m_read_lat_buckets) {
+            b.store(b.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t PhysicalDev::window_latency_percentile_us(double pct, uint64_t min_samples) {
+    std::array< uint64_t, num_read_lat_buckets > counts;
+    uint64_t total{0};
+    for (size_t i{0}; i < num_read_lat_buckets; ++i) {
+        counts[i] = m_window_lat_buckets[i].exchange(0, std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if ((total == 0) || (total < min_samples)) { return 0; }
+
+    const auto target{static_cast< uint64_t >(std::ceil(total * pct / 100.0))};
+    uint64_t cum{0};
+    for (size_t i{0}; i < num_read_lat_buckets; ++i) {
+        cum += counts[i];
+        if (cum >= target) { return (static_cast< uint64_t >(1) << i); }
+    }
+    return (static_cast< uint64_t >(1) << (num_read_lat_buckets - 1));
+}
+
+uint64_t PhysicalDev::read_latency_percentile_us(double pct) const {
+    uint64_t total{0};
+    for (const auto& b : m_read_lat_buckets) {
+        total += b.load(std::memory_order_relaxed);
+    }
+    if (total == 0) { return 0; }
+
+    const auto target{static_cast< uint64_t >(std::ceil(total * pct / 100.0))};
+    uint64_t cum{0};
+    for (size_t i{0}; i < num_read_lat_buckets; ++i) {
+        cum += m_read_lat_buckets[i].load(std::memory_order_relaxed);
+        if (cum >= target) { return (static_cast< uint64_t >(1) << i); }
+    }
+    return (static_cast< uint64_t >(1) << (num_read_lat_buckets - 1));
+}
+
+void PhysicalDev::fsync(uint8_t* cookie) {
+    if (m_mem_drive) {
+        m_mem_drive->fsync(cookie);
+    } else {
+        m_drive_iface->fsync(m_iodev.get(), cookie);
+    }
+}
 
 ssize_t PhysicalDev::sync_write(const char* data, uint32_t size, uint64_t offset) {
     try {
         HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
         COUNTER_INCREMENT(m_metrics, drive_sync_write_count, 1);
         auto const start_time = Clock::now();
-        auto const ret = m_drive_iface->sync_write(m_iodev.get(), data, size, offset);
+        auto const ret = drive_sync_write(data, size, offset);
         HISTOGRAM_OBSERVE(m_metrics, drive_write_latency, get_elapsed_time_us(start_time));
         return ret;
     } catch (const std::system_error& e) {
@@ -468,7 +598,8 @@ ssize_t PhysicalDev::sync_writev(const iovec* iov, int iovcnt, uint32_t size, ui
         HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
         COUNTER_INCREMENT(m_metrics, drive_sync_write_count, 1);
         auto const start_time = Clock::now();
-        auto const ret = m_drive_iface->sync_writev(m_iodev.get(), iov, iovcnt, size, offset);
+        auto const ret = m_mem_drive ? m_mem_drive->sync_writev(iov, iovcnt, size, offset)
+                                     : m_drive_iface->sync_writev(m_iodev.get(), iov, iovcnt, size, offset);
         HISTOGRAM_OBSERVE(m_metrics, drive_write_latency, get_elapsed_time_us(start_time));
         return ret;
     } catch (const std::system_error& e) {
@@ -478,7 +609,26 @@ ssize_t PhysicalDev::sync_writev(const iovec* iov, int iovcnt, uint32_t size, ui
 }
 
 void PhysicalDev::write_zero(uint64_t size, uint64_t offset, uint8_t* cookie) {
-    m_drive_iface->write_zero(m_iodev.get(), size, offset, cookie);
+    if (m_mem_drive) {
+        m_mem_drive->write_zero(size, offset, cookie);
+    } else {
+        m_drive_iface->write_zero(m_iodev.get(), size, offset, cookie);
+    }
+}
+
+int PhysicalDev::sync_discard(uint64_t size, uint64_t offset) {
+    if (m_mem_drive) { return m_mem_drive->discard(size, offset); }
+
+    const iomgr::drive_type dtype = iomgr::DriveInterface::get_drive_type(m_devname);
+    int ret;
+    if ((dtype == iomgr::drive_type::block_nvme) || (dtype == iomgr::drive_type::block_hdd)) {
+        uint64_t range[2]{offset, size};
+        ret = ::ioctl(m_iodev->fd(), BLKDISCARD, &range);
+    } else {
+        ret = ::fallocate(m_iodev->fd(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, s_cast< off_t >(offset),
+                          s_cast< off_t >(size));
+    }
+    return (ret == 0) ? 0 : errno;
 }
 
 ssize_t PhysicalDev::sync_read(char* data, uint32_t size, uint64_t offset) {
@@ -486,7 +636,7 @@ ssize_t PhysicalDev::sync_read(char* data, uint32_t size, uint64_t offset) {
         HISTOGRAM_OBSERVE(m_metrics, read_io_sizes, (((size - 1) / 1024) + 1));
         COUNTER_INCREMENT(m_metrics, drive_sync_read_count, 1);
         auto const start_time = Clock::now();
-        auto const ret = m_drive_iface->sync_read(m_iodev.get(), data, size, offset);
+        auto const ret = drive_sync_read(data, size, offset);
         HISTOGRAM_OBSERVE(m_metrics, drive_read_latency, get_elapsed_time_us(start_time));
         return ret;
     } catch (const std::system_error& e) {
@@ -501,7 +651,8 @@ ssize_t PhysicalDev::sync_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t
         HISTOGRAM_OBSERVE(m_metrics, read_io_sizes, (((size - 1) / 1024) + 1));
         COUNTER_INCREMENT(m_metrics, drive_sync_read_count, 1);
         auto const start_time = Clock::now();
-        auto const ret = m_drive_iface->sync_readv(m_iodev.get(), iov, iovcnt, size, offset);
+        auto const ret = m_mem_drive ? m_mem_drive->sync_readv(iov, iovcnt, size, offset)
+                                     : m_drive_iface->sync_readv(m_iodev.get(), iov, iovcnt, size, offset);
         HISTOGRAM_OBSERVE(m_metrics, drive_read_latency, get_elapsed_time_us(start_time));
         return ret;
     } catch (const std::system_error& e) {
@@ -586,7 +737,7 @@ PhysicalDevChunk* PhysicalDev::find_free_chunk(uint64_t req_size) {
 }
 
 std::string PhysicalDev::to_string() const {
-    auto str = fmt::format("Device={}, ID={}, Size={}, SuperBlk=[{}], Chunks[", m_devname, m_iodev->dev_id(), size(),
+    auto str = fmt::format("Device={}, ID={}, Size={}, SuperBlk=[{}], Chunks[", m_devname, drive_dev_id(), size(),
                            m_super_blk->to_string());
     const PhysicalDevChunk* pchunk = device_manager()->get_chunk(m_info_blk.first_chunk_id);
     while (pchunk) {
@@ -598,6 +749,7 @@ std::string PhysicalDev::to_string() const {
 }
 
 bool PhysicalDev::is_hdd() const {
+    if (m_mem_drive) { return false; }
     const iomgr::drive_type dtype = iomgr::DriveInterface::get_drive_type(m_devname);
     if (dtype == iomgr::drive_type::block_hdd || dtype == iomgr::drive_type::file_on_hdd) { return true; }
     return false;
@@ -713,21 +865,172 @@ void PhysicalDevChunk::recover() {
     if (m_allocator && m_recovered_bm) { m_allocator->set_disk_bm(std::move(m_recovered_bm)); }
 }
 
+void PhysicalDevChunk::recover_bm_page(const blkalloc_bm_page_hdr& hdr, std::unique_ptr< sisl::Bitset > page_bm,
+                                       meta_blk* mblk) {
+    // Pages are picked only once the journal is found, since pages of a different page size could be around as well
+    recovered_bm_page page;
+    page.page_num = hdr.page_num;
+    page.info.meta_blk_cookie = mblk;
+    page.info.version = hdr.version;
+    page.info.page_nbits = hdr.page_nbits;
+    page.info.recovered_bm = std::move(page_bm);
+    m_recovered_bm_pages.push_back(std::move(page));
+}
+
+void PhysicalDevChunk::recover_bm_journal(const blkalloc_bm_journal_hdr& hdr, meta_blk* mblk) {
+    m_bm_journal_cookie = mblk;
+    m_bm_version = std::max(m_bm_version, hdr.version);
+    m_recovered_journal_nbits = hdr.page_nbits;
+    m_recovered_journal_versions.assign(hdr.page_versions(), hdr.page_versions() + hdr.num_pages);
+}
+
+void PhysicalDevChunk::pick_recovered_bm_pages() {
+    // Layout of the pages is the one of the last journal written. Pages of any other page size are either of the
+    // layout it replaced, which were not removed yet, or of the flush which could not write its journal.
+    uint32_t layout_nbits{m_recovered_journal_nbits};
+    if (layout_nbits == 0) {
+        uint64_t max_version{0};
+        for (const auto& page : m_recovered_bm_pages) {
+            if (page.info.version >= max_version) {
+                max_version = page.info.version;
+                layout_nbits = page.info.page_nbits;
+            }
+        }
+    }
+
+    for (auto& page : m_recovered_bm_pages) {
+        if (page.info.page_nbits != layout_nbits) {
+            m_stale_bm_page_cookies.push_back(page.info.meta_blk_cookie);
+            continue;
+        }
+        if (page.page_num >= m_bm_pages.size()) { m_bm_pages.resize(page.page_num + 1); }
+        auto& cur{m_bm_pages[page.page_num]};
+        if (cur.meta_blk_cookie && (cur.version >= page.info.version)) {
+            m_stale_bm_page_cookies.push_back(page.info.meta_blk_cookie);
+            continue;
+        }
+        if (cur.meta_blk_cookie) { m_stale_bm_page_cookies.push_back(cur.meta_blk_cookie); }
+        cur = std::move(page.info);
+    }
+    m_recovered_bm_pages.clear();
+}
+
+void PhysicalDevChunk::recover_bm_pages_done() {
+    pick_recovered_bm_pages();
+
+    // Every page the journal knows about should have been persisted atleast at that version, since pages are always
+    // written ahead of the journal.
+    for (uint32_t p{0}; p < m_recovered_journal_versions.size(); ++p) {
+        if (m_recovered_journal_versions[p] == 0) { continue; }
+        HS_REL_ASSERT((p < m_bm_pages.size()) && (m_bm_pages[p].meta_blk_cookie != nullptr) &&
+                          (m_bm_pages[p].version >= m_recovered_journal_versions[p]),
+                      "Chunk id={} bitmap page={} is missing or older than journal version={}", chunk_id(), p,
+                      m_recovered_journal_versions[p]);
+    }
+    m_recovered_journal_versions.clear();
+    m_recovered_journal_nbits = 0;
+
+    auto* allocator{blk_allocator_mutable().get()};
+    bool layout_changed{false};
+    for (uint32_t p{0}; p < m_bm_pages.size(); ++p) {
+        auto& page{m_bm_pages[p]};
+        if (page.meta_blk_cookie == nullptr) { continue; }
+        m_bm_version = std::max(m_bm_version, page.version);
+        if (page.recovered_bm) {
+            allocator->apply_disk_bm_page(p * page.page_nbits, *page.recovered_bm);
+            page.recovered_bm.reset();
+        }
+        if (page.page_nbits != allocator->disk_bm_page_nbits()) { layout_changed = true; }
+    }
+
+    if (layout_changed) {
+        // Page size is changed since the pages were written. apply_disk_bm_page had marked the blks dirty, so they are
+        // written in new layout on next flush and the pages of old layout are removed after that.
+        LOGINFO("Chunk id={} bitmap page size changed to nbits={}, will be rewritten on next cp", chunk_id(),
+                allocator->disk_bm_page_nbits());
+        for (auto& page : m_bm_pages) {
+            if (page.meta_blk_cookie) { m_stale_bm_page_cookies.push_back(page.meta_blk_cookie); }
+        }
+        m_bm_pages.clear();
+    }
+    m_bm_pages.resize(allocator->num_disk_bm_pages());
+}
+
 void PhysicalDevChunk::cp_flush() {
     auto allocator = blk_allocator_mutable();
 
     // only do write when bitmap is dirty
-    if (allocator->need_flush_dirty_bm()) {
-        auto bitmap_mem = allocator->acquire_underlying_buffer();
-        if (m_meta_blk_cookie) {
-            meta_service().update_sub_sb(bitmap_mem->bytes, bitmap_mem->size, m_meta_blk_cookie);
-        } else {
-            meta_service().add_sub_sb("BLK_ALLOC", bitmap_mem->bytes, bitmap_mem->size, m_meta_blk_cookie);
+    if (!allocator->need_flush_dirty_bm()) {
+        COUNTER_INCREMENT(m_pdev->metrics(), drive_skipped_chunk_bm_writes, 1);
+        return;
+    }
+
+    const auto dirty_pages{allocator->acquire_dirty_disk_bm_pages()};
+    if (!dirty_pages.empty()) {
+        ++m_bm_version;
+        m_bm_pages.resize(allocator->num_disk_bm_pages());
+
+        for (const auto p : dirty_pages) {
+            const auto page_mem{allocator->serialize_disk_bm_page(p)};
+            auto buf{hs_utils::make_byte_array(sizeof(blkalloc_bm_page_hdr) + page_mem->size, true /* aligned */,
+                                               sisl::buftag::metablk, meta_service().align_size())};
+            auto* hdr{new (buf->bytes) blkalloc_bm_page_hdr{}};
+            hdr->chunk_id = chunk_id();
+            hdr->page_num = p;
+            hdr->page_nbits = allocator->disk_bm_page_nbits();
+            hdr->version = m_bm_version;
+            std::memcpy(buf->bytes + sizeof(blkalloc_bm_page_hdr), page_mem->bytes, page_mem->size);
+
+            auto& page{m_bm_pages[p]};
+            if (page.meta_blk_cookie) {
+                meta_service().update_sub_sb(buf->bytes, buf->size, page.meta_blk_cookie);
+            } else {
+                meta_service().add_sub_sb("BLK_ALLOC_PAGE", buf->bytes, buf->size, page.meta_blk_cookie);
+            }
+            page.version = m_bm_version;
+            page.page_nbits = hdr->page_nbits;
+        }
+        write_bm_journal();
+
+        // Stale pages are removed only once the pages and the journal which replace them are persisted. Recovery
+        // discards whatever of them is left behind by a crash before this.
+        for (auto* cookie : m_stale_bm_page_cookies) {
+            meta_service().remove_sub_sb(cookie);
         }
-        allocator->reset_disk_bm_dirty();
-        allocator->release_underlying_buffer();
+        m_stale_bm_page_cookies.clear();
+
+        COUNTER_INCREMENT(m_pdev->metrics(), drive_chunk_bm_pages_written, dirty_pages.size());
+        COUNTER_INCREMENT(m_pdev->metrics(), drive_chunk_bm_pages_skipped,
+                          allocator->num_disk_bm_pages() - dirty_pages.size());
+    }
+    allocator->release_underlying_buffer();
+
+    // Bitmap persisted as a single blob by older versions is not needed once every page is persisted
+    if (m_meta_blk_cookie &&
+        std::all_of(m_bm_pages.cbegin(), m_bm_pages.cend(),
+                    [](const bm_page_info& page) { return page.meta_blk_cookie != nullptr; })) {
+        meta_service().remove_sub_sb(m_meta_blk_cookie);
+        m_meta_blk_cookie = nullptr;
+    }
+}
+
+void PhysicalDevChunk::write_bm_journal() {
+    const auto npages{static_cast< uint32_t >(m_bm_pages.size())};
+    auto buf{hs_utils::make_byte_array(blkalloc_bm_journal_hdr::size(npages), true /* aligned */,
+                                       sisl::buftag::metablk, meta_service().align_size())};
+    auto* hdr{new (buf->bytes) blkalloc_bm_journal_hdr{}};
+    hdr->chunk_id = chunk_id();
+    hdr->num_pages = npages;
+    hdr->page_nbits = blk_allocator()->disk_bm_page_nbits();
+    hdr->version = m_bm_version;
+    for (uint32_t p{0}; p < npages; ++p) {
+        hdr->page_versions()[p] = m_bm_pages[p].version;
+    }
+
+    if (m_bm_journal_cookie) {
+        meta_service().update_sub_sb(buf->bytes, buf->size, m_bm_journal_cookie);
     } else {
-        COUNTER_INCREMENT(m_pdev->metrics(), drive_skipped_chunk_bm_writes, 1);
+        meta_service().add_sub_sb("BLK_ALLOC_JOURNAL", buf->bytes, buf->size, m_bm_journal_cookie);
     }
 }
 } // namespace homestore
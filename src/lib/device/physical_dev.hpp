@@ -14,6 +14,8 @@
  *
  *********************************************************************************/
 #pragma once
+#include <array>
+#include <atomic>
 #include <vector>
 #include <string>
 
@@ -31,6 +33,8 @@
 #include <homestore/homestore_decl.hpp>
 #include "common/homestore_assert.hpp"
 #include "common/homestore_utils.hpp"
+#include "io_scheduler.hpp"
+#include "mem_drive.hpp"
 
 SISL_LOGGING_DECL(device)
 
@@ -152,9 +156,10 @@ struct vdev_info_block {
     uint32_t num_primary_chunks{0}; // 28: number of primary chunks
     uint8_t slot_allocated{0};      // 32: Is this current slot allocated
     uint8_t failed{0};              // 33: set to true if disk is replaced
+    uint32_t stripe_unit_blks{0};   // 34: Blks per stripe unit if large allocs are striped across pdevs, 0 if not
 
     uint8_t
-        padding[MAX_VDEV_INFO_BLOCK_HDR_SZ - 34]{}; // Ugly hardcode will be removed after moving to superblk blkstore
+        padding[MAX_VDEV_INFO_BLOCK_HDR_SZ - 38]{}; // Ugly hardcode will be removed after moving to superblk blkstore
     uint8_t context_data[MAX_CONTEXT_DATA_SZ]{};
 
     uint32_t get_vdev_id() const { return vdev_id; }
@@ -169,6 +174,38 @@ struct vdev_info_block {
 };
 #pragma pack()
 
+/************* Chunk blk allocator bitmap page definition ******************/
+// Disk bitmap of each chunk is persisted as one meta blk per bitmap page and a journal meta blk per chunk which records
+// the version each page is persisted at. Pages are written before the journal, so a page is never older than what the
+// journal says. It could be newer if crashed after writing the page but before the journal, which is fine as the disk
+// bitmap is allowed to be ahead of the checkpoint.
+static constexpr uint32_t BLKALLOC_BM_PAGE_MAGIC{0xB17A0A6E};
+static constexpr uint32_t BLKALLOC_BM_JOURNAL_MAGIC{0xB17A0D1A};
+
+#pragma pack(1)
+struct blkalloc_bm_page_hdr {
+    uint32_t magic{BLKALLOC_BM_PAGE_MAGIC};
+    uint32_t chunk_id{0};
+    uint32_t page_num{0};
+    uint32_t page_nbits{0}; // Number of blks per page at the time of write
+    uint64_t version{0};    // Bitmap flush version of the chunk at which this page is written
+    // Followed by the serialized bitmap of the page
+};
+
+struct blkalloc_bm_journal_hdr {
+    uint32_t magic{BLKALLOC_BM_JOURNAL_MAGIC};
+    uint32_t chunk_id{0};
+    uint32_t num_pages{0};
+    uint32_t page_nbits{0};
+    uint64_t version{0}; // Latest bitmap flush version of the chunk
+
+    // Followed by num_pages of uint64_t page versions
+    uint64_t* page_versions() { return r_cast< uint64_t* >(this + 1); }
+    const uint64_t* page_versions() const { return r_cast< const uint64_t* >(this + 1); }
+    static uint64_t size(uint32_t npages) { return sizeof(blkalloc_bm_journal_hdr) + npages * sizeof(uint64_t); }
+};
+#pragma pack()
+
 // This assert is trying catch mistakes of overlaping the header to context_data portion.
 static_assert(offsetof(vdev_info_block, context_data) == MAX_VDEV_INFO_BLOCK_HDR_SZ,
               "vdev info block header size should be size of 512 bytes!");
@@ -307,10 +344,27 @@ public:
         REGISTER_COUNTER(drive_write_errors, "Total drive write errors");
         REGISTER_COUNTER(drive_spurios_events, "Total number of spurious events per drive");
         REGISTER_COUNTER(drive_skipped_chunk_bm_writes, "Total number of skipped writes for chunk bitmap");
+        REGISTER_COUNTER(drive_chunk_bm_pages_written, "Total number of chunk bitmap pages written");
+        REGISTER_COUNTER(drive_chunk_bm_pages_skipped, "Total number of clean chunk bitmap pages skipped from write");
 
         REGISTER_HISTOGRAM(drive_write_latency, "BlkStore drive write latency in us");
         REGISTER_HISTOGRAM(drive_read_latency, "BlkStore drive read latency in us");
 
+        REGISTER_HISTOGRAM(drive_read_latency_upto_4k, "Drive read latency in us of ios upto 4K",
+                           "drive_read_latency_by_size", {"io_size", "upto_4k"});
+        REGISTER_HISTOGRAM(drive_read_latency_upto_64k, "Drive read latency in us of ios upto 64K",
+                           "drive_read_latency_by_size", {"io_size", "upto_64k"});
+        REGISTER_HISTOGRAM(drive_read_latency_large, "Drive read latency in us of ios larger than 64K",
+                           "drive_read_latency_by_size", {"io_size", "large"});
+        REGISTER_HISTOGRAM(drive_write_latency_upto_4k, "Drive write latency in us of ios upto 4K",
+                           "drive_write_latency_by_size", {"io_size", "upto_4k"});
+        REGISTER_HISTOGRAM(drive_write_latency_upto_64k, "Drive write latency in us of ios upto 64K",
+                           "drive_write_latency_by_size", {"io_size", "upto_64k"});
+        REGISTER_HISTOGRAM(drive_write_latency_large, "Drive write latency in us of ios larger than 64K",
+                           "drive_write_latency_by_size", {"io_size", "large"});
+        REGISTER_COUNTER(drive_marked_slow_count, "Number of times the drive is marked slow");
+        REGISTER_GAUGE(drive_is_slow, "Is the drive currently marked slow");
+
         REGISTER_HISTOGRAM(write_io_sizes, "Write IO Sizes", "io_sizes", {"io_direction", "write"},
                            HistogramBucketsType(ExponentialOfTwoBuckets));
         REGISTER_HISTOGRAM(read_io_sizes, "Read IO Sizes", "io_sizes", {"io_direction", "read"},
@@ -399,15 +453,41 @@ public:
     /////////////// Recovery and CP related ////////////////////
     void recover(std::unique_ptr< sisl::Bitset > recovered_bm, meta_blk* mblk);
     void recover();
+    void recover_bm_page(const blkalloc_bm_page_hdr& hdr, std::unique_ptr< sisl::Bitset > page_bm, meta_blk* mblk);
+    void recover_bm_journal(const blkalloc_bm_journal_hdr& hdr, meta_blk* mblk);
+    void recover_bm_pages_done();
     void cp_flush();
 
 private:
+    void write_bm_journal();
+    void pick_recovered_bm_pages();
+
+    struct bm_page_info {
+        void* meta_blk_cookie{nullptr};
+        uint64_t version{0};
+        uint32_t page_nbits{0};
+        std::unique_ptr< sisl::Bitset > recovered_bm; // Only until the page is applied to the allocator
+    };
+
+    struct recovered_bm_page {
+        uint32_t page_num{0};
+        bm_page_info info;
+    };
+
     chunk_info_block* m_chunk_info;
     PhysicalDev* m_pdev;
     std::shared_ptr< BlkAllocator > m_allocator;
     uint64_t m_vdev_metadata_size;
-    void* m_meta_blk_cookie = nullptr;
+    void* m_meta_blk_cookie = nullptr; // Entire bitmap as a single blob, written by older versions
     std::unique_ptr< sisl::Bitset > m_recovered_bm;
+
+    std::vector< bm_page_info > m_bm_pages; // Indexed by page num
+    std::vector< void* > m_stale_bm_page_cookies; // Pages replaced, to be removed after the next flush
+    void* m_bm_journal_cookie{nullptr};
+    std::vector< recovered_bm_page > m_recovered_bm_pages; // Every page found, till they are picked on recovery done
+    std::vector< uint64_t > m_recovered_journal_versions;
+    uint32_t m_recovered_journal_nbits{0};
+    uint64_t m_bm_version{0};
 };
 
 class PhysicalDev {
@@ -467,7 +547,8 @@ public:
     const DeviceManager* device_manager() const { return m_mgr; }
     DeviceManager* device_manager_mutable() { return m_mgr; }
     PhysicalDevMetrics& metrics() { return m_metrics; }
-    iomgr::DriveInterface* drive_iface() const { return m_drive_iface; }
+    IoScheduler& io_scheduler() { return m_io_sched; }
+    iomgr::DriveInterface* drive_iface() const { return m_drive_iface; } // nullptr for memory backed drives
 
     void set_dev_offset(uint64_t offset) { m_info_blk.dev_offset = offset; }
     void set_dev_id(uint32_t id) { m_info_blk.dev_num = id; }
@@ -493,6 +574,10 @@ public:
     void readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset, uint8_t* cookie, bool part_of_batch = false);
     void fsync(uint8_t* cookie);
 
+    /// @brief Synchronously tell the device that the range no longer has valid data. Block devices are discarded and
+    /// files have a hole punched. Returns 0 on success or the errno.
+    int sync_discard(uint64_t size, uint64_t offset);
+
     ssize_t sync_write(const char* data, uint32_t size, uint64_t offset);
     ssize_t sync_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset);
 
@@ -503,6 +588,36 @@ public:
     void write_dm_chunk(uint64_t gen_cnt, const char* mem, uint64_t size);
     uint64_t inc_error_cnt() { return (m_error_cnt.increment(1)); }
 
+    //////////// Live load of the device, used by device selector /////////////////////
+    void on_io_submit() { m_outstanding_ios.fetch_add(1, std::memory_order_relaxed); }
+    void on_io_complete(uint64_t latency_us, bool is_read = false, uint64_t size = 0) {
+        m_outstanding_ios.fetch_sub(1, std::memory_order_relaxed);
+        // EWMA with weight of 1/8 to the latest sample. Racing updates could lose a sample, which is fine.
+        const auto old_lat{m_ewma_latency_us.load(std::memory_order_relaxed)};
+        m_ewma_latency_us.store((old_lat == 0) ? latency_us : (old_lat * 7 + latency_us) / 8,
+                                std::memory_order_relaxed);
+        record_latency(latency_us, is_read, size);
+    }
+    int64_t outstanding_ios() const { return m_outstanding_ios.load(std::memory_order_relaxed); }
+    uint64_t ewma_latency_us() const { return m_ewma_latency_us.load(std::memory_order_relaxed); }
+
+    /// @brief Approximate read latency of the device at the given percentile (say 99.0), over the recent reads. It is
+    /// the upper bound of the power of 2 bucket the percentile falls in. Returns 0 if there are no reads yet.
+    uint64_t read_latency_percentile_us(double pct) const;
+
+    /// @brief Latency of all ios of the device at the given percentile, over the ios completed since the previous call
+    /// and starts a new window. Returns 0 if there are fewer than min_samples ios in the window.
+    uint64_t window_latency_percentile_us(double pct, uint64_t min_samples);
+
+    /// @brief Is the tail latency of the device way off from its peers, as marked by the slow device detector of
+    /// DeviceManager. Device selection and mirror reads steer ios away from slow devices.
+    bool is_slow() const { return m_is_slow.load(std::memory_order_relaxed); }
+    void set_slow(bool slow) {
+        if (m_is_slow.exchange(slow, std::memory_order_relaxed) == slow) { return; }
+        if (slow) { COUNTER_INCREMENT(m_metrics, drive_marked_slow_count, 1); }
+        GAUGE_UPDATE(m_metrics, drive_is_slow, slow ? 1 : 0);
+    }
+
     /**
      * @brief: zero the super block;
      */
@@ -546,6 +661,10 @@ private:
     void write_superblock();
     void read_superblock();
     void read_and_fill_superblock(int oflags);
+    void open_drive(const std::string& devname, int oflags);
+    ssize_t drive_sync_read(char* data, uint32_t size, uint64_t offset);
+    ssize_t drive_sync_write(const char* data, uint32_t size, uint64_t offset);
+    int64_t drive_dev_id() const { return m_mem_drive ? -1 : s_cast< int64_t >(m_iodev->dev_id()); }
 
     void alloc_superblock(uint32_t sb_size, uint32_t align_sz);
     void free_superblock();
@@ -575,7 +694,8 @@ private:
 private:
     DeviceManager* m_mgr; // Back pointer to physical device
     iomgr::io_device_ptr m_iodev;
-    iomgr::DriveInterface* m_drive_iface; // Interface to do IO
+    iomgr::DriveInterface* m_drive_iface{nullptr}; // Interface to do IO
+    std::shared_ptr< MemDrive > m_mem_drive;       // Does the IO instead of m_drive_iface, for memory backed drives
     std::string m_devname;
     super_block* m_super_blk{nullptr}; // Persisent header block
     uint64_t m_devsize{0};
@@ -583,8 +703,24 @@ private:
     std::array< PhysicalDevChunk*, super_block::s_num_dm_chunks > m_dm_chunk;
     static constexpr size_t s_dm_chunk_mask{super_block::s_num_dm_chunks - 1};
     PhysicalDevMetrics m_metrics; // Metrics instance per physical device
+    IoScheduler m_io_sched;       // Schedules async ios of the vdevs on this device by their io class
     int32_t m_cur_indx{0};
     bool m_superblock_valid{false};
     sisl::atomic_counter< uint64_t > m_error_cnt{0};
+    std::atomic< int64_t > m_outstanding_ios{0};
+    std::atomic< uint64_t > m_ewma_latency_us{0};
+
+    // Read latencies in power of 2 buckets of us. Counts are halved once they add up to max_read_lat_samples, so that
+    // the percentiles follow the recent behavior of the device.
+    static constexpr size_t num_read_lat_buckets{32};
+    static constexpr uint64_t max_read_lat_samples{1ul << 16};
+    std::array< std::atomic< uint64_t >, num_read_lat_buckets > m_read_lat_buckets{};
+    std::atomic< uint64_t > m_read_lat_samples{0};
+
+    // Latencies of all ios since the last check of slow device detector, in the same power of 2 buckets
+    std::array< std::atomic< uint64_t >, num_read_lat_buckets > m_window_lat_buckets{};
+    std::atomic< bool > m_is_slow{false};
+
+    void record_latency(uint64_t latency_us, bool is_read, uint64_t size);
 };
 } // namespace homestore
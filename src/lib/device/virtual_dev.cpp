@@ -13,10 +13,12 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iterator>
 #include <limits>
@@ -26,6 +28,7 @@
 #include <string>
 #include <system_error>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/range/irange.hpp>
@@ -34,6 +37,7 @@
 #include <sisl/logging/logging.h>
 #include <sisl/utility/atomic_counter.hpp>
 #include <iomgr/drive_interface.hpp>
+#include <iomgr/iomgr.hpp>
 
 #include <homestore/homestore.hpp>
 #include "physical_dev.hpp"
@@ -41,8 +45,10 @@
 #include "virtual_dev.hpp"
 #include "blkalloc/blk_allocator.h"
 #include "blkalloc/varsize_blk_allocator.h"
+#include "blkalloc/extent_blk_allocator.h"
 #include "common/error.h"
 #include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 #include "common/homestore_flip.hpp"
 
 SISL_LOGGING_DECL(device)
@@ -91,14 +97,20 @@ void VirtualDev::static_process_completions(int64_t res, uint8_t* cookie) {
 
     PhysicalDev* pdev{nullptr};
     if (vd_req->chunk) {
+        // Device latency excludes the time the io waited in the scheduler, which is accounted only to its io class
+        auto const dev_latency_us = get_elapsed_time_us(vd_req->io_issue_time);
         pdev = vd_req->chunk->physical_dev_mutable();
+        pdev->on_io_complete(dev_latency_us, (vd_req->op_type == vdev_op_type_t::read), vd_req->io_size);
+        if (vd_req->scheduled) {
+            pdev->io_scheduler().on_complete(vd_req->io_class, get_elapsed_time_us(vd_req->io_start_time));
+        }
         if (vd_req->err) {
             COUNTER_INCREMENT_IF_ELSE(pdev->metrics(), (vd_req->op_type == vdev_op_type_t::read), drive_read_errors,
                                       drive_write_errors, 1);
             pdev->device_manager_mutable()->handle_error(pdev);
         } else {
             HISTOGRAM_OBSERVE_IF_ELSE(pdev->metrics(), (vd_req->op_type == vdev_op_type_t::read), drive_read_latency,
-                                      drive_write_latency, get_elapsed_time_us(vd_req->io_start_time));
+                                      drive_write_latency, dev_latency_us);
         }
     }
 
@@ -124,6 +136,66 @@ uint64_t VirtualDev::get_len(const iovec* iov, const int iovcnt) {
     return len;
 }
 
+// Carves the next size bytes out of the iovs, starting from where the previous call has left off
+static std::vector< iovec > next_iovs(const iovec* iov, const int iovcnt, int& cur_ind, uint64_t& cur_off,
+                                      uint64_t size) {
+    std::vector< iovec > out_iovs;
+    while ((size > 0) && (cur_ind < iovcnt)) {
+        auto const len = std::min< uint64_t >(iov[cur_ind].iov_len - cur_off, size);
+        iovec sub_iov;
+        sub_iov.iov_base = r_cast< uint8_t* >(iov[cur_ind].iov_base) + cur_off;
+        sub_iov.iov_len = len;
+        out_iovs.push_back(sub_iov);
+
+        size -= len;
+        cur_off += len;
+        if (cur_off == iov[cur_ind].iov_len) {
+            ++cur_ind;
+            cur_off = 0;
+        }
+    }
+    return out_iovs;
+}
+
+// Parent request of an io which is split into nios ios, say on multiple blkids or on all mirrors
+static boost::intrusive_ptr< vdev_req_context > make_multi_io_req(vdev_op_type_t op_type, vdev_io_comp_cb_t cb,
+                                                                  const void* cookie, uint32_t nios) {
+    auto parent_req = vdev_req_context::make_req_context();
+    parent_req->cb = std::move(cb);
+    parent_req->op_type = op_type;
+    parent_req->cookie = const_cast< void* >(cookie);
+    parent_req->io_on_multi_pdevs = true;
+    parent_req->outstanding_ios.set(nios);
+    return parent_req;
+}
+
+// Completion of one of the ios of the parent request. Callback of the parent request is called once all of them are
+// completed, with the first error if any.
+static vdev_io_comp_cb_t multi_io_comp_cb(const boost::intrusive_ptr< vdev_req_context >& parent_req) {
+    return [parent_req](std::error_condition err, void*) {
+        if (err && !parent_req->err) { parent_req->err = err; }
+        if (parent_req->outstanding_ios.decrement_testz() && parent_req->cb) {
+            parent_req->cb(parent_req->err, parent_req->cookie);
+        }
+    };
+}
+
+// Write queued as part of a batch, to be merged with its physically adjacent writes on the same pdev on submit_batch()
+struct coalesce_write {
+    const VirtualDev* vdev;
+    PhysicalDev* pdev;
+    PhysicalDevChunk* pchunk;
+    uint64_t dev_offset;
+    uint64_t size;
+    std::vector< iovec > iovs;
+    vdev_io_comp_cb_t cb;
+    void* cookie;
+};
+
+// Writes of a batch are issued and submitted by the same thread, so the queue is per thread and needs no locking
+static thread_local std::vector< coalesce_write > s_coalesce_writes;
+static constexpr size_t max_coalesce_iovs{1024}; // IOV_MAX
+
 static std::shared_ptr< BlkAllocator > create_blk_allocator(blk_allocator_type_t btype, uint32_t vblock_size,
                                                             uint32_t ppage_sz, uint32_t align_sz, uint64_t size,
                                                             bool is_auto_recovery, uint32_t unique_id, bool is_init) {
@@ -145,6 +217,11 @@ static std::shared_ptr< BlkAllocator > create_blk_allocator(blk_allocator_type_t
         cfg.set_auto_recovery(is_auto_recovery);
         return std::make_shared< VarsizeBlkAllocator >(cfg, is_init, unique_id);
     }
+    case blk_allocator_type_t::extent: {
+        BlkAllocConfig cfg{vblock_size, align_sz, size, std::string{"extent_chunk_"} + std::to_string(unique_id)};
+        cfg.set_auto_recovery(is_auto_recovery);
+        return std::make_shared< ExtentBlkAllocator >(cfg, is_init, unique_id);
+    }
     case blk_allocator_type_t::none:
     default:
         return nullptr;
@@ -158,7 +235,19 @@ void VirtualDev::init(DeviceManager* mgr, vdev_info_block* vb, uint32_t blk_size
     m_chunk_size = 0;
     m_num_chunks = 0;
     m_blk_size = blk_size;
-    m_selector = std::make_unique< RoundRobinDeviceSelector >();
+    if (HS_DYNAMIC_CONFIG(device.load_aware_device_selector)) {
+        m_selector = std::make_unique< LoadAwareDeviceSelector >([this](uint32_t dev_ind) {
+            blk_cap_t avail_blks{0};
+            blk_cap_t total_blks{0};
+            for (const auto* chunk : m_primary_pdev_chunks_list[dev_ind].chunks_in_pdev) {
+                avail_blks += chunk->blk_allocator()->available_blks();
+                total_blks += chunk->blk_allocator()->get_config().get_total_blks();
+            }
+            return (total_blks == 0) ? 1.0 : static_cast< double >(avail_blks) / total_blks;
+        });
+    } else {
+        m_selector = std::make_unique< RoundRobinDeviceSelector >();
+    }
     m_recovery_init = false;
     m_auto_recovery = auto_recovery;
     m_hwm_cb = std::move(hwm_cb);
@@ -180,8 +269,8 @@ VirtualDev::VirtualDev(DeviceManager* mgr, const char* name, PhysicalDevGroup pd
     m_primary_pdev_chunks_list.reserve(pdev_list.size());
     uint64_t mapped_stream_size = 0;
     const bool is_hdd = pdev_list.front()->is_hdd();
-    m_drive_iface = pdev_list.front()->drive_iface();
     for (const auto& pdev : pdev_list) {
+        add_drive_iface(pdev->drive_iface());
         pdev_chunk_map mp;
         mp.pdev = pdev;
         mp.chunks_in_pdev.reserve(1);
@@ -250,10 +339,18 @@ VirtualDev::VirtualDev(DeviceManager* mgr, const char* name, PhysicalDevGroup pd
         throw homestore::homestore_exception("invalid chunk size in init", homestore_error::invalid_chunk_size);
     }
 
+    // Striping large allocations makes sense only if the chunks are spread across more than one pdev
+    if (is_stripe && (num_pdevs > 1)) {
+        m_stripe_unit_blks = std::min< uint32_t >(HS_DYNAMIC_CONFIG(device.stripe_unit_size) / blk_size,
+                                                  BlkId::max_blks_in_op());
+        LOGINFO("vdev name {} stripes large allocations across {} pdevs in units of {} blks", m_name, num_pdevs,
+                m_stripe_unit_blks);
+    }
+
     /* make size multiple of chunk size */
     size = m_chunk_size * m_num_chunks;
     // Create a new vdev in persistent area and get the block of it
-    m_vb = mgr->alloc_vdev(context_size, nmirror, blk_size, m_num_chunks, context, size);
+    m_vb = mgr->alloc_vdev(context_size, nmirror, blk_size, m_num_chunks, context, size, m_stripe_unit_blks);
 
     for (auto i : boost::irange< uint32_t >(0, m_num_chunks)) {
         auto const pdev_ind = i % num_pdevs;
@@ -316,9 +413,11 @@ VirtualDev::VirtualDev(DeviceManager* mgr, const char* name, vdev_info_block* vb
         m_pdev_group{pdev_group} {
     init(mgr, vb, vb->blk_size, auto_recovery, std::move(hwm_cb));
 
+    // Stripe unit is persisted at creation, so that layout doesn't change with the config
+    m_stripe_unit_blks = vb->stripe_unit_blks;
     m_recovery_init = recovery_init;
     m_mgr->add_chunks(vb->vdev_id, [this](PhysicalDevChunk* chunk) {
-        if (m_drive_iface == nullptr) { m_drive_iface = chunk->physical_dev_mutable()->drive_iface(); }
+        add_drive_iface(chunk->physical_dev_mutable()->drive_iface());
         add_chunk(chunk);
     });
 
@@ -480,6 +579,11 @@ BlkAllocStatus VirtualDev::alloc_contiguous_blk(const blk_count_t nblks, const b
 }
 
 BlkAllocStatus VirtualDev::alloc_blk(uint32_t nblks, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkid) {
+    if (is_striped() && (nblks > m_stripe_unit_blks) && !hints.is_contiguous && (hints.stream_info == 0) &&
+        (hints.dev_id_hint == INVALID_DEV_ID)) {
+        return alloc_striped_blk(nblks, hints, out_blkid);
+    }
+
     size_t start_idx = out_blkid.size();
     while (nblks != 0) {
         const blk_count_t nblks_op = std::min(BlkId::max_blks_in_op(), s_cast< blk_count_t >(nblks));
@@ -496,6 +600,35 @@ BlkAllocStatus VirtualDev::alloc_blk(uint32_t nblks, const blk_alloc_hints& hint
     return BlkAllocStatus::SUCCESS;
 }
 
+BlkAllocStatus VirtualDev::alloc_striped_blk(uint32_t nblks, const blk_alloc_hints& hints,
+                                             std::vector< BlkId >& out_blkid) {
+    auto const start_idx = out_blkid.size();
+    auto const num_pdevs = uint32_cast(m_primary_pdev_chunks_list.size());
+    // Every unit should be a multiple of the multiplier, otherwise the allocation in the unit could not honor it
+    auto const unit_blks = std::max(m_stripe_unit_blks / hints.multiplier * hints.multiplier, hints.multiplier);
+
+    // Start from the device selector picks and lay the rest of the units round robin across the pdevs. If a pdev
+    // can't hold its unit, do_alloc_blk falls back to the other pdevs.
+    blk_alloc_hints unit_hints{hints};
+    uint32_t dev_ind = m_selector->select(hints);
+    while (nblks != 0) {
+        const blk_count_t nblks_op = s_cast< blk_count_t >(std::min(nblks, unit_blks));
+        unit_hints.dev_id_hint = dev_ind;
+        const auto ret = do_alloc_blk(nblks_op, unit_hints, out_blkid);
+        if (ret != BlkAllocStatus::SUCCESS) {
+            for (auto i = start_idx; i < out_blkid.size(); ++i) {
+                free_blk(out_blkid[i]);
+            }
+            out_blkid.erase(out_blkid.begin() + start_idx, out_blkid.end());
+            return ret;
+        }
+        nblks -= nblks_op;
+        dev_ind = (dev_ind + 1) % num_pdevs;
+    }
+    COUNTER_INCREMENT(m_metrics, vdev_striped_alloc_count, 1);
+    return BlkAllocStatus::SUCCESS;
+}
+
 BlkAllocStatus VirtualDev::do_alloc_blk(blk_count_t nblks, const blk_alloc_hints& hints,
                                         std::vector< BlkId >& out_blkid) {
     try {
@@ -532,7 +665,7 @@ BlkAllocStatus VirtualDev::do_alloc_blk(blk_count_t nblks, const blk_alloc_hints
         // First select a device to allocate from
         uint32_t chunk_num, start_chunk_num;
         uint32_t dev_ind{0};
-        dev_ind = (hints.dev_id_hint == INVALID_DEV_ID) ? m_selector->select(hints) : uint32_cast(hints.dev_id_hint);
+        dev_ind = m_selector->select(hints);
 
         // Pick a physical chunk based on physDevId.
         // TODO: Right now there is only one primary chunk per device in a virtualdev. Need to support multiple
@@ -598,12 +731,43 @@ void VirtualDev::free_blk(const BlkId& b) {
     chunk->blk_allocator_mutable()->free(b);
 }
 
+void VirtualDev::free_blks_on_cp(const std::vector< BlkId >& blkids) {
+    std::unordered_map< chunk_num_t, std::vector< BlkId > > chunk_blkids;
+    for (const auto& b : blkids) {
+        chunk_blkids[b.get_chunk_num()].push_back(b);
+    }
+
+    static thread_local std::vector< BlkId > s_disk_bids;
+    for (const auto& [chunk_num, bids] : chunk_blkids) {
+        PhysicalDevChunk* chunk = m_mgr->get_chunk_mutable(chunk_num);
+
+        // Free them on the disk bitmap in one batch per chunk, so that the bitmap flushed by this CP has them free.
+        // Blks which were never committed on disk have nothing to free there.
+        auto ba = chunk->blk_allocator_mutable();
+        if (ba->get_config().get_auto_recovery()) {
+            s_disk_bids.clear();
+            std::copy_if(bids.cbegin(), bids.cend(), std::back_inserter(s_disk_bids),
+                         [&ba](const BlkId& b) { return ba->is_blk_alloced_on_disk(b); });
+            if (!s_disk_bids.empty()) { ba->free_on_disk(s_disk_bids); }
+        }
+
+        auto const it = m_mirror_chunks.find(chunk);
+        if (it == m_mirror_chunks.cend()) {
+            m_mgr->discard_mgr().free_blks(chunk, bids);
+        } else {
+            m_mgr->discard_mgr().free_blks(chunk, bids, it->second);
+        }
+    }
+}
+
 void VirtualDev::recovery_done() {
     for (auto& pcm : m_primary_pdev_chunks_list) {
         for (auto& pchunk : pcm.chunks_in_pdev) {
+            pchunk->recover_bm_pages_done();
             pchunk->blk_allocator_mutable()->inited();
             auto mchunks_list = m_mirror_chunks[pchunk];
             for (auto& mchunk : mchunks_list) {
+                mchunk->recover_bm_pages_done();
                 mchunk->blk_allocator_mutable()->inited();
             }
         }
@@ -628,9 +792,60 @@ void VirtualDev::async_writev(const iovec* iov, const int iovcnt, const BlkId& b
                           part_of_batch);
 }
 
+void VirtualDev::async_writev(const iovec* iov, const int iovcnt, const std::vector< BlkId >& bids,
+                              vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
+    HS_DBG_ASSERT(!bids.empty(), "Writing on empty list of blkids");
+    if (bids.size() == 1) {
+        async_writev(iov, iovcnt, bids.front(), std::move(cb), cookie, part_of_batch);
+        return;
+    }
+
+    auto parent_req = make_multi_io_req(vdev_op_type_t::write, std::move(cb), cookie, uint32_cast(bids.size()));
+    COUNTER_INCREMENT(m_metrics, vdev_striped_io_count, 1);
+
+    int cur_ind{0};
+    uint64_t cur_off{0};
+    for (const auto& bid : bids) {
+        PhysicalDevChunk* chunk;
+        uint64_t const dev_offset = to_dev_offset(bid, &chunk);
+        uint64_t const size = s_cast< uint64_t >(bid.get_nblks()) * block_size();
+        auto const sub_iovs = next_iovs(iov, iovcnt, cur_ind, cur_off, size);
+        HS_DBG_ASSERT_EQ(get_len(sub_iovs.data(), s_cast< int >(sub_iovs.size())), size,
+                         "Buffer is smaller than the blkids");
+        async_writev_internal(sub_iovs.data(), s_cast< int >(sub_iovs.size()), size, chunk->physical_dev_mutable(),
+                              chunk, dev_offset, multi_io_comp_cb(parent_req), nullptr, part_of_batch);
+    }
+}
+
 void VirtualDev::async_write_internal(const char* buf, uint32_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
                                       uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie,
                                       bool part_of_batch) {
+    const auto* mchunks = mirror_chunks_of(pchunk);
+    if (mchunks == nullptr) {
+        submit_write(buf, size, pdev, pchunk, dev_offset, std::move(cb), cookie, part_of_batch);
+        return;
+    }
+
+    // Writes on the primary and all mirrors are issued together and completed once all of them are done
+    auto parent_req =
+        make_multi_io_req(vdev_op_type_t::write, std::move(cb), cookie, uint32_cast(mchunks->size() + 1));
+    submit_write(buf, size, pdev, pchunk, dev_offset, multi_io_comp_cb(parent_req), nullptr, part_of_batch);
+    for (auto* mchunk : *mchunks) {
+        submit_write(buf, size, mchunk->physical_dev_mutable(), mchunk, replica_offset(pchunk, dev_offset, mchunk),
+                     multi_io_comp_cb(parent_req), nullptr, part_of_batch);
+    }
+}
+
+void VirtualDev::submit_write(const char* buf, uint32_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                              uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
+    if (part_of_batch && can_coalesce(pdev, dev_offset, size)) {
+        iovec iov;
+        iov.iov_base = const_cast< char* >(buf);
+        iov.iov_len = size;
+        queue_coalesce_write(&iov, 1, size, pdev, pchunk, dev_offset, std::move(cb), cookie);
+        return;
+    }
+
     auto req = vdev_req_context::make_req_context();
     req->cb = std::move(cb);
     req->op_type = vdev_op_type_t::write;
@@ -642,12 +857,45 @@ void VirtualDev::async_write_internal(const char* buf, uint32_t size, PhysicalDe
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    pdev->write(buf, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+    schedule_io(
+        pdev, req, size,
+        [pdev, buf, size, dev_offset, req](bool batch) {
+            pdev->write(buf, size, dev_offset, uintptr_cast(req.get()), batch);
+        },
+        part_of_batch);
 }
 
 void VirtualDev::async_writev_internal(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev,
                                        PhysicalDevChunk* pchunk, uint64_t dev_offset, vdev_io_comp_cb_t cb,
                                        const void* cookie, bool part_of_batch) {
+    const auto* mchunks = mirror_chunks_of(pchunk);
+    if (mchunks == nullptr) {
+        submit_writev(iov, iovcnt, size, pdev, pchunk, dev_offset, std::move(cb), cookie, part_of_batch);
+        return;
+    }
+
+    // Writes on the primary and all mirrors are issued together and completed once all of them are done
+    auto parent_req =
+        make_multi_io_req(vdev_op_type_t::write, std::move(cb), cookie, uint32_cast(mchunks->size() + 1));
+    submit_writev(iov, iovcnt, size, pdev, pchunk, dev_offset, multi_io_comp_cb(parent_req), nullptr, part_of_batch);
+    for (auto* mchunk : *mchunks) {
+        submit_writev(iov, iovcnt, size, mchunk->physical_dev_mutable(), mchunk,
+                      replica_offset(pchunk, dev_offset, mchunk), multi_io_comp_cb(parent_req), nullptr,
+                      part_of_batch);
+    }
+}
+
+void VirtualDev::submit_writev(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                               uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
+    if (part_of_batch && can_coalesce(pdev, dev_offset, size)) {
+        queue_coalesce_write(iov, iovcnt, size, pdev, pchunk, dev_offset, std::move(cb), cookie);
+        return;
+    }
+    issue_writev(iov, iovcnt, size, pdev, pchunk, dev_offset, std::move(cb), cookie, part_of_batch);
+}
+
+void VirtualDev::issue_writev(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                              uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
     auto req = vdev_req_context::make_req_context();
     req->cb = std::move(cb);
     req->op_type = vdev_op_type_t::write;
@@ -659,7 +907,85 @@ void VirtualDev::async_writev_internal(const iovec* iov, int iovcnt, uint64_t si
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    pdev->writev(iov, iovcnt, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+    req->iovs.assign(iov, iov + iovcnt); // Io could be issued by the scheduler after caller's iovs are gone
+    schedule_io(
+        pdev, req, size,
+        [pdev, size, dev_offset, req](bool batch) {
+            pdev->writev(req->iovs.data(), s_cast< int >(req->iovs.size()), size, dev_offset,
+                         uintptr_cast(req.get()), batch);
+        },
+        part_of_batch);
+}
+
+bool VirtualDev::can_coalesce(const PhysicalDev* pdev, uint64_t dev_offset, uint64_t size) const {
+    // Only aligned writes are merged, so that the merged io remains aligned
+    auto const max_size = HS_DYNAMIC_CONFIG(device.write_coalesce_max_size);
+    return (size < max_size) && hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()) &&
+        hs_utils::mod_aligned_sz(size, pdev->align_size());
+}
+
+void VirtualDev::queue_coalesce_write(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev,
+                                      PhysicalDevChunk* pchunk, uint64_t dev_offset, vdev_io_comp_cb_t cb,
+                                      const void* cookie) {
+    s_coalesce_writes.push_back(coalesce_write{this, pdev, pchunk, dev_offset, size,
+                                               std::vector< iovec >(iov, iov + iovcnt), std::move(cb),
+                                               const_cast< void* >(cookie)});
+}
+
+void VirtualDev::flush_coalesce_writes() {
+    if (s_coalesce_writes.empty()) { return; }
+
+    // Take out the writes of this vdev, writes queued on other vdevs are left for their own submit_batch()
+    auto const mine = std::stable_partition(s_coalesce_writes.begin(), s_coalesce_writes.end(),
+                                            [this](const coalesce_write& w) { return w.vdev != this; });
+    std::vector< coalesce_write > writes{std::make_move_iterator(mine),
+                                         std::make_move_iterator(s_coalesce_writes.end())};
+    s_coalesce_writes.erase(mine, s_coalesce_writes.end());
+    if (writes.empty()) { return; }
+
+    std::stable_sort(writes.begin(), writes.end(), [](const coalesce_write& a, const coalesce_write& b) {
+        return (a.pdev != b.pdev) ? (a.pdev < b.pdev) : (a.dev_offset < b.dev_offset);
+    });
+
+    auto const max_size = HS_DYNAMIC_CONFIG(device.write_coalesce_max_size);
+    size_t start{0};
+    while (start < writes.size()) {
+        // Extend the run as long as the next write starts where the previous one ends on the same chunk. Chunks of a
+        // pdev could be physically adjacent, but the merged io is issued and accounted against a single chunk.
+        size_t end{start + 1};
+        uint64_t run_size{writes[start].size};
+        size_t run_iovs{writes[start].iovs.size()};
+        while ((end < writes.size()) && (writes[end].pdev == writes[start].pdev) &&
+               (writes[end].pchunk == writes[start].pchunk) &&
+               (writes[end].dev_offset == writes[end - 1].dev_offset + writes[end - 1].size) &&
+               (run_size + writes[end].size <= max_size) && (run_iovs + writes[end].iovs.size() <= max_coalesce_iovs)) {
+            run_size += writes[end].size;
+            run_iovs += writes[end].iovs.size();
+            ++end;
+        }
+
+        // Iovs are kept alive till completion, as the io is queued and submitted only at the end of the batch. Each of
+        // the original writes is completed with the result of the merged write.
+        auto merged = std::make_shared< std::vector< coalesce_write > >();
+        merged->reserve(end - start);
+        auto miovs = std::make_shared< std::vector< iovec > >();
+        miovs->reserve(run_iovs);
+        for (auto i = start; i < end; ++i) {
+            miovs->insert(miovs->end(), writes[i].iovs.begin(), writes[i].iovs.end());
+            merged->push_back(std::move(writes[i]));
+        }
+        if (end - start > 1) { COUNTER_INCREMENT(m_metrics, vdev_coalesced_write_count, end - start - 1); }
+
+        auto const& head = merged->front();
+        issue_writev(miovs->data(), s_cast< int >(miovs->size()), run_size, head.pdev, head.pchunk, head.dev_offset,
+                     [merged, miovs](std::error_condition err, void*) {
+                         for (auto& w : *merged) {
+                             if (w.cb) { w.cb(err, w.cookie); }
+                         }
+                     },
+                     nullptr, true /* part_of_batch */);
+        start = end;
+    }
 }
 
 ////////////////////////// sync write section //////////////////////////////////
@@ -718,28 +1044,248 @@ void VirtualDev::async_readv(iovec* iovs, int iovcnt, uint64_t size, const BlkId
                          part_of_batch);
 }
 
+void VirtualDev::async_readv(iovec* iovs, int iovcnt, uint64_t size, const std::vector< BlkId >& bids,
+                             vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
+    HS_DBG_ASSERT(!bids.empty(), "Reading on empty list of blkids");
+    if (bids.size() == 1) {
+        async_readv(iovs, iovcnt, size, bids.front(), std::move(cb), cookie, part_of_batch);
+        return;
+    }
+
+    auto parent_req = make_multi_io_req(vdev_op_type_t::read, std::move(cb), cookie, uint32_cast(bids.size()));
+    COUNTER_INCREMENT(m_metrics, vdev_striped_io_count, 1);
+
+    int cur_ind{0};
+    uint64_t cur_off{0};
+    uint64_t total_size{0};
+    for (const auto& bid : bids) {
+        PhysicalDevChunk* pchunk;
+        uint64_t const dev_offset = to_dev_offset(bid, &pchunk);
+        uint64_t const bid_size = s_cast< uint64_t >(bid.get_nblks()) * block_size();
+        auto sub_iovs = next_iovs(iovs, iovcnt, cur_ind, cur_off, bid_size);
+        HS_DBG_ASSERT_EQ(get_len(sub_iovs.data(), s_cast< int >(sub_iovs.size())), bid_size,
+                         "Buffer is smaller than the blkids");
+        async_readv_internal(sub_iovs.data(), s_cast< int >(sub_iovs.size()), bid_size, pchunk->physical_dev_mutable(),
+                             pchunk, dev_offset, multi_io_comp_cb(parent_req), nullptr, part_of_batch);
+        total_size += bid_size;
+    }
+    HS_DBG_ASSERT_EQ(total_size, size, "Size doesn't match the total size of blkids");
+}
+
 void VirtualDev::async_read_internal(char* buf, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
                                      uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie,
                                      bool part_of_batch) {
+    if (mirror_chunks_of(pchunk) != nullptr) {
+        if (HS_DYNAMIC_CONFIG(device.hedged_read_percentile) > 0) {
+            iovec iov;
+            iov.iov_base = buf;
+            iov.iov_len = size;
+            hedged_readv(&iov, 1, size, pchunk, dev_offset, std::move(cb), cookie, part_of_batch);
+            return;
+        }
+        if (HS_DYNAMIC_CONFIG(device.mirror_read_balance)) {
+            auto* rchunk = least_loaded_replica(pchunk, nullptr /* exclude */);
+            if (rchunk != pchunk) {
+                COUNTER_INCREMENT(m_metrics, vdev_mirror_read_count, 1);
+                dev_offset = replica_offset(pchunk, dev_offset, rchunk);
+                pchunk = rchunk;
+                pdev = rchunk->physical_dev_mutable();
+            }
+        }
+    }
+    submit_read(buf, size, pdev, pchunk, dev_offset, std::move(cb), cookie, part_of_batch);
+}
+
+void VirtualDev::submit_read(char* buf, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                             uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
     auto req = vdev_req_context::make_req_context();
     req->cb = std::move(cb);
     req->op_type = vdev_op_type_t::read;
     req->chunk = pchunk;
     req->cookie = const_cast< void* >(cookie);
 
-    pdev->read(buf, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+    schedule_io(
+        pdev, req, size,
+        [pdev, buf, size, dev_offset, req](bool batch) {
+            pdev->read(buf, size, dev_offset, uintptr_cast(req.get()), batch);
+        },
+        part_of_batch);
 }
 
 void VirtualDev::async_readv_internal(iovec* iovs, int iovcnt, uint64_t size, PhysicalDev* pdev,
                                       PhysicalDevChunk* pchunk, uint64_t dev_offset, vdev_io_comp_cb_t cb,
                                       const void* cookie, bool part_of_batch) {
+    if (mirror_chunks_of(pchunk) != nullptr) {
+        if (HS_DYNAMIC_CONFIG(device.hedged_read_percentile) > 0) {
+            hedged_readv(iovs, iovcnt, size, pchunk, dev_offset, std::move(cb), cookie, part_of_batch);
+            return;
+        }
+        if (HS_DYNAMIC_CONFIG(device.mirror_read_balance)) {
+            auto* rchunk = least_loaded_replica(pchunk, nullptr /* exclude */);
+            if (rchunk != pchunk) {
+                COUNTER_INCREMENT(m_metrics, vdev_mirror_read_count, 1);
+                dev_offset = replica_offset(pchunk, dev_offset, rchunk);
+                pchunk = rchunk;
+                pdev = rchunk->physical_dev_mutable();
+            }
+        }
+    }
+    submit_readv(iovs, iovcnt, size, pdev, pchunk, dev_offset, std::move(cb), cookie, part_of_batch);
+}
+
+void VirtualDev::submit_readv(iovec* iovs, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                              uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
     auto req = vdev_req_context::make_req_context();
     req->cb = std::move(cb);
     req->op_type = vdev_op_type_t::read;
     req->chunk = pchunk;
     req->cookie = const_cast< void* >(cookie);
 
-    pdev->readv(iovs, iovcnt, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+    req->iovs.assign(iovs, iovs + iovcnt); // Io could be issued by the scheduler after caller's iovs are gone
+    schedule_io(
+        pdev, req, size,
+        [pdev, size, dev_offset, req](bool batch) {
+            pdev->readv(req->iovs.data(), s_cast< int >(req->iovs.size()), size, dev_offset, uintptr_cast(req.get()),
+                        batch);
+        },
+        part_of_batch);
+}
+
+void VirtualDev::schedule_io(PhysicalDev* pdev, const boost::intrusive_ptr< vdev_req_context >& req, uint64_t size,
+                             IoScheduler::io_issue_cb_t issue_cb, bool part_of_batch) {
+    req->io_size = size;
+    pdev->on_io_submit();
+    if (!HS_DYNAMIC_CONFIG(device.io_sched_enabled)) {
+        req->io_issue_time = Clock::now();
+        issue_cb(part_of_batch);
+        return;
+    }
+
+    req->io_class = (req->op_type == vdev_op_type_t::read) ? m_read_io_class : m_write_io_class;
+    req->scheduled = true;
+    pdev->io_scheduler().submit(
+        req->io_class, size,
+        [req, issue_cb = std::move(issue_cb)](bool batch) {
+            req->io_issue_time = Clock::now();
+            issue_cb(batch);
+        },
+        part_of_batch);
+}
+
+////////////////////////////////////////// mirror read section ////////////////////////////////////////////
+// Read which could be issued on more than one replica. Every replica reads to its own buffer and the one which
+// completes first is copied to the caller's buffers, so that the late one doesn't overwrite the caller's buffers after
+// the caller is called back.
+struct hedged_read_ctx {
+    std::vector< iovec > iovs; // Caller's buffers
+    uint64_t size{0};
+    vdev_io_comp_cb_t cb;
+    void* cookie{nullptr};
+    PhysicalDevChunk* pchunk{nullptr}; // Primary chunk and the offset in it the read is for
+    uint64_t dev_offset{0};
+
+    std::array< PhysicalDevChunk*, 2 > chunks{nullptr, nullptr}; // Replica each leg is read from
+    std::array< uint8_t*, 2 > bufs{nullptr, nullptr};
+    std::atomic< bool > completed{false};
+    std::atomic< bool > hedge_issued{false};
+    std::atomic< uint32_t > nissued{0};
+    std::atomic< uint32_t > nfailed{0};
+
+    ~hedged_read_ctx() {
+        for (auto* buf : bufs) {
+            if (buf) { hs_utils::iobuf_free(buf, sisl::buftag::common); }
+        }
+    }
+};
+
+const std::vector< PhysicalDevChunk* >* VirtualDev::mirror_chunks_of(PhysicalDevChunk* pchunk) const {
+    if (num_mirrors() == 0) { return nullptr; }
+    const auto it = m_mirror_chunks.find(pchunk);
+    return ((it == m_mirror_chunks.cend()) || it->second.empty()) ? nullptr : &it->second;
+}
+
+uint64_t VirtualDev::replica_offset(const PhysicalDevChunk* pchunk, uint64_t dev_offset,
+                                    const PhysicalDevChunk* rchunk) {
+    return rchunk->start_offset() + (dev_offset - pchunk->start_offset());
+}
+
+PhysicalDevChunk* VirtualDev::least_loaded_replica(PhysicalDevChunk* pchunk, const PhysicalDevChunk* exclude) const {
+    // Same cost as load aware device selector, but without free space as replicas have the same data
+    const auto cost = [](const PhysicalDevChunk* chunk) {
+        const auto* pdev = chunk->physical_dev();
+        const double wait{static_cast< double >(pdev->outstanding_ios() + 1) *
+                          static_cast< double >(pdev->ewma_latency_us() + 1)};
+        return pdev->is_slow() ? wait * HS_DYNAMIC_CONFIG(device.slow_dev_cost_penalty) : wait;
+    };
+
+    PhysicalDevChunk* best = (pchunk == exclude) ? nullptr : pchunk;
+    for (auto* mchunk : *mirror_chunks_of(pchunk)) {
+        if (mchunk == exclude) { continue; }
+        if ((best == nullptr) || (cost(mchunk) < cost(best))) { best = mchunk; }
+    }
+    return best;
+}
+
+void VirtualDev::hedged_readv(iovec* iovs, int iovcnt, uint64_t size, PhysicalDevChunk* pchunk, uint64_t dev_offset,
+                              vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch) {
+    auto ctx = std::make_shared< hedged_read_ctx >();
+    ctx->iovs.assign(iovs, iovs + iovcnt);
+    ctx->size = size;
+    ctx->cb = std::move(cb);
+    ctx->cookie = const_cast< void* >(cookie);
+    ctx->pchunk = pchunk;
+    ctx->dev_offset = dev_offset;
+
+    auto* rchunk = HS_DYNAMIC_CONFIG(device.mirror_read_balance) ? least_loaded_replica(pchunk, nullptr) : pchunk;
+    issue_hedged_read(ctx, 0, rchunk, part_of_batch);
+
+    // If the read doesn't complete within the percentile latency of its device, issue it on the next best replica
+    const auto delay_us = std::max(
+        rchunk->physical_dev()->read_latency_percentile_us(HS_DYNAMIC_CONFIG(device.hedged_read_percentile)),
+        HS_DYNAMIC_CONFIG(device.hedged_read_min_delay_us));
+    iomanager.schedule_thread_timer(delay_us * 1000, false /* recurring */, nullptr /* cookie */,
+                                    [this, ctx](void*) {
+                                        if (ctx->completed.load() || ctx->hedge_issued.exchange(true)) { return; }
+                                        COUNTER_INCREMENT(m_metrics, vdev_hedged_read_count, 1);
+                                        issue_hedged_read(ctx, 1, least_loaded_replica(ctx->pchunk, ctx->chunks[0]),
+                                                          false /* part_of_batch */);
+                                    });
+}
+
+void VirtualDev::issue_hedged_read(const std::shared_ptr< hedged_read_ctx >& ctx, uint32_t leg,
+                                   PhysicalDevChunk* rchunk, bool part_of_batch) {
+    ctx->nissued.fetch_add(1);
+    ctx->chunks[leg] = rchunk;
+    ctx->bufs[leg] = hs_utils::iobuf_alloc(ctx->size, sisl::buftag::common, align_size());
+    if (rchunk != ctx->pchunk) { COUNTER_INCREMENT(m_metrics, vdev_mirror_read_count, 1); }
+
+    submit_read(r_cast< char* >(ctx->bufs[leg]), ctx->size, rchunk->physical_dev_mutable(), rchunk,
+                replica_offset(ctx->pchunk, ctx->dev_offset, rchunk),
+                [this, ctx, leg](std::error_condition err, void*) { on_hedged_read_done(ctx, leg, err); }, nullptr,
+                part_of_batch);
+}
+
+void VirtualDev::on_hedged_read_done(const std::shared_ptr< hedged_read_ctx >& ctx, uint32_t leg,
+                                     std::error_condition err) {
+    if (!err) {
+        if (ctx->completed.exchange(true)) { return; } // Other replica has already returned the data
+        uint64_t buf_offset{0};
+        for (const auto& iov : ctx->iovs) {
+            std::memcpy(iov.iov_base, ctx->bufs[leg] + buf_offset, iov.iov_len);
+            buf_offset += iov.iov_len;
+        }
+        if (leg == 1) { COUNTER_INCREMENT(m_metrics, vdev_hedged_read_win_count, 1); }
+        ctx->cb(no_error, ctx->cookie);
+        return;
+    }
+
+    // Fail over to the other replica right away if it is not issued yet, else fail once all issued reads failed
+    const auto nfailed = ctx->nfailed.fetch_add(1) + 1;
+    if (!ctx->hedge_issued.exchange(true)) {
+        issue_hedged_read(ctx, 1, least_loaded_replica(ctx->pchunk, ctx->chunks[0]), false /* part_of_batch */);
+        return;
+    }
+    if ((nfailed == ctx->nissued.load()) && !ctx->completed.exchange(true)) { ctx->cb(err, ctx->cookie); }
 }
 
 ////////////////////////////////////////// sync read section ////////////////////////////////////////////
@@ -814,7 +1360,21 @@ void VirtualDev::fsync_pdevs(vdev_io_comp_cb_t cb) {
     }
 }
 
-void VirtualDev::submit_batch() { m_drive_iface->submit_batch(); }
+void VirtualDev::submit_batch() {
+    flush_coalesce_writes();
+
+    // Ios of a batch could be spread across pdevs (striped or mirrored), so submit on every drive interface they use
+    for (auto* iface : m_drive_ifaces) {
+        iface->submit_batch();
+    }
+}
+
+void VirtualDev::add_drive_iface(iomgr::DriveInterface* iface) {
+    if (iface == nullptr) { return; } // Memory backed drives have nothing to batch
+    if (std::find(m_drive_ifaces.cbegin(), m_drive_ifaces.cend(), iface) == m_drive_ifaces.cend()) {
+        m_drive_ifaces.push_back(iface);
+    }
+}
 
 void VirtualDev::get_vb_context(const sisl::blob& ctx_data) const { m_mgr->get_vb_context(m_vb->vdev_id, ctx_data); }
 
@@ -906,13 +1466,9 @@ void VirtualDev::write_nmirror(const char* buf, const uint32_t size, PhysicalDev
     const uint64_t primary_chunk_offset = dev_offset - chunk->start_offset();
 
     // Write to the mirror as well
-    for (auto i : boost::irange< uint32_t >(0, num_mirrors())) {
-        for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
-            dev_offset = mchunk->start_offset() + primary_chunk_offset;
-
-            // We do not support async mirrored writes yet.
-            mchunk->physical_dev_mutable()->sync_write(buf, size, dev_offset);
-        }
+    for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
+        dev_offset = mchunk->start_offset() + primary_chunk_offset;
+        mchunk->physical_dev_mutable()->sync_write(buf, size, dev_offset);
     }
 }
 
@@ -922,13 +1478,9 @@ void VirtualDev::writev_nmirror(const iovec* iov, const int iovcnt, const uint32
     const uint64_t primary_chunk_offset = dev_offset - chunk->start_offset();
 
     // Write to the mirror as well
-    for (auto i : boost::irange< uint32_t >(0, num_mirrors())) {
-        for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
-            dev_offset = mchunk->start_offset() + primary_chunk_offset;
-
-            // We do not support async mirrored writes yet.
-            mchunk->physical_dev_mutable()->sync_writev(iov, iovcnt, size, dev_offset);
-        }
+    for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
+        dev_offset = mchunk->start_offset() + primary_chunk_offset;
+        mchunk->physical_dev_mutable()->sync_writev(iov, iovcnt, size, dev_offset);
     }
 }
 
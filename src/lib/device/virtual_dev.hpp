@@ -36,6 +36,7 @@
 
 #include "device.h"
 #include "device_selector.hpp"
+#include "io_scheduler.hpp"
 
 namespace iomgr {
 class DriveInterface;
@@ -50,7 +51,7 @@ struct pdev_chunk_map {
     PhysicalDev* pdev;
     std::vector< PhysicalDevChunk* > chunks_in_pdev;
 };
-// ENUM(blk_allocator_type_t, uint8_t, none, fixed, varsize);
+// ENUM(blk_allocator_type_t, uint8_t, none, fixed, varsize, extent);
 ENUM(vdev_op_type_t, uint8_t, read, write, format, fsync);
 
 typedef std::function< void(std::error_condition, void* /* cookie */) > vdev_io_comp_cb_t;
@@ -67,7 +68,12 @@ struct vdev_req_context : public sisl::ObjLifeCounter< vdev_req_context > {
     bool io_on_multi_pdevs{false};                // Is IO part of multiple pdevs (say format)
     sisl::atomic_counter< uint32_t > outstanding_ios{0}; // Outstanding ios in case of multi pdev io
     PhysicalDevChunk* chunk{nullptr};                    // Chunk where the io is issued if its a single pdev io
-    Clock::time_point io_start_time{Clock::now()};
+    io_class_t io_class{io_class_t::latency};            // Io class it is scheduled under on the pdev
+    bool scheduled{false};                               // Is it submitted through the io scheduler of the pdev
+    uint64_t io_size{0};                                 // Size of the io if its a single pdev read/write
+    std::vector< iovec > iovs;                           // Copy of the iovs of a vectored io till it is issued
+    Clock::time_point io_start_time{Clock::now()};       // Time the io is submitted to the vdev
+    Clock::time_point io_issue_time{io_start_time};      // Time it is issued to the device, after the scheduler wait
 
     void inc_ref() { intrusive_ptr_add_ref(this); }
     void dec_ref() { intrusive_ptr_release(this); }
@@ -108,6 +114,12 @@ public:
         REGISTER_COUNTER(default_chunk_allocation_cnt, "default chunk allocation count");
         REGISTER_COUNTER(random_chunk_allocation_cnt,
                          "random chunk allocation count"); // ideally it should be zero for hdd
+        REGISTER_COUNTER(vdev_striped_alloc_count, "vdev allocations striped across pdevs");
+        REGISTER_COUNTER(vdev_striped_io_count, "vdev ios split across multiple blkids in parallel");
+        REGISTER_COUNTER(vdev_mirror_read_count, "vdev reads served by a mirror instead of primary");
+        REGISTER_COUNTER(vdev_hedged_read_count, "vdev reads issued on one more replica as first one is slow");
+        REGISTER_COUNTER(vdev_hedged_read_win_count, "vdev hedged reads where the later replica returned first");
+        REGISTER_COUNTER(vdev_coalesced_write_count, "vdev batched writes merged into an adjacent write");
         register_me_to_farm();
     }
 
@@ -122,7 +134,8 @@ public:
 /*
  * VirtualDev: Virtual device implements a similar functionality of RAID striping, customized however. Virtual devices
  * can be created across multiple physical devices. Unlike RAID, its io is not always in a bigger strip sizes. It
- * support n-mirrored writes.
+ * support n-mirrored writes, which are issued on all the mirrors in parallel. Reads are served from the replica on the
+ * least loaded device and optionally hedged on one more replica.
  *
  */
 static constexpr uint32_t VIRDEV_BLKSIZE{512};
@@ -130,6 +143,7 @@ static constexpr uint64_t CHUNK_EOF{0xabcdabcd};
 static constexpr off_t INVALID_OFFSET{std::numeric_limits< off_t >::max()};
 
 struct blkalloc_cp;
+struct hedged_read_ctx;
 
 class VirtualDev {
 protected:
@@ -146,7 +160,7 @@ protected:
     // for the mirrored chunk always follows the next device pattern.
     std::map< PhysicalDevChunk*, std::vector< PhysicalDevChunk* > > m_mirror_chunks;
 
-    std::unique_ptr< RoundRobinDeviceSelector > m_selector; // Instance of device selector
+    std::unique_ptr< DeviceSelector > m_selector; // Instance of device selector
     uint32_t m_num_chunks{0};
     uint32_t m_blk_size{4096};
     bool m_recovery_init{false};
@@ -154,12 +168,15 @@ protected:
     blk_allocator_type_t m_allocator_type;
     bool m_auto_recovery{false};
     vdev_high_watermark_cb_t m_hwm_cb{nullptr};
-    iomgr::DriveInterface* m_drive_iface{nullptr};
+    std::vector< iomgr::DriveInterface* > m_drive_ifaces; // Distinct drive interfaces of the pdevs, for batch submit
+    io_class_t m_read_io_class{io_class_t::latency};       // Io class reads of this vdev are scheduled under
+    io_class_t m_write_io_class{io_class_t::throughput};   // Io class writes of this vdev are scheduled under
     VirtualDevMetrics m_metrics;
     std::vector< PhysicalDevChunk* > m_free_streams;
     std::mutex m_free_streams_lk;
     PhysicalDevChunk* m_default_chunk{nullptr};
     PhysicalDevGroup m_pdev_group;
+    uint32_t m_stripe_unit_blks{0}; // Blks per stripe unit if large allocations are striped across pdevs
 
 private:
     static uint32_t s_num_chunks_created; // vdev will not be created in parallel threads;
@@ -219,6 +236,8 @@ public:
     /// @param hints : Hints about block allocation, (specific device to allocate, stream etc)
     /// @param out_blkid : Reference to the vector of blkids to be placed. It appends into the vector
     /// @return BlkAllocStatus : Status about the allocation
+    /// If the vdev is striped, large requests which need not be contiguous are carved in stripe units laid round robin
+    /// across the pdevs, so that io on the returned blkids is spread across all the drives.
     virtual BlkAllocStatus alloc_blk(uint32_t nblks, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkid);
 
     /// @brief Checks if a given block id is allocated in the in-memory version of the blk allocator
@@ -238,6 +257,11 @@ public:
     virtual bool free_on_realtime(const BlkId& b);
     virtual void free_blk(const BlkId& b);
 
+    /// @brief Free the blkids freed by a CP. They are freed on the disk bitmap right away, to be persisted by the
+    /// following cp_flush(). Freed blks could be discarded on the device, before they are available to be allocated
+    /// again.
+    void free_blks_on_cp(const std::vector< BlkId >& blkids);
+
     /////////////////////// Write API related methods /////////////////////////////
     /// @brief Asynchornously write the buffer to the device on a given blkid
     /// @param buf : Buffer to write data from
@@ -263,6 +287,18 @@ public:
     void async_writev(const iovec* iov, int iovcnt, const BlkId& bid, vdev_io_comp_cb_t cb,
                       const void* cookie = nullptr, bool part_of_batch = false);
 
+    /// @brief Asynchornously write the vector of buffers across the list of blkids. Buffers are split in the order of
+    /// the blkids and io on every blkid is issued in parallel. Callback is called once all of them are completed.
+    /// @param iov : Vector of buffer to write data from
+    /// @param iovcnt : Count of buffer
+    /// @param bids : BlkIds which were previously allocated. Size of the buffers should match the total of blkids
+    /// @param cb : Callback once write on all the blkids are completed. Error is the first error encountered if any.
+    /// @param cookie : cookie set by caller and returned on completion;
+    /// @param part_of_batch : Is this write part of batch io. If true, caller is expected to call submit_batch at
+    /// the end of the batch, otherwise this write request will not be queued.
+    void async_writev(const iovec* iov, int iovcnt, const std::vector< BlkId >& bids, vdev_io_comp_cb_t cb,
+                      const void* cookie = nullptr, bool part_of_batch = false);
+
     /// @brief Synchronously write the buffer to the blkid
     /// @param buf : Buffer to write data from
     /// @param size : Size of the buffer
@@ -306,6 +342,20 @@ public:
     void async_readv(iovec* iovs, int iovcnt, uint64_t size, const BlkId& bid, vdev_io_comp_cb_t cb,
                      const void* cookie = nullptr, bool part_of_batch = false);
 
+    /// @brief Asynchronously read the data for the list of blkids to the vector of buffers. Buffers are split in the
+    /// order of the blkids and io on every blkid is issued in parallel. Callback is called once all of them are
+    /// completed.
+    /// @param iov : Vector of buffer to read data to
+    /// @param iovcnt : Count of buffer
+    /// @param size : Total size of the blkids
+    /// @param bids : BlkIds from data needs to be read
+    /// @param cb : Callback once read on all the blkids are completed. Error is the first error encountered if any.
+    /// @param cookie : cookie set by caller and returned on completion;
+    /// @param part_of_batch : Is this read part of batch io. If true, caller is expected to call submit_batch at
+    /// the end of the batch, otherwise this read request will not be queued.
+    void async_readv(iovec* iovs, int iovcnt, uint64_t size, const std::vector< BlkId >& bids, vdev_io_comp_cb_t cb,
+                     const void* cookie = nullptr, bool part_of_batch = false);
+
     /// @brief Synchronously read the data for a given BlkId.
     /// @param buf : Buffer to read data to
     /// @param size : Size of the buffer
@@ -326,9 +376,18 @@ public:
     /// @param cb Callback upon fsync on all devices is completed
     void fsync_pdevs(vdev_io_comp_cb_t cb);
 
-    /// @brief Submit the batch of IOs previously queued as part of async read/write APIs.
+    /// @brief Submit the batch of IOs previously queued as part of async read/write APIs, on all the pdevs of the vdev.
+    /// Physically adjacent writes of the batch are merged into larger ios before submission. Writes with part_of_batch
+    /// are issued only by this call and it has to be called from the same thread which queued them.
     void submit_batch();
 
+    /// @brief Set the io class reads and writes of this vdev are scheduled under on the pdevs. By default reads are
+    /// latency critical and writes are throughput ios (say CP flushes).
+    void set_io_class(io_class_t read_class, io_class_t write_class) {
+        m_read_io_class = read_class;
+        m_write_io_class = write_class;
+    }
+
     void get_vb_context(const sisl::blob& ctx_data) const;
     void update_vb_context(const sisl::blob& ctx_data);
     virtual void recovery_done();
@@ -343,8 +402,11 @@ public:
     virtual uint32_t blks_per_chunk() const { return chunk_size() / block_size(); }
     virtual uint32_t block_size() const;
     virtual uint32_t num_mirrors() const;
+    uint32_t stripe_unit_blks() const { return m_stripe_unit_blks; }
+    bool is_striped() const { return (m_stripe_unit_blks != 0); }
     virtual std::string to_string() const { return std::string{}; }
     virtual nlohmann::json get_status(const int log_level) const;
+    nlohmann::json get_metrics_in_json() { return m_metrics.get_result_in_json(true); }
 
     static uint64_t get_len(const iovec* iov, const int iovcnt);
     virtual void reset_failed_state();
@@ -440,12 +502,49 @@ protected:
                                 uint64_t dev_offset);
 
 private:
+    void submit_write(const char* buf, uint32_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk, uint64_t dev_offset,
+                      vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch);
+    void submit_writev(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                       uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch);
+    void schedule_io(PhysicalDev* pdev, const boost::intrusive_ptr< vdev_req_context >& req, uint64_t size,
+                     IoScheduler::io_issue_cb_t issue_cb, bool part_of_batch);
+    void issue_writev(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                      uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch);
+    void submit_read(char* buf, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk, uint64_t dev_offset,
+                     vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch);
+
+    /// @brief Writes queued as part of a batch are held back till submit_batch(), where physically adjacent writes
+    /// within a chunk are merged into a single writev and completions are fanned back out to each of the original
+    /// writes.
+    bool can_coalesce(const PhysicalDev* pdev, uint64_t dev_offset, uint64_t size) const;
+    void queue_coalesce_write(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                              uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie);
+    void flush_coalesce_writes();
+    void submit_readv(iovec* iovs, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                      uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch);
+
+    /// @brief Mirrors of the given primary chunk, nullptr if it doesn't have any
+    const std::vector< PhysicalDevChunk* >* mirror_chunks_of(PhysicalDevChunk* pchunk) const;
+
+    /// @brief Offset in the replica rchunk for the dev_offset in the primary chunk pchunk
+    static uint64_t replica_offset(const PhysicalDevChunk* pchunk, uint64_t dev_offset, const PhysicalDevChunk* rchunk);
+
+    /// @brief Replica (primary or one of its mirrors) of the primary chunk on the least loaded pdev other than exclude
+    PhysicalDevChunk* least_loaded_replica(PhysicalDevChunk* pchunk, const PhysicalDevChunk* exclude) const;
+
+    void hedged_readv(iovec* iovs, int iovcnt, uint64_t size, PhysicalDevChunk* pchunk, uint64_t dev_offset,
+                      vdev_io_comp_cb_t cb, const void* cookie, bool part_of_batch);
+    void issue_hedged_read(const std::shared_ptr< hedged_read_ctx >& ctx, uint32_t leg, PhysicalDevChunk* rchunk,
+                           bool part_of_batch);
+    void on_hedged_read_done(const std::shared_ptr< hedged_read_ctx >& ctx, uint32_t leg, std::error_condition err);
+
     void write_nmirror(const char* buf, const uint32_t size, PhysicalDevChunk* chunk, const uint64_t dev_offset_in);
     void writev_nmirror(const iovec* iov, const int iovcnt, const uint32_t size, PhysicalDevChunk* chunk,
                         const uint64_t dev_offset_in);
 
     virtual BlkAllocStatus do_alloc_blk(blk_count_t nblks, const blk_alloc_hints& hints,
                                         std::vector< BlkId >& out_blkid);
+    BlkAllocStatus alloc_striped_blk(uint32_t nblks, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkid);
     uint32_t num_streams() const;
     uint64_t stream_size() const;
 
@@ -457,6 +556,7 @@ private:
     BlkAllocStatus alloc_blk_from_chunk(const blk_count_t nblks, const blk_alloc_hints& hints,
                                         std::vector< BlkId >& out_blkid, PhysicalDevChunk* const chunk);
     void reserve_stream(const stream_id_t id);
+    void add_drive_iface(iomgr::DriveInterface* iface);
 };
 
 } // namespace homestore
@@ -20,6 +20,7 @@
 
 #include <sisl/fds/malloc_helper.hpp>
 #include <sisl/fds/buffer.hpp>
+#include <sisl/metrics/metrics.hpp>
 #include <sisl/logging/logging.h>
 #include <sisl/cache/lru_evictor.hpp>
 
@@ -38,6 +39,7 @@
 #include "device/device.h"
 #include "device/virtual_dev.hpp"
 #include "common/resource_mgr.hpp"
+#include "common/iobuf_pool.hpp"
 #include "meta/meta_sb.hpp"
 #include "logstore/log_store_family.hpp"
 #include "device/journal_vdev.hpp"
@@ -55,6 +57,32 @@
 namespace homestore {
 HomeStoreSafePtr HomeStore::s_instance{nullptr};
 
+class HomeStoreInitMetrics : public sisl::MetricsGroup {
+public:
+    explicit HomeStoreInitMetrics() : sisl::MetricsGroup("HomeStoreInit", "homestore_init") {
+        REGISTER_GAUGE(init_device_discovery_ms, "Time to open the devices and load their superblocks in ms");
+        REGISTER_GAUGE(init_format_ms, "Time to create the vdevs on first time boot in ms");
+        REGISTER_GAUGE(init_blkalloc_ms, "Time to initialize the blk allocators of all chunks in ms");
+        REGISTER_GAUGE(init_meta_service_ms, "Time to start the meta service and replay its blks in ms");
+        REGISTER_GAUGE(init_log_service_ms, "Time to start the log service and recover the log stores in ms");
+        REGISTER_GAUGE(init_index_service_ms, "Time to start the index service in ms");
+        REGISTER_GAUGE(init_total_ms, "Total time of homestore init in ms");
+        register_me_to_farm();
+    }
+
+    HomeStoreInitMetrics(const HomeStoreInitMetrics&) = delete;
+    HomeStoreInitMetrics(HomeStoreInitMetrics&&) noexcept = delete;
+    HomeStoreInitMetrics& operator=(const HomeStoreInitMetrics&) = delete;
+    HomeStoreInitMetrics& operator=(HomeStoreInitMetrics&&) noexcept = delete;
+    ~HomeStoreInitMetrics() { deregister_me_from_farm(); }
+};
+
+// Process wide, so that the timings of the last init are reported even across homestore restarts
+static HomeStoreInitMetrics& init_metrics() {
+    static HomeStoreInitMetrics s_init_metrics;
+    return s_init_metrics;
+}
+
 HomeStore* HomeStore::instance() {
     if (s_instance == nullptr) { s_instance = std::make_shared< HomeStore >(); }
     return s_instance.get();
@@ -91,8 +119,9 @@ HomeStore& HomeStore::with_meta_service(float size_pct) {
     return *this;
 }
 
-HomeStore& HomeStore::with_data_service(float size_pct) {
+HomeStore& HomeStore::with_data_service(float size_pct, blk_allocator_type_t allocator_type) {
     m_data_store_size_pct = size_pct;
+    m_data_allocator_type = allocator_type;
     return *this;
 }
 
@@ -107,6 +136,7 @@ HomeStore& HomeStore::before_init_devices(hs_init_starting_cb_t init_starting_cb
 }
 
 void HomeStore::init(bool wait_for_init) {
+    m_init_start_time = Clock::now();
     auto& hs_config = HomeStoreStaticConfig::instance();
     if (hs_config.input.data_devices.empty()) {
         LOGERROR("no data devices given");
@@ -161,6 +191,9 @@ void HomeStore::init(bool wait_for_init) {
     // Restrict iomanager to throttle upto the app mem size allocated for us
     iomanager.set_io_memory_limit(HS_STATIC_CONFIG(input.io_mem_size()));
 
+    // Pool of io buffers, carved out of the io memory above. It is process wide, so restart reuses the same pool
+    IoBufPool::instance().start(m_resource_mgr->get_iobuf_pool_cap());
+
     ///////////// Startup of services  /////////////////////////
     // Order of the initialization
     // 1. Meta Service instance is created
@@ -176,13 +209,15 @@ void HomeStore::init(bool wait_for_init) {
     LOGINFO("Homestore is initializing with following services: ", list_services());
     if (has_meta_service()) { m_meta_service = std::make_unique< MetaBlkService >(); }
     if (has_log_service()) { m_log_service = std::make_unique< LogStoreService >(); }
-    if (has_data_service()) { m_data_service = std::make_unique< BlkDataService >(); }
+    if (has_data_service()) { m_data_service = std::make_unique< BlkDataService >(m_data_allocator_type); }
     if (has_index_service()) { m_index_service = std::make_unique< IndexService >(std::move(m_index_svc_cbs)); }
 
+    auto phase_start = Clock::now();
     m_dev_mgr = std::make_unique< DeviceManager >(hs_config.input.data_devices, bind_this(HomeStore::new_vdev_found, 2),
                                                   sizeof(sb_blkstore_blob), VirtualDev::static_process_completions,
                                                   bind_this(HomeStore::process_vdev_error, 1));
     m_dev_mgr->init();
+    GAUGE_UPDATE(init_metrics(), init_device_discovery_ms, get_elapsed_time_ms(phase_start));
 
     uint64_t cache_size = resource_mgr().get_cache_size();
     m_evictor = std::make_shared< sisl::LRUEvictor >(cache_size, 1000);
@@ -193,7 +228,11 @@ void HomeStore::init(bool wait_for_init) {
     iomanager.create_reactor("hs_init", INTERRUPT_LOOP, [this](bool thread_started) {
         if (thread_started) {
             if (m_before_init_starting_cb) { m_before_init_starting_cb(); }
-            if (is_first_time_boot()) { create_vdevs(); }
+            if (is_first_time_boot()) {
+                auto const format_start = Clock::now();
+                create_vdevs();
+                GAUGE_UPDATE(init_metrics(), init_format_ms, get_elapsed_time_ms(format_start));
+            }
             init_done();
         }
     });
@@ -320,17 +359,33 @@ void HomeStore::init_done() {
     const auto& inp_params = HomeStoreStaticConfig::instance().input;
     auto cnt = m_format_cnt.fetch_sub(1);
     if (cnt != 1) { return; }
+    auto phase_start = Clock::now();
     m_dev_mgr->init_done();
+    GAUGE_UPDATE(init_metrics(), init_blkalloc_ms, get_elapsed_time_ms(phase_start));
 
     m_cp_mgr = std::make_unique< CPManager >(is_first_time_boot()); // Initialize CPManager
+    phase_start = Clock::now();
     m_meta_service->start(is_first_time_boot());
+    GAUGE_UPDATE(init_metrics(), init_meta_service_ms, get_elapsed_time_ms(phase_start));
     m_resource_mgr->set_total_cap(m_dev_mgr->total_cap());
 
     // In case of custom recovery, let consumer starts the recovery and it is consumer module's responsibilities to
     // start log store
-    if (has_log_service() && inp_params.auto_recovery) { m_log_service->start(is_first_time_boot()); }
+    if (has_log_service() && inp_params.auto_recovery) {
+        phase_start = Clock::now();
+        m_log_service->start(is_first_time_boot());
+        GAUGE_UPDATE(init_metrics(), init_log_service_ms, get_elapsed_time_ms(phase_start));
+    }
+
+    if (has_index_service()) {
+        phase_start = Clock::now();
+        m_index_service->start();
+        GAUGE_UPDATE(init_metrics(), init_index_service_ms, get_elapsed_time_ms(phase_start));
+    }
 
-    if (has_index_service()) { m_index_service->start(); }
+    auto const total_ms = get_elapsed_time_ms(m_init_start_time);
+    GAUGE_UPDATE(init_metrics(), init_total_ms, total_ms);
+    LOGINFO("HomeStore init took {} ms", total_ms);
 
     if (m_init_done_cb) { m_init_done_cb(); }
 }
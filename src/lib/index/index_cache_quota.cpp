@@ -0,0 +1,243 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <limits>
+#include <boost/uuid/nil_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include "index/index_cache_quota.hpp"
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+
+namespace homestore {
+IndexCacheQuota::IndexCacheQuota(uint64_t total_cache_size) : m_total_size{int64_cast(total_cache_size)} {
+    // Reserve ordinal 0 for buffers which are not owned by any table. They are never restricted
+    auto t = std::make_unique< table_cache_stats >(boost::uuids::nil_uuid());
+    t->min_quota_size = 0;
+    t->max_quota_size = m_total_size;
+    t->quota_size.store(m_total_size);
+    m_tables.emplace_back(std::move(t));
+}
+
+IndexCacheQuota::~IndexCacheQuota() { stop(); }
+
+void IndexCacheQuota::start() {
+    auto const freq_ms = HS_DYNAMIC_CONFIG(cache.index_quota_rebalance_interval_ms);
+    if (freq_ms == 0) { return; }
+
+    m_rebalance_timer_hdl = iomanager.schedule_global_timer(freq_ms * 1000 * 1000, true, nullptr,
+                                                            iomgr::thread_regex::all_worker,
+                                                            [this](void* cookie) { rebalance(); });
+}
+
+void IndexCacheQuota::stop() {
+    if (m_rebalance_timer_hdl != iomgr::null_timer_handle) {
+        iomanager.cancel_timer(m_rebalance_timer_hdl);
+        m_rebalance_timer_hdl = iomgr::null_timer_handle;
+    }
+}
+
+uint32_t IndexCacheQuota::register_table(uuid_t uuid) {
+    std::unique_lock lg{m_tables_mtx};
+    for (uint32_t i{1}; i < m_tables.size(); ++i) {
+        if (m_tables[i]->uuid == uuid) { return i; }
+    }
+
+    auto t = std::make_unique< table_cache_stats >(uuid);
+    t->min_quota_size = int64_cast(m_total_size * HS_DYNAMIC_CONFIG(cache.index_table_min_quota_pct) / 100);
+    t->max_quota_size = int64_cast(m_total_size * HS_DYNAMIC_CONFIG(cache.index_table_max_quota_pct) / 100);
+
+    // Start with a fair share of cache, rebalancer will move it based on the benefit the table gets out of the cache.
+    // Unaccounted slot is not a table and is not counted towards the share.
+    auto const ntables = int64_cast(m_tables.size()); // Existing tables + 1 new - 1 unaccounted
+    auto const fair_share =
+        std::clamp(m_total_size / ntables, t->min_quota_size, std::max(t->min_quota_size, t->max_quota_size));
+
+    // Shrink the existing tables proportionally to make room for the new table, so that the total quota does not
+    // exceed the cache size (unless the configured min quotas of all tables by themselves exceed it)
+    int64_t existing_quota{0};
+    for (uint32_t i{1}; i < m_tables.size(); ++i) {
+        existing_quota += m_tables[i]->quota_size.load();
+    }
+    auto const avail_quota = m_total_size - fair_share;
+    if (existing_quota > avail_quota) {
+        for (uint32_t i{1}; i < m_tables.size(); ++i) {
+            auto et = m_tables[i].get();
+            auto const scaled = int64_cast(static_cast< double >(et->quota_size.load()) * avail_quota / existing_quota);
+            et->quota_size.store(std::clamp(scaled, et->min_quota_size, et->max_quota_size));
+            update_over_quota(et);
+        }
+    }
+    t->quota_size.store(fair_share);
+    m_tables.emplace_back(std::move(t));
+
+    LOGINFO("Index table uuid={} registered with cache ordinal={} quota=[min={}, cur={}, max={}]",
+            boost::uuids::to_string(uuid), m_tables.size() - 1, m_tables.back()->min_quota_size,
+            m_tables.back()->quota_size.load(), m_tables.back()->max_quota_size);
+    return uint32_cast(m_tables.size() - 1);
+}
+
+void IndexCacheQuota::set_quota(uint32_t ordinal, double min_pct, double max_pct) {
+    HS_REL_ASSERT_LE(min_pct, max_pct, "Invalid quota range for index table cache");
+    auto t = get_table(ordinal);
+    if (t == nullptr) { return; }
+
+    std::unique_lock lg{m_tables_mtx};
+    t->min_quota_size = int64_cast(m_total_size * min_pct / 100);
+    t->max_quota_size = int64_cast(m_total_size * max_pct / 100);
+    t->quota_size.store(std::clamp(t->quota_size.load(), t->min_quota_size, t->max_quota_size));
+    update_over_quota(t);
+}
+
+void IndexCacheQuota::on_insert(uint32_t ordinal, uint32_t size) {
+    auto t = get_table(ordinal);
+    t->resident_size.fetch_add(size, std::memory_order_relaxed);
+    update_over_quota(t);
+}
+
+void IndexCacheQuota::on_remove(uint32_t ordinal, uint32_t size) {
+    auto t = get_table(ordinal);
+    t->resident_size.fetch_sub(size, std::memory_order_relaxed);
+    update_over_quota(t);
+}
+
+void IndexCacheQuota::on_hit(uint32_t ordinal) { get_table(ordinal)->hits.fetch_add(1, std::memory_order_relaxed); }
+
+void IndexCacheQuota::on_miss(uint32_t ordinal, BlkId blkid) {
+    auto t = get_table(ordinal);
+    t->misses.fetch_add(1, std::memory_order_relaxed);
+
+    std::unique_lock lg{t->ghost_mtx};
+    if (t->ghost_set.erase(blkid.to_integer())) { t->ghost_hits.fetch_add(1, std::memory_order_relaxed); }
+}
+
+bool IndexCacheQuota::can_evict(uint32_t ordinal) const {
+    auto t = get_table(ordinal);
+
+    // Protect the working set of the table upto its minimum quota
+    if (t->resident_size.load(std::memory_order_relaxed) <= t->min_quota_size) { return false; }
+
+    // If any table has exceeded its quota, give preference to evict from them
+    if ((m_num_over_quota.load(std::memory_order_relaxed) != 0) && !t->over_quota.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    return true;
+}
+
+void IndexCacheQuota::on_evict(uint32_t ordinal, BlkId blkid, uint32_t size) {
+    auto t = get_table(ordinal);
+    t->evictions.fetch_add(1, std::memory_order_relaxed);
+    t->resident_size.fetch_sub(size, std::memory_order_relaxed);
+    update_over_quota(t);
+
+    auto const max_ghosts = HS_DYNAMIC_CONFIG(cache.index_ghost_entries_per_table);
+    if (max_ghosts != 0) {
+        std::unique_lock lg{t->ghost_mtx};
+        if (t->ghost_set.insert(blkid.to_integer()).second) { t->ghost_fifo.push_back(blkid.to_integer()); }
+        while (t->ghost_fifo.size() > max_ghosts) {
+            t->ghost_set.erase(t->ghost_fifo.front());
+            t->ghost_fifo.pop_front();
+        }
+    }
+}
+
+void IndexCacheQuota::rebalance() {
+    std::unique_lock lg{m_tables_mtx};
+    if (m_tables.size() <= 2) { return; } // Nothing to rebalance with less than 2 tables
+
+    table_cache_stats* gainer{nullptr};
+    table_cache_stats* loser{nullptr};
+    uint64_t gainer_benefit{0};
+    uint64_t loser_benefit{std::numeric_limits< uint64_t >::max()};
+
+    for (uint32_t i{1}; i < m_tables.size(); ++i) {
+        auto t = m_tables[i].get();
+        auto const ghost_hits = t->ghost_hits.load(std::memory_order_relaxed);
+        auto const benefit = ghost_hits - t->last_ghost_hits;
+        t->last_ghost_hits = ghost_hits;
+
+        auto const quota = t->quota_size.load(std::memory_order_relaxed);
+        if ((quota < t->max_quota_size) && (benefit > gainer_benefit)) {
+            gainer = t;
+            gainer_benefit = benefit;
+        }
+        if ((quota > t->min_quota_size) && (benefit < loser_benefit)) {
+            loser = t;
+            loser_benefit = benefit;
+        }
+    }
+
+    if ((gainer == nullptr) || (loser == nullptr) || (gainer == loser) || (gainer_benefit <= loser_benefit)) { return; }
+
+    auto const step = int64_cast(m_total_size * HS_DYNAMIC_CONFIG(cache.index_quota_rebalance_step_pct) / 100);
+    auto const move_size = std::min({step, loser->quota_size.load() - loser->min_quota_size,
+                                     gainer->max_quota_size - gainer->quota_size.load()});
+    if (move_size <= 0) { return; }
+
+    loser->quota_size.fetch_sub(move_size);
+    gainer->quota_size.fetch_add(move_size);
+    update_over_quota(loser);
+    update_over_quota(gainer);
+
+    HS_PERIODIC_LOG(DEBUG, base,
+                    "Index cache rebalance moved {} bytes quota from table={} (ghost_hits={}) to table={} "
+                    "(ghost_hits={})",
+                    move_size, boost::uuids::to_string(loser->uuid), loser_benefit,
+                    boost::uuids::to_string(gainer->uuid), gainer_benefit);
+}
+
+nlohmann::json IndexCacheQuota::get_status(int verbosity) const {
+    nlohmann::json js;
+    js["total_cache_size"] = m_total_size;
+    js["tables_over_quota"] = m_num_over_quota.load();
+
+    std::shared_lock lg{m_tables_mtx};
+    for (uint32_t i{0}; i < m_tables.size(); ++i) {
+        auto const& t = m_tables[i];
+        auto const hits = t->hits.load();
+        auto const lookups = hits + t->misses.load();
+
+        nlohmann::json tjs;
+        tjs["ordinal"] = i;
+        tjs["resident_size"] = t->resident_size.load();
+        tjs["quota_size"] = t->quota_size.load();
+        tjs["min_quota_size"] = t->min_quota_size;
+        tjs["max_quota_size"] = t->max_quota_size;
+        tjs["hit_ratio"] = (lookups == 0) ? 0.0 : (static_cast< double >(hits) / lookups);
+        if (verbosity > 0) {
+            tjs["hits"] = hits;
+            tjs["misses"] = t->misses.load();
+            tjs["ghost_hits"] = t->ghost_hits.load();
+            tjs["evictions"] = t->evictions.load();
+        }
+        js[(i == unaccounted_ordinal) ? "unaccounted" : boost::uuids::to_string(t->uuid)] = std::move(tjs);
+    }
+    return js;
+}
+
+IndexCacheQuota::table_cache_stats* IndexCacheQuota::get_table(uint32_t ordinal) const {
+    std::shared_lock lg{m_tables_mtx};
+    return (ordinal < m_tables.size()) ? m_tables[ordinal].get() : m_tables[unaccounted_ordinal].get();
+}
+
+void IndexCacheQuota::update_over_quota(table_cache_stats* t) {
+    bool const is_over = (t->resident_size.load(std::memory_order_relaxed) > t->quota_size.load());
+    bool was_over = !is_over;
+    if (t->over_quota.compare_exchange_strong(was_over, is_over)) {
+        is_over ? m_num_over_quota.fetch_add(1) : m_num_over_quota.fetch_sub(1);
+    }
+}
+} // namespace homestore
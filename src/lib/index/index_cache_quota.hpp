@@ -0,0 +1,118 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+#include <vector>
+
+#include <iomgr/iomgr.hpp>
+#include <nlohmann/json.hpp>
+#include <homestore/blk.h>
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+
+/*
+ * Per index table accounting of the shared index writeback cache.
+ *
+ * All IndexTables share one IndexWBCache and one evictor. To prevent a cold scan heavy table evicting the working set
+ * of other tables, each table (identified by its uuid) is given an ordinal and every cached buffer carries that
+ * ordinal. The cache reports inserts, hits, misses, evictions and removals here and consults us before evicting any
+ * buffer.
+ *
+ * Each table has a [min, max] quota and a current quota within that range. Eviction of a table's buffer is refused
+ * while the table is at or below its min quota. While any table is above its current quota, only tables above their
+ * quota are allowed to be evicted. These are only preferences, if the cache cannot find any buffer that the quota
+ * allows to evict, it falls back to evicting any evictable buffer rather than failing the insert.
+ *
+ * A rebalancer runs periodically and moves quota from the table with lowest marginal benefit to the one with highest.
+ * Marginal benefit is measured through ghost hits, i.e. misses on blkids that were recently evicted from the table. A
+ * ghost hit means the table would have gained a hit had it been given a bit more quota.
+ */
+class IndexCacheQuota {
+public:
+    static constexpr uint32_t unaccounted_ordinal{0};
+
+private:
+    struct table_cache_stats {
+        uuid_t uuid;
+        std::atomic< int64_t > resident_size{0};
+        std::atomic< int64_t > quota_size{0};
+        int64_t min_quota_size{0};
+        int64_t max_quota_size{0};
+        std::atomic< bool > over_quota{false};
+
+        std::atomic< uint64_t > hits{0};
+        std::atomic< uint64_t > misses{0};
+        std::atomic< uint64_t > ghost_hits{0};
+        std::atomic< uint64_t > evictions{0};
+        uint64_t last_ghost_hits{0}; // Snapshot of ghost_hits during previous rebalance, accessed only by rebalancer
+
+        std::mutex ghost_mtx;
+        std::deque< uint64_t > ghost_fifo;
+        std::unordered_set< uint64_t > ghost_set;
+
+        explicit table_cache_stats(uuid_t id) : uuid{id} {}
+    };
+
+    int64_t m_total_size;
+    mutable std::shared_mutex m_tables_mtx;
+    std::vector< std::unique_ptr< table_cache_stats > > m_tables; // Index 0 is reserved for unaccounted buffers
+    std::atomic< uint32_t > m_num_over_quota{0};
+    iomgr::timer_handle_t m_rebalance_timer_hdl{iomgr::null_timer_handle};
+
+public:
+    explicit IndexCacheQuota(uint64_t total_cache_size);
+    IndexCacheQuota(const IndexCacheQuota&) = delete;
+    IndexCacheQuota& operator=(const IndexCacheQuota&) = delete;
+    ~IndexCacheQuota();
+
+    void start();
+    void stop();
+
+    /// @brief Get the cache ordinal for the index table, registering the table if it is not already done.
+    /// @param uuid UUID of the index table
+    /// @return Ordinal to be stamped on every IndexBuffer owned by this table
+    uint32_t register_table(uuid_t uuid);
+
+    /// @brief Override the min/max quota for the table given in percentage of total cache size.
+    void set_quota(uint32_t ordinal, double min_pct, double max_pct);
+
+    void on_insert(uint32_t ordinal, uint32_t size);
+    void on_remove(uint32_t ordinal, uint32_t size);
+    void on_hit(uint32_t ordinal);
+    void on_miss(uint32_t ordinal, BlkId blkid);
+
+    /// @brief Check if a buffer of the given table can be evicted. It only answers the question and does not account
+    /// anything, the caller is expected to call on_evict() once the buffer is actually evicted.
+    bool can_evict(uint32_t ordinal) const;
+
+    /// @brief Account the buffer as evicted and remember its blkid as a ghost entry of the table.
+    void on_evict(uint32_t ordinal, BlkId blkid, uint32_t size);
+
+    void rebalance();
+    nlohmann::json get_status(int verbosity) const;
+
+private:
+    table_cache_stats* get_table(uint32_t ordinal) const;
+    void update_over_quota(table_cache_stats* t);
+};
+} // namespace homestore
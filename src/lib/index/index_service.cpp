@@ -17,14 +17,19 @@
 #include <homestore/index_service.hpp>
 #include <homestore/index/index_internal.hpp>
 #include "index/wb_cache.hpp"
+#include "index/index_cache_quota.hpp"
 #include "common/homestore_utils.hpp"
 #include "device/virtual_dev.hpp"
 #include "device/physical_dev.hpp"
+#include "common/resource_mgr.hpp"
+#include "common/homestore_status_mgr.hpp"
 
 namespace homestore {
 IndexService& index_service() { return hs()->index_service(); }
 
-IndexService::IndexService(std::unique_ptr< IndexServiceCallbacks > cbs) : m_svc_cbs{std::move(cbs)} {
+IndexService::IndexService(std::unique_ptr< IndexServiceCallbacks > cbs) :
+        m_svc_cbs{std::move(cbs)},
+        m_cache_quota{std::make_unique< IndexCacheQuota >(resource_mgr().get_cache_size())} {
     meta_service().register_handler(
         "index",
         [this](meta_blk* mblk, sisl::byte_view buf, size_t size) {
@@ -33,6 +38,8 @@ IndexService::IndexService(std::unique_ptr< IndexServiceCallbacks > cbs) : m_svc
         nullptr);
 }
 
+IndexService::~IndexService() { m_cache_quota->stop(); }
+
 void IndexService::create_vdev(uint64_t size) {
     auto const atomic_page_size = hs()->device_mgr()->atomic_page_size({PhysicalDevGroup::FAST});
 
@@ -65,7 +72,10 @@ void IndexService::start() {
 
     // Start Writeback cache
     m_wb_cache = std::make_unique< IndexWBCache >(m_vdev, hs()->evictor(),
-                                                  hs()->device_mgr()->atomic_page_size({PhysicalDevGroup::FAST}));
+                                                  hs()->device_mgr()->atomic_page_size({PhysicalDevGroup::FAST}),
+                                                  m_cache_quota.get());
+    m_cache_quota->start();
+    hs()->status_mgr()->register_status_cb("Index", bind_this(IndexService::get_status, 1));
 }
 
 void IndexService::start_threads() {
@@ -100,10 +110,28 @@ void IndexService::start_threads() {
 }
 
 void IndexService::add_index_table(const std::shared_ptr< IndexTableBase >& tbl) {
+    cache_ordinal(tbl->uuid());
     std::unique_lock lg(m_index_map_mtx);
     m_index_map.insert(std::make_pair(tbl->uuid(), tbl));
 }
 
+uint32_t IndexService::cache_ordinal(uuid_t uuid) { return m_cache_quota->register_table(uuid); }
+
+void IndexService::set_cache_quota(uuid_t uuid, double min_pct, double max_pct) {
+    m_cache_quota->set_quota(m_cache_quota->register_table(uuid), min_pct, max_pct);
+}
+
+nlohmann::json IndexService::get_status(int verbosity) const {
+    nlohmann::json js;
+    js["used_size"] = used_size();
+    {
+        std::unique_lock lg{m_index_map_mtx};
+        js["num_tables"] = m_index_map.size();
+    }
+    js["cache"] = m_wb_cache ? m_wb_cache->get_status(verbosity) : m_cache_quota->get_status(verbosity);
+    return js;
+}
+
 iomgr::io_thread_t IndexService::get_next_btree_write_thread() {
     return m_btree_write_thread_ids[m_btree_write_thrd_idx++ % m_btree_write_thread_ids.size()];
 }
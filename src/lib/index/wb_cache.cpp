@@ -21,23 +21,35 @@
 
 #include "wb_cache.hpp"
 #include "index_cp.hpp"
+#include "index_cache_quota.hpp"
 #include "device/virtual_dev.hpp"
 #include "common/resource_mgr.hpp"
 
 namespace homestore {
 IndexWBCache& wb_cache() { return index_service().wb_cache(); }
 
+// Set while retrying an insert which failed because quota refused every evictable buffer
+static thread_local bool t_bypass_cache_quota{false};
+
 IndexWBCache::IndexWBCache(const std::shared_ptr< VirtualDev >& vdev, const std::shared_ptr< sisl::Evictor >& evictor,
-                           uint32_t node_size) :
+                           uint32_t node_size, IndexCacheQuota* cache_quota) :
         m_vdev{vdev},
         m_cache{
             evictor, 1000, node_size,
             [](const BtreeNodePtr& node) -> BlkId { return IndexBtreeNode::convert(node.get())->m_idx_buf->m_blkid; },
-            [](const sisl::CacheRecord& rec) -> bool {
+            [this](const sisl::CacheRecord& rec) -> bool {
                 const auto& hnode = (sisl::SingleEntryHashNode< BtreeNodePtr >&)rec;
-                return (hnode.m_value->m_refcount.test_le(1));
+                if (!hnode.m_value->m_refcount.test_le(1)) { return false; }
+
+                // Let the quota decide if the owning table can afford to lose this buffer. Once we return true, the
+                // evictor removes the record, so account the eviction right here.
+                auto const& idx_buf = IndexBtreeNode::convert(hnode.m_value.get())->m_idx_buf;
+                if (!t_bypass_cache_quota && !m_cache_quota->can_evict(idx_buf->m_cache_ordinal)) { return false; }
+                m_cache_quota->on_evict(idx_buf->m_cache_ordinal, idx_buf->m_blkid, m_node_size);
+                return true;
             }},
-        m_node_size{node_size} {
+        m_node_size{node_size},
+        m_cache_quota{cache_quota} {
     for (size_t i{0}; i < MAX_CP_COUNT; ++i) {
         m_dirty_list[i] = std::make_unique< sisl::ThreadVector< IndexBufferPtr > >();
         m_free_blkid_list[i] = std::make_unique< sisl::ThreadVector< BlkId > >();
@@ -57,8 +69,9 @@ BtreeNodePtr IndexWBCache::alloc_buf(node_initializer_t&& node_initializer) {
     auto node = node_initializer(idx_buf);
 
     // Add the node to the cache
-    bool done = m_cache.insert(node);
+    bool done = insert_to_cache(node);
     HS_REL_ASSERT_EQ(done, true, "Unable to add alloc'd node to cache, low memory or duplicate inserts?");
+    m_cache_quota->on_insert(idx_buf->m_cache_ordinal, m_node_size);
     return node;
 }
 
@@ -79,6 +92,7 @@ std::error_condition IndexWBCache::read_buf(bnodeid_t id, BtreeNodePtr& node, bo
 retry:
     // Check if the blkid is already in cache, if not load and put it into the cache
     if (m_cache.get(blkid, node)) {
+        m_cache_quota->on_hit(IndexBtreeNode::convert(node.get())->m_idx_buf->m_cache_ordinal);
         return no_error;
     } else if (cache_only) {
         return std::make_error_condition(std::errc::operation_would_block);
@@ -90,18 +104,31 @@ retry:
     auto const size = m_vdev->sync_read(r_cast< char* >(raw_buf), m_node_size, blkid);
     if (size != m_node_size) { return std::make_error_condition(std::io_errc::stream); }
 
-    // Create the btree node out of buffer
+    // Create the btree node out of buffer. Initializer stamps the owner table's ordinal on the buffer
     node = node_initializer(idx_buf);
+    m_cache_quota->on_miss(idx_buf->m_cache_ordinal, blkid);
 
     // Push the node into cache
-    bool done = m_cache.insert(node);
+    bool done = insert_to_cache(node);
     if (!done) {
         // There is a race between 2 concurrent reads from vdev and other party won the race. Re-read from cache
         goto retry;
     }
+    m_cache_quota->on_insert(idx_buf->m_cache_ordinal, m_node_size);
     return no_error;
 }
 
+bool IndexWBCache::insert_to_cache(const BtreeNodePtr& node) {
+    if (m_cache.insert(node)) { return true; }
+
+    // Quota is only a preference of whom to evict. If it refused every evictable buffer (say the over quota table has
+    // all its buffers pinned or dirty), evict whatever is evictable rather than failing the insert.
+    t_bypass_cache_quota = true;
+    bool const done = m_cache.insert(node);
+    t_bypass_cache_quota = false;
+    return done;
+}
+
 bool IndexWBCache::create_chain(IndexBufferPtr& second, IndexBufferPtr& third) {
     bool copied{false};
     if (second->m_next_buffer != nullptr) {
@@ -137,6 +164,7 @@ void IndexWBCache::free_buf(const IndexBufferPtr& buf, CPContext* cp_ctx) {
     BtreeNodePtr node;
     bool done = m_cache.remove(buf->m_blkid, node);
     HS_REL_ASSERT_EQ(done, true, "Race on cache removal of btree blkid?");
+    m_cache_quota->on_remove(buf->m_cache_ordinal, m_node_size);
 
     resource_mgr().inc_free_blk(m_node_size);
     r_cast< IndexCPContext* >(cp_ctx)->add_to_free_node_list(buf->m_blkid);
@@ -177,9 +205,17 @@ std::unique_ptr< CPContext > IndexWBCache::create_cp_context(cp_id_t cp_id) {
 IndexBufferPtr IndexWBCache::copy_buffer(const IndexBufferPtr& cur_buf) const {
     auto new_buf = std::make_shared< IndexBuffer >(cur_buf->m_blkid, m_node_size, m_vdev->align_size());
     std::memcpy(new_buf->raw_buffer(), cur_buf->raw_buffer(), m_node_size);
+    new_buf->m_cache_ordinal = cur_buf->m_cache_ordinal;
     return new_buf;
 }
 
+nlohmann::json IndexWBCache::get_status(int verbosity) const {
+    nlohmann::json js;
+    js["node_size"] = m_node_size;
+    js["tables"] = m_cache_quota->get_status(verbosity);
+    return js;
+}
+
 void IndexWBCache::do_flush_one_buf(IndexCPContext* cp_ctx, const IndexBufferPtr& buf, bool part_of_batch) {
     buf->m_buf_state = index_buf_state_t::FLUSHING;
     m_vdev->async_write(r_cast< const char* >(buf->raw_buffer()), m_node_size, buf->m_blkid,
@@ -264,9 +300,11 @@ void IndexWBCache::get_next_bufs_internal(IndexCPContext* cp_ctx, uint32_t max_c
 
 void IndexWBCache::do_free_btree_blks(IndexCPContext* cp_ctx) {
     BlkId* pbid;
+    std::vector< BlkId > blkids;
     while ((pbid = cp_ctx->next_blkid()) != nullptr) {
-        m_vdev->free_blk(*pbid);
+        blkids.push_back(*pbid);
     }
+    m_vdev->free_blks_on_cp(blkids);
 
     m_vdev->cp_flush(); // As of now its a sync call, since metablk manager is sync write
     cp_ctx->m_flush_done_cb(cp_ctx->cp());
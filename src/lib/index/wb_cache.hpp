@@ -31,12 +31,14 @@ class Evictor;
 
 namespace homestore {
 class VirtualDev;
+class IndexCacheQuota;
 
 class IndexWBCache : public IndexWBCacheBase {
 private:
     std::shared_ptr< VirtualDev > m_vdev;
     sisl::SimpleCache< BlkId, BtreeNodePtr > m_cache;
     uint32_t m_node_size;
+    IndexCacheQuota* m_cache_quota;
 
     // Dirty buffer list arranged in a dependent list fashion
     std::unique_ptr< sisl::ThreadVector< IndexBufferPtr > > m_dirty_list[MAX_CP_COUNT];
@@ -46,7 +48,7 @@ private:
 
 public:
     IndexWBCache(const std::shared_ptr< VirtualDev >& vdev, const std::shared_ptr< sisl::Evictor >& evictor,
-                 uint32_t node_size);
+                 uint32_t node_size, IndexCacheQuota* cache_quota);
 
     BtreeNodePtr alloc_buf(node_initializer_t&& node_initializer) override;
     void realloc_buf(const IndexBufferPtr& buf) override;
@@ -62,7 +64,10 @@ public:
     std::unique_ptr< CPContext > create_cp_context(cp_id_t cp_id);
     IndexBufferPtr copy_buffer(const IndexBufferPtr& cur_buf) const;
 
+    nlohmann::json get_status(int verbosity) const;
+
 private:
+    bool insert_to_cache(const BtreeNodePtr& node);
     void process_write_completion(IndexCPContext* cp_ctx, IndexBuffer* pbuf);
     void do_flush_one_buf(IndexCPContext* cp_ctx, const IndexBufferPtr& buf, bool part_of_batch);
     std::pair< IndexBufferPtr, bool > on_buf_flush_done(IndexCPContext* cp_ctx, IndexBuffer* buf);
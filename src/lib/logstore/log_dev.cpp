@@ -16,7 +16,10 @@
 #include <algorithm>
 #include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <iterator>
+#include <utility>
+#include <vector>
 
 #include <sisl/fds/vector_pool.hpp>
 #include <isa-l/crc.h>
@@ -65,8 +68,10 @@ void LogDev::start(bool format, JournalVirtualDev* vdev) {
     if (m_flush_size_multiple == 0) { m_flush_size_multiple = m_vdev->phys_page_size(); }
     THIS_LOGDEV_LOG(INFO, "Initializing logdev with flush size multiple={}", m_flush_size_multiple);
 
-    for (uint32_t i = 0; i < max_log_group; ++i) {
-        m_log_group_pool[i].start(m_flush_size_multiple, m_vdev->align_size());
+    auto const ngroups = std::max(HS_DYNAMIC_CONFIG(logstore.max_inflight_log_groups), 1u);
+    for (uint32_t i = 0; i < ngroups; ++i) {
+        m_log_group_pool.emplace_back(std::make_unique< LogGroup >());
+        m_log_group_pool.back()->start(m_flush_size_multiple, m_vdev->align_size());
     }
     m_log_records = std::make_unique< sisl::StreamTracker< log_record > >();
     m_stopped = false;
@@ -93,11 +98,12 @@ void LogDev::start(bool format, JournalVirtualDev* vdev) {
         do_load(m_logdev_meta.get_start_dev_offset());
         m_log_records->reinit(m_log_idx);
         m_last_flush_idx = m_log_idx - 1;
+        m_last_prepared_idx = m_last_flush_idx;
     }
     m_flush_timer_hdl = iomanager.schedule_global_timer(
         HS_DYNAMIC_CONFIG(logstore.flush_timer_frequency_us) * 1000, true, nullptr, iomgr::thread_regex::all_worker,
         [this](void* cookie) {
-            if (m_pending_flush_size.load() && !m_is_flushing.load(std::memory_order_relaxed)) { flush_if_needed(); }
+            if (m_pending_flush_size.load() && can_add_inflight_group()) { flush_if_needed(); }
         });
 }
 
@@ -119,20 +125,27 @@ void LogDev::stop() {
         m_block_flush_q_cv.wait(lk, [&] { return m_stopped; });
     }
 
+#ifdef _PRERELEASE
+    if (homestore_flip->test_flip("logdev_simulate_torn_inflight_groups")) { simulate_torn_inflight_groups(); }
+#endif
+
     m_log_records = nullptr;
     m_logdev_meta.reset();
     m_log_idx.store(0);
     m_pending_flush_size.store(0);
     m_is_flushing.store(false);
     m_last_flush_idx = -1;
+    m_last_prepared_idx = -1;
     m_last_truncate_idx = -1;
     m_last_crc = INVALID_CRC32_VALUE;
     if (m_block_flush_q != nullptr) {
         sisl::VectorPool< flush_blocked_callback >::free(m_block_flush_q, false /* no_cache */);
     }
-    for (size_t i{0}; i < max_log_group; ++i) {
-        m_log_group_pool[i].stop();
+    for (auto& lg : m_log_group_pool) {
+        lg->stop();
     }
+    m_log_group_pool.clear();
+    m_log_group_idx = 0;
 
     THIS_LOGDEV_LOG(INFO, "LogDev stopped successfully");
     // cancel the timer
@@ -140,77 +153,169 @@ void LogDev::stop() {
     m_hs.reset();
 }
 
+#ifdef _PRERELEASE
+void LogDev::simulate_torn_inflight_groups() {
+    // Leaves the device as a crash with log groups in flight would: first of them torn, i.e. its footer never made it
+    // to the device, while the ones after it are written completely. None of them were acknowledged, so they carry
+    // log idx beyond what is issued till now.
+    const uint32_t ngroups = std::max(HS_DYNAMIC_CONFIG(logstore.max_inflight_log_groups), 1u);
+    std::vector< uint8_t > data(initial_read_size, 0xAB); // Spans the group over pages, to have its footer apart
+    const auto align = m_vdev->align_size();
+
+    crc32_t prev_crc = m_last_crc;
+    for (uint32_t i{0}; i < ngroups; ++i) {
+        LogGroup lg;
+        lg.start(m_flush_size_multiple, align);
+        lg.reset(1);
+        lg.add_record(log_record{0, 0, sisl::io_blob{data.data(), uint32_cast(data.size()), false}, nullptr},
+                      m_log_idx.load(std::memory_order_acquire) + i);
+        lg.finish(prev_crc);
+        prev_crc = lg.header()->cur_grp_crc;
+
+        auto const size = lg.header()->total_size();
+        auto const offset = m_vdev->alloc_next_append_blk(size);
+        HS_REL_ASSERT_NE(offset, INVALID_OFFSET, "No space to simulate the torn log groups");
+        if (i == 0) {
+            auto buf = hs_utils::create_byte_view(size, true, sisl::buftag::logwrite, align);
+            uint32_t filled{0};
+            for (const auto& iov : lg.iovecs()) {
+                std::memcpy(buf.bytes() + filled, iov.iov_base, iov.iov_len);
+                filled += uint32_cast(iov.iov_len);
+            }
+            std::memset(buf.bytes() + lg.header()->footer_offset, 0, sizeof(log_group_footer));
+            m_vdev->sync_pwrite(buf.bytes(), size, offset);
+        } else {
+            m_vdev->sync_pwritev(lg.iovecs().data(), int_cast(lg.iovecs().size()), offset);
+        }
+        THIS_LOGDEV_LOG(INFO, "Simulated {} log group of idx={} at offset={}", (i == 0) ? "torn" : "in flight",
+                        lg.header()->start_idx(), offset);
+        lg.stop();
+    }
+}
+#endif
+
 void LogDev::do_load(const off_t device_cursor) {
-    log_stream_reader lstream{device_cursor, m_vdev, m_flush_size_multiple};
+    // The groups are framed by the reader as they come, while their crc is verified on the pool in parallel, ahead of
+    // their replay. The replay itself stays in the order of the groups, since the stores expect their logs in order.
+    static constexpr size_t max_verifying_groups_per_thread{8};
+    const auto nverifiers = HS_DYNAMIC_CONFIG(logstore.recovery_crc_verify_threads);
+    log_stream_reader lstream{device_cursor, m_vdev, m_flush_size_multiple, (nverifiers == 0) /* verify_crc */};
+    ordered_job_pool< bool > verify_pool{"logdev_crc", nverifiers};
+    std::deque< std::pair< sisl::byte_view, off_t > > verifying_groups;
+
+    const auto replay_oldest_group = [&]() {
+        auto group = std::move(verifying_groups.front());
+        verifying_groups.pop_front();
+        const bool crc_valid = verify_pool.next();
+        HS_REL_ASSERT(crc_valid, "data is corrupted in log group at dev offset {}", group.second);
+        replay_log_group(group.first, group.second);
+    };
+
+    const auto start_time = Clock::now();
     logid_t loaded_from{-1};
-
+    logid_t next_idx{m_log_idx.load(std::memory_order_acquire)};
     off_t group_dev_offset;
     do {
         const auto buf = lstream.next_group(&group_dev_offset);
-        if (buf.size() == 0) {
-            assert_next_pages(lstream);
-            THIS_LOGDEV_LOG(INFO, "LogDev loaded log_idx in range of [{} - {}]", loaded_from, m_log_idx - 1);
-            break;
-        }
+        if (buf.size() == 0) { break; }
 
         auto* header = r_cast< const log_group_header* >(buf.bytes());
-        if (loaded_from == -1 && header->start_idx() < m_log_idx) {
+        if (loaded_from == -1 && header->start_idx() < next_idx) {
             // log dev is truncated completely
-            assert_next_pages(lstream);
-            THIS_LOGDEV_LOG(INFO, "LogDev loaded log_idx in range of [{} - {}]", loaded_from, m_log_idx - 1);
             break;
         }
 
-        HS_REL_ASSERT_EQ(header->start_idx(), m_log_idx, "log indx is not the expected one");
+        HS_REL_ASSERT_EQ(header->start_idx(), next_idx, "log indx is not the expected one");
+        HS_REL_ASSERT_GT(header->nrecords(), 0, "nrecords greater then zero");
         if (loaded_from == -1) { loaded_from = header->start_idx(); }
+        next_idx = header->start_idx() + header->nrecords();
 
-        // Loop through each record within the log group and do a callback
-        decltype(header->nrecords()) i{0};
-        HS_REL_ASSERT_GT(header->nrecords(), 0, "nrecords greater then zero");
-        const auto flush_ld_key =
-            logdev_key{header->start_idx() + header->nrecords() - 1, group_dev_offset + header->total_size()};
-        while (i < header->nrecords()) {
-            const auto* rec = header->nth_record(i);
-            const uint32_t data_offset = (rec->offset + (rec->get_inlined() ? 0 : header->oob_data_offset));
-
-            // Do a callback on the found log entry
-            sisl::byte_view b = buf;
-            b.move_forward(data_offset);
-            b.set_size(rec->size);
-            if (m_last_truncate_idx == -1) { m_last_truncate_idx = header->start_idx() + i; }
-            if (m_logfound_cb) {
-                // Validate if the id is present in rollback info
-                if (m_logdev_meta.is_rolled_back(rec->store_id, header->start_idx() + i)) {
-                    THIS_LOGDEV_LOG(
-                        DEBUG, "logstore_id[{}] log_idx={}, lsn={} has been rolledback, not notifying the logstore",
-                        rec->store_id, (header->start_idx() + i), rec->store_seq_num);
-                } else {
-                    THIS_LOGDEV_LOG(TRACE, "seq num {}, log indx {}, group dev offset {} size {}", rec->store_seq_num,
-                                    (header->start_idx() + i), group_dev_offset, rec->size);
-                    m_logfound_cb(rec->store_id, rec->store_seq_num, {header->start_idx() + i, group_dev_offset},
-                                  flush_ld_key, b, (header->nrecords() - (i + 1)));
-                }
-            }
-            ++i;
+        if (nverifiers == 0) {
+            replay_log_group(buf, group_dev_offset);
+            continue;
         }
-        m_log_idx = header->start_idx() + i;
-        m_last_crc = header->cur_grp_crc;
+        verify_pool.submit([buf]() { return log_stream_reader::is_group_crc_valid(buf); });
+        verifying_groups.emplace_back(buf, group_dev_offset);
+        if (verifying_groups.size() > nverifiers * max_verifying_groups_per_thread) { replay_oldest_group(); }
     } while (true);
 
+    while (!verifying_groups.empty()) {
+        replay_oldest_group();
+    }
+    assert_next_pages(lstream);
+    THIS_LOGDEV_LOG(INFO, "LogDev loaded log_idx in range of [{} - {}] in {} us", loaded_from, m_log_idx - 1,
+                    get_elapsed_time_us(start_time));
+
     // Update the tail offset with where we finally end up loading, so that new append entries can be written from
     // here.
     m_vdev->update_tail_offset(group_dev_offset);
 }
 
+void LogDev::replay_log_group(const sisl::byte_view& buf, off_t group_dev_offset) {
+    auto* header = r_cast< const log_group_header* >(buf.bytes());
+
+    // Inline records are at their offsets within the inline area as it was before compression, so expand it upfront
+    sisl::byte_view const inline_buf = header->is_inline_compressed() ? LogGroup::decompress_inline_area(header) : buf;
+
+    // Loop through each record within the log group and do a callback
+    decltype(header->nrecords()) i{0};
+    const auto flush_ld_key =
+        logdev_key{header->start_idx() + header->nrecords() - 1, group_dev_offset + header->total_size()};
+    while (i < header->nrecords()) {
+        const auto* rec = header->nth_record(i);
+
+        // Do a callback on the found log entry
+        sisl::byte_view b = rec->get_inlined() ? inline_buf : buf;
+        if (rec->get_inlined()) {
+            b.move_forward(rec->offset);
+        } else if (rec->get_compressed()) {
+            b = sisl::byte_view{static_cast< uint32_t >(rec->size)};
+            LogGroup::decompress(header->oob_area() + rec->offset,
+                                 header->footer_offset - (header->oob_data_offset + rec->offset), b.bytes(),
+                                 rec->size);
+        } else {
+            b.move_forward(rec->offset + header->oob_data_offset);
+        }
+        b.set_size(rec->size);
+        if (m_last_truncate_idx == -1) { m_last_truncate_idx = header->start_idx() + i; }
+        if (m_logfound_cb) {
+            // Validate if the id is present in rollback info
+            if (m_logdev_meta.is_rolled_back(rec->store_id, header->start_idx() + i)) {
+                THIS_LOGDEV_LOG(DEBUG,
+                                "logstore_id[{}] log_idx={}, lsn={} has been rolledback, not notifying the logstore",
+                                rec->store_id, (header->start_idx() + i), rec->store_seq_num);
+            } else {
+                THIS_LOGDEV_LOG(TRACE, "seq num {}, log indx {}, group dev offset {} size {}", rec->store_seq_num,
+                                (header->start_idx() + i), group_dev_offset, rec->size);
+                m_logfound_cb(rec->store_id, rec->store_seq_num, {header->start_idx() + i, group_dev_offset},
+                              flush_ld_key, b, (header->nrecords() - (i + 1)));
+            }
+        }
+        ++i;
+    }
+    m_log_idx = header->start_idx() + i;
+    m_last_crc = header->cur_grp_crc;
+}
+
 void LogDev::assert_next_pages(log_stream_reader& lstream) {
     THIS_LOGDEV_LOG(INFO,
                     "Logdev reached offset, which has invalid header, because of end of stream. Validating if it is "
                     "indeed the case or there is any corruption");
+
+    // With multiple log groups in flight, the groups after a torn one could have made it to the device. They were never
+    // acknowledged, so it is fine to find as many of them beyond the end of the stream.
+    const uint32_t max_inflight_ahead = std::max(HS_DYNAMIC_CONFIG(logstore.max_inflight_log_groups), 1u) - 1;
+    uint32_t nfound_ahead{0};
     for (uint32_t i{0}; i < HS_DYNAMIC_CONFIG(logstore->recovery_max_blks_read_for_additional_check); ++i) {
         const auto buf = lstream.group_in_next_page();
         if (buf.size() != 0) {
             auto* header = r_cast< const log_group_header* >(buf.bytes());
-            HS_REL_ASSERT_GT(m_log_idx.load(std::memory_order_acquire), header->start_idx(),
+            if (header->start_idx() >= m_log_idx.load(std::memory_order_acquire)) {
+                ++nfound_ahead;
+                THIS_LOGDEV_LOG(WARN, "Found a log group ahead of the end of log, which was in flight, Header: {}",
+                                *header);
+            }
+            HS_REL_ASSERT_LE(nfound_ahead, max_inflight_ahead,
                              "Found a header with future log_idx after reaching end of log. Hence rbuf which was read "
                              "must have been corrupted, Header: {}",
                              *header);
@@ -222,11 +327,12 @@ int64_t LogDev::append_async(const logstore_id_t store_id, const logstore_seq_nu
                              void* cb_context) {
     auto prev_size = m_pending_flush_size.fetch_add(data.size, std::memory_order_relaxed);
     const auto idx = m_log_idx.fetch_add(1, std::memory_order_acq_rel);
-    auto threshold_size = LogDev::flush_data_threshold_size();
+    auto threshold_size = flush_data_threshold_size();
+    m_flush_ctrl.on_append(data.size);
     m_log_records->create(idx, store_id, seq_num, data, cb_context);
 
     if (prev_size < threshold_size && ((prev_size + data.size) >= threshold_size) &&
-        !m_is_flushing.load(std::memory_order_relaxed)) {
+        can_add_inflight_group()) {
         flush_if_needed();
     }
     return idx;
@@ -234,6 +340,7 @@ int64_t LogDev::append_async(const logstore_id_t store_id, const logstore_seq_nu
 
 log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_record_header) {
     static thread_local sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logread > read_buf;
+    static thread_local sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logread > addln_read_buf;
 
     // First read the offset and read the log_group. Then locate the log_idx within that and get the actual data
     // Read about 4K of buffer
@@ -260,35 +367,65 @@ log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_rec
         HS_REL_ASSERT_EQ(header->this_group_crc(), crc, "CRC mismatch on read data");
     }
 
-    auto record_header = header->nth_record(key.idx - header->start_log_idx);
-    uint32_t const data_offset = (record_header->offset + (record_header->get_inlined() ? 0 : header->oob_data_offset));
+    // Copies the data of the group at data_offset to dst, reading it from the device if it is beyond what is read
+    // already. The additional read goes to a buffer of its own, so that the header in rbuf stays intact.
+    auto const copy_group_data = [&](uint32_t data_offset, uint32_t size, uint8_t* dst) {
+        if ((data_offset + size) < initial_read_size) {
+            std::memcpy(static_cast< void* >(dst), static_cast< const void* >(rbuf + data_offset),
+                        size); // Already read them enough, copy the data
+            return;
+        }
 
-    log_buffer const b{static_cast< uint32_t >(record_header->size)};
-    if ((data_offset + b.size()) < initial_read_size) {
-        std::memcpy(static_cast< void* >(b.bytes()), static_cast< const void* >(rbuf + data_offset),
-                    b.size()); // Already read them enough, copy the data
-    } else {
         // Round them data offset to dma boundary in-order to make sure pread on direct io succeed. We need to skip
         // the rounded portion while copying to user buffer
         auto const rounded_data_offset = sisl::round_down(data_offset, m_vdev->align_size());
-        auto const rounded_size = sisl::round_up(b.size() + data_offset - rounded_data_offset, m_vdev->align_size());
+        auto const rounded_size = sisl::round_up(size + data_offset - rounded_data_offset, m_vdev->align_size());
 
         // Allocate a fresh aligned buffer, if size cannot fit standard size
-        if (rounded_size > initial_read_size) {
-            rbuf = hs_utils::iobuf_alloc(rounded_size, sisl::buftag::logread, m_vdev->align_size());
+        if (!addln_read_buf) {
+            addln_read_buf = sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logread >::make_sized(
+                m_flush_size_multiple, initial_read_size);
         }
+        auto abuf = (rounded_size > initial_read_size)
+            ? hs_utils::iobuf_alloc(rounded_size, sisl::buftag::logread, m_vdev->align_size())
+            : addln_read_buf.get();
 
         THIS_LOGDEV_LOG(TRACE,
                         "Addln read as data resides outside initial_read_size={} key.idx={} key.group_dev_offset={} "
                         "data_offset={} size={} rounded_data_offset={} rounded_size={}",
-                        initial_read_size, key.idx, key.dev_offset, data_offset, b.size(), rounded_data_offset,
+                        initial_read_size, key.idx, key.dev_offset, data_offset, size, rounded_data_offset,
                         rounded_size);
-        m_vdev->sync_pread(rbuf, rounded_size, key.dev_offset + rounded_data_offset);
-        std::memcpy(static_cast< void* >(b.bytes()),
-                    static_cast< const void* >(rbuf + data_offset - rounded_data_offset), b.size());
+        m_vdev->sync_pread(abuf, rounded_size, key.dev_offset + rounded_data_offset);
+        std::memcpy(static_cast< void* >(dst), static_cast< const void* >(abuf + data_offset - rounded_data_offset),
+                    size);
 
         // Free the buffer in case we allocated above
-        if (rounded_size > initial_read_size) { hs_utils::iobuf_free(rbuf, sisl::buftag::logread); }
+        if (rounded_size > initial_read_size) { hs_utils::iobuf_free(abuf, sisl::buftag::logread); }
+    };
+
+    auto record_header = header->nth_record(key.idx - header->start_log_idx);
+    log_buffer const b{static_cast< uint32_t >(record_header->size)};
+    if (record_header->get_inlined() && header->is_inline_compressed()) {
+        // Inline records are at their offsets within the inline area as it was before compression, so expand it whole.
+        // Its raw size is taken from the device, so the whole group is matched with its crc before it is trusted.
+        std::vector< uint8_t > group(header->total_size());
+        copy_group_data(0, uint32_cast(group.size()), group.data());
+        crc32_t const crc =
+            crc32_ieee(init_crc32, group.data() + sizeof(log_group_header), group.size() - sizeof(log_group_header));
+        HS_REL_ASSERT_EQ(header->this_group_crc(), crc, "CRC mismatch on read data");
+
+        auto const image = LogGroup::decompress_inline_area(r_cast< const log_group_header* >(group.data()));
+        std::memcpy(static_cast< void* >(b.bytes()), static_cast< const void* >(image.bytes() + record_header->offset),
+                    b.size());
+    } else if (record_header->get_compressed()) {
+        // Compressed record is always stored in less than its raw size, so reading that much of it is enough
+        uint32_t const data_offset = header->oob_data_offset + record_header->offset;
+        std::vector< uint8_t > stored(std::min< uint32_t >(b.size(), header->footer_offset - data_offset));
+        copy_group_data(data_offset, uint32_cast(stored.size()), stored.data());
+        LogGroup::decompress(stored.data(), uint32_cast(stored.size()), b.bytes(), b.size());
+    } else {
+        copy_group_data(record_header->offset + (record_header->get_inlined() ? 0 : header->oob_data_offset),
+                        b.size(), b.bytes());
     }
     return_record_header =
         serialized_log_record(record_header->size, record_header->offset, record_header->get_inlined(),
@@ -330,7 +467,7 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
 
     assert(estimated_records > 0);
     auto* lg = make_log_group(static_cast< uint32_t >(estimated_records));
-    m_log_records->foreach_contiguous_active(m_last_flush_idx + 1,
+    m_log_records->foreach_contiguous_active(m_last_prepared_idx + 1,
                                              [&](int64_t idx, int64_t, log_record& record) -> bool {
                                                  if (lg->add_record(record, idx)) {
                                                      flushing_upto_idx = idx;
@@ -342,8 +479,10 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
 
     lg->finish(get_prev_crc());
     if (sisl_unlikely(flushing_upto_idx == -1)) { return nullptr; }
-    lg->m_flush_log_idx_from = m_last_flush_idx + 1;
+    lg->m_flush_log_idx_from = m_last_prepared_idx + 1;
     lg->m_flush_log_idx_upto = flushing_upto_idx;
+    m_last_prepared_idx = flushing_upto_idx;
+    m_last_crc = lg->header()->cur_grp_crc;
     HS_DBG_ASSERT_GE(lg->m_flush_log_idx_upto, lg->m_flush_log_idx_from, "log indx upto is smaller then log indx from");
 
     HS_DBG_ASSERT_GT(lg->header()->oob_data_offset, 0);
@@ -366,13 +505,13 @@ bool LogDev::can_flush_in_this_thread() {
 bool LogDev::flush_if_needed(int64_t threshold_size) {
     // If after adding the record size, if we have enough to flush or if its been too much time before we actually
     // flushed, attempt to flush by setting the atomic bool variable.
-    if (threshold_size < 0) { threshold_size = LogDev::flush_data_threshold_size(); }
+    if (threshold_size < 0) { threshold_size = flush_data_threshold_size(); }
 
     const auto elapsed_time = get_elapsed_time_us(m_last_flush_time);
     auto const pending_sz = m_pending_flush_size.load(std::memory_order_relaxed);
     bool const flush_by_size = (pending_sz >= threshold_size);
     bool const flush_by_time =
-        !flush_by_size && pending_sz && (elapsed_time > HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us));
+        !flush_by_size && pending_sz && (elapsed_time > max_time_between_flush_us());
 
     if (flush_by_size || flush_by_time) {
         // First off, check if we can flush in this thread itself, if not, schedule it into different thread
@@ -382,29 +521,45 @@ bool LogDev::flush_if_needed(int64_t threshold_size) {
             return false;
         }
 
-        bool expected_flushing{false};
-        if (!m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel)) {
+        // Groups are prepared one at a time, so that they take the log idx, the crc chain and the device offsets in
+        // order. The first group in flight takes the flush lock, which is released once the last one completes.
+        std::unique_lock< std::mutex > lk{m_flush_mutex};
+        if (m_inflight_groups.empty()) {
+            bool expected_flushing{false};
+            if (!m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel)) {
+                return false;
+            }
+        } else if (!can_add_inflight_group() || is_flush_lock_waited()) {
+            // Either no more room in flight or someone waits to lock the flush, in which case we let the groups in
+            // flight drain. Their completion attempts the flush again.
             return false;
         }
         THIS_LOGDEV_LOG(TRACE,
                         "Flushing now because either pending_size={} is greater than data_threshold={} or "
                         "elapsed time since last flush={} us is greater than max_time_between_flush={} us",
-                        pending_sz, threshold_size, elapsed_time,
-                        HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us));
+                        pending_sz, threshold_size, elapsed_time, max_time_between_flush_us());
+
+        const auto abort_flush = [this, &lk]() {
+            const bool idle = m_inflight_groups.empty();
+            lk.unlock();
+            if (idle) { unlock_flush(false); }
+        };
 
         m_last_flush_time = Clock::now();
         // We were able to win the flushing competition and now we gather all the flush data and reserve a slot.
         auto new_idx = m_log_idx.load(std::memory_order_relaxed) - 1;
-        if (m_last_flush_idx >= new_idx) {
+        if (m_last_prepared_idx >= new_idx) {
             THIS_LOGDEV_LOG(TRACE, "Log idx {} is just flushed", new_idx);
-            unlock_flush(false);
+            abort_flush();
             return false;
         }
 
-        auto* lg = prepare_flush(new_idx - m_last_flush_idx + 4); // Estimate 4 more extra in case of parallel writes
+        // Estimate 4 more extra in case of parallel writes
+        auto* lg = prepare_flush(new_idx - m_last_prepared_idx + 4);
         if (sisl_unlikely(!lg)) {
-            THIS_LOGDEV_LOG(TRACE, "Log idx {} last_flush_idx {} prepare flush failed", new_idx, m_last_flush_idx);
-            unlock_flush(false);
+            THIS_LOGDEV_LOG(TRACE, "Log idx {} last_prepared_idx {} prepare flush failed", new_idx,
+                            m_last_prepared_idx);
+            abort_flush();
             return false;
         }
         auto sz = m_pending_flush_size.fetch_sub(lg->actual_data_size(), std::memory_order_relaxed);
@@ -414,6 +569,13 @@ bool LogDev::flush_if_needed(int64_t threshold_size) {
         lg->m_log_dev_offset = offset;
         HS_REL_ASSERT_NE(lg->m_log_dev_offset, INVALID_OFFSET, "log dev is full");
         THIS_LOGDEV_LOG(TRACE, "Flush prepared, flushing data size={} at offset={}", lg->actual_data_size(), offset);
+
+        advance_log_group_idx();
+        m_inflight_groups.push_back(lg);
+        m_ninflight_groups.store(uint32_cast(m_inflight_groups.size()), std::memory_order_relaxed);
+        HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_inflight_groups, m_inflight_groups.size());
+        lk.unlock();
+
         do_flush(lg);
         return true;
     } else {
@@ -421,6 +583,11 @@ bool LogDev::flush_if_needed(int64_t threshold_size) {
     }
 }
 
+bool LogDev::is_flush_lock_waited() {
+    std::unique_lock< std::mutex > lk{m_block_flush_q_mutex};
+    return (m_block_flush_q != nullptr);
+}
+
 void LogDev::do_flush(LogGroup* lg) {
     // if (has_data_service() && data_service().is_fsync_needed()) {
     //     data_service().fsync([this, lg]() { do_flush_write(lg); })
@@ -443,16 +610,56 @@ void LogDev::do_flush_write(LogGroup* lg) {
     THIS_LOGDEV_LOG(TRACE, "vdev offset={} log group total size={}", lg->m_log_dev_offset, lg->header()->total_size());
 
     // write log
+    lg->m_flush_issue_time = Clock::now();
     m_vdev->async_pwritev(lg->iovecs().data(), int_cast(lg->iovecs().size()), lg->m_log_dev_offset,
                           [this, lg](std::error_condition err, void* cookie) {
                               if (err != no_error) {
                                   HS_DBG_ASSERT(false, "Error in writing the journal log - {}", err.message());
                                   throw std::runtime_error("Error in writing the journal log - " + err.message());
                               }
-                              on_flush_completion(lg);
+#ifdef _PRERELEASE
+                              if (homestore_flip->delay_flip< int >(
+                                      "simulate_log_flush_done_delay", [this, lg]() { on_flush_write_done(lg); },
+                                      m_family_id)) {
+                                  THIS_LOGDEV_LOG(INFO, "Delaying the completion of flush write of log group");
+                                  return;
+                              }
+#endif
+                              on_flush_write_done(lg);
                           });
 }
 
+void LogDev::on_flush_write_done(LogGroup* lg) {
+    std::unique_lock< std::mutex > lk{m_flush_mutex};
+    lg->m_flush_done = true;
+    m_flush_ctrl.on_flush_done(get_elapsed_time_us(lg->m_flush_issue_time));
+
+    // Writes of the groups in flight could finish in any order, but they are completed only in the order of the groups.
+    // Whoever is completing the groups ahead of this one will complete it as well.
+    if (m_completing_flush) { return; }
+    m_completing_flush = true;
+    while (!m_inflight_groups.empty() && m_inflight_groups.front()->m_flush_done) {
+        auto* done_lg = m_inflight_groups.front();
+        lk.unlock();
+        on_flush_completion(done_lg);
+        lk.lock();
+
+        // Remove it only after completion, so that its slot in the pool is not reused till then
+        m_inflight_groups.pop_front();
+        m_ninflight_groups.store(uint32_cast(m_inflight_groups.size()), std::memory_order_relaxed);
+    }
+    m_completing_flush = false;
+    const bool idle = m_inflight_groups.empty();
+    lk.unlock();
+
+    // Flush lock is held till the last group in flight is completed, unlocking it attempts the next flush as well
+    if (idle) {
+        unlock_flush();
+    } else {
+        flush_if_needed();
+    }
+}
+
 void LogDev::on_flush_completion(LogGroup* lg) {
     lg->m_flush_finish_time = Clock::now();
     lg->m_post_flush_msg_rcvd_time = Clock::now();
@@ -461,7 +668,6 @@ void LogDev::on_flush_completion(LogGroup* lg) {
     m_log_records->complete(lg->m_flush_log_idx_from, lg->m_flush_log_idx_upto);
     m_last_flush_idx = lg->m_flush_log_idx_upto;
     const auto flush_ld_key = logdev_key{m_last_flush_idx, lg->m_log_dev_offset + lg->header()->total_size()};
-    m_last_crc = lg->header()->cur_grp_crc;
 
     auto from_indx = lg->m_flush_log_idx_from;
     auto upto_indx = lg->m_flush_log_idx_upto;
@@ -476,8 +682,6 @@ void LogDev::on_flush_completion(LogGroup* lg) {
                       get_elapsed_time_us(lg->m_flush_finish_time, lg->m_post_flush_msg_rcvd_time));
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_post_flush_processing_latency,
                       get_elapsed_time_us(lg->m_post_flush_msg_rcvd_time, lg->m_post_flush_process_done_time));
-    free_log_group(lg);
-    unlock_flush();
 }
 
 bool LogDev::try_lock_flush(const flush_blocked_callback& cb) {
@@ -593,6 +797,10 @@ void LogDev::get_status(const int verbosity, nlohmann::json& js) const {
     if (verbosity == 2) {
         js["logdev_stopped?"] = m_stopped;
         js["is_log_flushing_now?"] = m_is_flushing.load(std::memory_order_relaxed);
+        js["log_groups_in_flight"] = m_ninflight_groups.load(std::memory_order_relaxed);
+        js["adaptive_flush?"] = LogFlushController::is_adaptive();
+        js["flush_threshold_size"] = flush_data_threshold_size();
+        js["max_time_between_flush_us"] = max_time_between_flush_us();
         js["logdev_sb_start_offset"] = m_logdev_meta.get_start_dev_offset();
         js["logdev_sb_num_stores_reserved"] = m_logdev_meta.num_stores_reserved();
     }
@@ -17,6 +17,7 @@
 
 #include <atomic>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <limits>
 #include <map>
@@ -36,6 +37,9 @@
 #include <homestore/logstore/log_store_internal.hpp>
 #include <homestore/superblk_handler.hpp>
 #include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+#include "log_flush_controller.hpp"
+#include "ordered_job_pool.hpp"
 
 namespace homestore {
 
@@ -43,8 +47,6 @@ static constexpr uint32_t LOG_GROUP_HDR_MAGIC{0xF00D1E};
 static constexpr uint32_t LOG_GROUP_FOOTER_MAGIC{0xB00D1E};
 static constexpr uint32_t dma_address_boundary{512}; // Mininum size the dma/writes to be aligned with
 static constexpr uint32_t initial_read_size{4096};
-// logdev doesn't support concurrent writes. There can only be 2 active log groups.
-static constexpr uint32_t max_log_group{2};
 
 // clang-format off
 /*
@@ -67,18 +69,22 @@ static constexpr uint32_t max_log_group{2};
 #pragma pack(1)
 struct serialized_log_record {
     uint32_t size;                    // Size of this log record
-    uint32_t offset : 31;             // Offset within the log_group where data is residing
+    uint32_t offset : 30;             // Offset within the log_group where data is residing
+    uint32_t is_compressed : 1;       // Is the out-of-band data stored compressed
     uint32_t is_inlined : 1;          // Is the log data is inlined or out-of-band area
     logstore_seq_num_t store_seq_num; // Seqnum by the log store
     logstore_id_t store_id;           // ID of the store this log is associated with
 
     void set_inlined(bool inlined) { is_inlined = static_cast< uint32_t >(inlined ? 0x1 : 0x0); }
     bool get_inlined() const { return ((is_inlined == static_cast< uint32_t >(0x1)) ? true : false); }
+    void set_compressed(bool compressed) { is_compressed = static_cast< uint32_t >(compressed ? 0x1 : 0x0); }
+    bool get_compressed() const { return ((is_compressed == static_cast< uint32_t >(0x1)) ? true : false); }
 
     serialized_log_record() = default;
     serialized_log_record(uint32_t s, uint32_t o, bool inlined, logstore_seq_num_t sq, logstore_id_t id) :
             size{s}, offset{o}, store_seq_num{sq}, store_id{id} {
         set_inlined(inlined);
+        set_compressed(false);
     }
     serialized_log_record(const serialized_log_record&) = default;
     serialized_log_record& operator=(const serialized_log_record&) = default;
@@ -117,14 +123,25 @@ struct log_record {
     static size_t serialized_size(const uint32_t sz) { return sizeof(serialized_log_record) + sz; }
 };
 
+/* Compressed data in the log group, either the whole inline area or an out-of-band record, is prefixed with this */
+#pragma pack(1)
+struct log_compressed_header {
+    uint32_t raw_size;        // Size of the data before compression
+    uint32_t compressed_size; // Size of the compressed data which follows this header
+};
+#pragma pack()
+
 /************************************* Log Group Section ************************************/
 /* This structure represents a group commit log header */
 #pragma pack(1)
 struct log_group_header {
     static constexpr uint8_t header_version{0};
+    static constexpr uint16_t inline_compressed_flag{0x1}; // Inline area is compressed as a whole
+    static constexpr uint16_t oob_compressed_flag{0x2};    // Some of the out-of-band records are compressed
 
     uint32_t magic;
-    uint32_t version;
+    uint16_t version;
+    uint16_t flags;              // How the data is stored in the group. Groups written before it was added read 0
     uint32_t n_log_records;      // Total number of log records
     logid_t start_log_idx;       // log id of the first log record
     uint32_t group_size;         // Total size of this group including this header
@@ -134,7 +151,7 @@ struct log_group_header {
     crc32_t prev_grp_crc;        // Checksum of the previous group that was written
     crc32_t cur_grp_crc;         // Checksum of the current group record
 
-    log_group_header() : magic{LOG_GROUP_HDR_MAGIC}, version{header_version} {}
+    log_group_header() : magic{LOG_GROUP_HDR_MAGIC}, version{header_version}, flags{0} {}
     log_group_header(const log_group_header&) = delete;
     log_group_header& operator=(const log_group_header&) = delete;
     log_group_header(log_group_header&&) noexcept = delete;
@@ -173,6 +190,8 @@ struct log_group_header {
     crc32_t this_group_crc() const { return cur_grp_crc; }
     crc32_t prev_group_crc() const { return prev_grp_crc; }
     uint32_t _inline_data_offset() const { return inline_data_offset; }
+    bool is_inline_compressed() const { return (flags & inline_compressed_flag); }
+    bool has_compressed_oob() const { return (flags & oob_compressed_flag); }
 };
 #pragma pack()
 
@@ -197,9 +216,9 @@ std::basic_ostream< charT, traits >& operator<<(std::basic_ostream< charT, trait
 
     // print the stream
     const auto s{fmt::format(
-        "magic = {} version={} n_log_records = {} start_log_idx = {} group_size = {} inline_data_offset = {} "
+        "magic = {} version={} flags={} n_log_records = {} start_log_idx = {} group_size = {} inline_data_offset = {} "
         "oob_data_offset = {} prev_grp_crc = {} cur_grp_crc = {}",
-        header.magic, header.version, header.n_log_records, header.start_log_idx, header.group_size,
+        header.magic, header.version, header.flags, header.n_log_records, header.start_log_idx, header.group_size,
         header.inline_data_offset, header.oob_data_offset, header.prev_grp_crc, header.cur_grp_crc)};
     out_string_stream << s;
     out_stream << out_string_stream.str();
@@ -247,6 +266,15 @@ public:
     const iovec_array& finish(const crc32_t prev_crc);
     crc32_t compute_crc();
 
+    /// @brief Decompress the data stored at src, prefixed with its log_compressed_header, into dst of raw_size.
+    /// src_size is how much of it is available at src, which it is validated against.
+    static void decompress(const uint8_t* src, const uint32_t src_size, uint8_t* dst, const uint32_t raw_size);
+
+    /// @brief Image of the group upto the end of its inline area, with the compressed inline area expanded in place,
+    /// so that the inline records are found at their offsets in it. The header should be followed by the whole of
+    /// its inline area.
+    static sisl::byte_view decompress_inline_area(const log_group_header* header);
+
     log_group_header* header() { return reinterpret_cast< log_group_header* >(m_cur_log_buf); }
     const log_group_header* header() const { return reinterpret_cast< const log_group_header* >(m_cur_log_buf); }
     iovec_array const& iovecs() const { return m_iovecs; }
@@ -261,7 +289,7 @@ public:
 
     sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_log_buf;
     sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_footer_buf;
-    sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_overflow_log_buf;
+    iobuf_unique_ptr< sisl::buftag::logwrite > m_overflow_log_buf; // Allocated on every overflow, so from the pool
 
     uint8_t* m_cur_log_buf;
     uint32_t m_cur_buf_len;
@@ -280,8 +308,16 @@ public:
     int64_t m_flush_log_idx_from;
     int64_t m_flush_log_idx_upto;
     off_t m_log_dev_offset;
+    bool m_flush_done{false}; // Is the write of this group to the device completed
+
+    // Compression of the group, picked up from the config on every reset
+    bool m_compress{false};
+    bool m_inline_compressed{false};
+    std::vector< uint8_t > m_compress_buf; // Scratch area the inline area is compressed into
+    std::vector< iobuf_unique_ptr< sisl::buftag::logwrite > > m_compressed_oob_bufs;
 
     uint64_t m_flush_multiple_size{0};
+    Clock::time_point m_flush_issue_time;             // Time at which flush is issued to the device
     Clock::time_point m_flush_finish_time;            // Time at which flush is completed
     Clock::time_point m_post_flush_msg_rcvd_time;     // Time at which flush done message delivered
     Clock::time_point m_post_flush_process_done_time; // Time at which entire log group cb is called
@@ -289,6 +325,11 @@ public:
 private:
     log_group_footer* add_and_get_footer();
     bool new_iovec_for_footer() const;
+    uint32_t inline_data_offset() const {
+        return sizeof(log_group_header) + (m_max_records * sizeof(serialized_log_record));
+    }
+    void compress_inline_area();
+    uint32_t compress_oob_record(const log_record& record);
 };
 
 template < typename charT, typename traits >
@@ -529,9 +570,14 @@ class HomeStore;
 typedef std::shared_ptr< HomeStore > HomeStoreSafePtr;
 class JournalVirtualDev;
 
+/*
+ * log_stream_reader: Reads the log groups of the journal one after the other, starting at the given cursor. It keeps
+ * the bulk reads of the stream beyond the group being parsed outstanding on a set of threads, so the device stays busy
+ * while the groups are parsed and replayed.
+ */
 class log_stream_reader {
 public:
-    log_stream_reader(off_t device_cursor, JournalVirtualDev* vdev, uint64_t min_read_size);
+    log_stream_reader(off_t device_cursor, JournalVirtualDev* vdev, uint64_t min_read_size, bool verify_crc = true);
     log_stream_reader(const log_stream_reader&) = delete;
     log_stream_reader& operator=(const log_stream_reader&) = delete;
     log_stream_reader(log_stream_reader&&) noexcept = delete;
@@ -541,8 +587,13 @@ public:
     sisl::byte_view next_group(off_t* out_dev_offset);
     sisl::byte_view group_in_next_page();
 
+    /// @brief Check the data of a group returned by next_group against its crc. The reader does it by itself unless
+    /// it is asked not to verify the crc, in which case the caller is expected to do it before using the group.
+    static bool is_group_crc_valid(const sisl::byte_view& group_buf);
+
 private:
     sisl::byte_view read_next_bytes(uint64_t nbytes);
+    void issue_read_ahead();
 
 private:
     JournalVirtualDev* m_vdev;
@@ -551,6 +602,13 @@ private:
     off_t m_cur_read_bytes{0};
     crc32_t m_prev_crc{0};
     uint64_t m_read_size_multiple;
+    bool m_verify_crc;
+
+    off_t m_read_ahead_cursor;       // Logical offset of the next bulk read to issue
+    uint64_t m_read_ahead_issued{0}; // Bytes of the journal covered by the bulk reads issued so far
+    uint64_t m_read_ahead_size;      // Size of each bulk read
+    uint32_t m_read_ahead_depth;     // Number of bulk reads kept outstanding
+    std::unique_ptr< ordered_job_pool< sisl::byte_view > > m_read_pool;
 };
 
 struct meta_blk;
@@ -566,8 +624,15 @@ public:
     typedef std::function< void(logstore_id_t, const logstore_superblk&) > store_found_callback;
     typedef std::function< void(void) > flush_blocked_callback;
 
-    static inline int64_t flush_data_threshold_size() {
-        return HS_DYNAMIC_CONFIG(logstore.flush_threshold_size) - sizeof(log_group_header);
+    int64_t flush_data_threshold_size() const {
+        return LogFlushController::is_adaptive()
+            ? m_flush_ctrl.threshold_size()
+            : (HS_DYNAMIC_CONFIG(logstore.flush_threshold_size) - sizeof(log_group_header));
+    }
+
+    uint64_t max_time_between_flush_us() const {
+        return LogFlushController::is_adaptive() ? m_flush_ctrl.max_wait_us()
+                                                 : HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us);
     }
 
     LogDev(logstore_family_id_t f_id, const std::string& metablk_name);
@@ -752,18 +817,24 @@ public:
     static bool can_flush_in_this_thread();
 
 private:
+    // Groups are taken from the pool in a round robin, since they are flushed and completed in the same order
     LogGroup* make_log_group(uint32_t estimated_records) {
-        m_log_group_pool[m_log_group_idx].reset(estimated_records);
-        return &m_log_group_pool[m_log_group_idx];
+        m_log_group_pool[m_log_group_idx]->reset(estimated_records);
+        return m_log_group_pool[m_log_group_idx].get();
     }
 
-    void free_log_group(LogGroup* lg) { m_log_group_idx = !m_log_group_idx; }
+    void advance_log_group_idx() { m_log_group_idx = (m_log_group_idx + 1) % m_log_group_pool.size(); }
+    bool can_add_inflight_group() const {
+        return (m_ninflight_groups.load(std::memory_order_relaxed) < m_log_group_pool.size());
+    }
 
     LogGroup* prepare_flush(int32_t estimated_record);
 
     void do_flush(LogGroup* lg);
     void do_flush_write(LogGroup* lg);
     void flush_by_size(uint32_t min_threshold, uint32_t new_record_size = 0, logid_t new_idx = -1);
+    bool is_flush_lock_waited();
+    void on_flush_write_done(LogGroup* lg);
     void on_flush_completion(LogGroup* lg);
     void do_load(off_t offset);
 
@@ -774,6 +845,10 @@ private:
 
     void _persist_info_block();
     void assert_next_pages(log_stream_reader& lstream);
+#ifdef _PRERELEASE
+    void simulate_torn_inflight_groups();
+#endif
+    void replay_log_group(const sisl::byte_view& buf, off_t group_dev_offset);
     void set_flush_status(bool flush_status);
     bool get_flush_status();
 
@@ -782,7 +857,7 @@ private:
         m_log_records;                              // The container which stores all in-memory log records
     std::atomic< logid_t > m_log_idx{0};            // Generator of log idx
     std::atomic< int64_t > m_pending_flush_size{0}; // How much flushable logs are pending
-    std::atomic< bool > m_is_flushing{false}; // Is LogDev currently flushing (so far supports one flusher at a time)
+    std::atomic< bool > m_is_flushing{false}; // Is flush locked, by the log groups in flight or by try_lock_flush
     bool m_stopped{false}; // Is Logdev stopped. We don't need lock here, because it is updated under flush lock
     logstore_family_id_t m_family_id; // The family id this logdev is part of
     JournalVirtualDev* m_vdev{nullptr};
@@ -795,7 +870,8 @@ private:
     off_t m_last_flush_dev_offset{0};
     logid_t m_last_truncate_idx{-1};
 
-    crc32_t m_last_crc{INVALID_CRC32_VALUE};
+    logid_t m_last_prepared_idx{-1}; // Last log idx put in a log group to flush, which could still be in flight
+    crc32_t m_last_crc{INVALID_CRC32_VALUE}; // Crc of the last log group prepared, which the next group chains to
     log_append_comp_callback m_append_comp_cb{nullptr};
     log_found_callback m_logfound_cb{nullptr};
     store_found_callback m_store_found_cb{nullptr};
@@ -814,8 +890,16 @@ private:
     uint64_t m_flush_size_multiple{0};
 
     // Pool for creating log group
-    LogGroup m_log_group_pool[max_log_group];
+    std::vector< std::unique_ptr< LogGroup > > m_log_group_pool;
     uint32_t m_log_group_idx{0};
+
+    // Log groups being written to the device, in the order of their log idx. Groups are prepared and their completions
+    // are processed under this mutex, but the callbacks of the completions are made outside of it.
+    std::mutex m_flush_mutex;
+    std::deque< LogGroup* > m_inflight_groups;
+    std::atomic< uint32_t > m_ninflight_groups{0};
+    bool m_completing_flush{false}; // Is there a thread processing the completions of the groups in flight
+    LogFlushController m_flush_ctrl;
     std::atomic< bool > m_flush_status = false;
     // Timer handle
     iomgr::timer_handle_t m_flush_timer_hdl;
@@ -0,0 +1,78 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+
+#include <homestore/logstore_service.hpp>
+
+#include "common/homestore_config.hpp"
+#include "log_flush_controller.hpp"
+
+namespace homestore {
+static constexpr uint64_t min_sample_interval_us{100};
+
+static double ewma(double cur, double sample, double weight) {
+    return (cur == 0) ? sample : ((weight * sample) + ((1.0 - weight) * cur));
+}
+
+bool LogFlushController::is_adaptive() { return HS_DYNAMIC_CONFIG(logstore.adaptive_flush); }
+
+void LogFlushController::on_flush_done(uint64_t latency_us) {
+    HISTOGRAM_OBSERVE(logstore_service().metrics(), logdev_flush_write_latency_us, latency_us);
+    m_flush_latency_us = ewma(m_flush_latency_us, static_cast< double >(latency_us), s_ewma_weight);
+
+    // Rate of appends since the last sample, which is skipped if flushes are too close to get a meaningful rate
+    auto const elapsed_us = get_elapsed_time_us(m_last_sample_time);
+    if (elapsed_us >= min_sample_interval_us) {
+        auto const nappends = m_nappends.load(std::memory_order_relaxed);
+        auto const bytes = m_append_bytes.load(std::memory_order_relaxed);
+        m_appends_per_us = ewma(m_appends_per_us, static_cast< double >(nappends - m_last_nappends) / elapsed_us,
+                                s_ewma_weight);
+        m_bytes_per_us =
+            ewma(m_bytes_per_us, static_cast< double >(bytes - m_last_append_bytes) / elapsed_us, s_ewma_weight);
+        m_last_sample_time = Clock::now();
+        m_last_nappends = nappends;
+        m_last_append_bytes = bytes;
+    }
+    if (!is_adaptive()) {
+        m_threshold_size.store(1, std::memory_order_relaxed);
+        m_max_wait_us.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    // Time an append could wait for others to batch with it, while the flush could still make the target latency
+    auto const target_us = static_cast< double >(HS_DYNAMIC_CONFIG(logstore.adaptive_flush_target_latency_us));
+    auto const window_us = std::max(target_us - m_flush_latency_us, 0.0);
+
+    int64_t threshold_size{1};
+    uint64_t max_wait_us{0};
+    if ((m_appends_per_us * window_us) < 1.0) {
+        // No other append is likely within the window, flush as soon as there is something
+        COUNTER_INCREMENT(logstore_service().metrics(), logdev_adaptive_flush_immediate_count, 1);
+    } else {
+        auto const min_size = HS_DYNAMIC_CONFIG(logstore.flush_threshold_size);
+        auto const max_size = std::max(HS_DYNAMIC_CONFIG(logstore.adaptive_flush_max_batch_size), min_size);
+        threshold_size =
+            static_cast< int64_t >(std::clamp(static_cast< uint64_t >(m_bytes_per_us * window_us), min_size, max_size));
+        max_wait_us = static_cast< uint64_t >(window_us);
+        COUNTER_INCREMENT(logstore_service().metrics(), logdev_adaptive_flush_batched_count, 1);
+    }
+    m_threshold_size.store(threshold_size, std::memory_order_relaxed);
+    m_max_wait_us.store(max_wait_us, std::memory_order_relaxed);
+
+    HISTOGRAM_OBSERVE(logstore_service().metrics(), logdev_adaptive_flush_threshold_size, threshold_size);
+    HISTOGRAM_OBSERVE(logstore_service().metrics(), logdev_adaptive_flush_max_wait_us, max_wait_us);
+}
+} // namespace homestore
@@ -0,0 +1,78 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+
+/*
+ * LogFlushController: Picks how much LogDev batches before a flush and how long it lets the batch wait, so that an
+ * append is on the device within the target latency. It follows the rate of appends and the latency of the flushes:
+ *
+ * - If the next append is not expected within the time left after a flush takes its latency, waiting only adds to the
+ *   latency, so it asks to flush right away.
+ * - Otherwise it lets the appends expected in that time batch up, so that the device sees fewer and larger writes.
+ *
+ * The estimates are refreshed on every flush completion. LogDev falls back to the static threshold and time between
+ * flushes when the adaptive flush is switched off. The controller then resets its decisions to flush right away, but
+ * keeps tracking so it could be switched back on any time.
+ */
+class LogFlushController {
+public:
+    LogFlushController() = default;
+    LogFlushController(const LogFlushController&) = delete;
+    LogFlushController(LogFlushController&&) noexcept = delete;
+    LogFlushController& operator=(const LogFlushController&) = delete;
+    LogFlushController& operator=(LogFlushController&&) noexcept = delete;
+    ~LogFlushController() = default;
+
+    static bool is_adaptive();
+
+    void on_append(uint64_t size) {
+        m_nappends.fetch_add(1, std::memory_order_relaxed);
+        m_append_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    /// @brief Account a flush which took the latency given and refresh the decisions. Expected to be called from one
+    /// thread at a time.
+    void on_flush_done(uint64_t latency_us);
+
+    int64_t threshold_size() const { return m_threshold_size.load(std::memory_order_relaxed); }
+    uint64_t max_wait_us() const { return m_max_wait_us.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr double s_ewma_weight{0.25}; // Weight of the latest sample in the estimates
+
+    std::atomic< uint64_t > m_nappends{0};
+    std::atomic< uint64_t > m_append_bytes{0};
+
+    // Estimates, only updated on flush completion
+    Clock::time_point m_last_sample_time{Clock::now()};
+    uint64_t m_last_nappends{0};
+    uint64_t m_last_append_bytes{0};
+    double m_appends_per_us{0};
+    double m_bytes_per_us{0};
+    double m_flush_latency_us{0};
+
+    // Decisions, read by the appenders and flushers
+    std::atomic< int64_t > m_threshold_size{1};
+    std::atomic< uint64_t > m_max_wait_us{0};
+};
+} // namespace homestore
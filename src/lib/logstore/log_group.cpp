@@ -13,17 +13,48 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <cstring>
 
 #include <isa-l/crc.h>
+#include <sisl/fds/compress.hpp>
 
 #include <homestore/logstore/log_store.hpp>
+#include <homestore/logstore_service.hpp>
 #include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 #include "log_dev.hpp"
 
 namespace homestore {
 SISL_LOGGING_DECL(logstore)
 
+/* Compresses size bytes at src into dst, prefixed with log_compressed_header, and returns the bytes it takes in dst.
+ * Returns 0 if it could not be compressed well enough to be worth it. dst should have room for the worst case */
+static uint32_t compress_log_data(const uint8_t* src, const uint32_t size, uint8_t* dst) {
+    size_t compressed_size = sisl::Compress::max_compress_len(size);
+    auto const ret = sisl::Compress::compress(r_cast< const char* >(src),
+                                              r_cast< char* >(dst + sizeof(log_compressed_header)), size,
+                                              &compressed_size);
+    if (ret != 0) {
+        LOGERRORMOD(logstore, "Failed to compress log data of size={}, ret={}, writing it uncompressed", size, ret);
+        return 0;
+    }
+
+    auto const stored_size = uint32_cast(sizeof(log_compressed_header) + compressed_size);
+    auto const ratio_percent = uint32_cast(uint64_cast(stored_size) * 100 / size);
+    if (ratio_percent > HS_DYNAMIC_CONFIG(logstore.compress_ratio_limit)) {
+        COUNTER_INCREMENT(logstore_service().metrics(), logdev_compress_backoff_count, 1);
+        return 0;
+    }
+    COUNTER_INCREMENT(logstore_service().metrics(), logdev_compress_success_count, 1);
+    HISTOGRAM_OBSERVE(logstore_service().metrics(), logdev_compress_ratio_percent, ratio_percent);
+
+    auto* chdr = r_cast< log_compressed_header* >(dst);
+    chdr->raw_size = size;
+    chdr->compressed_size = uint32_cast(compressed_size);
+    return stored_size;
+}
+
 LogGroup::LogGroup() = default;
 void LogGroup::start(const uint64_t flush_multiple_size, const uint32_t align_size) {
     m_iovecs.reserve(estimated_iovs);
@@ -42,6 +73,7 @@ void LogGroup::stop() {
     m_log_buf.reset();
     m_overflow_log_buf.reset();
     m_footer_buf.reset();
+    m_compressed_oob_bufs.clear();
 }
 
 void LogGroup::reset(const uint32_t max_records) {
@@ -55,6 +87,10 @@ void LogGroup::reset(const uint32_t max_records) {
     m_nrecords = 0;
     m_max_records = std::min(max_records, max_records_in_a_batch);
     m_actual_data_size = 0;
+    m_flush_done = false;
+    m_compress = HS_DYNAMIC_CONFIG(logstore.compress_feature_on);
+    m_inline_compressed = false;
+    m_compressed_oob_bufs.clear();
 
     m_iovecs.clear();
     m_iovecs.emplace_back(static_cast< void* >(m_cur_log_buf), m_inline_data_pos);
@@ -62,8 +98,8 @@ void LogGroup::reset(const uint32_t max_records) {
 
 void LogGroup::create_overflow_buf(const uint32_t min_needed) {
     auto const new_len = sisl::round_up(std::max(min_needed, m_cur_buf_len * 2), m_flush_multiple_size);
-    auto new_buf =
-        sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite >::make_sized(m_flush_multiple_size, new_len);
+    iobuf_unique_ptr< sisl::buftag::logwrite > new_buf{
+        hs_utils::iobuf_alloc(new_len, sisl::buftag::logwrite, m_flush_multiple_size)};
     std::memcpy(s_cast< void* >(new_buf.get()), s_cast< const void* >(m_cur_log_buf), m_cur_buf_len);
 
     m_overflow_log_buf = std::move(new_buf);
@@ -96,6 +132,7 @@ bool LogGroup::add_record(const log_record& record, const int64_t log_idx) {
     m_record_slots[m_nrecords].size = record.data.size;
     m_record_slots[m_nrecords].store_id = record.store_id;
     m_record_slots[m_nrecords].store_seq_num = record.seq_num;
+    m_record_slots[m_nrecords].set_compressed(false);
     if (record.is_inlineable(m_flush_multiple_size)) {
         m_record_slots[m_nrecords].offset = m_inline_data_pos;
         m_record_slots[m_nrecords].set_inlined(true);
@@ -107,8 +144,14 @@ bool LogGroup::add_record(const log_record& record, const int64_t log_idx) {
         // We do not round it now, it will be rounded during finish
         m_record_slots[m_nrecords].offset = m_oob_data_pos;
         m_record_slots[m_nrecords].set_inlined(false);
-        m_iovecs.emplace_back(s_cast< void* >(record.data.bytes), record.data.size);
-        m_oob_data_pos += record.data.size;
+        auto const compressed_len = m_compress ? compress_oob_record(record) : 0;
+        if (compressed_len != 0) {
+            m_record_slots[m_nrecords].set_compressed(true);
+            m_oob_data_pos += compressed_len;
+        } else {
+            m_iovecs.emplace_back(s_cast< void* >(record.data.bytes), record.data.size);
+            m_oob_data_pos += record.data.size;
+        }
     }
     ++m_nrecords;
 
@@ -119,7 +162,46 @@ bool LogGroup::new_iovec_for_footer() const {
     return ((m_inline_data_pos + sizeof(log_group_footer)) >= m_cur_buf_len || m_oob_data_pos != 0);
 }
 
+uint32_t LogGroup::compress_oob_record(const log_record& record) {
+    if (record.data.size < HS_DYNAMIC_CONFIG(logstore.min_compress_size)) { return 0; }
+
+    // Stored in multiples of flush size like the uncompressed records, so that the oob area stays dma'ble
+    auto const max_len = uint32_cast(sisl::round_up(
+        sizeof(log_compressed_header) + sisl::Compress::max_compress_len(record.data.size), m_flush_multiple_size));
+    iobuf_unique_ptr< sisl::buftag::logwrite > buf{
+        hs_utils::iobuf_alloc(max_len, sisl::buftag::logwrite, m_flush_multiple_size)};
+    auto const len = compress_log_data(record.data.bytes, record.data.size, buf.get());
+    auto const stored_len = uint32_cast(sisl::round_up(len, m_flush_multiple_size));
+    if ((len == 0) || (stored_len >= record.data.size)) { return 0; }
+
+    std::memset(s_cast< void* >(buf.get() + len), 0, stored_len - len);
+    m_iovecs.emplace_back(s_cast< void* >(buf.get()), stored_len);
+    m_compressed_oob_bufs.emplace_back(std::move(buf));
+    return stored_len;
+}
+
+void LogGroup::compress_inline_area() {
+    auto const start = inline_data_offset();
+    auto const raw_size = m_inline_data_pos - start;
+    if ((raw_size == 0) || (raw_size < HS_DYNAMIC_CONFIG(logstore.min_compress_size)) ||
+        (raw_size > HS_DYNAMIC_CONFIG(logstore.max_inline_compress_size))) {
+        return;
+    }
+
+    m_compress_buf.resize(sizeof(log_compressed_header) + sisl::Compress::max_compress_len(raw_size));
+    auto const len = compress_log_data(m_cur_log_buf + start, raw_size, m_compress_buf.data());
+    if (len == 0) { return; }
+
+    // Inline records keep their offsets within the uncompressed inline area, which the readers build back
+    std::memcpy(s_cast< void* >(m_cur_log_buf + start), s_cast< const void* >(m_compress_buf.data()), len);
+    m_inline_data_pos = start + len;
+    m_iovecs[0].iov_len = m_inline_data_pos;
+    m_inline_compressed = true;
+}
+
 const iovec_array& LogGroup::finish(const crc32_t prev_crc) {
+    if (m_compress) { compress_inline_area(); }
+
     // add footer
     auto footer = add_and_get_footer();
 
@@ -128,8 +210,10 @@ const iovec_array& LogGroup::finish(const crc32_t prev_crc) {
     log_group_header* hdr = new (header()) log_group_header{};
     hdr->n_log_records = m_nrecords;
     hdr->prev_grp_crc = prev_crc;
-    hdr->inline_data_offset = sizeof(log_group_header) + (m_max_records * sizeof(serialized_log_record));
+    hdr->inline_data_offset = inline_data_offset();
     hdr->oob_data_offset = m_iovecs[0].iov_len;
+    if (m_inline_compressed) { hdr->flags |= log_group_header::inline_compressed_flag; }
+    if (!m_compressed_oob_bufs.empty()) { hdr->flags |= log_group_header::oob_compressed_flag; }
     if (new_iovec_for_footer()) {
         hdr->footer_offset = hdr->oob_data_offset + m_oob_data_pos;
         hdr->group_size = hdr->footer_offset + m_footer_buf_len;
@@ -166,6 +250,43 @@ log_group_footer* LogGroup::add_and_get_footer() {
     return footer;
 }
 
+void LogGroup::decompress(const uint8_t* src, const uint32_t src_size, uint8_t* dst, const uint32_t raw_size) {
+    auto const* chdr = r_cast< const log_compressed_header* >(src);
+    uint32_t const stored_raw_size = chdr->raw_size;
+    uint32_t const compressed_size = chdr->compressed_size;
+    HS_REL_ASSERT_EQ(stored_raw_size, raw_size, "Compressed log data is not of the size expected");
+    HS_REL_ASSERT_LE(sizeof(log_compressed_header) + compressed_size, src_size,
+                     "Compressed log data goes beyond the area it is stored in");
+
+    size_t decompressed_size = raw_size;
+    auto const ret = sisl::Compress::decompress(r_cast< const char* >(src + sizeof(log_compressed_header)),
+                                                r_cast< char* >(dst), compressed_size, &decompressed_size);
+    HS_REL_ASSERT_EQ(ret, 0, "Failed to decompress log data of compressed_size={}", compressed_size);
+    HS_REL_ASSERT_EQ(uint64_cast(decompressed_size), uint64_cast(raw_size), "Decompressed log data size mismatch");
+}
+
+sisl::byte_view LogGroup::decompress_inline_area(const log_group_header* header) {
+    auto const* chdr = r_cast< const log_compressed_header* >(header->inline_area());
+    uint32_t const raw_size = chdr->raw_size;
+
+    // Inline records are laid back to back in the inline area, so its raw size is known from the records as well
+    uint64_t inline_end{header->_inline_data_offset()};
+    for (uint32_t i{0}; i < header->nrecords(); ++i) {
+        auto const* rec = header->nth_record(i);
+        if (rec->get_inlined()) { inline_end = std::max(inline_end, uint64_cast(rec->offset) + rec->size); }
+    }
+    HS_REL_ASSERT_LE(raw_size, HS_DYNAMIC_CONFIG(logstore.max_inline_compress_size),
+                     "Compressed inline area is larger than the max size it could be compressed with");
+    HS_REL_ASSERT_EQ(uint64_cast(raw_size), inline_end - header->_inline_data_offset(),
+                     "Compressed inline area size does not match with the inline records of the group");
+
+    sisl::byte_view image{header->_inline_data_offset() + raw_size};
+    std::memcpy(s_cast< void* >(image.bytes()), s_cast< const void* >(header), header->_inline_data_offset());
+    decompress(header->inline_area(), header->inline_data_size(), image.bytes() + header->_inline_data_offset(),
+               raw_size);
+    return image;
+}
+
 crc32_t LogGroup::compute_crc() {
     crc32_t crc =
         crc32_ieee(init_crc32, static_cast< const unsigned char* >(m_iovecs[0].iov_base) + sizeof(log_group_header),
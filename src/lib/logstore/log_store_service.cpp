@@ -232,12 +232,24 @@ LogStoreServiceMetrics::LogStoreServiceMetrics() : sisl::MetricsGroup("LogStores
                        HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logdev_flush_records_distribution, "Distribution of num records to flush",
                        HistogramBucketsType(LinearUpto128Buckets));
+    REGISTER_HISTOGRAM(logdev_flush_inflight_groups, "Distribution of log groups in flight on every flush",
+                       HistogramBucketsType(LinearUpto128Buckets));
     REGISTER_HISTOGRAM(logstore_record_size, "Distribution of log record size",
                        HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logdev_flush_done_msg_time_ns, "Logdev flush completion msg time in ns");
     REGISTER_HISTOGRAM(logdev_post_flush_processing_latency,
                        "Logdev post flush processing (including callbacks) latency");
     REGISTER_HISTOGRAM(logdev_fsync_time_us, "Logdev fsync completion time in us");
+    REGISTER_HISTOGRAM(logdev_flush_write_latency_us, "Logdev log group write latency in us");
+    REGISTER_COUNTER(logdev_adaptive_flush_immediate_count, "Number of times adaptive flush chose to flush right away");
+    REGISTER_COUNTER(logdev_adaptive_flush_batched_count, "Number of times adaptive flush chose to batch the appends");
+    REGISTER_HISTOGRAM(logdev_adaptive_flush_threshold_size, "Flush threshold size picked by adaptive flush",
+                       HistogramBucketsType(ExponentialOfTwoBuckets));
+    REGISTER_HISTOGRAM(logdev_adaptive_flush_max_wait_us, "Max time between flushes picked by adaptive flush in us");
+    REGISTER_COUNTER(logdev_compress_success_count, "Number of log group areas and records written compressed");
+    REGISTER_COUNTER(logdev_compress_backoff_count, "Number of times compression was skipped for the ratio limit");
+    REGISTER_HISTOGRAM(logdev_compress_ratio_percent, "Compressed size of log data as percentage of its raw size",
+                       HistogramBucketsType(LinearUpto128Buckets));
 
     register_me_to_farm();
 }
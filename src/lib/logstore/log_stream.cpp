@@ -13,6 +13,10 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include <isa-l/crc.h>
 
 #include "common/homestore_assert.hpp"
@@ -24,9 +28,19 @@
 namespace homestore {
 SISL_LOGGING_DECL(logstore)
 
-log_stream_reader::log_stream_reader(off_t device_cursor, JournalVirtualDev* store, uint64_t read_size_multiple) :
-        m_vdev{store}, m_first_group_cursor{device_cursor}, m_read_size_multiple{read_size_multiple} {
-    m_vdev->lseek(m_first_group_cursor);
+log_stream_reader::log_stream_reader(off_t device_cursor, JournalVirtualDev* store, uint64_t read_size_multiple,
+                                     bool verify_crc) :
+        m_vdev{store},
+        m_first_group_cursor{device_cursor},
+        m_read_size_multiple{read_size_multiple},
+        m_verify_crc{verify_crc},
+        m_read_ahead_cursor{device_cursor},
+        m_read_ahead_size{
+            uint64_cast(sisl::round_up(HS_DYNAMIC_CONFIG(logstore.bulk_read_size), m_read_size_multiple))} {
+    // With no threads to read ahead, the pool does each read inline when it is issued, which is one at a time
+    auto const nthreads = HS_DYNAMIC_CONFIG(logstore.recovery_read_ahead_depth);
+    m_read_ahead_depth = std::max(nthreads, 1u);
+    m_read_pool = std::make_unique< ordered_job_pool< sisl::byte_view > >("logstream_rd", nthreads);
 }
 
 sisl::byte_view log_stream_reader::next_group(off_t* out_dev_offset) {
@@ -37,9 +51,13 @@ sisl::byte_view log_stream_reader::next_group(off_t* out_dev_offset) {
 
 read_again:
     if (m_cur_log_buf.size() < min_needed) {
-        do {
-            m_cur_log_buf = read_next_bytes(std::max(min_needed, bulk_read_size));
-        } while (m_cur_log_buf.size() < sizeof(log_group_header));
+        m_cur_log_buf = read_next_bytes(std::max(min_needed, bulk_read_size));
+        if (m_cur_log_buf.size() < std::max< uint64_t >(min_needed, sizeof(log_group_header))) {
+            LOGINFOMOD(logstore, "Logstream has read the entire journal, must have come to end of logdev at pos {}",
+                       m_vdev->dev_offset(m_cur_read_bytes));
+            *out_dev_offset = m_vdev->dev_offset(m_cur_read_bytes);
+            return ret_buf;
+        }
         min_needed = 0;
     }
 
@@ -97,11 +115,8 @@ read_again:
     }
     HS_DBG_ASSERT_EQ(footer->version, log_group_footer::footer_version, "Log footer version mismatch");
 
-    // verify crc with data
-    const crc32_t cur_crc =
-        crc32_ieee(init_crc32, s_cast< const uint8_t* >(m_cur_log_buf.bytes()) + sizeof(log_group_header),
-                   (header->total_size() - sizeof(log_group_header)));
-    if (cur_crc != header->cur_grp_crc) {
+    // verify crc with data, unless the caller is verifying it by itself
+    if (m_verify_crc && !is_group_crc_valid(m_cur_log_buf)) {
         /* This is a valid entry so crc should match */
         HS_REL_ASSERT(0, "data is corrupted");
         LOGINFOMOD(logstore, "crc doesn't match {}", m_vdev->dev_offset(m_cur_read_bytes));
@@ -114,7 +129,7 @@ read_again:
     }
 
     // store cur crc in prev crc
-    m_prev_crc = cur_crc;
+    m_prev_crc = header->cur_grp_crc;
 
     ret_buf = m_cur_log_buf;
     *out_dev_offset = m_vdev->dev_offset(m_cur_read_bytes);
@@ -130,22 +145,67 @@ sisl::byte_view log_stream_reader::group_in_next_page() {
     return next_group(&dev_offset);
 }
 
+bool log_stream_reader::is_group_crc_valid(const sisl::byte_view& group_buf) {
+    const auto* header = r_cast< const log_group_header* >(group_buf.bytes());
+    const crc32_t cur_crc =
+        crc32_ieee(init_crc32, s_cast< const uint8_t* >(group_buf.bytes()) + sizeof(log_group_header),
+                   (header->total_size() - sizeof(log_group_header)));
+    return (cur_crc == header->cur_grp_crc);
+}
+
 sisl::byte_view log_stream_reader::read_next_bytes(uint64_t nbytes) {
-    // TO DO: Might need to address alignment based on data or fast type
-    auto out_buf =
-        hs_utils::create_byte_view(nbytes + m_cur_log_buf.size(), true, sisl::buftag::logread, m_vdev->align_size());
-    auto ret_buf = out_buf;
-    if (m_cur_log_buf.size()) {
-        memcpy(out_buf.bytes(), m_cur_log_buf.bytes(), m_cur_log_buf.size());
-        out_buf.move_forward(m_cur_log_buf.size());
+    // Collect the bulk reads issued ahead till we have the bytes asked for, topping up the read ahead as they are taken
+    std::vector< sisl::byte_view > reads;
+    uint64_t nread{0};
+    while (nread < nbytes) {
+        issue_read_ahead();
+        if (m_read_pool->outstanding() == 0) { break; } // Entire journal is read, nothing more to read
+        reads.emplace_back(m_read_pool->next());
+        nread += reads.back().size();
     }
+    issue_read_ahead();
+    if (reads.empty()) { return m_cur_log_buf; }
+    if ((reads.size() == 1) && (m_cur_log_buf.size() == 0)) { return reads.front(); }
 
-    const auto prev_pos = m_vdev->seeked_pos();
-    auto actual_read = m_vdev->sync_next_read(out_buf.bytes(), nbytes);
-    HS_REL_ASSERT_NE(actual_read, 0, "zero bytes are read");
-    LOGINFOMOD(logstore, "LogStream read {} bytes from vdev offset {} and vdev cur offset {}", actual_read, prev_pos,
-               m_vdev->seeked_pos());
-    ret_buf.set_size(actual_read + m_cur_log_buf.size());
+    // TO DO: Might need to address alignment based on data or fast type
+    auto ret_buf =
+        hs_utils::create_byte_view(nread + m_cur_log_buf.size(), true, sisl::buftag::logread, m_vdev->align_size());
+    uint64_t filled{m_cur_log_buf.size()};
+    if (filled) { std::memcpy(ret_buf.bytes(), m_cur_log_buf.bytes(), filled); }
+    for (const auto& r : reads) {
+        std::memcpy(ret_buf.bytes() + filled, r.bytes(), r.size());
+        filled += r.size();
+    }
+    ret_buf.set_size(filled);
     return ret_buf;
 }
+
+void log_stream_reader::issue_read_ahead() {
+    // Journal can't have more than its size written from the first group, so reading ahead beyond that would only wrap
+    // around to the groups already read
+    auto const journal_size = m_vdev->size();
+    while ((m_read_pool->outstanding() < m_read_ahead_depth) && (m_read_ahead_issued < journal_size)) {
+        off_t next_cursor{0};
+        auto const cursor = m_read_ahead_cursor;
+        auto const max_size = std::min(m_read_ahead_size, journal_size - m_read_ahead_issued);
+        auto const size = m_vdev->next_read_size(cursor, max_size, next_cursor);
+        m_read_ahead_cursor = next_cursor;
+        m_read_ahead_issued += uint64_cast((next_cursor > cursor) ? (next_cursor - cursor)
+                                                                  : (next_cursor + int64_cast(journal_size) - cursor));
+
+        // Segment beyond the tail could be left with nothing in it by an earlier pass over the journal
+        if (size == 0) { continue; }
+
+        m_read_pool->submit([this, cursor, size]() {
+            auto buf = hs_utils::create_byte_view(size, true, sisl::buftag::logread, m_vdev->align_size());
+            auto const actual_read = m_vdev->sync_pread(buf.bytes(), size, cursor);
+            HS_REL_ASSERT_NE(actual_read, 0, "zero bytes are read");
+            HS_REL_ASSERT_EQ(actual_read, s_cast< ssize_t >(size), "Error reading log stream at vdev offset {}",
+                             cursor);
+            LOGINFOMOD(logstore, "LogStream read {} bytes from vdev offset {}", actual_read, cursor);
+            buf.set_size(actual_read);
+            return buf;
+        });
+    }
+}
 } // namespace homestore
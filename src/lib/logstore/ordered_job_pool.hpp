@@ -0,0 +1,123 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sisl/utility/thread_factory.hpp>
+
+namespace homestore {
+
+/*
+ * ordered_job_pool: Runs the jobs submitted to it on a fixed set of threads, while handing their results back in the
+ * order of submission. The log recovery uses it to keep the journal reads and the crc checks of the log groups going
+ * ahead of the replay, which still has to see them in the order they were written.
+ *
+ * Only one thread is expected to submit and collect the jobs. With no threads, the jobs are run inline on submit.
+ */
+template < typename ResultT >
+class ordered_job_pool {
+public:
+    using job_t = std::function< ResultT(void) >;
+
+    ordered_job_pool(const std::string& name, uint32_t nthreads) {
+        for (uint32_t t{0}; t < nthreads; ++t) {
+            m_threads.emplace_back(sisl::named_thread(name + std::to_string(t), [this]() { run(); }));
+        }
+    }
+    ordered_job_pool(const ordered_job_pool&) = delete;
+    ordered_job_pool(ordered_job_pool&&) noexcept = delete;
+    ordered_job_pool& operator=(const ordered_job_pool&) = delete;
+    ordered_job_pool& operator=(ordered_job_pool&&) noexcept = delete;
+
+    ~ordered_job_pool() {
+        {
+            std::unique_lock< std::mutex > lg{m_mtx};
+            m_stopping = true;
+        }
+        m_job_cv.notify_all();
+        for (auto& t : m_threads) {
+            t.join();
+        }
+    }
+
+    void submit(job_t job) {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        m_jobs.emplace_back();
+        if (m_threads.empty()) {
+            m_jobs.back().result = job();
+            ++m_next_pick;
+            return;
+        }
+        m_jobs.back().job = std::move(job);
+        m_job_cv.notify_one();
+    }
+
+    /// @brief Waits for the oldest job submitted and returns its result. Should be called only if outstanding() > 0
+    ResultT next() {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        m_done_cv.wait(lg, [this]() { return m_jobs.front().result.has_value(); });
+        auto ret = std::move(*m_jobs.front().result);
+        m_jobs.pop_front();
+        --m_next_pick;
+        return ret;
+    }
+
+    size_t outstanding() const {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        return m_jobs.size();
+    }
+
+private:
+    struct job_slot {
+        job_t job;
+        std::optional< ResultT > result;
+    };
+
+    void run() {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        while (true) {
+            m_job_cv.wait(lg, [this]() { return m_stopping || (m_next_pick < m_jobs.size()); });
+            if (m_stopping) { return; }
+
+            // Slots are only popped from the front once they have their result, so this one stays put while we run it
+            auto& slot = m_jobs[m_next_pick++];
+            lg.unlock();
+            auto res = slot.job();
+            lg.lock();
+            slot.result = std::move(res);
+            m_done_cv.notify_one();
+        }
+    }
+
+private:
+    mutable std::mutex m_mtx;
+    std::condition_variable m_job_cv;
+    std::condition_variable m_done_cv;
+    std::deque< job_slot > m_jobs;
+    size_t m_next_pick{0}; // Index of the first job in m_jobs no thread has picked up yet
+    bool m_stopping{false};
+    std::vector< std::thread > m_threads;
+};
+} // namespace homestore
@@ -0,0 +1,339 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+/*
+ * Standalone benchmark and fragmentation simulator of the blk allocators. It runs entirely in memory on an allocator
+ * of num_blks, without any device or homestore instance.
+ *
+ * For each fill level in --fill_levels, the allocator is first filled upto that level and then every thread runs
+ * --ops_per_level alloc/free pairs, which keeps the fill level steady while churning the free space. At the end of each
+ * level it reports throughput, alloc latency percentiles, allocator retry/direct alloc counters and the fragmentation
+ * of free space as seen by the client (largest free extent and histogram of free extent sizes).
+ *
+ * Size of each alloc is drawn from --size_dist which is one of
+ *   fixed : Always --size blks
+ *   zipf  : Zipfian over [1, --max_size] with exponent --zipf_exponent, i.e. smaller sizes are far more common
+ *   trace : Sizes (in blks, one per line) replayed from --trace_file in round robin
+ *
+ * FixedBlkAllocator always allocates 1 blk, irrespective of the size distribution.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+#include <nlohmann/json.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include "blkalloc/blk_allocator.h"
+#include "blkalloc/extent_blk_allocator.h"
+#include "blkalloc/varsize_blk_allocator.h"
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+SISL_OPTIONS_ENABLE(logging, blkalloc_bench)
+SISL_OPTION_GROUP(blkalloc_bench,
+                  (allocator, "", "allocator", "Allocator to benchmark [varsize|fixed|extent]",
+                   ::cxxopts::value< std::string >()->default_value("varsize"), "name"),
+                  (num_blks, "", "num_blks", "Number of blks in the allocator",
+                   ::cxxopts::value< uint32_t >()->default_value("4194304"), "number"),
+                  (num_threads, "", "num_threads", "Number of threads doing alloc/free",
+                   ::cxxopts::value< uint32_t >()->default_value("8"), "number"),
+                  (use_slabs, "", "use_slabs", "Use slab cache for varsize allocator",
+                   ::cxxopts::value< bool >()->default_value("true"), "true/false"),
+                  (size_dist, "", "size_dist", "Distribution of alloc sizes [fixed|zipf|trace]",
+                   ::cxxopts::value< std::string >()->default_value("zipf"), "name"),
+                  (size, "", "size", "Alloc size in blks for fixed distribution",
+                   ::cxxopts::value< uint32_t >()->default_value("1"), "number"),
+                  (max_size, "", "max_size", "Max alloc size in blks for zipf distribution",
+                   ::cxxopts::value< uint32_t >()->default_value("64"), "number"),
+                  (zipf_exponent, "", "zipf_exponent", "Exponent of zipf distribution",
+                   ::cxxopts::value< double >()->default_value("1.0"), "number"),
+                  (trace_file, "", "trace_file", "File with one alloc size in blks per line",
+                   ::cxxopts::value< std::string >()->default_value(""), "path"),
+                  (fill_levels, "", "fill_levels", "Comma separated fill levels in pct to run at",
+                   ::cxxopts::value< std::string >()->default_value("50,70,80,90,95"), "list"),
+                  (ops_per_level, "", "ops_per_level", "Number of alloc/free pairs per thread at each fill level",
+                   ::cxxopts::value< uint64_t >()->default_value("100000"), "number"))
+
+using namespace homestore;
+
+namespace {
+using size_generator_t = std::function< blk_count_t(std::default_random_engine&) >;
+
+size_generator_t make_size_generator() {
+    const auto dist{SISL_OPTIONS["size_dist"].as< std::string >()};
+    if (SISL_OPTIONS["allocator"].as< std::string >() == "fixed") {
+        return [](std::default_random_engine&) { return blk_count_t{1}; };
+    } else if (dist == "fixed") {
+        const auto sz{static_cast< blk_count_t >(SISL_OPTIONS["size"].as< uint32_t >())};
+        return [sz](std::default_random_engine&) { return sz; };
+    } else if (dist == "zipf") {
+        const auto max_size{std::min< uint32_t >(SISL_OPTIONS["max_size"].as< uint32_t >(), BlkId::max_blks_in_op())};
+        const auto s{SISL_OPTIONS["zipf_exponent"].as< double >()};
+        auto cdf{std::make_shared< std::vector< double > >(max_size)};
+        double sum{0};
+        for (uint32_t k{1}; k <= max_size; ++k) {
+            sum += 1.0 / std::pow(static_cast< double >(k), s);
+            (*cdf)[k - 1] = sum;
+        }
+        return [cdf, sum](std::default_random_engine& re) {
+            std::uniform_real_distribution< double > u{0.0, sum};
+            const auto it{std::lower_bound(cdf->cbegin(), cdf->cend(), u(re))};
+            return static_cast< blk_count_t >(std::min< size_t >(it - cdf->cbegin(), cdf->size() - 1) + 1);
+        };
+    } else if (dist == "trace") {
+        std::ifstream f{SISL_OPTIONS["trace_file"].as< std::string >()};
+        HS_REL_ASSERT(f.is_open(), "Unable to open trace file {}", SISL_OPTIONS["trace_file"].as< std::string >());
+        auto sizes{std::make_shared< std::vector< blk_count_t > >()};
+        uint32_t sz;
+        while (f >> sz) {
+            if (sz > 0) { sizes->push_back(static_cast< blk_count_t >(std::min(sz, BlkId::max_blks_in_op()))); }
+        }
+        HS_REL_ASSERT(!sizes->empty(), "Trace file has no sizes");
+        auto cursor{std::make_shared< std::atomic< uint64_t > >(0)};
+        return [sizes, cursor](std::default_random_engine&) {
+            return (*sizes)[cursor->fetch_add(1, std::memory_order_relaxed) % sizes->size()];
+        };
+    }
+    HS_REL_ASSERT(false, "Unknown size distribution {}", dist);
+    return {};
+}
+
+std::unique_ptr< BlkAllocator > make_allocator(blk_num_t num_blks) {
+    const auto type{SISL_OPTIONS["allocator"].as< std::string >()};
+    const uint64_t size{static_cast< uint64_t >(num_blks) * 4096};
+    if (type == "varsize") {
+        VarsizeBlkAllocConfig cfg{4096, 4096, 4096u, size, "bench", false};
+        cfg.set_phys_page_size(4096);
+        cfg.set_use_slabs(SISL_OPTIONS["use_slabs"].as< bool >());
+        return std::make_unique< VarsizeBlkAllocator >(cfg, true, 0);
+    } else if (type == "fixed") {
+        BlkAllocConfig cfg{4096, 4096, size, "bench", false};
+        return std::make_unique< FixedBlkAllocator >(cfg, true, 0);
+    } else if (type == "extent") {
+        BlkAllocConfig cfg{4096, 4096, size, "bench", false};
+        return std::make_unique< ExtentBlkAllocator >(cfg, true, 0);
+    }
+    HS_REL_ASSERT(false, "Unknown allocator type {}", type);
+    return nullptr;
+}
+
+// Find the counter anywhere in the metrics json, so that it doesn't depend on how metrics group lays them out
+uint64_t find_counter(const nlohmann::json& j, const std::string& name) {
+    if (!j.is_object() && !j.is_array()) { return 0; }
+    for (auto it{j.begin()}; it != j.end(); ++it) {
+        if (j.is_object() && (it.key().find(name) != std::string::npos) && it.value().is_number()) {
+            return it.value().get< uint64_t >();
+        }
+        if (const auto v{find_counter(it.value(), name)}; v != 0) { return v; }
+    }
+    return 0;
+}
+
+struct alloc_counters {
+    uint64_t num_retries{0};
+    uint64_t num_blks_alloc_direct{0};
+};
+
+alloc_counters get_alloc_counters(BlkAllocator* allocator) {
+    alloc_counters c;
+    if (auto* v{dynamic_cast< VarsizeBlkAllocator* >(allocator)}) {
+        const auto j{v->get_metrics_in_json()};
+        c.num_retries = find_counter(j, "num_retries");
+        c.num_blks_alloc_direct = find_counter(j, "num_blks_alloc_direct");
+    }
+    return c;
+}
+
+struct thread_ctx {
+    std::default_random_engine re{std::random_device{}()};
+    std::vector< BlkId > alloced;
+    std::vector< uint64_t > alloc_lat_ns;
+    uint64_t num_alloc_failures{0};
+};
+
+void alloc_one(BlkAllocator* allocator, const size_generator_t& gen, thread_ctx& ctx) {
+    static thread_local std::vector< BlkId > s_bids;
+    s_bids.clear();
+
+    blk_alloc_hints hints;
+    hints.is_contiguous = false;
+    const auto nblks{gen(ctx.re)};
+    const auto start{std::chrono::steady_clock::now()};
+    const auto status{allocator->alloc(nblks, hints, s_bids)};
+    ctx.alloc_lat_ns.push_back(static_cast< uint64_t >(
+        std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count()));
+
+    if ((status == BlkAllocStatus::SUCCESS) || (status == BlkAllocStatus::PARTIAL)) {
+        ctx.alloced.insert(ctx.alloced.end(), s_bids.cbegin(), s_bids.cend());
+    } else {
+        ++ctx.num_alloc_failures;
+    }
+}
+
+void free_one(BlkAllocator* allocator, thread_ctx& ctx) {
+    if (ctx.alloced.empty()) { return; }
+    std::uniform_int_distribution< size_t > pick{0, ctx.alloced.size() - 1};
+    const auto i{pick(ctx.re)};
+    allocator->free(ctx.alloced[i]);
+    ctx.alloced[i] = ctx.alloced.back();
+    ctx.alloced.pop_back();
+}
+
+uint64_t percentile(const std::vector< uint64_t >& sorted, double pct) {
+    if (sorted.empty()) { return 0; }
+    const auto idx{static_cast< size_t >(std::ceil(pct / 100.0 * sorted.size())) - 1};
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+// Fragmentation of free space as seen by the client, i.e. blks not held by any thread are free
+void report_fragmentation(const std::vector< thread_ctx >& ctxs, blk_num_t num_blks) {
+    boost::dynamic_bitset<> used(num_blks);
+    for (const auto& ctx : ctxs) {
+        for (const auto& b : ctx.alloced) {
+            for (blk_num_t i{0}; i < b.get_nblks(); ++i) {
+                used.set(b.get_blk_num() + i);
+            }
+        }
+    }
+
+    std::vector< uint64_t > hist(33, 0); // Free extents bucketed by power of 2 of their size
+    uint64_t largest{0};
+    uint64_t nextents{0};
+    blk_num_t cur{0};
+    while (cur < num_blks) {
+        if (used.test(cur)) {
+            ++cur;
+            continue;
+        }
+        blk_num_t end{cur};
+        while ((end < num_blks) && !used.test(end)) {
+            ++end;
+        }
+        const uint64_t len{end - cur};
+        largest = std::max(largest, len);
+        ++hist[63 - __builtin_clzll(len)];
+        ++nextents;
+        cur = end;
+    }
+
+    std::ostringstream ss;
+    for (size_t i{0}; i < hist.size(); ++i) {
+        if (hist[i]) { ss << " [" << (1ull << i) << "-" << ((1ull << (i + 1)) - 1) << "]=" << hist[i]; }
+    }
+    LOGINFO("  free_extents={} largest_free_extent={} free_extent_histogram:{}", nextents, largest, ss.str());
+}
+
+void run_level(BlkAllocator* allocator, const size_generator_t& gen, std::vector< thread_ctx >& ctxs,
+               blk_num_t num_blks, uint32_t fill_pct, uint64_t ops_per_thread) {
+    const auto target{static_cast< uint64_t >(num_blks) * fill_pct / 100};
+    const auto nthreads{ctxs.size()};
+
+    // Phase 1: Fill upto the level
+    for (auto& ctx : ctxs) {
+        ctx.num_alloc_failures = 0;
+    }
+    std::vector< std::thread > threads;
+    for (size_t t{0}; t < nthreads; ++t) {
+        threads.emplace_back([&, t]() {
+            auto& ctx{ctxs[t]};
+            while ((allocator->get_used_blks() < target) && (ctx.num_alloc_failures == 0)) {
+                alloc_one(allocator, gen, ctx);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    threads.clear();
+
+    // Phase 2: Steady state churn at that level
+    const auto before{get_alloc_counters(allocator)};
+    for (auto& ctx : ctxs) {
+        ctx.alloc_lat_ns.clear();
+        ctx.num_alloc_failures = 0;
+    }
+    const auto start{std::chrono::steady_clock::now()};
+    for (size_t t{0}; t < nthreads; ++t) {
+        threads.emplace_back([&, t]() {
+            auto& ctx{ctxs[t]};
+            for (uint64_t i{0}; i < ops_per_thread; ++i) {
+                free_one(allocator, ctx);
+                alloc_one(allocator, gen, ctx);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    const auto elapsed_us{
+        std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() - start).count()};
+    const auto after{get_alloc_counters(allocator)};
+
+    std::vector< uint64_t > lat;
+    uint64_t failures{0};
+    for (const auto& ctx : ctxs) {
+        lat.insert(lat.end(), ctx.alloc_lat_ns.cbegin(), ctx.alloc_lat_ns.cend());
+        failures += ctx.num_alloc_failures;
+    }
+    std::sort(lat.begin(), lat.end());
+
+    const double total_ops{2.0 * ops_per_thread * nthreads};
+    LOGINFO("fill_level={}% used_blks={} ({:.1f}%): ops/sec={:.0f} alloc_latency_ns p50={} p99={} p999={} "
+            "alloc_failures={} num_retries={} num_blks_alloc_direct={}",
+            fill_pct, allocator->get_used_blks(), 100.0 * allocator->get_used_blks() / num_blks,
+            (elapsed_us > 0) ? total_ops * 1000000.0 / elapsed_us : 0.0, percentile(lat, 50), percentile(lat, 99),
+            percentile(lat, 99.9), failures, after.num_retries - before.num_retries,
+            after.num_blks_alloc_direct - before.num_blks_alloc_direct);
+    report_fragmentation(ctxs, num_blks);
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, blkalloc_bench)
+    sisl::logging::SetLogger("blkalloc_benchmark");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%t] %v");
+    HomeStoreDynamicConfig::init_settings_default();
+
+    const auto num_blks{static_cast< blk_num_t >(SISL_OPTIONS["num_blks"].as< uint32_t >())};
+    auto allocator{make_allocator(num_blks)};
+    const auto gen{make_size_generator()};
+    std::vector< thread_ctx > ctxs(std::max(SISL_OPTIONS["num_threads"].as< uint32_t >(), 1u));
+
+    LOGINFO("Benchmarking allocator={} num_blks={} threads={} size_dist={}", SISL_OPTIONS["allocator"].as< std::string >(),
+            num_blks, ctxs.size(), SISL_OPTIONS["size_dist"].as< std::string >());
+
+    std::stringstream levels{SISL_OPTIONS["fill_levels"].as< std::string >()};
+    std::string level;
+    while (std::getline(levels, level, ',')) {
+        const auto pct{std::min< uint32_t >(std::stoul(level), 95)};
+        run_level(allocator.get(), gen, ctxs, num_blks, pct, SISL_OPTIONS["ops_per_level"].as< uint64_t >());
+    }
+    return 0;
+}
@@ -277,6 +277,54 @@ TEST_F(BlkCacheQueueTest, join_from_multiple_levels) {
     validate_alloc(1 /* count */, 0 /* slab */, last_blk_num_at_slab(0), 1);
 }
 
+TEST_F(BlkCacheQueueTest, MagazinePopByLevel) {
+    static constexpr blk_cap_t level_limit{16384};
+    static constexpr blk_num_t nentries{100};
+    static constexpr blk_num_t hot_start{1000};
+    SlabCacheQueue sq{1 /* slab_size */, {level_limit, level_limit}, 50.0f /* refill_pct */, 8 /* magazine_size */,
+                      g_metrics.get()};
+
+    LOGINFO("Step 1: Fill {} entries in each of the 2 levels", nentries);
+    for (blk_num_t i{0}; i < nentries; ++i) {
+        ASSERT_EQ(sq.push(blk_cache_entry{i, 1, 0}, true /* only_this_level */), blk_temp_t{0});
+        ASSERT_EQ(sq.push(blk_cache_entry{hot_start + i, 1, 1}, true /* only_this_level */), blk_temp_t{1});
+    }
+
+    LOGINFO("Step 2: Pop all entries of level 1 and expect none of them from level 0");
+    blk_cache_entry e;
+    for (blk_num_t i{0}; i < nentries; ++i) {
+        const auto level{sq.magazine_pop(1, e)};
+        ASSERT_TRUE(level.has_value()) << "Expected entries of level 1 to be available";
+        ASSERT_EQ(*level, blk_temp_t{1});
+        ASSERT_GE(e.get_blk_num(), hot_start) << "Popped entry of level 0 while asked for level 1";
+    }
+
+    LOGINFO("Step 3: Level 1 is exhausted, pop should fall back to level 0 and report it");
+    auto level{sq.magazine_pop(1, e)};
+    ASSERT_TRUE(level.has_value());
+    ASSERT_EQ(*level, blk_temp_t{0}) << "Fallback pop did not report the level it is popped from";
+    ASSERT_LT(e.get_blk_num(), hot_start);
+
+    LOGINFO("Step 4: Freed entry goes back to its own level");
+    ASSERT_EQ(sq.magazine_push(blk_cache_entry{5000, 1, 1}), blk_temp_t{1});
+    level = sq.magazine_pop(0, e);
+    ASSERT_EQ(*level, blk_temp_t{0});
+    ASSERT_LT(e.get_blk_num(), hot_start) << "Pop of level 0 returned an entry freed to level 1";
+    level = sq.magazine_pop(1, e);
+    ASSERT_EQ(*level, blk_temp_t{1});
+    ASSERT_EQ(e.get_blk_num(), 5000u);
+
+    LOGINFO("Step 5: Drain the rest and validate nothing is lost or duplicated in magazines");
+    ASSERT_EQ(sq.entry_count(), nentries - 2);
+    blk_num_t ndrained{0};
+    while (sq.magazine_pop(1, e)) {
+        ASSERT_LT(e.get_blk_num(), hot_start);
+        ++ndrained;
+    }
+    ASSERT_EQ(ndrained, nentries - 2);
+    ASSERT_EQ(sq.entry_count(), 0u);
+}
+
 SISL_OPTIONS_ENABLE(logging)
 int main(int argc, char* argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
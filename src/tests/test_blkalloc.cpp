@@ -16,6 +16,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <iostream>
@@ -35,11 +36,14 @@
 #include <sisl/options/options.h>
 
 #include "blkalloc/blk_allocator.h"
+#include "blkalloc/blk_alloc_summary.h"
 #include "blkalloc/blk_cache.h"
+#include "blkalloc/extent_blk_allocator.h"
 #include "common/homestore_assert.hpp"
 #include "common/homestore_config.hpp"
 #include "common/homestore_flip.hpp"
 #include "blkalloc/varsize_blk_allocator.h"
+#include "blkdata_svc/write_hotness_tracker.hpp"
 
 SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
 
@@ -424,7 +428,37 @@ struct VarsizeBlkAllocatorTest : public ::testing::Test, BlkAllocatorTest {
     virtual ~VarsizeBlkAllocatorTest() override = default;
 
     virtual void SetUp() override{};
-    virtual void TearDown() override{};
+    virtual void TearDown() override {
+        // Restore the settings even if the test which changed them failed midway, for the tests which follow
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.blkallocator.num_blk_temperatures = 1;
+            s.blkallocator.warmup_cache_on_init = false;
+        });
+        HS_SETTINGS_FACTORY().save();
+    };
+
+    // Counters could be reported against their name or their description, look for either
+    static uint64_t find_counter(const nlohmann::json& j, const std::string& name, const std::string& desc) {
+        if (!j.is_object() && !j.is_array()) { return 0; }
+        for (auto it{j.begin()}; it != j.end(); ++it) {
+            if (j.is_object() && it.value().is_number() &&
+                ((it.key().find(name) != std::string::npos) || (it.key().find(desc) != std::string::npos))) {
+                return it.value().get< uint64_t >();
+            }
+            if (const auto v{find_counter(it.value(), name, desc)}; v != 0) { return v; }
+        }
+        return 0;
+    }
+
+    uint64_t magazine_hits() {
+        return find_counter(m_allocator->get_metrics_in_json(), "num_magazine_hits",
+                            "allocated from the thread magazine as is");
+    }
+
+    uint64_t slab_queue_pops() {
+        return find_counter(m_allocator->get_metrics_in_json(), "num_slab_queue_pops",
+                            "allocated from slab queues bypassing magazines");
+    }
 
     void create_allocator(const bool use_slabs = true) {
         VarsizeBlkAllocConfig cfg{4096, 4096, 4096u, static_cast< uint64_t >(m_total_count) * 4096, "", false};
@@ -848,6 +882,362 @@ TEST_F(VarsizeBlkAllocatorTest, alloc_var_scatter_direct_unirandsize_without_sla
     alloc_var_scatter_direct_unirandsize(this);
 }
 #endif
+TEST(BlkAllocSummaryTest, free_run_search_matches_bitmap) {
+    static constexpr blk_num_t total_blks{64 * 1024};
+    static constexpr blk_num_t blks_per_portion{4096};
+    sisl::Bitset bm{total_blks, 0, 4096};
+    BlkAllocSummary summary{total_blks, blks_per_portion};
+
+    LOGINFO("Step 1: Fill most of the bitmap, leaving random holes of random sizes");
+    bm.set_bits(0, total_blks);
+    summary.rebuild(bm);
+    std::uniform_int_distribution< blk_num_t > rand_blk{0, total_blks - 1};
+    std::uniform_int_distribution< blk_count_t > rand_size{1, 200};
+    for (uint32_t i{0}; i < 200; ++i) {
+        const blk_num_t start{rand_blk(g_re)};
+        const blk_num_t portion_end{(start / blks_per_portion + 1) * blks_per_portion};
+        const blk_count_t nblks{std::min< blk_count_t >(rand_size(g_re), portion_end - start)};
+        if (bm.is_bits_set(start, nblks)) {
+            bm.reset_bits(start, nblks);
+            summary.mark_free(start, nblks);
+        }
+    }
+
+    LOGINFO("Step 2: Compare free run search with and without summary for every portion and run size");
+    for (blk_num_t p{0}; p < total_blks / blks_per_portion; ++p) {
+        const blk_num_t start{p * blks_per_portion};
+        const blk_num_t end{start + blks_per_portion - 1};
+        for (const blk_count_t n : {1, 2, 8, 64, 65, 150, 256}) {
+            const auto expected{bm.get_next_contiguous_n_reset_bits(start, end, n, n)};
+            const auto actual{summary.next_free_run(bm, start, end, n, n)};
+            ASSERT_EQ(actual.nbits, expected.nbits) << "Mismatch in run size for portion=" << p << " n=" << n;
+            if (expected.nbits != 0) {
+                ASSERT_EQ(actual.start_bit, expected.start_bit) << "Mismatch in run for portion=" << p << " n=" << n;
+            }
+        }
+    }
+
+    LOGINFO("Step 3: Allocate every free blk through summary and expect summary to report every portion full");
+    for (blk_num_t p{0}; p < total_blks / blks_per_portion; ++p) {
+        const blk_num_t end{(p + 1) * blks_per_portion - 1};
+        blk_num_t cur{p * blks_per_portion};
+        while (true) {
+            const auto b{summary.next_free_run(bm, cur, end, 1, end - cur + 1)};
+            if (b.nbits == 0) { break; }
+            bm.set_bits(b.start_bit, b.nbits);
+            summary.mark_used(b.start_bit, b.nbits);
+            cur = b.start_bit + b.nbits;
+            if (cur > end) { break; }
+        }
+        ASSERT_EQ(summary.portion_free_blks(p), 0u) << "Expected portion=" << p << " to be full";
+    }
+    ASSERT_EQ(bm.get_set_count(), total_blks) << "Expected all blks to be allocated";
+}
+
+TEST(ExtentBlkAllocatorTest, best_fit_alloc_and_coalesce_on_free) {
+    static constexpr blk_num_t total_blks{64 * 1024};
+    BlkAllocConfig cfg{4096, 4096, static_cast< uint64_t >(total_blks) * 4096, "extent_test", false};
+    ExtentBlkAllocator allocator{cfg, true, 0};
+    ASSERT_EQ(allocator.num_free_extents(), 1u) << "Expected fresh allocator to have single free extent";
+    ASSERT_EQ(allocator.largest_free_extent(), total_blks);
+
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+
+    LOGINFO("Step 1: Allocate the entire space in chunks of 128 blks and free every alternate one to create holes");
+    std::vector< BlkId > bids;
+    for (blk_num_t i{0}; i < total_blks / 128; ++i) {
+        ASSERT_EQ(allocator.alloc(128, hints, bids), BlkAllocStatus::SUCCESS);
+    }
+    ASSERT_EQ(allocator.available_blks(), 0u);
+    for (size_t i{0}; i < bids.size(); i += 2) {
+        allocator.free(bids[i]);
+    }
+    ASSERT_EQ(allocator.num_free_extents(), bids.size() / 2);
+
+    LOGINFO("Step 2: Free one more chunk to create a bigger hole and expect best fit to pick the smaller one");
+    allocator.free(bids[3]); // Coalesces bids[2], bids[3], bids[4] into one extent of 384 blks
+    ASSERT_EQ(allocator.largest_free_extent(), 384u);
+    std::vector< BlkId > fit_bids;
+    ASSERT_EQ(allocator.alloc(100, hints, fit_bids), BlkAllocStatus::SUCCESS);
+    ASSERT_EQ(fit_bids.size(), 1u);
+    ASSERT_EQ(allocator.largest_free_extent(), 384u) << "Best fit should not have carved from the largest extent";
+    ASSERT_TRUE(allocator.is_blk_alloced(fit_bids[0]));
+
+    LOGINFO("Step 3: Contiguous alloc larger than any extent should fail, scattered one should be carved in pieces");
+    std::vector< BlkId > big_bids;
+    ASSERT_EQ(allocator.alloc(512, hints, big_bids), BlkAllocStatus::FAILED);
+    hints.is_contiguous = false;
+    ASSERT_EQ(allocator.alloc(512, hints, big_bids), BlkAllocStatus::SUCCESS);
+    blk_cap_t big_nblks{0};
+    for (const auto& b : big_bids) {
+        big_nblks += b.get_nblks();
+    }
+    ASSERT_EQ(big_nblks, 512u);
+    ASSERT_EQ(big_bids[0].get_blk_num(), bids[2].get_blk_num()) << "Expected first piece from the largest extent";
+    ASSERT_EQ(big_bids[1].get_blk_num(), big_bids[0].get_blk_num() + big_bids[0].get_nblks())
+        << "Expected pieces of a single extent to be physically adjacent";
+
+    LOGINFO("Step 4: Free everything and expect the free space to coalesce back to a single extent");
+    allocator.free(big_bids);
+    allocator.free(fit_bids);
+    for (size_t i{1}; i < bids.size(); i += 2) {
+        if (i != 3) { allocator.free(bids[i]); }
+    }
+    ASSERT_EQ(allocator.available_blks(), total_blks);
+    ASSERT_EQ(allocator.num_free_extents(), 1u) << "Expected all free extents to be coalesced";
+    ASSERT_EQ(allocator.largest_free_extent(), total_blks);
+
+    LOGINFO("Step 5: Allocate everything in large scattered allocations and expect space full afterwards");
+    std::vector< BlkId > all_bids;
+    for (blk_num_t i{0}; i < total_blks / 4096; ++i) {
+        ASSERT_EQ(allocator.alloc(4096, hints, all_bids), BlkAllocStatus::SUCCESS);
+    }
+    std::vector< BlkId > none_bids;
+    ASSERT_EQ(allocator.alloc(1, hints, none_bids), BlkAllocStatus::SPACE_FULL);
+}
+
+namespace {
+void set_magazine_size(const uint32_t magazine_size) {
+    HS_SETTINGS_FACTORY().modifiable_settings(
+        [magazine_size](auto& s) { s.blkallocator.free_blk_magazine_size = magazine_size; });
+    HS_SETTINGS_FACTORY().save();
+}
+
+// Each thread keeps a window of its own allocations outstanding and frees the oldest one on every new alloc, which is
+// the typical pattern of a write heavy workload. It doesn't track the blks on the shared skip list, so that the
+// throughput measured is dominated by the allocator and not by the test bookkeeping.
+double alloc_free_throughput(VarsizeBlkAllocatorTest* const block_test_pointer, const uint32_t nthreads,
+                             const uint64_t num_iters, uint64_t& out_total_ops) {
+    static constexpr size_t window_size{256};
+    std::atomic< uint64_t > total_ops{0};
+
+    const auto start_time{std::chrono::steady_clock::now()};
+    block_test_pointer->run_parallel(
+        nthreads, num_iters, [&](const uint64_t iters_per_thread, std::atomic< bool >& terminate_flag) {
+            blk_alloc_hints hints;
+            hints.is_contiguous = true;
+
+            std::vector< BlkId > window;
+            window.reserve(window_size);
+            std::vector< BlkId > bids;
+            size_t oldest{0};
+            uint64_t ops{0};
+
+            for (uint64_t i{0}; (i < iters_per_thread) && !terminate_flag; ++i) {
+                bids.clear();
+                if (block_test_pointer->m_allocator->alloc(BlkAllocatorTest::round_rand_size(), hints, bids) !=
+                    BlkAllocStatus::SUCCESS) {
+                    terminate_flag = true;
+                    break;
+                }
+
+                if (window.size() < window_size) {
+                    window.push_back(bids.front());
+                } else {
+                    block_test_pointer->m_allocator->free(window[oldest]);
+                    window[oldest] = bids.front();
+                    oldest = (oldest + 1) % window_size;
+                    ++ops;
+                }
+                ++ops;
+            }
+
+            block_test_pointer->m_allocator->free(window);
+            total_ops.fetch_add(ops + window.size());
+        });
+
+    const auto elapsed_us{std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now() -
+                                                                                   start_time)
+                              .count()};
+    out_total_ops = total_ops.load();
+    return (elapsed_us == 0) ? 0.0 : (static_cast< double >(total_ops.load()) * 1000000.0 / elapsed_us);
+}
+} // namespace
+
+TEST_F(VarsizeBlkAllocatorTest, alloc_free_throughput_magazines) {
+    const auto nthreads{
+        std::clamp< uint32_t >(std::thread::hardware_concurrency(), 2, SISL_OPTIONS["num_threads"].as< uint32_t >())};
+    const auto num_iters{SISL_OPTIONS["iters"].as< uint64_t >()};
+    const auto default_magazine_size{HS_DYNAMIC_CONFIG(blkallocator.free_blk_magazine_size)};
+
+    LOGINFO("Step 1: Measure alloc/free throughput directly on slab queues with threads={} iters={}", nthreads,
+            num_iters);
+    uint64_t total_ops{0};
+    set_magazine_size(0);
+    create_allocator();
+    const auto queue_ops_per_sec{alloc_free_throughput(this, nthreads, num_iters, total_ops)};
+    ASSERT_EQ(total_ops, 2 * num_iters) << "Expected every iteration to alloc and free once";
+    ASSERT_EQ(m_allocator->get_used_blks(), 0u) << "Expected all blks to be freed";
+    ASSERT_EQ(magazine_hits(), 0u) << "Allocs are served from magazines, even though they are disabled";
+    ASSERT_GT(slab_queue_pops(), 0u) << "Allocs are not served from slab queues directly";
+
+    LOGINFO("Step 2: Measure alloc/free throughput with per thread magazines of size={}", default_magazine_size);
+    set_magazine_size(default_magazine_size);
+    create_allocator();
+    const auto magazine_ops_per_sec{alloc_free_throughput(this, nthreads, num_iters, total_ops)};
+    ASSERT_EQ(total_ops, 2 * num_iters) << "Expected every iteration to alloc and free once";
+    ASSERT_EQ(m_allocator->get_used_blks(), 0u) << "Expected all blks to be freed";
+    ASSERT_GT(magazine_hits(), 0u) << "Allocs are not served from magazines";
+    ASSERT_EQ(slab_queue_pops(), 0u) << "Allocs bypassed the magazines";
+
+    LOGINFO("Alloc/free throughput: slab_queue={:.0f} ops/sec magazines={:.0f} ops/sec speedup={:.2f}x",
+            queue_ops_per_sec, magazine_ops_per_sec,
+            (queue_ops_per_sec == 0.0) ? 0.0 : (magazine_ops_per_sec / queue_ops_per_sec));
+    LOGINFO("Metrics with magazines: {}", m_allocator->get_metrics_in_json().dump(4));
+}
+
+TEST_F(VarsizeBlkAllocatorTest, alloc_by_temperature) {
+    static constexpr blk_temp_t num_temps{2};
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.blkallocator.num_blk_temperatures = num_temps; });
+    HS_SETTINGS_FACTORY().save();
+
+    const VarsizeBlkAllocConfig cfg{4096, 4096, 4096u, static_cast< uint64_t >(m_total_count) * 4096, "", false};
+    const blk_num_t hot_start_blk{cfg.get_portions_per_temp_group() * cfg.get_blks_per_portion()};
+    create_allocator(false /* use_slabs */);
+
+    LOGINFO("Step 1: Allocate blks for each temperature and expect them to be placed in that temperature's region");
+    std::vector< BlkId > all_bids;
+    for (blk_temp_t temp{1}; temp <= num_temps; ++temp) {
+        blk_alloc_hints hints;
+        hints.is_contiguous = true;
+        hints.desired_temp = temp;
+        for (uint32_t i{0}; i < 100; ++i) {
+            std::vector< BlkId > bids;
+            ASSERT_EQ(m_allocator->alloc(8, hints, bids), BlkAllocStatus::SUCCESS);
+            ASSERT_EQ(bids.size(), 1u);
+            ASSERT_EQ(bids[0].get_blk_num() >= hot_start_blk, temp == num_temps)
+                << "blk_num=" << bids[0].get_blk_num() << " placed in wrong region for temperature=" << temp;
+            all_bids.push_back(bids[0]);
+        }
+    }
+
+    LOGINFO("Step 2: Free all blks and expect everything to be available");
+    m_allocator->free(all_bids);
+    ASSERT_EQ(m_allocator->get_used_blks(), 0u);
+    LOGINFO("Metrics with temperatures: {}", m_allocator->get_metrics_in_json().dump(4));
+}
+
+TEST_F(VarsizeBlkAllocatorTest, warmup_cache_on_init) {
+    LOGINFO("Step 1: With warmup, free blk cache is filled when the allocator is inited, ahead of the sweeper");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.blkallocator.warmup_cache_on_init = true; });
+    HS_SETTINGS_FACTORY().save();
+    create_allocator();
+    ASSERT_GT(m_allocator->cached_free_blks(), 0u) << "Cache is not warmed up on init";
+
+    LOGINFO("Step 2: Blks taken from the warmed up cache should be allocated and not left in cache");
+    blk_alloc_hints hints;
+    std::vector< BlkId > bids;
+    ASSERT_EQ(m_allocator->alloc(8, hints, bids), BlkAllocStatus::SUCCESS);
+    for (const auto& b : bids) {
+        ASSERT_TRUE(m_allocator->is_blk_alloced(b, true /* use_lock */));
+    }
+    m_allocator->free(bids);
+    ASSERT_EQ(m_allocator->get_used_blks(), 0u);
+}
+
+TEST_F(VarsizeBlkAllocatorTest, batch_free_coalesces_adjacent_blks) {
+    create_allocator(false /* use_slabs */);
+
+    LOGINFO("Step 1: Adjacent blkids given in any order should be merged, but not across a portion");
+    const blk_num_t portion_blks{m_allocator->get_config().get_blks_per_portion()};
+    const std::vector< BlkId > unsorted{BlkId{10, 2, 0}, BlkId{12, 3, 0}, BlkId{0, 4, 0}, BlkId{4, 1, 0},
+                                        BlkId{20, 1, 0}, BlkId{portion_blks, 2, 0}, BlkId{portion_blks - 2, 2, 0}};
+    std::vector< BlkId > merged;
+    m_allocator->coalesce_blkids(unsorted, merged);
+    ASSERT_EQ(merged, (std::vector< BlkId >{BlkId{0, 5, 0}, BlkId{10, 5, 0}, BlkId{20, 1, 0},
+                                            BlkId{portion_blks - 2, 2, 0}, BlkId{portion_blks, 2, 0}}));
+
+    LOGINFO("Step 2: Allocate single blks, free them in shuffled batch and expect the space fully reusable");
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    std::vector< BlkId > bids;
+    for (uint32_t i{0}; i < 1024; ++i) {
+        ASSERT_EQ(m_allocator->alloc(1, hints, bids), BlkAllocStatus::SUCCESS);
+    }
+    std::shuffle(bids.begin(), bids.end(), g_re);
+    m_allocator->free(bids);
+    ASSERT_EQ(m_allocator->get_used_blks(), 0u);
+
+    std::vector< BlkId > big_bids;
+    ASSERT_EQ(m_allocator->alloc(BlkId::max_blks_in_op(), hints, big_bids), BlkAllocStatus::SUCCESS);
+    m_allocator->free(big_bids);
+
+    LOGINFO("Step 3: Commit blks on disk bitmap, free them on disk in one shuffled batch and expect all of them reset");
+    std::vector< BlkId > disk_bids;
+    for (blk_num_t i{0}; i < 64; ++i) {
+        disk_bids.emplace_back(100 + 2 * i, (i % 2) + 1, 0);
+        ASSERT_EQ(m_allocator->alloc_on_disk(disk_bids.back()), BlkAllocStatus::SUCCESS);
+    }
+    std::shuffle(disk_bids.begin(), disk_bids.end(), g_re);
+    m_allocator->free_on_disk(disk_bids);
+    for (const auto& b : disk_bids) {
+        ASSERT_FALSE(m_allocator->is_blk_alloced_on_disk(b)) << "Blkid=" << b.to_string() << " not freed on disk";
+    }
+}
+
+TEST(WriteHotnessTrackerTest, overwrites_make_data_hotter) {
+    static constexpr blk_temp_t num_temps{3};
+    WriteHotnessTracker tracker{4096, num_temps};
+
+    ASSERT_EQ(tracker.record_write(100), 1) << "Data written once should be coldest";
+    ASSERT_EQ(tracker.record_write(100), 2);
+    tracker.record_write(100);
+    ASSERT_EQ(tracker.record_write(100), 3) << "Data overwritten 4 times should be hottest";
+    for (uint32_t i{0}; i < 100; ++i) {
+        ASSERT_EQ(tracker.record_write(100), num_temps) << "Temperature should be capped to number of temperatures";
+    }
+    ASSERT_GE(tracker.estimate(100), 104u) << "Sketch should never under estimate";
+    ASSERT_EQ(tracker.record_write(200), 1) << "Unrelated key should stay cold";
+}
+
+TEST(BlkAllocatorTest, disk_bm_dirty_pages) {
+    static constexpr blk_num_t total_blks{64 * 1024};
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.blkallocator.disk_bm_page_size = 512; });
+    HS_SETTINGS_FACTORY().save();
+
+    BlkAllocConfig cfg{4096, 4096, static_cast< uint64_t >(total_blks) * 4096, "dirty_page_test", false};
+    cfg.set_auto_recovery(true);
+    ExtentBlkAllocator allocator{cfg, false, 0};
+    ExtentBlkAllocator recovered{cfg, false, 0};
+    const auto page_nbits{allocator.disk_bm_page_nbits()};
+    ASSERT_EQ(page_nbits, 4096u);
+    ASSERT_EQ(allocator.num_disk_bm_pages(), total_blks / page_nbits);
+
+    LOGINFO("Step 1: Fresh bitmap should have every page dirty");
+    ASSERT_EQ(allocator.acquire_dirty_disk_bm_pages().size(), allocator.num_disk_bm_pages());
+    allocator.release_underlying_buffer();
+    ASSERT_FALSE(allocator.need_flush_dirty_bm());
+
+    LOGINFO("Step 2: Alloc in page 3 and a blk spanning page 5 and 6, only those pages should be dirty");
+    ASSERT_EQ(allocator.alloc_on_disk(BlkId{3 * page_nbits + 10, 20, 0}), BlkAllocStatus::SUCCESS);
+    ASSERT_EQ(allocator.alloc_on_disk(BlkId{6 * page_nbits - 8, 16, 0}), BlkAllocStatus::SUCCESS);
+    ASSERT_TRUE(allocator.need_flush_dirty_bm());
+    const auto dirty_pages{allocator.acquire_dirty_disk_bm_pages()};
+    ASSERT_EQ(dirty_pages, (std::vector< uint32_t >{3, 5, 6}));
+
+    LOGINFO("Step 3: Dirty pages applied to another bitmap should reproduce the same allocations");
+    for (const auto p : dirty_pages) {
+        sisl::Bitset page_bm{allocator.serialize_disk_bm_page(p)};
+        ASSERT_EQ(page_bm.size(), page_nbits);
+        recovered.apply_disk_bm_page(p * page_nbits, page_bm);
+    }
+    ASSERT_TRUE(recovered.get_disk_bm_const()->is_bits_set(3 * page_nbits + 10, 20));
+    ASSERT_TRUE(recovered.get_disk_bm_const()->is_bits_set(6 * page_nbits - 8, 16));
+    ASSERT_EQ(recovered.get_disk_bm_const()->get_set_count(), 36u);
+    allocator.release_underlying_buffer();
+
+    LOGINFO("Step 4: Nothing modified since, so no page should be dirty. Free should dirty only its page");
+    ASSERT_TRUE(allocator.acquire_dirty_disk_bm_pages().empty());
+    allocator.release_underlying_buffer();
+    allocator.free_on_disk(BlkId{3 * page_nbits + 10, 20, 0});
+    ASSERT_EQ(allocator.acquire_dirty_disk_bm_pages(), (std::vector< uint32_t >{3}));
+    allocator.release_underlying_buffer();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.blkallocator.disk_bm_page_size = 65536; });
+    HS_SETTINGS_FACTORY().save();
+}
+
 template < typename T >
 std::shared_ptr< cxxopts::Value > opt_default(const char* val) {
     return ::cxxopts::value< T >()->default_value(val);
@@ -15,6 +15,7 @@
  *********************************************************************************/
 #include <vector>
 #include <iostream>
+#include <set>
 #include <filesystem>
 
 #include <gtest/gtest.h>
@@ -347,6 +348,49 @@ public:
                  });
     }
 
+    void write_io_read_all_verify(const uint64_t io_size) {
+        std::shared_ptr< sisl::sg_list > sg_write = std::make_shared< sisl::sg_list >();
+        write_io(io_size, sg_write, 1 /* num_iovs */,
+                 [sg_write, this](std::error_condition err, std::shared_ptr< std::vector< BlkId > > sout_bids) {
+                     LOGINFO("after_write_cb: Write completed;");
+                     const auto out_bids = *(sout_bids.get());
+
+                     // Large write on a striped vdev is expected to be spread across the chunks of all devices
+                     std::set< chunk_num_t > chunks;
+                     for (const auto& bid : out_bids) {
+                         chunks.insert(bid.get_chunk_num());
+                     }
+                     LOGINFO("Write is spread across {} blkids in {} chunks", out_bids.size(), chunks.size());
+                     if (SISL_OPTIONS["num_devs"].as< uint32_t >() > 1) { HS_REL_ASSERT_GT(chunks.size(), 1ul); }
+
+                     std::shared_ptr< sisl::sg_list > sg_read = std::make_shared< sisl::sg_list >();
+                     struct iovec iov;
+                     iov.iov_len = sg_write->size;
+                     iov.iov_base = iomanager.iobuf_alloc(512, iov.iov_len);
+                     sg_read->iovs.push_back(iov);
+                     sg_read->size += iov.iov_len;
+
+                     LOGINFO("Step 2: async read on all {} blkids", out_bids.size());
+                     inst().async_read(out_bids, *(sg_read.get()), sg_read->size,
+                                       [sg_read, sg_write, this](std::error_condition err) {
+                                           assert(!err);
+
+                                           assert(verify_read(sg_read, sg_write));
+
+                                           LOGINFO("Read completed;");
+                                           free_sg_buf(sg_write);
+                                           free_sg_buf(sg_read);
+
+                                           {
+                                               std::lock_guard lk(this->m_mtx);
+                                               this->m_io_job_done = true;
+                                           }
+
+                                           this->m_cv.notify_one();
+                                       });
+                 });
+    }
+
     bool verify_read(std::shared_ptr< sisl::sg_list > read_sg, std::shared_ptr< sisl::sg_list > write_sg) {
         if ((write_sg->size != read_sg->size)) {
             LOGINFO("sg_list of read size: {} mismatch with write size: {}, ", read_sg->size, write_sg->size);
@@ -530,6 +574,24 @@ TEST_F(BlkDataServiceTest, TestWriteThenReadVerify) {
     this->shutdown();
 }
 
+TEST_F(BlkDataServiceTest, TestLargeWriteThenReadAllVerify) {
+    LOGINFO("Step 0: Starting homestore.");
+    start_homestore(SISL_OPTIONS["num_devs"].as< uint32_t >(),
+                    SISL_OPTIONS["dev_size_gb"].as< uint64_t >() * 1024 * 1024 * 1024, gp.num_threads);
+
+    // start io in worker thread;
+    auto io_size = 4 * Mi;
+    LOGINFO("Step 1: run on worker thread to schedule write for {} Bytes.", io_size);
+    iomanager.run_on(iomgr::thread_regex::random_worker,
+                     [this, &io_size](iomgr::io_thread_addr_t a) { this->write_io_read_all_verify(io_size); });
+
+    LOGINFO("Step 3: Wait for I/O to complete.");
+    wait_for_all_io_complete();
+
+    LOGINFO("Step 4: I/O completed, do shutdown.");
+    this->shutdown();
+}
+
 // Free_blk test, no read involved;
 TEST_F(BlkDataServiceTest, TestWriteThenFreeBlk) {
     LOGINFO("Step 0: Starting homestore.");
@@ -0,0 +1,193 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <gtest/gtest.h>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include "common/homestore_config.hpp"
+#include "index/index_cache_quota.hpp"
+
+using namespace homestore;
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+SISL_OPTIONS_ENABLE(logging)
+
+static constexpr uint64_t g_total_size{1000000};
+static constexpr uint32_t g_buf_size{1000};
+
+class IndexCacheQuotaTest : public testing::Test {
+protected:
+    std::unique_ptr< IndexCacheQuota > m_quota;
+    std::vector< uuid_t > m_uuids;
+
+protected:
+    void SetUp() override {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.cache.index_table_min_quota_pct = 2.0;
+            s.cache.index_table_max_quota_pct = 80.0;
+            s.cache.index_ghost_entries_per_table = 16;
+        });
+        HS_SETTINGS_FACTORY().save();
+        m_quota = std::make_unique< IndexCacheQuota >(g_total_size);
+    }
+
+    void TearDown() override { m_quota.reset(); }
+
+    uint32_t add_table() {
+        m_uuids.push_back(boost::uuids::random_generator()());
+        return m_quota->register_table(m_uuids.back());
+    }
+
+    nlohmann::json table_status(uint32_t ordinal) const {
+        return m_quota->get_status(1)[boost::uuids::to_string(m_uuids[ordinal - 1])];
+    }
+
+    int64_t quota_of(uint32_t ordinal) const { return table_status(ordinal)["quota_size"].get< int64_t >(); }
+    int64_t resident_of(uint32_t ordinal) const { return table_status(ordinal)["resident_size"].get< int64_t >(); }
+
+    void insert(uint32_t ordinal, uint32_t nbufs) {
+        for (uint32_t i{0}; i < nbufs; ++i) {
+            m_quota->on_insert(ordinal, g_buf_size);
+        }
+    }
+};
+
+TEST_F(IndexCacheQuotaTest, FairShareOnRegister) {
+    LOGINFO("Step 1: First table gets the max quota as fair share is entire cache");
+    auto const t1 = add_table();
+    ASSERT_EQ(t1, 1u) << "Ordinal 0 is reserved for unaccounted buffers";
+    ASSERT_EQ(quota_of(t1), int64_cast(g_total_size * 80 / 100));
+
+    LOGINFO("Step 2: Register more tables and validate existing tables are shrunk to make room");
+    for (uint32_t ntables{2}; ntables <= 5; ++ntables) {
+        auto const t = add_table();
+        ASSERT_EQ(t, ntables);
+        ASSERT_EQ(quota_of(t), int64_cast(g_total_size / ntables)) << "New table did not get its fair share";
+
+        int64_t sum{0};
+        for (uint32_t i{1}; i <= ntables; ++i) {
+            sum += quota_of(i);
+        }
+        ASSERT_LE(sum, int64_cast(g_total_size)) << "Total quota exceeds cache size after " << ntables << " tables";
+    }
+
+    LOGINFO("Step 3: Registering an already registered table returns the same ordinal");
+    ASSERT_EQ(m_quota->register_table(m_uuids[1]), 2u);
+}
+
+TEST_F(IndexCacheQuotaTest, MinQuotaLimitsFairShare) {
+    // With 10% min quota, 20 tables together ask for more than entire cache. Quota should never go below min
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.cache.index_table_min_quota_pct = 10.0; });
+    HS_SETTINGS_FACTORY().save();
+
+    for (uint32_t i{0}; i < 20; ++i) {
+        add_table();
+    }
+    for (uint32_t i{1}; i <= 20; ++i) {
+        ASSERT_EQ(quota_of(i), int64_cast(g_total_size / 10)) << "Table=" << i << " quota is not clamped to min";
+    }
+}
+
+TEST_F(IndexCacheQuotaTest, RefuseEvictWithinMinQuota) {
+    auto const t = add_table();
+    auto const min_bufs = uint32_cast(g_total_size * 2 / 100 / g_buf_size);
+
+    insert(t, min_bufs);
+    ASSERT_FALSE(m_quota->can_evict(t)) << "Table at its min quota should not be evicted";
+
+    insert(t, 1);
+    ASSERT_TRUE(m_quota->can_evict(t)) << "Table above its min quota should be evictable";
+
+    m_quota->on_evict(t, BlkId{100, 1, 0}, g_buf_size);
+    ASSERT_FALSE(m_quota->can_evict(t)) << "Table back to its min quota should not be evicted";
+}
+
+TEST_F(IndexCacheQuotaTest, PreferOverQuotaTable) {
+    auto const t1 = add_table();
+    auto const t2 = add_table();
+    auto const quota_bufs = uint32_cast(quota_of(t1) / g_buf_size);
+
+    LOGINFO("Step 1: Both tables within their quota, both are evictable");
+    insert(t1, quota_bufs);
+    insert(t2, quota_bufs / 2);
+    ASSERT_TRUE(m_quota->can_evict(t1));
+    ASSERT_TRUE(m_quota->can_evict(t2));
+
+    LOGINFO("Step 2: Table1 goes over quota, only table1 is evictable");
+    insert(t1, 10);
+    ASSERT_TRUE(m_quota->can_evict(t1));
+    ASSERT_FALSE(m_quota->can_evict(t2)) << "Table within quota is evicted while other table is over quota";
+    ASSERT_FALSE(m_quota->can_evict(IndexCacheQuota::unaccounted_ordinal));
+
+    LOGINFO("Step 3: Evict table1 back within quota, table2 is evictable again");
+    for (uint32_t i{0}; i < 10; ++i) {
+        m_quota->on_evict(t1, BlkId{i, 1, 0}, g_buf_size);
+    }
+    ASSERT_TRUE(m_quota->can_evict(t2));
+}
+
+TEST_F(IndexCacheQuotaTest, CanEvictHasNoSideEffects) {
+    auto const t = add_table();
+    insert(t, 100);
+
+    for (uint32_t i{0}; i < 1000; ++i) {
+        ASSERT_TRUE(m_quota->can_evict(t));
+    }
+    ASSERT_EQ(resident_of(t), int64_cast(100 * g_buf_size));
+    ASSERT_EQ(table_status(t)["evictions"].get< uint64_t >(), 0u);
+
+    // Miss on a blkid which is not evicted yet, should not account a ghost hit
+    m_quota->on_miss(t, BlkId{5, 1, 0});
+    ASSERT_EQ(table_status(t)["ghost_hits"].get< uint64_t >(), 0u);
+}
+
+TEST_F(IndexCacheQuotaTest, EvictionAccountingAndGhostHits) {
+    auto const t = add_table();
+    insert(t, 100);
+
+    for (uint32_t i{0}; i < 32; ++i) {
+        m_quota->on_evict(t, BlkId{i, 1, 0}, g_buf_size);
+    }
+    ASSERT_EQ(resident_of(t), int64_cast(68 * g_buf_size));
+    ASSERT_EQ(table_status(t)["evictions"].get< uint64_t >(), 32u);
+
+    LOGINFO("Only last 16 evicted blkids are remembered as ghosts");
+    m_quota->on_miss(t, BlkId{0, 1, 0});
+    ASSERT_EQ(table_status(t)["ghost_hits"].get< uint64_t >(), 0u) << "Ghost entry beyond the limit is not dropped";
+    m_quota->on_miss(t, BlkId{31, 1, 0});
+    ASSERT_EQ(table_status(t)["ghost_hits"].get< uint64_t >(), 1u);
+
+    LOGINFO("Ghost entry is consumed on hit");
+    m_quota->on_miss(t, BlkId{31, 1, 0});
+    ASSERT_EQ(table_status(t)["ghost_hits"].get< uint64_t >(), 1u);
+    ASSERT_EQ(table_status(t)["misses"].get< uint64_t >(), 3u);
+}
+
+int main(int argc, char* argv[]) {
+    int parsed_argc{argc};
+    ::testing::InitGoogleTest(&parsed_argc, argv);
+    SISL_OPTIONS_LOAD(parsed_argc, argv, logging);
+    sisl::logging::SetLogger("test_index_cache_quota");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    return RUN_ALL_TESTS();
+}
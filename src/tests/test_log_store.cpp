@@ -47,6 +47,7 @@
 #include <homestore/homestore.hpp>
 #include <homestore/logstore_service.hpp>
 
+#include "device/device.h"
 #include "logstore/log_dev.hpp"
 #include "logstore/log_store_family.hpp"
 #include "common/homestore_flip.hpp"
@@ -1133,6 +1134,262 @@ TEST_F(LogStoreTest, ThrottleSeqInsertThenRecover) {
         this->truncate_validate();
     }
 }
+
+TEST_F(LogStoreTest, RecoverWithoutReadAhead) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+
+    LOGINFO("Step 1: Reinit the num records to start sequential write test");
+    this->init(num_records);
+
+    LOGINFO("Step 2: Issue sequential inserts with q depth of 30");
+    this->kickstart_inserts(1, 30);
+    this->wait_for_inserts();
+
+    LOGINFO("Step 3: Restart homestore with the journal reads and crc checks done inline by the recovery");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.recovery_read_ahead_depth = 0;
+        s.logstore.recovery_crc_verify_threads = 0;
+    });
+    HS_SETTINGS_FACTORY().save();
+    SampleDB::instance().start_homestore(true /* restart */);
+    this->recovery_validate();
+    this->init(num_records);
+
+    LOGINFO("Step 4: Restart homestore again with the read ahead and parallel crc checks");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.recovery_read_ahead_depth = 4;
+        s.logstore.recovery_crc_verify_threads = 2;
+    });
+    HS_SETTINGS_FACTORY().save();
+    SampleDB::instance().start_homestore(true /* restart */);
+    this->recovery_validate();
+    this->init(num_records);
+
+    LOGINFO("Step 5: Restart homestore with the read ahead going well beyond the end of the log");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.recovery_read_ahead_depth = 8;
+        s.logstore.bulk_read_size = 4 * 1024 * 1024;
+    });
+    HS_SETTINGS_FACTORY().save();
+    SampleDB::instance().start_homestore(true /* restart */);
+    this->recovery_validate();
+    this->init(num_records);
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.recovery_read_ahead_depth = 4;
+        s.logstore.bulk_read_size = 524288;
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    LOGINFO("Step 6: Truncate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, RecoverWithParallelDeviceOpen) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+
+    LOGINFO("Step 1: Reinit the num records to start sequential write test");
+    this->init(num_records);
+
+    LOGINFO("Step 2: Issue sequential inserts with q depth of 30");
+    this->kickstart_inserts(1, 30);
+    this->wait_for_inserts();
+    const auto sys_uuid = hs()->device_mgr()->system_uuid();
+
+    LOGINFO("Step 3: Restart homestore with the devices opened one after another");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.num_dev_init_threads = 1; });
+    HS_SETTINGS_FACTORY().save();
+    SampleDB::instance().start_homestore(true /* restart */);
+    ASSERT_EQ(hs()->device_mgr()->system_uuid(), sys_uuid);
+    this->recovery_validate();
+    this->init(num_records);
+
+    LOGINFO("Step 4: Restart homestore again with a thread per device and validate it loads the same");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.num_dev_init_threads = 0; });
+    HS_SETTINGS_FACTORY().save();
+    SampleDB::instance().start_homestore(true /* restart */);
+    ASSERT_EQ(hs()->device_mgr()->system_uuid(), sys_uuid) << "Parallel open picked a different system uuid";
+    ASSERT_EQ(hs()->device_mgr()->get_all_devices().size(), SISL_OPTIONS["num_devs"].as< uint32_t >());
+    this->recovery_validate();
+    this->init(num_records);
+
+    LOGINFO("Step 5: Truncate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, InflightLogGroupsThenRecover) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+#ifdef _PRERELEASE
+    flip::FlipClient* fc = HomeStoreFlip::client_instance();
+    flip::FlipCondition dont_care_cond;
+    fc->create_condition("", flip::Operator::DONT_CARE, (int)1, &dont_care_cond);
+#endif
+
+    for (const uint32_t ngroups : {1u, 8u}) {
+        LOGINFO("Step 1: Restart homestore with {} log groups in flight at a time", ngroups);
+        HS_SETTINGS_FACTORY().modifiable_settings([ngroups](auto& s) { s.logstore.max_inflight_log_groups = ngroups; });
+        HS_SETTINGS_FACTORY().save();
+        SampleDB::instance().start_homestore(true /* restart */);
+        this->recovery_validate();
+        this->init(num_records);
+
+#ifdef _PRERELEASE
+        LOGINFO("Step 2a: Delay completion of some log group writes, for the groups after them to finish first");
+        flip::FlipFrequency delay_freq;
+        delay_freq.set_count(10);
+        delay_freq.set_percent(50);
+        fc->inject_delay_flip("simulate_log_flush_done_delay", {dont_care_cond}, delay_freq, 20000); // Delay by 20ms
+#endif
+        LOGINFO("Step 2: Issue sequential inserts with q depth of 60");
+        this->kickstart_inserts(1, 60);
+        this->wait_for_inserts();
+
+        LOGINFO("Step 3: Read all the inserts one by one for each log store to validate if what is written is valid");
+        this->read_validate(true);
+
+#ifdef _PRERELEASE
+        LOGINFO("Step 4a: Leave a torn log group at the end of the log, with the groups in flight after it on device");
+        flip::FlipFrequency torn_freq;
+        torn_freq.set_count(2); // Both the log families
+        torn_freq.set_percent(100);
+        flip::FlipCondition null_cond;
+        fc->inject_noreturn_flip("logdev_simulate_torn_inflight_groups", {null_cond}, torn_freq);
+#endif
+        LOGINFO("Step 4: Restart homestore to validate the recovery of the log groups written");
+        SampleDB::instance().start_homestore(true /* restart */);
+        this->recovery_validate();
+        this->init(num_records);
+        this->truncate_validate();
+
+        LOGINFO("Step 5: Issue inserts over the torn end of the log and validate them after another restart");
+        this->kickstart_inserts(1, 60);
+        this->wait_for_inserts();
+        this->read_validate(true);
+        SampleDB::instance().start_homestore(true /* restart */);
+        this->recovery_validate();
+        this->init(num_records);
+    }
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.max_inflight_log_groups = 4; });
+    HS_SETTINGS_FACTORY().save();
+}
+
+TEST_F(LogStoreTest, AdaptiveFlushSwitchOnAndOff) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+
+    LOGINFO("Step 1: Switch on the adaptive flush and issue sequential inserts with q depth of 1");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.adaptive_flush = true; });
+    HS_SETTINGS_FACTORY().save();
+    this->init(num_records);
+    this->kickstart_inserts(1, 1);
+    this->wait_for_inserts();
+    this->read_validate(true);
+
+    LOGINFO("Step 2: Issue sequential inserts with q depth of 60, for the adaptive flush to batch them");
+    this->init(num_records);
+    this->kickstart_inserts(1, 60);
+    this->wait_for_inserts();
+    this->read_validate(true);
+
+    LOGINFO("Step 3: Switch back to static flush in the middle of inserts");
+    this->init(num_records);
+    this->kickstart_inserts(1, 30);
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.adaptive_flush = false; });
+    HS_SETTINGS_FACTORY().save();
+    this->wait_for_inserts();
+    this->read_validate(true);
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, AdaptiveFlushControllerDecisions) {
+    static constexpr uint64_t flush_latency_us{10};
+    auto const min_size = HS_DYNAMIC_CONFIG(logstore.flush_threshold_size);
+    auto const max_size = HS_DYNAMIC_CONFIG(logstore.adaptive_flush_max_batch_size);
+    auto const target_us = HS_DYNAMIC_CONFIG(logstore.adaptive_flush_target_latency_us);
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.adaptive_flush = true; });
+    HS_SETTINGS_FACTORY().save();
+
+    // Flushes are spaced apart, so that every one of them samples the rate of appends
+    LogFlushController ctrl;
+    LOGINFO("Step 1: With no appends since the last flush, the controller should ask to flush right away");
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    ctrl.on_flush_done(flush_latency_us);
+    ASSERT_EQ(ctrl.threshold_size(), 1);
+    ASSERT_EQ(ctrl.max_wait_us(), 0u);
+
+    LOGINFO("Step 2: With appends expected within the target latency, the controller should batch them");
+    for (uint32_t i{0}; i < 10000; ++i) {
+        ctrl.on_append(1024);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    ctrl.on_flush_done(flush_latency_us);
+    ASSERT_GT(ctrl.threshold_size(), 1);
+    ASSERT_GE(static_cast< uint64_t >(ctrl.threshold_size()), min_size);
+    ASSERT_LE(static_cast< uint64_t >(ctrl.threshold_size()), max_size);
+    ASSERT_GT(ctrl.max_wait_us(), 0u);
+    ASSERT_LE(ctrl.max_wait_us(), target_us);
+
+    LOGINFO("Step 3: Switch off the adaptive flush, the decisions should go back to flushing right away");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.adaptive_flush = false; });
+    HS_SETTINGS_FACTORY().save();
+    for (uint32_t i{0}; i < 10000; ++i) {
+        ctrl.on_append(1024);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    ctrl.on_flush_done(flush_latency_us);
+    ASSERT_EQ(ctrl.threshold_size(), 1);
+    ASSERT_EQ(ctrl.max_wait_us(), 0u);
+}
+
+TEST_F(LogStoreTest, CompressLogGroupsThenRecover) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+
+    LOGINFO("Step 1: Switch on the compression of log groups and issue sequential inserts with q depth of 60");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.compress_feature_on = true;
+        s.logstore.min_compress_size = 64;
+    });
+    HS_SETTINGS_FACTORY().save();
+    this->init(num_records);
+    this->kickstart_inserts(1, 60);
+    this->wait_for_inserts();
+
+    LOGINFO("Step 2: Read all the inserts one by one for each log store to validate if what is written is valid");
+    this->read_validate(true);
+
+    LOGINFO("Step 3: Switch off the compression in the middle of inserts, so that both kinds of groups are written");
+    this->init(num_records);
+    this->kickstart_inserts(1, 30);
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.compress_feature_on = false; });
+    HS_SETTINGS_FACTORY().save();
+    this->wait_for_inserts();
+    this->read_validate(true);
+
+    LOGINFO("Step 4: Compress only the small inline areas, larger ones should be written uncompressed");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.compress_feature_on = true;
+        s.logstore.max_inline_compress_size = 1024;
+    });
+    HS_SETTINGS_FACTORY().save();
+    this->init(num_records);
+    this->kickstart_inserts(1, 60);
+    this->wait_for_inserts();
+    this->read_validate(true);
+
+    LOGINFO("Step 5: Restart homestore to validate the recovery of the compressed and uncompressed log groups");
+    SampleDB::instance().start_homestore(true /* restart */);
+    this->recovery_validate();
+    this->init(num_records);
+    this->truncate_validate();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.compress_feature_on = false;
+        s.logstore.min_compress_size = 512;
+        s.logstore.max_inline_compress_size = 16777216;
+    });
+    HS_SETTINGS_FACTORY().save();
+}
+
 TEST_F(LogStoreTest, FlushSync) {
 #ifdef _PRERELEASE
     LOGINFO("Step 1: Delay the flush threshold and flush timer to very high value to ensure flush works fine")
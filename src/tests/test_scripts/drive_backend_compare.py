@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+## @file drive_backend_compare.py
+#  Runs the data service test and log store benchmark on file backed devices once per drive backend and prints the
+#  wall clock time of each run side by side, so that a drive interface change (e.g. aio vs io_uring) can be compared.
+#
+#  The drive interface itself is picked by iomgr, so every backend is given as
+#      <name>:<extra args passed to both binaries>[:<ENV=VAL,...>]
+#  where the args/env are whatever the iomgr build in use takes to switch its drive interface, e.g.
+#      python3 drive_backend_compare.py -d ../ -b "aio::" -b "uring::<ENV>=<VAL>" -r 3
+#  The first backend is the baseline the others are compared against.
+#
+import getopt
+import os
+import subprocess
+import sys
+import time
+
+opts, args = getopt.getopt(sys.argv[1:], 'd:b:r:n:', ['dirpath=', 'backend=', 'runs=', 'num_devs='])
+dirpath = "./"
+backends = []
+runs = 1
+num_devs = 2
+
+for opt, arg in opts:
+    if opt in ('-d', '--dirpath'):
+        dirpath = arg
+        print(("dir path (%s)") % (arg))
+    if opt in ('-b', '--backend'):
+        backends.append(arg)
+    if opt in ('-r', '--runs'):
+        runs = int(arg)
+    if opt in ('-n', '--num_devs'):
+        num_devs = int(arg)
+
+if not backends:
+    backends = ["default::"]
+
+tests = [
+    ("test_data_service", " --num_devs=" + str(num_devs) + " --gtest_filter=*Write*"),
+    ("log_store_benchmark", " --benchmark_repetitions=1"),
+]
+
+
+def parse_backend(spec):
+    parts = spec.split(":", 2)
+    name = parts[0]
+    extra_args = parts[1] if len(parts) > 1 else ""
+    env = dict(os.environ)
+    if len(parts) > 2 and parts[2]:
+        for kv in parts[2].split(","):
+            k, v = kv.split("=", 1)
+            env[k] = v
+    return name, extra_args, env
+
+
+def run_one(binary, test_args, extra_args, env):
+    cmd_opts = test_args + " " + extra_args
+    start = time.monotonic()
+    status = subprocess.call(dirpath + binary + cmd_opts, stderr=subprocess.STDOUT, shell=True, env=env)
+    elapsed = time.monotonic() - start
+    if status != 0:
+        print(("%s failed with status %d") % (binary, status))
+        sys.exit(status)
+    return elapsed
+
+
+results = {}
+for spec in backends:
+    name, extra_args, env = parse_backend(spec)
+    for binary, test_args in tests:
+        times = [run_one(binary, test_args, extra_args, env) for _ in range(runs)]
+        results[(binary, name)] = min(times)
+
+names = [parse_backend(spec)[0] for spec in backends]
+print("")
+print(("%-24s" % "test") + "".join(("%16s" % n) for n in names))
+for binary, _ in tests:
+    base = results[(binary, names[0])]
+    row = "%-24s" % binary
+    for n in names:
+        t = results[(binary, n)]
+        row += "%16s" % ("%.2fs (%+.1f%%)" % (t, (t - base) * 100.0 / base if base else 0.0))
+    print(row)
@@ -13,15 +13,20 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <iomgr/aio_drive_interface.hpp>
@@ -31,9 +36,17 @@
 #include <farmhash.h>
 
 #include <homestore/homestore.hpp>
+#include "blkalloc/blk_allocator.h"
+#include "device/device.h"
+#include "device/device_selector.hpp"
+#include "device/physical_dev.hpp"
 #include "device/virtual_dev.hpp"
 #include "device/journal_vdev.hpp"
+#include "device/mem_drive.hpp"
+#include "device/io_scheduler.hpp"
+#include "common/homestore_config.hpp"
 #include "common/homestore_utils.hpp"
+#include "common/iobuf_pool.hpp"
 
 using namespace homestore;
 
@@ -353,6 +366,935 @@ private:
 
 TEST_F(VDevIOTest, VDevIOTest) { this->execute(); }
 
+TEST_F(VDevIOTest, LoadAwareDeviceSelector) {
+    static constexpr uint32_t busy_ios{100000};
+    auto const pdevs = hs()->device_mgr()->get_all_devices();
+    ASSERT_GE(pdevs.size(), 2u) << "Need atleast 2 devices to select from";
+
+    LoadAwareDeviceSelector selector{nullptr /* free_ratio_cb */};
+    selector.add_pdev(pdevs[0]);
+    selector.add_pdev(pdevs[1]);
+    blk_alloc_hints hints;
+
+    LOGINFO("Step 1: Device with lot more outstanding ios should not be picked");
+    for (uint32_t i{0}; i < busy_ios; ++i) {
+        pdevs[0]->on_io_submit();
+    }
+    for (uint32_t i{0}; i < 100; ++i) {
+        ASSERT_EQ(selector.select(hints), 1u) << "Busy device is selected";
+    }
+
+    LOGINFO("Step 2: Device pinned by hint is picked even if it is busy");
+    hints.dev_id_hint = 0;
+    ASSERT_EQ(selector.select(hints), 0u);
+    hints.dev_id_hint = INVALID_DEV_ID;
+
+    for (uint32_t i{0}; i < busy_ios; ++i) {
+        pdevs[0]->on_io_complete(pdevs[0]->ewma_latency_us());
+    }
+
+    LOGINFO("Step 3: Device marked slow should not be picked");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.slow_dev_cost_penalty = 1000000; });
+    HS_SETTINGS_FACTORY().save();
+    pdevs[1]->set_slow(true);
+    for (uint32_t i{0}; i < 100; ++i) {
+        ASSERT_EQ(selector.select(hints), 0u) << "Slow device is selected";
+    }
+    pdevs[1]->set_slow(false);
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.slow_dev_cost_penalty = 8; });
+    HS_SETTINGS_FACTORY().save();
+}
+
+TEST_F(VDevIOTest, IoBufPoolAllocFree) {
+    auto& pool = IoBufPool::instance();
+    if (pool.cap() == 0) { GTEST_SKIP() << "IoBufPool could not be mapped"; }
+    static constexpr auto tag{sisl::buftag::common};
+    auto const base_used = pool.used_size(tag);
+
+    LOGINFO("Step 1: Buffers upto the largest class are served by the pool, aligned to their class size");
+    std::vector< std::pair< uint8_t*, size_t > > bufs;
+    for (size_t sz{IoBufPool::min_class_size}; sz <= IoBufPool::max_class_size; sz *= 4) {
+        auto* buf = hs_utils::iobuf_alloc(sz, tag, dma_alignment);
+        ASSERT_TRUE(pool.owns(buf)) << "Buffer of size=" << sz << " is not served by the pool";
+        ASSERT_EQ(r_cast< uintptr_t >(buf) % sz, 0u) << "Buffer is not aligned to its class size=" << sz;
+        std::memset(buf, 0xab, sz);
+        bufs.emplace_back(buf, sz);
+    }
+    auto* odd = hs_utils::iobuf_alloc(5000, tag, dma_alignment);
+    ASSERT_TRUE(pool.owns(odd));
+    ASSERT_EQ(r_cast< uintptr_t >(odd) % 8192, 0u) << "Odd size is not rounded up to the next class";
+    ASSERT_GT(pool.used_size(tag), base_used);
+
+    LOGINFO("Step 2: Freed buffer is reused by the next alloc of the same class on the same thread");
+    hs_utils::iobuf_free(odd, tag);
+    auto* odd2 = hs_utils::iobuf_alloc(8192, tag, dma_alignment);
+    ASSERT_EQ(odd2, odd);
+    hs_utils::iobuf_free(odd2, tag);
+
+    LOGINFO("Step 3: Oversized or over aligned requests fall back to the general allocator");
+    auto* big = hs_utils::iobuf_alloc(IoBufPool::max_class_size * 2, tag, dma_alignment);
+    ASSERT_FALSE(pool.owns(big));
+    hs_utils::iobuf_free(big, tag);
+    auto* over_aligned = hs_utils::iobuf_alloc(IoBufPool::min_class_size, tag, IoBufPool::min_class_size * 2);
+    ASSERT_FALSE(pool.owns(over_aligned));
+    hs_utils::iobuf_free(over_aligned, tag);
+
+    LOGINFO("Step 4: Buffers freed on another thread are returned to the pool");
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool freed{false};
+    iomanager.run_on(iomgr::thread_regex::random_worker, [&bufs, &mtx, &cv, &freed](iomgr::io_thread_addr_t) {
+        for (auto& b : bufs) {
+            hs_utils::iobuf_free(b.first, tag);
+        }
+        std::unique_lock lg{mtx};
+        freed = true;
+        cv.notify_one();
+    });
+    {
+        std::unique_lock lg{mtx};
+        cv.wait(lg, [&freed] { return freed; });
+    }
+    ASSERT_EQ(pool.used_size(tag), base_used) << "Pool usage is not back after all the buffers are freed";
+}
+
+TEST_F(VDevIOTest, StripedJournalAppend) {
+    auto const pdevs = hs()->device_mgr()->get_all_devices();
+    if (m_vdev->stripe_width() < 2) { GTEST_SKIP() << "Journal vdev is not striped"; }
+    ASSERT_EQ(m_vdev->stripe_width(), pdevs.size());
+
+    // Spans every pdev twice, with a partial stripe unit at the end
+    auto const unit = uint64_cast(m_vdev->stripe_unit_blks()) * m_vdev->block_size();
+    auto const size = unit * pdevs.size() * 2 + 4096;
+    auto* wbuf = hs_utils::iobuf_alloc(size, sisl::buftag::common, dma_alignment);
+    auto* rbuf = hs_utils::iobuf_alloc(size, sisl::buftag::common, dma_alignment);
+    for (uint64_t i{0}; i < size; ++i) {
+        wbuf[i] = s_cast< uint8_t >(i % 251);
+    }
+
+    LOGINFO("Step 1: Append spanning all the pdevs is issued as one io on every pdev and completes once");
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint32_t ncomps{0};
+    std::error_condition comp_err;
+    std::vector< int64_t > ios_issued(pdevs.size(), 0);
+    auto const offset = m_vdev->alloc_next_append_blk(size);
+    iomanager.run_on(iomgr::thread_regex::random_worker, [&](iomgr::io_thread_addr_t) {
+        // Completions are processed by this reactor only after this returns, so the ios are still outstanding here
+        for (size_t i{0}; i < pdevs.size(); ++i) {
+            ios_issued[i] = -pdevs[i]->outstanding_ios();
+        }
+        m_vdev->async_pwrite(wbuf, size, offset, [&](std::error_condition err, void*) {
+            std::unique_lock lg{mtx};
+            comp_err = err;
+            ++ncomps;
+            cv.notify_one();
+        });
+        for (size_t i{0}; i < pdevs.size(); ++i) {
+            ios_issued[i] += pdevs[i]->outstanding_ios();
+        }
+    });
+    {
+        std::unique_lock lg{mtx};
+        ASSERT_TRUE(cv.wait_for(lg, std::chrono::seconds{10}, [&ncomps] { return ncomps > 0; }));
+    }
+    ASSERT_FALSE(comp_err);
+    for (size_t i{0}; i < pdevs.size(); ++i) {
+        ASSERT_EQ(ios_issued[i], 1) << "Append is not split into one io on pdev=" << i;
+    }
+
+    LOGINFO("Step 2: Read it back across the stripe and validate");
+    ASSERT_EQ(m_vdev->sync_pread(rbuf, size, offset), s_cast< ssize_t >(size));
+    ASSERT_EQ(std::memcmp(rbuf, wbuf, size), 0) << "Striped append is not read back as written";
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    ASSERT_EQ(ncomps, 1u) << "Append is completed more than once";
+    hs_utils::iobuf_free(rbuf, sisl::buftag::common);
+    hs_utils::iobuf_free(wbuf, sisl::buftag::common);
+}
+
+static void set_mem_drive_config(uint64_t read_lat_us, uint64_t write_lat_us, uint64_t bw_mbps) {
+    HS_SETTINGS_FACTORY().modifiable_settings([read_lat_us, write_lat_us, bw_mbps](auto& s) {
+        s.device.mem_drive_read_latency_us = read_lat_us;
+        s.device.mem_drive_write_latency_us = write_lat_us;
+        s.device.mem_drive_bandwidth_mbps = bw_mbps;
+    });
+    HS_SETTINGS_FACTORY().save();
+}
+
+TEST_F(VDevIOTest, MemDriveLatencyModel) {
+    static constexpr uint32_t io_size{1024 * 1024};
+    auto drive = MemDrive::open("mem:test_mem_drive:16");
+    ASSERT_EQ(drive->size(), 16u * 1024 * 1024);
+    ASSERT_EQ(MemDrive::open("mem:test_mem_drive"), drive) << "Drive of the same name is not shared";
+
+    std::vector< char > wbuf(io_size, 0x5a);
+    std::vector< char > rbuf(io_size, 0);
+
+    LOGINFO("Step 1: Data written is read back and ios beyond the drive size fail");
+    ASSERT_EQ(drive->sync_write(wbuf.data(), io_size, io_size), s_cast< ssize_t >(io_size));
+    ASSERT_EQ(drive->sync_read(rbuf.data(), io_size, io_size), s_cast< ssize_t >(io_size));
+    ASSERT_EQ(rbuf, wbuf);
+    ASSERT_EQ(drive->sync_read(rbuf.data(), io_size, drive->size()), -1);
+
+    LOGINFO("Step 2: Sync ios take the configured latency");
+    set_mem_drive_config(20000 /* read_lat_us */, 40000 /* write_lat_us */, 0 /* bw_mbps */);
+    auto start_time = Clock::now();
+    drive->sync_read(rbuf.data(), io_size, 0);
+    ASSERT_GE(get_elapsed_time_us(start_time), 20000u) << "Read completed before its latency";
+    start_time = Clock::now();
+    drive->sync_write(wbuf.data(), io_size, 0);
+    ASSERT_GE(get_elapsed_time_us(start_time), 40000u) << "Write completed before its latency";
+
+    LOGINFO("Step 3: Ios are queued behind each other at the configured bandwidth");
+    set_mem_drive_config(0 /* read_lat_us */, 0 /* write_lat_us */, 100 /* bw_mbps */);
+    start_time = Clock::now();
+    for (uint32_t i{0}; i < 4; ++i) {
+        drive->sync_write(wbuf.data(), io_size, i * io_size);
+    }
+    ASSERT_GE(get_elapsed_time_us(start_time), 40000u) << "4MB is transferred faster than 100MB/s";
+
+    LOGINFO("Step 4: Async io completes through the completion callback once its latency elapses");
+    set_mem_drive_config(0 /* read_lat_us */, 30000 /* write_lat_us */, 0 /* bw_mbps */);
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector< std::pair< int64_t, uint64_t > > comps; // result and elapsed time of every completion
+    start_time = Clock::now();
+    drive->attach_completion_cb([&mtx, &cv, &comps, start_time](int64_t res, uint8_t*) {
+        std::unique_lock lg{mtx};
+        comps.emplace_back(res, get_elapsed_time_us(start_time));
+        cv.notify_one();
+    });
+    iomanager.run_on(iomgr::thread_regex::random_worker, [&drive, &wbuf](iomgr::io_thread_addr_t) {
+        drive->async_write(wbuf.data(), io_size, 0, nullptr);
+        drive->async_write(wbuf.data(), io_size, drive->size(), nullptr);
+    });
+    {
+        std::unique_lock lg{mtx};
+        ASSERT_TRUE(cv.wait_for(lg, std::chrono::seconds{10}, [&comps] { return comps.size() == 2; }));
+    }
+    std::sort(comps.begin(), comps.end());
+    ASSERT_EQ(comps[0].first, -EINVAL) << "Async io beyond the drive size did not fail";
+    ASSERT_EQ(comps[1].first, 0);
+    ASSERT_GE(comps[1].second, 30000u) << "Async write completed before its latency";
+
+    set_mem_drive_config(0 /* read_lat_us */, 0 /* write_lat_us */, 0 /* bw_mbps */);
+    drive.reset();
+    MemDrive::remove("mem:test_mem_drive");
+}
+
+class SlowDevDetectTest : public VDevIOTest {
+protected:
+    // Slow device callbacks could come till homestore is shutdown, so they are recorded in the fixture
+    std::mutex m_slow_mtx;
+    std::vector< std::pair< PhysicalDev*, bool > > m_transitions;
+
+public:
+    void SetUp() override {
+        // Detector timer is started at init, so it needs to be configured before homestore is started
+        set_check_interval(50);
+        VDevIOTest::SetUp();
+    }
+
+    void TearDown() override {
+        VDevIOTest::TearDown();
+        set_check_interval(0);
+    }
+
+    static void set_check_interval(uint32_t interval_ms) {
+        HS_SETTINGS_FACTORY().modifiable_settings(
+            [interval_ms](auto& s) { s.device.slow_dev_check_interval_ms = interval_ms; });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    // Keeps completing reads of the given latencies on the devices, till the condition is met or it times out
+    template < typename PredT >
+    bool feed_latencies_until(PhysicalDev* pdev0, uint64_t lat0_us, PhysicalDev* pdev1, uint64_t lat1_us,
+                              PredT&& pred) {
+        auto const start_time = Clock::now();
+        while (!pred() && (get_elapsed_time_ms(start_time) < 10000)) {
+            for (uint32_t i{0}; i < 64; ++i) {
+                pdev0->on_io_submit();
+                pdev0->on_io_complete(lat0_us, true /* is_read */, 4096);
+                pdev1->on_io_submit();
+                pdev1->on_io_complete(lat1_us, true /* is_read */, 4096);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        return pred();
+    }
+};
+
+TEST_F(SlowDevDetectTest, MarkAndUnmarkSlowDevice) {
+    auto const pdevs = hs()->device_mgr()->get_all_devices();
+    ASSERT_GE(pdevs.size(), 2u) << "Need atleast 2 devices to compare with";
+
+    hs()->device_mgr()->register_slow_dev_cb([this](PhysicalDev* pdev, bool is_slow) {
+        std::unique_lock lg{m_slow_mtx};
+        m_transitions.emplace_back(pdev, is_slow);
+    });
+
+    LOGINFO("Step 1: One device consistently much slower than its peer should be marked slow");
+    ASSERT_TRUE(feed_latencies_until(pdevs[0], 10000, pdevs[1], 100, [&pdevs]() { return pdevs[0]->is_slow(); }))
+        << "Device is not marked slow";
+    ASSERT_FALSE(pdevs[1]->is_slow()) << "Fast device is marked slow";
+
+    LOGINFO("Step 2: Once the device is back in line with its peer, it should be unmarked");
+    ASSERT_TRUE(feed_latencies_until(pdevs[0], 100, pdevs[1], 100, [&pdevs]() { return !pdevs[0]->is_slow(); }))
+        << "Device is not unmarked slow";
+
+    std::unique_lock lg{m_slow_mtx};
+    ASSERT_GE(m_transitions.size(), 2u);
+    ASSERT_EQ(m_transitions.front(), std::make_pair(pdevs[0], true));
+    ASSERT_EQ(m_transitions.back(), std::make_pair(pdevs[0], false));
+}
+
+class IoSchedulerTest : public ::testing::Test {
+protected:
+    std::unique_ptr< IoScheduler > m_sched;
+    std::mutex m_mtx;
+    std::vector< io_class_t > m_issued; // Classes in the order the ios are issued to the device
+
+protected:
+    void SetUp() override {
+        ioenvironment.with_iomgr(1 /* nthreads */, false /* is_spdk */);
+        m_sched = std::make_unique< IoScheduler >("test_io_sched");
+    }
+
+    void TearDown() override {
+        m_sched.reset();
+        iomanager.stop();
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.device.io_sched_latency_qd = 128;
+            s.device.io_sched_throughput_qd = 32;
+            s.device.io_sched_latency_weight = 16;
+            s.device.io_sched_throughput_weight = 4;
+            s.device.io_sched_background_rate = 0;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    void submit(io_class_t cls, uint64_t size) {
+        m_sched->submit(
+            cls, size,
+            [this, cls](bool) {
+                std::unique_lock lg{m_mtx};
+                m_issued.push_back(cls);
+            },
+            false /* part_of_batch */);
+    }
+
+    size_t num_issued() {
+        std::unique_lock lg{m_mtx};
+        return m_issued.size();
+    }
+};
+
+TEST_F(IoSchedulerTest, WeightedFairDispatch) {
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.device.io_sched_latency_qd = 1;
+        s.device.io_sched_throughput_qd = 1;
+        s.device.io_sched_latency_weight = 4;
+        s.device.io_sched_throughput_weight = 1;
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    LOGINFO("Step 1: One io of each class fills their queue depth and is issued right away");
+    submit(io_class_t::latency, 4096);
+    submit(io_class_t::throughput, 4096);
+    ASSERT_EQ(num_issued(), 2u);
+
+    LOGINFO("Step 2: Subsequent ios are held back");
+    for (uint32_t i{0}; i < 8; ++i) {
+        submit(io_class_t::throughput, 4096);
+        submit(io_class_t::latency, 4096);
+    }
+    ASSERT_EQ(num_issued(), 2u);
+    ASSERT_EQ(m_sched->queued_ios(io_class_t::latency), 8u);
+    ASSERT_EQ(m_sched->queued_ios(io_class_t::throughput), 8u);
+
+    LOGINFO("Step 3: Lift the queue depth and complete an io, held back ios should be issued in weighted fair order");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.device.io_sched_latency_qd = 128;
+        s.device.io_sched_throughput_qd = 128;
+    });
+    HS_SETTINGS_FACTORY().save();
+    m_sched->on_complete(io_class_t::latency, 100 /* latency_us */);
+    ASSERT_EQ(num_issued(), 18u);
+    ASSERT_EQ(m_sched->outstanding_ios(io_class_t::latency), 8u);
+    ASSERT_EQ(m_sched->outstanding_ios(io_class_t::throughput), 9u);
+
+    // With 4:1 weight, latency class gets 4 times the bytes of throughput class while both are backlogged. The
+    // throughput io issued in step 1 is worth 4 latency ios, so held back ios go as 7 latency, 1 throughput, 1 latency
+    // and then rest of throughput. Throughput class should not be starved once latency class catches up.
+    std::vector< io_class_t > expected(7, io_class_t::latency);
+    expected.push_back(io_class_t::throughput);
+    expected.push_back(io_class_t::latency);
+    expected.insert(expected.end(), 7, io_class_t::throughput);
+    ASSERT_EQ(std::vector< io_class_t >(m_issued.begin() + 2, m_issued.end()), expected)
+        << "Held back ios are not dispatched in weighted fair order";
+}
+
+TEST_F(IoSchedulerTest, RateLimitedClass) {
+    static constexpr uint64_t rate{1024 * 1024};
+    static constexpr uint64_t io_size{64 * 1024};
+    static constexpr uint32_t nios{20};
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.io_sched_background_rate = rate; });
+    HS_SETTINGS_FACTORY().save();
+
+    LOGINFO("Step 1: Submit {} bytes of background ios at a rate limit of {} bytes/sec", nios * io_size, rate);
+    auto const start_time = Clock::now();
+    for (uint32_t i{0}; i < nios; ++i) {
+        submit(io_class_t::background, io_size);
+    }
+    ASSERT_GT(m_sched->queued_ios(io_class_t::background), nios / 2) << "Rate limit did not hold back the ios";
+
+    LOGINFO("Step 2: Unlimited class is not held back by the other class's rate limit");
+    auto const before = num_issued();
+    submit(io_class_t::latency, io_size);
+    ASSERT_EQ(num_issued(), before + 1);
+
+    LOGINFO("Step 3: Wait for the refill timer to issue all held back ios");
+    while ((num_issued() < nios + 1) && (get_elapsed_time_ms(start_time) < 10000)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    ASSERT_EQ(num_issued(), nios + 1) << "Held back ios are not issued after tokens are refilled";
+
+    // Beyond the burst of 100ms worth of bytes and the one io which can take the tokens negative, rest is paced
+    auto const min_ms = ((nios - 1) * io_size - rate / 10) * 1000 / rate;
+    ASSERT_GE(get_elapsed_time_ms(start_time), min_ms) << "Ios are issued faster than the rate limit";
+}
+
+class DiscardMgrTest : public VDevIOTest {
+protected:
+    std::unique_ptr< VirtualDev > m_data_vdev;
+
+public:
+    void SetUp() override {
+        // Timer is not expected to fire during the test, unless restarted with a shorter interval
+        set_discard_config(true /* enabled */, 60000 /* interval_ms */);
+        VDevIOTest::SetUp();
+
+        const auto dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
+        const auto ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+        m_data_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "test_discard", PhysicalDevGroup::DATA,
+                                                     blk_allocator_type_t::varsize, (dev_size * ndevices * 10) / 100,
+                                                     0 /* nmirror */, true /* is_stripe */, 4096 /* blk_size */,
+                                                     nullptr, 0, true /* auto_recovery */);
+    }
+
+    void TearDown() override {
+        m_data_vdev.reset();
+        VDevIOTest::TearDown();
+        set_discard_config(false /* enabled */, 100 /* interval_ms */);
+    }
+
+    static void set_discard_config(bool enabled, uint64_t interval_ms) {
+        HS_SETTINGS_FACTORY().modifiable_settings([enabled, interval_ms](auto& s) {
+            s.device.discard_enabled = enabled;
+            s.device.discard_interval_ms = interval_ms;
+            s.device.discard_min_size = enabled ? 4096 : 1048576;
+            s.blkallocator.free_blk_reuse_pct = enabled ? 0 : 70;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    DiscardMgr& discard_mgr() { return hs()->device_mgr()->discard_mgr(); }
+
+    std::vector< BlkId > alloc_committed_blks(uint32_t nblks) {
+        std::vector< BlkId > bids;
+        blk_alloc_hints hints;
+        hints.is_contiguous = true;
+        EXPECT_EQ(m_data_vdev->alloc_blk(nblks, hints, bids), BlkAllocStatus::SUCCESS);
+        for (const auto& b : bids) {
+            EXPECT_EQ(m_data_vdev->commit_blk(b), BlkAllocStatus::SUCCESS);
+        }
+        return bids;
+    }
+
+    bool is_alloced_on_disk(const BlkId& b) {
+        auto ba = hs()->device_mgr()->get_chunk_mutable(b.get_chunk_num())->blk_allocator_mutable();
+        return ba->is_blk_alloced_on_disk(b);
+    }
+
+    bool is_hdd(const BlkId& b) {
+        return hs()->device_mgr()->get_chunk_mutable(b.get_chunk_num())->physical_dev_mutable()->is_hdd();
+    }
+};
+
+TEST_F(DiscardMgrTest, HoldFreedBlksTillDiscard) {
+    auto const bids = alloc_committed_blks(64);
+    if (is_hdd(bids[0])) { GTEST_SKIP() << "Discard is skipped on hdd"; }
+
+    LOGINFO("Step 1: Free the blks on cp, they should be freed on disk bitmap, but held back from reuse");
+    m_data_vdev->free_blks_on_cp(bids);
+    ASSERT_EQ(discard_mgr().pending_bytes(), 64u * 4096);
+    for (const auto& b : bids) {
+        ASSERT_FALSE(is_alloced_on_disk(b)) << "Blkid=" << b.to_string() << " is not freed on disk bitmap";
+        ASSERT_TRUE(m_data_vdev->is_blk_alloced(b)) << "Blkid=" << b.to_string() << " is reusable before discard";
+    }
+
+    LOGINFO("Step 2: Restart discard mgr with short interval and wait for the blks to be discarded and freed");
+    discard_mgr().stop();
+    ASSERT_EQ(discard_mgr().pending_bytes(), 0u);
+    set_discard_config(true /* enabled */, 10 /* interval_ms */);
+    discard_mgr().start();
+
+    auto const bids2 = alloc_committed_blks(64);
+    m_data_vdev->free_blks_on_cp(bids2);
+    auto const start_time = Clock::now();
+    while ((discard_mgr().pending_bytes() != 0) && (get_elapsed_time_ms(start_time) < 10000)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    ASSERT_EQ(discard_mgr().pending_bytes(), 0u) << "Queued blks are not discarded in the background";
+
+    // Blks are freed to the allocator right after the discard, give it a moment
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    for (const auto& b : bids2) {
+        ASSERT_FALSE(m_data_vdev->is_blk_alloced(b)) << "Blkid=" << b.to_string() << " is not freed after discard";
+    }
+}
+
+TEST_F(DiscardMgrTest, StopFreesPendingBlks) {
+    auto const bids = alloc_committed_blks(32);
+    if (is_hdd(bids[0])) { GTEST_SKIP() << "Discard is skipped on hdd"; }
+
+    m_data_vdev->free_blks_on_cp(bids);
+    ASSERT_EQ(discard_mgr().pending_bytes(), 32u * 4096);
+
+    LOGINFO("Stop should join the discard reactor and free all pending blks to the allocator");
+    discard_mgr().stop();
+    ASSERT_EQ(discard_mgr().pending_bytes(), 0u);
+    for (const auto& b : bids) {
+        ASSERT_FALSE(m_data_vdev->is_blk_alloced(b)) << "Blkid=" << b.to_string() << " is not freed on stop";
+    }
+
+    LOGINFO("Once stopped, freed blks go to the allocator right away");
+    auto const bids2 = alloc_committed_blks(32);
+    m_data_vdev->free_blks_on_cp(bids2);
+    ASSERT_EQ(discard_mgr().pending_bytes(), 0u);
+    for (const auto& b : bids2) {
+        ASSERT_FALSE(m_data_vdev->is_blk_alloced(b));
+    }
+}
+
+class MirrorVDevTest : public VDevIOTest {
+protected:
+    static constexpr uint32_t busy_ios{100000};
+    std::unique_ptr< VirtualDev > m_mirror_vdev;
+    std::atomic< uint32_t > m_ncomps{0};
+
+public:
+    void SetUp() override {
+        // Tests here serve reads from the mirror by keeping the primary busy
+        set_read_balance(true);
+        VDevIOTest::SetUp();
+
+        const auto dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
+        const auto ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+        if (ndevices < 2) { return; }
+        m_mirror_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "test_mirror", PhysicalDevGroup::DATA,
+                                                       blk_allocator_type_t::varsize, (dev_size * ndevices * 10) / 100,
+                                                       1 /* nmirror */, true /* is_stripe */, 4096 /* blk_size */,
+                                                       nullptr, 0);
+    }
+
+    void TearDown() override {
+        // Let the reads on the other replica, which lost the hedge, complete before the vdev is gone
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        m_mirror_vdev.reset();
+        VDevIOTest::TearDown();
+        set_hedge_config(0 /* percentile */, 500 /* min_delay_us */);
+        set_read_balance(false);
+    }
+
+    static void set_read_balance(bool enabled) {
+        HS_SETTINGS_FACTORY().modifiable_settings([enabled](auto& s) { s.device.mirror_read_balance = enabled; });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    static void set_hedge_config(double percentile, uint64_t min_delay_us) {
+        HS_SETTINGS_FACTORY().modifiable_settings([percentile, min_delay_us](auto& s) {
+            s.device.hedged_read_percentile = percentile;
+            s.device.hedged_read_min_delay_us = min_delay_us;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    // Issues the io on a worker thread, as the hedge timer needs an io thread, and waits for its completion
+    std::error_condition do_io(bool is_write, uint8_t* buf, uint32_t size, const BlkId& bid) {
+        struct io_waiter {
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool done{false};
+            std::error_condition err;
+        };
+        auto waiter = std::make_shared< io_waiter >();
+        auto cb = [this, waiter](std::error_condition err, void*) {
+            m_ncomps.fetch_add(1);
+            std::unique_lock lg{waiter->mtx};
+            waiter->err = err;
+            waiter->done = true;
+            waiter->cv.notify_one();
+        };
+        iomanager.run_on(iomgr::thread_regex::random_worker,
+                         [this, is_write, buf, size, bid, cb](iomgr::io_thread_addr_t) {
+                             if (is_write) {
+                                 m_mirror_vdev->async_write(r_cast< const char* >(buf), size, bid, cb);
+                             } else {
+                                 m_mirror_vdev->async_read(r_cast< char* >(buf), size, bid, cb);
+                             }
+                         });
+        std::unique_lock lg{waiter->mtx};
+        waiter->cv.wait(lg, [&waiter] { return waiter->done; });
+        return waiter->err;
+    }
+
+    void set_busy(PhysicalDev* pdev, bool busy) {
+        for (uint32_t i{0}; i < busy_ios; ++i) {
+            if (busy) {
+                pdev->on_io_submit();
+            } else {
+                pdev->on_io_complete(pdev->ewma_latency_us());
+            }
+        }
+    }
+
+    // Marks every pdev other than the given one busy or not
+    void set_others_busy(PhysicalDev* pdev, bool busy) {
+        for (auto* p : hs()->device_mgr()->get_all_devices()) {
+            if (p != pdev) { set_busy(p, busy); }
+        }
+    }
+};
+
+TEST_F(MirrorVDevTest, WriteAllMirrorsAndBalanceReads) {
+    if (!m_mirror_vdev) { GTEST_SKIP() << "Need atleast 2 devices to mirror"; }
+    static constexpr uint32_t nblks{16};
+    auto const size = nblks * m_mirror_vdev->block_size();
+
+    std::vector< BlkId > bids;
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    ASSERT_EQ(m_mirror_vdev->alloc_blk(nblks, hints, bids), BlkAllocStatus::SUCCESS);
+    ASSERT_EQ(bids.size(), 1u);
+    auto* pchunk = hs()->device_mgr()->get_chunk_mutable(bids[0].get_chunk_num());
+    auto* primary = pchunk->physical_dev_mutable();
+    auto const primary_offset =
+        uint64_cast(bids[0].get_blk_num()) * m_mirror_vdev->block_size() + uint64_cast(pchunk->start_offset());
+
+    auto* wbuf = hs_utils::iobuf_alloc(size, sisl::buftag::common, dma_alignment);
+    auto* junk = hs_utils::iobuf_alloc(size, sisl::buftag::common, dma_alignment);
+    auto* rbuf = hs_utils::iobuf_alloc(size, sisl::buftag::common, dma_alignment);
+    std::memset(wbuf, 0xab, size);
+    std::memset(junk, 0xcd, size);
+
+    LOGINFO("Step 1: Async write on a mirrored chunk completes once, after the write on all replicas");
+    ASSERT_FALSE(do_io(true /* is_write */, wbuf, size, bids[0]));
+    ASSERT_EQ(m_ncomps.load(), 1u);
+
+    LOGINFO("Step 2: Overwrite the primary directly, read should be served from the mirror when primary is busy");
+    ASSERT_EQ(primary->sync_write(r_cast< const char* >(junk), size, primary_offset), s_cast< ssize_t >(size));
+    set_busy(primary, true);
+    ASSERT_FALSE(do_io(false /* is_write */, rbuf, size, bids[0]));
+    ASSERT_EQ(std::memcmp(rbuf, wbuf, size), 0) << "Read is not served from the mirror or mirror is not written";
+    set_busy(primary, false);
+
+    LOGINFO("Step 3: Read should be served from the primary when the mirror is busy");
+    set_others_busy(primary, true);
+    ASSERT_FALSE(do_io(false /* is_write */, rbuf, size, bids[0]));
+    ASSERT_EQ(std::memcmp(rbuf, junk, size), 0) << "Read is not served from the primary";
+    set_others_busy(primary, false);
+
+    LOGINFO("Step 4: Hedged reads on both replicas return the written data");
+    ASSERT_EQ(primary->sync_write(r_cast< const char* >(wbuf), size, primary_offset), s_cast< ssize_t >(size));
+    set_hedge_config(50 /* percentile */, 1 /* min_delay_us */);
+    for (uint32_t i{0}; i < 32; ++i) {
+        std::memset(rbuf, 0, size);
+        ASSERT_FALSE(do_io(false /* is_write */, rbuf, size, bids[0]));
+        ASSERT_EQ(std::memcmp(rbuf, wbuf, size), 0) << "Hedged read returned wrong data";
+    }
+    ASSERT_EQ(m_ncomps.load(), 35u) << "Callback is called more than once for an io";
+
+    hs_utils::iobuf_free(rbuf, sisl::buftag::common);
+    hs_utils::iobuf_free(junk, sisl::buftag::common);
+    hs_utils::iobuf_free(wbuf, sisl::buftag::common);
+}
+
+TEST_F(MirrorVDevTest, SubmitBatchOnAllPdevs) {
+    if (!m_mirror_vdev) { GTEST_SKIP() << "Need atleast 2 devices to mirror"; }
+    static constexpr uint32_t nios{8};
+    static constexpr uint32_t nblks{4};
+    auto const size = nblks * m_mirror_vdev->block_size();
+
+    std::vector< BlkId > bids;
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    for (uint32_t i{0}; i < nios; ++i) {
+        ASSERT_EQ(m_mirror_vdev->alloc_blk(nblks, hints, bids), BlkAllocStatus::SUCCESS);
+    }
+    ASSERT_EQ(bids.size(), nios);
+
+    auto* wbuf = hs_utils::iobuf_alloc(size * nios, sisl::buftag::common, dma_alignment);
+    auto* rbuf = hs_utils::iobuf_alloc(size, sisl::buftag::common, dma_alignment);
+    for (uint32_t i{0}; i < nios; ++i) {
+        std::memset(wbuf + i * size, i + 1, size);
+    }
+
+    LOGINFO("Step 1: Queue mirrored writes as a batch, they are held till the batch is submitted on every pdev");
+    iomanager.run_on(iomgr::thread_regex::random_worker, [this, wbuf, size, bids](iomgr::io_thread_addr_t) {
+        for (uint32_t i{0}; i < nios; ++i) {
+            m_mirror_vdev->async_write(
+                r_cast< const char* >(wbuf + i * size), size, bids[i],
+                [this](std::error_condition err, void*) {
+                    if (!err) { m_ncomps.fetch_add(1); }
+                },
+                nullptr /* cookie */, true /* part_of_batch */);
+        }
+        m_mirror_vdev->submit_batch();
+    });
+
+    auto const start_time = Clock::now();
+    while ((m_ncomps.load() < nios) && (get_elapsed_time_ms(start_time) < 10000)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    ASSERT_EQ(m_ncomps.load(), nios) << "Batched writes are not submitted on all the pdevs or they failed";
+
+    LOGINFO("Step 2: Read every blkid from its mirror by keeping the primary busy and validate");
+    for (uint32_t i{0}; i < nios; ++i) {
+        auto* primary = hs()->device_mgr()->get_chunk_mutable(bids[i].get_chunk_num())->physical_dev_mutable();
+        set_busy(primary, true);
+        ASSERT_FALSE(do_io(false /* is_write */, rbuf, size, bids[i]));
+        set_busy(primary, false);
+        ASSERT_EQ(std::memcmp(rbuf, wbuf + i * size, size), 0) << "Mirror of blkid=" << bids[i].to_string()
+                                                                << " is not written";
+    }
+
+    hs_utils::iobuf_free(rbuf, sisl::buftag::common);
+    hs_utils::iobuf_free(wbuf, sisl::buftag::common);
+}
+
+class CoalesceWriteTest : public VDevIOTest {
+protected:
+    static constexpr uint32_t coalesce_max_size{64 * 1024};
+    std::unique_ptr< VirtualDev > m_data_vdev;
+
+    struct write_io {
+        BlkId bid;
+        uint8_t* buf;
+        uint32_t size;
+    };
+
+public:
+    void SetUp() override {
+        set_coalesce_max_size(coalesce_max_size);
+        VDevIOTest::SetUp();
+
+        const auto dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
+        const auto ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+        m_data_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "test_coalesce", PhysicalDevGroup::DATA,
+                                                     blk_allocator_type_t::varsize, (dev_size * ndevices * 10) / 100,
+                                                     0 /* nmirror */, false /* is_stripe */, 4096 /* blk_size */,
+                                                     nullptr, 0);
+    }
+
+    void TearDown() override {
+        m_data_vdev.reset();
+        VDevIOTest::TearDown();
+        set_coalesce_max_size(0);
+    }
+
+    static void set_coalesce_max_size(uint32_t size) {
+        HS_SETTINGS_FACTORY().modifiable_settings([size](auto& s) { s.device.write_coalesce_max_size = size; });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    // Counters could be reported against their name or their description, look for either
+    static uint64_t find_counter(const nlohmann::json& j, const std::string& name, const std::string& desc) {
+        if (!j.is_object() && !j.is_array()) { return 0; }
+        for (auto it{j.begin()}; it != j.end(); ++it) {
+            if (j.is_object() && it.value().is_number() &&
+                ((it.key().find(name) != std::string::npos) || (it.key().find(desc) != std::string::npos))) {
+                return it.value().get< uint64_t >();
+            }
+            if (const auto v{find_counter(it.value(), name, desc)}; v != 0) { return v; }
+        }
+        return 0;
+    }
+
+    uint64_t coalesced_count() {
+        return find_counter(m_data_vdev->get_metrics_in_json(), "vdev_coalesced_write_count",
+                            "vdev batched writes merged into an adjacent write");
+    }
+
+    std::vector< BlkId > alloc_blks(uint32_t nblks) {
+        std::vector< BlkId > bids;
+        blk_alloc_hints hints;
+        hints.is_contiguous = true;
+        EXPECT_EQ(m_data_vdev->alloc_blk(nblks, hints, bids), BlkAllocStatus::SUCCESS);
+        EXPECT_EQ(bids.size(), 1u);
+
+        // Split into single blk ids, so that each of them can be written as a separate io
+        std::vector< BlkId > blks;
+        for (uint32_t i{0}; i < nblks; ++i) {
+            blks.emplace_back(bids[0].get_blk_num() + i, 1, bids[0].get_chunk_num());
+        }
+        return blks;
+    }
+
+    // Issues the writes as a batch on a worker thread, waits for all of them to complete and returns the number of
+    // writes merged into an adjacent write. Each of the original callbacks is expected to be called exactly once.
+    uint64_t batch_write(const std::vector< write_io >& ios, bool expect_success = true) {
+        struct batch_state {
+            std::mutex mtx;
+            std::vector< uint32_t > ncomps;
+            uint32_t nerrs{0};
+        };
+        auto state = std::make_shared< batch_state >();
+        state->ncomps.resize(ios.size(), 0);
+
+        auto const before = coalesced_count();
+        iomanager.run_on(iomgr::thread_regex::random_worker, [this, ios, state](iomgr::io_thread_addr_t) {
+            for (size_t i{0}; i < ios.size(); ++i) {
+                m_data_vdev->async_write(
+                    r_cast< const char* >(ios[i].buf), ios[i].size, ios[i].bid,
+                    [state, i](std::error_condition err, void*) {
+                        std::unique_lock lg{state->mtx};
+                        ++state->ncomps[i];
+                        if (err) { ++state->nerrs; }
+                    },
+                    nullptr /* cookie */, true /* part_of_batch */);
+            }
+            m_data_vdev->submit_batch();
+        });
+
+        auto const all_done = [&state] {
+            std::unique_lock lg{state->mtx};
+            return std::all_of(state->ncomps.begin(), state->ncomps.end(), [](uint32_t n) { return n != 0; });
+        };
+        auto const start_time = Clock::now();
+        while (!all_done() && (get_elapsed_time_ms(start_time) < 10000)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+
+        std::unique_lock lg{state->mtx};
+        for (size_t i{0}; i < ios.size(); ++i) {
+            EXPECT_EQ(state->ncomps[i], 1u) << "Callback of write on blkid=" << ios[i].bid.to_string()
+                                            << " is not called exactly once";
+        }
+        if (expect_success) { EXPECT_EQ(state->nerrs, 0u) << "Batched writes failed"; }
+        return coalesced_count() - before;
+    }
+
+    void validate(const write_io& io) {
+        auto* rbuf = hs_utils::iobuf_alloc(io.size, sisl::buftag::common, dma_alignment);
+        ASSERT_EQ(m_data_vdev->sync_read(r_cast< char* >(rbuf), io.size, io.bid), s_cast< ssize_t >(io.size));
+        ASSERT_EQ(std::memcmp(rbuf, io.buf, io.size), 0) << "Data mismatch on blkid=" << io.bid.to_string();
+        hs_utils::iobuf_free(rbuf, sisl::buftag::common);
+    }
+};
+
+TEST_F(CoalesceWriteTest, MergeAdjacentWrites) {
+    static constexpr uint32_t nblks{32};
+    auto const blk_size = m_data_vdev->block_size();
+    auto* wbuf = hs_utils::iobuf_alloc(nblks * blk_size, sisl::buftag::common, dma_alignment);
+    for (uint32_t i{0}; i < nblks; ++i) {
+        std::memset(wbuf + i * blk_size, i + 1, blk_size);
+    }
+
+    LOGINFO("Step 1: Adjacent aligned writes issued out of order are merged into one write");
+    {
+        auto const blks = alloc_blks(8);
+        std::vector< write_io > ios;
+        for (uint32_t i{0}; i < blks.size(); ++i) {
+            ios.push_back(write_io{blks[i], wbuf + i * blk_size, blk_size});
+        }
+        std::reverse(ios.begin(), ios.end());
+        ASSERT_EQ(batch_write(ios), blks.size() - 1);
+        for (const auto& io : ios) {
+            validate(io);
+        }
+    }
+
+    LOGINFO("Step 2: Writes with a gap between them are not merged");
+    {
+        auto const blks = alloc_blks(3);
+        std::vector< write_io > ios{write_io{blks[0], wbuf, blk_size}, write_io{blks[2], wbuf + blk_size, blk_size}};
+        ASSERT_EQ(batch_write(ios), 0u);
+        for (const auto& io : ios) {
+            validate(io);
+        }
+    }
+
+    LOGINFO("Step 3: Write of unaligned size is not merged, even if it starts where the previous write ends");
+    {
+        auto const blks = alloc_blks(2);
+        auto* pdev = hs()->device_mgr()->get_chunk_mutable(blks[0].get_chunk_num())->physical_dev_mutable();
+        auto const align_size = pdev->align_size();
+        std::vector< write_io > ios{write_io{blks[0], wbuf, blk_size},
+                                    write_io{blks[1], wbuf + blk_size, align_size / 2}};
+        // Unaligned write could fail on a direct io device, what matters is that it is issued and completed
+        ASSERT_EQ(batch_write(ios, false /* expect_success */), 0u);
+        validate(ios[0]);
+    }
+
+    LOGINFO("Step 4: Run of adjacent writes is capped at write_coalesce_max_size");
+    {
+        auto const blks = alloc_blks(nblks);
+        std::vector< write_io > ios;
+        for (uint32_t i{0}; i < blks.size(); ++i) {
+            ios.push_back(write_io{blks[i], wbuf + i * blk_size, blk_size});
+        }
+        auto const writes_per_run = coalesce_max_size / blk_size;
+        auto const nruns = (nblks + writes_per_run - 1) / writes_per_run;
+        ASSERT_EQ(batch_write(ios), nblks - nruns);
+        for (const auto& io : ios) {
+            validate(io);
+        }
+    }
+
+    hs_utils::iobuf_free(wbuf, sisl::buftag::common);
+}
+
+TEST_F(CoalesceWriteTest, NoMergeAcrossChunks) {
+    auto const blk_size = m_data_vdev->block_size();
+    auto const blks = alloc_blks(1);
+
+    // Find a chunk of this vdev which is followed physically on the pdev by another chunk of this vdev
+    auto* chunk = hs()->device_mgr()->get_chunk_mutable(blks[0].get_chunk_num());
+    auto const is_followed_by = [](PhysicalDevChunk* c, PhysicalDevChunk* n) {
+        return (c != nullptr) && (n != nullptr) && (c->vdev_id() == n->vdev_id()) &&
+            (n->start_offset() == c->start_offset() + c->size());
+    };
+    PhysicalDevChunk* first{nullptr};
+    PhysicalDevChunk* second{nullptr};
+    if (is_followed_by(chunk, chunk->next_chunk_mutable())) {
+        first = chunk;
+        second = chunk->next_chunk_mutable();
+    } else if (is_followed_by(chunk->prev_chunk_mutable(), chunk)) {
+        first = chunk->prev_chunk_mutable();
+        second = chunk;
+    } else {
+        GTEST_SKIP() << "Chunks of the vdev are not physically adjacent on the pdev";
+    }
+
+    auto* wbuf = hs_utils::iobuf_alloc(2 * blk_size, sisl::buftag::common, dma_alignment);
+    std::memset(wbuf, 0xab, blk_size);
+    std::memset(wbuf + blk_size, 0xcd, blk_size);
+
+    LOGINFO("Writes on the last blk of chunk={} and first blk of chunk={} are adjacent on pdev, but not merged",
+            first->chunk_id(), second->chunk_id());
+    std::vector< write_io > ios{
+        write_io{BlkId{s_cast< blk_num_t >(first->size() / blk_size - 1), 1, first->chunk_id()}, wbuf, blk_size},
+        write_io{BlkId{0, 1, second->chunk_id()}, wbuf + blk_size, blk_size}};
+    ASSERT_EQ(batch_write(ios), 0u);
+    for (const auto& io : ios) {
+        validate(io);
+    }
+
+    hs_utils::iobuf_free(wbuf, sisl::buftag::common);
+}
+
 SISL_OPTION_GROUP(
     test_vdev,
     (truncate_watermark_percentage, "", "truncate_watermark_percentage",